@@ -0,0 +1,92 @@
+# Converts an XBM image into the page-major format of the display controller
+#
+# Usage: cmake -DINPUT=<image.xbm> -DOUTPUT=<image_pages.h> -P xbm2pages.cmake
+#
+# XBM images are stored row by row with the leftmost pixel of each group of
+# eight in the LSB. The SH1106 (and thus the Display framebuffer) is organised
+# in pages of eight rows, where each byte is a column of eight pixels with the
+# topmost pixel in the LSB. The generated header defines <NAME>_WIDTH,
+# <NAME>_HEIGHT and a <NAME>_PAGES array that can be passed to PageBitmap,
+# where <NAME> is taken from the <NAME>_BITS array in the XBM file.
+
+if(NOT DEFINED INPUT OR NOT DEFINED OUTPUT)
+	message(FATAL_ERROR "Usage: cmake -DINPUT=<image.xbm> -DOUTPUT=<image_pages.h> -P xbm2pages.cmake")
+endif()
+
+file(READ ${INPUT} XBM)
+
+# Dimensions and name
+if(NOT XBM MATCHES "#define[ \t]+([A-Za-z0-9_]+)_WIDTH[ \t]+([0-9]+)")
+	message(FATAL_ERROR "${INPUT}: width not found")
+endif()
+set(NAME ${CMAKE_MATCH_1})
+set(WIDTH ${CMAKE_MATCH_2})
+if(NOT XBM MATCHES "#define[ \t]+${NAME}_HEIGHT[ \t]+([0-9]+)")
+	message(FATAL_ERROR "${INPUT}: height not found")
+endif()
+set(HEIGHT ${CMAKE_MATCH_1})
+
+# Pixel data
+if(NOT XBM MATCHES "${NAME}_BITS[^{]*{([^}]*)}")
+	message(FATAL_ERROR "${INPUT}: pixel data not found")
+endif()
+string(REGEX MATCHALL "0[xX][0-9a-fA-F]+" BYTES "${CMAKE_MATCH_1}")
+math(EXPR BYTES_PER_ROW "(${WIDTH} + 7) / 8")
+math(EXPR PAGES "(${HEIGHT} + 7) / 8")
+list(LENGTH BYTES NUM_BYTES)
+math(EXPR EXPECTED "${BYTES_PER_ROW} * ${HEIGHT}")
+if(NOT NUM_BYTES EQUAL EXPECTED)
+	message(FATAL_ERROR "${INPUT}: expected ${EXPECTED} bytes, found ${NUM_BYTES}")
+endif()
+
+# Transpose each page. Rows beyond the height of the image are left black.
+set(DATA "")
+set(COUNT 0)
+math(EXPR LAST_PAGE "${PAGES} - 1")
+math(EXPR LAST_COLUMN "${WIDTH} - 1")
+foreach(PAGE RANGE ${LAST_PAGE})
+	# Fetch the (up to) eight rows of this page once
+	set(ROWS "")
+	foreach(ROW RANGE 7)
+		math(EXPR Y "${PAGE} * 8 + ${ROW}")
+		if(Y LESS HEIGHT)
+			math(EXPR FIRST "${Y} * ${BYTES_PER_ROW}")
+			list(SUBLIST BYTES ${FIRST} ${BYTES_PER_ROW} ROW_BYTES)
+			list(APPEND ROWS "${ROW_BYTES}")
+		endif()
+	endforeach()
+	list(LENGTH ROWS NUM_ROW_BYTES)
+	math(EXPR NUM_ROWS "${NUM_ROW_BYTES} / ${BYTES_PER_ROW}")
+	foreach(X RANGE ${LAST_COLUMN})
+		math(EXPR COLUMN_BYTE "${X} / 8")
+		math(EXPR COLUMN_BIT "${X} % 8")
+		set(VALUE 0)
+		set(ROW 0)
+		while(ROW LESS NUM_ROWS)
+			math(EXPR INDEX "${ROW} * ${BYTES_PER_ROW} + ${COLUMN_BYTE}")
+			list(GET ROWS ${INDEX} BYTE)
+			math(EXPR VALUE "${VALUE} | (((${BYTE} >> ${COLUMN_BIT}) & 1) << ${ROW})")
+			math(EXPR ROW "${ROW} + 1")
+		endwhile()
+		math(EXPR VALUE "${VALUE}" OUTPUT_FORMAT HEXADECIMAL)
+		# Pad to two digits
+		string(LENGTH "${VALUE}" LENGTH)
+		if(LENGTH EQUAL 3)
+			string(REPLACE "0x" "0x0" VALUE "${VALUE}")
+		endif()
+		if(COUNT EQUAL 0)
+			string(APPEND DATA "\n\t")
+		else()
+			string(APPEND DATA ",")
+			math(EXPR WRAP "${COUNT} % 16")
+			if(WRAP EQUAL 0)
+				string(APPEND DATA "\n\t")
+			endif()
+		endif()
+		string(APPEND DATA "${VALUE}")
+		math(EXPR COUNT "${COUNT} + 1")
+	endforeach()
+endforeach()
+
+get_filename_component(INPUT_NAME ${INPUT} NAME)
+file(WRITE ${OUTPUT} "// Generated from ${INPUT_NAME} by xbm2pages.cmake, do not edit\n#define ${NAME}_WIDTH ${WIDTH}\n#define ${NAME}_HEIGHT ${HEIGHT}\nstatic const uint8_t ${NAME}_PAGES[] = {${DATA}\n};\n")
@@ -55,6 +55,114 @@ public:
 	 * \return Returns the color of the given pixel (0 or 1).
 	 */
 	inline uint8_t getPixel(uint x, uint y) const {return (bits[y * BYTES_PER_ROW + x / 8] >> (x % 8)) & 1;}
+
+	/**
+	 * \brief Get the byte containing eight horizontally adjacent pixels
+	 * \param x Column of the leftmost pixel. Must be a multiple of 8.
+	 * \param y Row of the pixels.
+	 * \return Returns the byte with pixel x in the LSB and pixel x + 7 in the
+	 * MSB. Bits beyond the width of the bitmap are undefined.
+	 */
+	inline uint8_t getByte(uint x, uint y) const {return bits[y * BYTES_PER_ROW + x / 8];}
+};
+
+/**
+ * \brief Represents a monochrome bitmap in the page-major format of the display
+ * \details The bitmap is divided into pages of eight rows. Each page is an
+ * array of bytes, one per column, with the topmost pixel of the page in the
+ * LSB. This is how the display controller organises its memory, so such a
+ * bitmap can be copied into a framebuffer without transposing it. Like Bitmap,
+ * instances are immutable and only refer to the data.
+ * \tparam width,height Dimensions of the bitmap
+ */
+template<uint width, uint height>
+class PageBitmap
+{
+private:
+	/**
+	 * \brief Contents
+	 */
+	const uint8_t* pages;
+
+public:
+	/**
+	 * \brief Number of pages
+	 */
+	static constexpr uint NUM_PAGES = (height + 7) / 8;
+
+	/**
+	 * \brief Constructs a bitmap
+	 * \param data The bitmap data, NUM_PAGES pages of width bytes each. Bits
+	 * below the last row are ignored.
+	 */
+	PageBitmap(const uint8_t* data): pages(data) {}
+
+	/**
+	 * \brief Width of the bitmap
+	 * \return The width of the bitmap in pixels.
+	 */
+	inline uint getWidth() const {return width;}
+
+	/**
+	 * \brief Height of the bitmap
+	 * \return The height of the bitmap in pixels.
+	 */
+	inline uint getHeight() const {return height;}
+
+	/**
+	 * \brief Get the color of a pixel
+	 * \param x,y Coordinates of the pixel.
+	 * \return Returns the color of the given pixel (0 or 1).
+	 */
+	inline uint8_t getPixel(uint x, uint y) const {return (pages[(y / 8) * width + x] >> (y % 8)) & 1;}
+
+	/**
+	 * \brief Get the columns of a page
+	 * \param page Index of the page. Must be in [0,NUM_PAGES).
+	 * \return Returns a pointer to the width bytes of the page.
+	 */
+	inline const uint8_t* getPage(uint page) const {return pages + page * width;}
+};
+
+/**
+ * \brief Storage for a PageBitmap converted at runtime
+ * \details Used for images that aren't known at compile time (e.g. the ones
+ * from the settings), so they only need to be transposed once rather than
+ * every time they are drawn.
+ * \tparam width,height Dimensions of the bitmap
+ */
+template<uint width, uint height>
+class PageBitmapBuffer
+{
+private:
+	/**
+	 * \brief Contents
+	 */
+	uint8_t pages[PageBitmap<width, height>::NUM_PAGES * width];
+
+public:
+	/**
+	 * \brief Constructs an empty (black) bitmap
+	 */
+	PageBitmapBuffer() {memset(pages, 0, sizeof(pages));}
+
+	/**
+	 * \brief Converts a row-major bitmap
+	 * \param bitmap The bitmap to be converted.
+	 */
+	void convert(const Bitmap<width, height>& bitmap)
+	{
+		memset(pages, 0, sizeof(pages));
+		for(uint y = 0; y < height; y++)
+			for(uint x = 0; x < width; x++)
+				pages[(y / 8) * width + x] |= bitmap.getPixel(x, y) << (y % 8);
+	}
+
+	/**
+	 * \brief Get the converted bitmap
+	 * \return Returns a PageBitmap referring to this buffer.
+	 */
+	inline PageBitmap<width, height> getBitmap() const {return PageBitmap<width, height>(pages);}
 };
 
 #endif // _BITMAP_H
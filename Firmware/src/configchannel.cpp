@@ -0,0 +1,170 @@
+/**
+ * \file configchannel.cpp
+ * Implementation for configchannel.h
+ */
+
+#include<cstring>
+#include"tusb.h"
+#include"configchannel.h"
+
+/**
+ * \brief Reads a little endian 32 bit integer
+ * \param bytes The four bytes.
+ * \return The integer.
+ */
+static uint32_t readUint32(const uint8_t* bytes)
+{
+	return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+ConfigChannel::ConfigChannel(uint8_t interface, uint8_t* data, uint32_t size, void (*writeCallback)(uint32_t address, uint32_t length))
+:	interface(interface),
+	data(data),
+	size(size),
+	writeCallback(writeCallback),
+	open(false),
+	expectedSeq(0),
+	ackPending(false),
+	ackSeq(0),
+	errorPending(false),
+	readAddress(0),
+	readEnd(0),
+	dataSeq(0),
+	dataAcked(0)
+{
+}
+
+void ConfigChannel::reject()
+{
+	open = false;
+	readEnd = readAddress;
+	ackPending = false;
+	errorPending = true;
+}
+
+void ConfigChannel::receive(const uint8_t* packet, uint16_t length, bool writable)
+{
+	if(length < CONFIG_HEADER_SIZE)
+		return;
+	ConfigCommand command = static_cast<ConfigCommand>(packet[0]);
+	uint8_t seq = packet[1];
+	uint8_t payloadLength = packet[2];
+	uint32_t address = readUint32(&packet[4]);
+	const uint8_t* payload = &packet[CONFIG_HEADER_SIZE];
+	if(payloadLength > CONFIG_PAYLOAD_SIZE || payloadLength > length - CONFIG_HEADER_SIZE)
+	{
+		reject();
+		return;
+	}
+
+	switch(command)
+	{
+		case ConfigCommand::OPEN:
+		{
+			open = true;
+			expectedSeq = seq + 1;
+			readEnd = readAddress;
+			errorPending = false;
+			ackPending = true;
+			ackSeq = seq;
+			break;
+		}
+		case ConfigCommand::ACK:
+		{
+			// Only DATA packets that have been sent can be acknowledged
+			if(static_cast<uint8_t>(seq + 1 - dataAcked) <= static_cast<uint8_t>(dataSeq - dataAcked))
+				dataAcked = seq + 1;
+			break;
+		}
+		case ConfigCommand::READ:
+		{
+			if(!open || seq != expectedSeq || payloadLength < 4)
+			{
+				reject();
+				return;
+			}
+			uint32_t count = readUint32(payload);
+			if(address > size || count > size - address)
+			{
+				reject();
+				return;
+			}
+			readAddress = address;
+			readEnd = address + count;
+			dataSeq = 0;
+			dataAcked = 0;
+			expectedSeq++;
+			ackPending = true;
+			ackSeq = seq;
+			break;
+		}
+		case ConfigCommand::WRITE:
+		{
+			if(!open || seq != expectedSeq || !writable || address > size || payloadLength > size - address)
+			{
+				reject();
+				return;
+			}
+			memcpy(data + address, payload, payloadLength);
+			if(writeCallback != nullptr)
+				writeCallback(address, payloadLength);
+			expectedSeq++;
+			ackPending = true;
+			ackSeq = seq;
+			break;
+		}
+		default:
+		{
+			// Ignore packets that only the device sends (and unknown ones)
+			break;
+		}
+	}
+}
+
+bool ConfigChannel::send()
+{
+	uint8_t packet[CONFIG_REPORT_SIZE] = {};
+	if(errorPending)
+	{
+		packet[0] = static_cast<uint8_t>(ConfigCommand::NAK);
+		packet[1] = expectedSeq;
+	}
+	else if(ackPending)
+	{
+		packet[0] = static_cast<uint8_t>(ConfigCommand::ACK);
+		packet[1] = ackSeq;
+	}
+	else if(readAddress != readEnd && static_cast<uint8_t>(dataSeq - dataAcked) < CONFIG_WINDOW)
+	{
+		uint32_t count = readEnd - readAddress;
+		if(count > CONFIG_PAYLOAD_SIZE)
+			count = CONFIG_PAYLOAD_SIZE;
+		packet[0] = static_cast<uint8_t>(ConfigCommand::DATA);
+		packet[1] = dataSeq;
+		packet[2] = count;
+		for(uint i = 0; i < 4; i++)
+			packet[4 + i] = (readAddress >> (8 * i)) & 0xff;
+		memcpy(&packet[CONFIG_HEADER_SIZE], data + readAddress, count);
+	}
+	else
+		return false;
+
+	if(!tud_hid_n_report(interface, 0, packet, sizeof(packet)))
+		return false;
+
+	// Packet is on its way
+	switch(static_cast<ConfigCommand>(packet[0]))
+	{
+		case ConfigCommand::NAK:
+			errorPending = false;
+			break;
+		case ConfigCommand::ACK:
+			ackPending = false;
+			break;
+		default:
+			readAddress += packet[2];
+			dataSeq++;
+			break;
+	}
+	return true;
+}
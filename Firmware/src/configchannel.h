@@ -0,0 +1,132 @@
+/**
+ * \file configchannel.h
+ * Transferring the settings through the vendor-defined configuration interface
+ */
+
+#ifndef _CONFIGCHANNEL_H
+#define _CONFIGCHANNEL_H
+
+#include<cstdint>
+#include"pico/stdlib.h"
+#include"usb_descriptors.h"
+
+/**
+ * \brief Device side of the configuration interface
+ * \details Implements the windowed protocol described at ConfigCommand on a
+ * block of memory (the Settings struct). Packets from the host are passed to
+ * receive(), which answers them by queuing an acknowledgement. Reads are
+ * streamed by send() as fast as the host polls the interrupt endpoint, as
+ * long as no more than CONFIG_WINDOW DATA packets are unacknowledged.
+ * This replaces hundreds of control transfers (one per REPORT_ID_SETTINGS_DATA
+ * feature report) by a pipelined stream. The feature reports still work.
+ * All methods must be called from the same context (the main loop and the
+ * TinyUSB callbacks of Core 0), so no locking is needed.
+ */
+class ConfigChannel
+{
+private:
+	/**
+	 * \brief Interface number
+	 */
+	uint8_t interface;
+
+	/**
+	 * \brief Memory that is read and written
+	 */
+	uint8_t* data;
+
+	/**
+	 * \brief Size of the memory
+	 */
+	uint32_t size;
+
+	/**
+	 * \brief Called after the host has written to the memory (may be nullptr)
+	 */
+	void (*writeCallback)(uint32_t address, uint32_t length);
+
+	/**
+	 * \brief Has the host opened a session (which hasn't failed since)?
+	 */
+	bool open;
+
+	/**
+	 * \brief Sequence number of the next packet from the host
+	 */
+	uint8_t expectedSeq;
+
+	/**
+	 * \brief Is an acknowledgement waiting to be sent?
+	 * \details Acknowledgements are cumulative, so only the newest one is
+	 * kept.
+	 */
+	bool ackPending;
+
+	/**
+	 * \brief Sequence number to acknowledge
+	 */
+	uint8_t ackSeq;
+
+	/**
+	 * \brief Is an error waiting to be sent?
+	 * \details The error carries the sequence number that was expected.
+	 */
+	bool errorPending;
+
+	/**
+	 * \brief Range that is still to be sent for a read in progress
+	 * \details No read is in progress if both are equal.
+	 */
+	uint32_t readAddress, readEnd;
+
+	/**
+	 * \brief Sequence number of the next DATA packet
+	 */
+	uint8_t dataSeq;
+
+	/**
+	 * \brief Sequence number of the first DATA packet that hasn't been
+	 * acknowledged yet
+	 */
+	uint8_t dataAcked;
+
+	/**
+	 * \brief Rejects a packet from the host
+	 * \details Aborts the session and queues an error.
+	 */
+	void reject();
+
+public:
+	/**
+	 * \brief Constructor
+	 * \param interface Interface number.
+	 * \param data Memory that can be read and written.
+	 * \param size Size of the memory.
+	 * \param writeCallback Function that is called with the address and
+	 * length of every WRITE after the payload has been copied to the memory
+	 * (e.g. to keep track of the modified parts). May be nullptr.
+	 */
+	ConfigChannel(uint8_t interface, uint8_t* data, uint32_t size, void (*writeCallback)(uint32_t address, uint32_t length) = nullptr);
+
+	/**
+	 * \brief Processes a packet from the host
+	 * \details Must be called from tud_hid_set_report_cb() for every report
+	 * received on the OUT endpoint of the interface.
+	 * \param packet The packet.
+	 * \param length Length of the packet.
+	 * \param writable Whether WRITE packets are accepted (only in maintenance
+	 * mode). If not, they are rejected.
+	 */
+	void receive(const uint8_t* packet, uint16_t length, bool writable);
+
+	/**
+	 * \brief Hands the next packet (if any) to TinyUSB
+	 * \details Must be called whenever the IN endpoint of the interface is
+	 * ready, i.e. from the main loop and from tud_hid_report_complete_cb().
+	 * Rejections go first, then acknowledgements, then data.
+	 * \return Returns true if a packet has been handed to TinyUSB.
+	 */
+	bool send();
+};
+
+#endif // _CONFIGCHANNEL_H
@@ -0,0 +1,126 @@
+/**
+ * \file dirtypages.h
+ * Keeping track of the parts of a block of memory that have been modified
+ */
+
+#ifndef _DIRTYPAGES_H
+#define _DIRTYPAGES_H
+
+#include<cstdint>
+
+/**
+ * \brief Keeps track of the pages of a block of memory that have been
+ * modified since they were last stored
+ * \details The block is divided into pages of PAGE_SIZE bytes (the last one
+ * may be shorter). Modifications mark pages as dirty, takeRun() hands out the
+ * dirty pages in runs of consecutive pages so they can be stored with as few
+ * operations as possible. Pages are marked clean when they are handed out, so
+ * a page that is modified while it is being stored is marked dirty again and
+ * stored once more.
+ * Not thread safe. All methods must be called from the same context.
+ * \tparam SIZE Size of the block of memory.
+ * \tparam PAGE_SIZE Size of a page. Should be a multiple of the page size of
+ * the EEPROM, so no EEPROM page is written more than once per run.
+ */
+template<uint32_t SIZE, uint32_t PAGE_SIZE>
+class DirtyPages
+{
+public:
+	/**
+	 * \brief Number of pages
+	 */
+	static constexpr uint32_t NUM_PAGES = (SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+
+private:
+	/**
+	 * \brief One bit per page (set if dirty)
+	 */
+	uint32_t bitmap[(NUM_PAGES + 31) / 32];
+
+	/**
+	 * \brief Number of dirty pages
+	 */
+	uint32_t count;
+
+	/**
+	 * \brief Checks whether a page is dirty
+	 */
+	inline bool isDirty(uint32_t page) const {return bitmap[page / 32] & (1u << (page % 32));}
+
+public:
+	/**
+	 * \brief Constructs a DirtyPages object with all pages clean
+	 */
+	DirtyPages() : bitmap{}, count(0) {}
+
+	/**
+	 * \brief Marks the pages overlapping a range of bytes as dirty
+	 * \param address Offset of the first modified byte.
+	 * \param length Number of modified bytes. The range is trimmed to the end
+	 * of the block.
+	 */
+	void mark(uint32_t address, uint32_t length)
+	{
+		if(length == 0 || address >= SIZE)
+			return;
+		if(length > SIZE - address)
+			length = SIZE - address;
+		for(uint32_t page = address / PAGE_SIZE; page <= (address + length - 1) / PAGE_SIZE; page++)
+		{
+			if(!isDirty(page))
+			{
+				bitmap[page / 32] |= 1u << (page % 32);
+				count++;
+			}
+		}
+	}
+
+	/**
+	 * \brief Marks all pages as clean
+	 */
+	void clear()
+	{
+		for(uint32_t& word : bitmap)
+			word = 0;
+		count = 0;
+	}
+
+	/**
+	 * \brief Returns the number of dirty pages
+	 */
+	inline uint32_t getCount() const {return count;}
+
+	/**
+	 * \brief Takes the first run of consecutive dirty pages and marks them as
+	 * clean
+	 * \param[out] address Receives the offset of the run.
+	 * \param[out] length Receives the length of the run in bytes.
+	 * \return Returns true if there was a dirty page, false otherwise.
+	 */
+	bool takeRun(uint32_t& address, uint32_t& length)
+	{
+		if(count == 0)
+			return false;
+
+		// Find the first dirty page (skipping clean words)
+		uint32_t first = 0;
+		while(bitmap[first / 32] == 0)
+			first += 32;
+		first += __builtin_ctz(bitmap[first / 32]);
+
+		// Collect the dirty pages that follow
+		uint32_t end = first;
+		while(end < NUM_PAGES && isDirty(end))
+		{
+			bitmap[end / 32] &= ~(1u << (end % 32));
+			count--;
+			end++;
+		}
+
+		address = first * PAGE_SIZE;
+		length = (end * PAGE_SIZE < SIZE ? end * PAGE_SIZE : SIZE) - address;
+		return true;
+	}
+};
+
+#endif // _DIRTYPAGES_H
@@ -5,11 +5,20 @@
 
 #include<cstring>
 #include"pico/stdlib.h"
+#include"hardware/dma.h"
+#include"hardware/irq.h"
+#include"hardware/sync.h"
 #include"display.h"
 
+//-----------------------------------------------------------------------------
+// Display implementation
+
 Display::Display(spi_inst_t* spi, uint cs, uint dc)
-: spi(spi), cs(cs), dc(dc), initialised(false)
-{}
+: spi(spi), cs(cs), dc(dc), initialised(false), bytesSent(0)
+{
+	markClean();
+	resetClipRect();
+}
 
 void Display::init()
 {
@@ -87,6 +96,7 @@ sendCommand(0x2e);
 		setColumnAddress(0);
 		sendData((uint8_t)0, 132);
 	}
+	memset(txBuffer, 0, sizeof(txBuffer));
 
 	initialised = true;
 }
@@ -100,23 +110,81 @@ void Display::turnOnOff(bool on)
 
 void Display::update()
 {
+	uint8_t first[8], last[8];
+	if(captureChanges(first, last) == 0)
+		return;
 	for(uint8_t p = 0; p < 8; p++)
 	{
+		if(first[p] > last[p])
+			continue;
 		setPageAddress(p);
 		// The visible area is centered, i.e. from 2 to 129
-		setColumnAddress(2);
-		sendData(framebuffer[p], 128);
+		setColumnAddress(2 + first[p]);
+		sendData(&txBuffer[p][first[p]], last[p] - first[p] + 1);
+	}
+}
+
+uint Display::captureChanges(uint8_t first[8], uint8_t last[8])
+{
+	uint numPages = 0;
+	for(uint p = 0; p < 8; p++)
+	{
+		// Narrow the dirty range down to the bytes that actually differ
+		int f = dirtyFirst[p], l = dirtyLast[p];
+		while(f <= l && framebuffer[p][f] == txBuffer[p][f])
+			f++;
+		while(l >= f && framebuffer[p][l] == txBuffer[p][l])
+			l--;
+		if(f > l)
+		{
+			first[p] = 1;
+			last[p] = 0;
+			continue;
+		}
+		first[p] = f;
+		last[p] = l;
+
+		// Take over the changes
+		memcpy(&txBuffer[p][f], &framebuffer[p][f], l - f + 1);
+
+		// 12. Set Page Address, 1./2. Set Column Address
+		// (The visible area is centered, i.e. from 2 to 129)
+		uint column = 2 + f;
+		txCommands[p][0] = 0xb0 | p;
+		txCommands[p][1] = 0x10 | (column >> 4);
+		txCommands[p][2] = 0x00 | (column & 0x0f);
+
+		bytesSent += sizeof(txCommands[p]) + (l - f + 1);
+		numPages++;
 	}
+	markClean();
+	return numPages;
 }
 
 void Display::fillRect(int x, int y, int w, int h, uint8_t color)
 {
 	if(w < 0) {w = -w; x -= w;}
 	if(h < 0) {h = -h; y -= h;}
-	if(x >= 128 || y >= 64) return;
-	for(int py = MAX(0, y); py < y + h && py < 64; py++)
-		for(int px = MAX(0, x); px < x + w && px < 128; px++)
-			setPixel(px, py, color);
+	int x0 = x, y0 = y, x1 = x + w, y1 = y + h;
+	if(!clip(x0, y0, x1, y1)) return;
+	markDirty(x0, y0, x1 - 1, y1 - 1);
+	for(int py = y0; py < y1; py++)
+		for(int px = x0; px < x1; px++)
+			writePixel(px, py, color);
+}
+
+void Display::setClipRect(int x, int y, int w, int h)
+{
+	clipLeft = MAX(0, x);
+	clipTop = MAX(0, y);
+	clipRight = MIN(128, x + w);
+	clipBottom = MIN(64, y + h);
+	for(int p = 0; p < 8; p++)
+	{
+		// Rows [clipTop, clipBottom) intersected with [8p, 8p+8)
+		int top = MAX(clipTop - 8 * p, 0), bottom = MIN(clipBottom - 8 * p, 8);
+		clipMask[p] = top < bottom ? (0xff >> (8 - (bottom - top))) << top : 0;
+	}
 }
 
 void Display::sendCommand(uint8_t cmd)
@@ -207,3 +275,175 @@ void Display::setPageAddress(uint8_t addr)
 	// (Since this is a 64-row display (8 pages x 8 rows), A3 must always be 0.)
 	sendCommand(0xb0 | (addr & 0x07));
 }
+
+//-----------------------------------------------------------------------------
+// DisplayBus implementation
+
+DisplayBus* DisplayBus::instance = nullptr;
+
+DisplayBus::DisplayBus(spi_inst_t* spi, Display* displays, uint numDisplays)
+:	spi(spi), displays(displays), numDisplays(numDisplays),
+	numSegments(0), currentSegment(0), flushing(false), bytesSent(0),
+	callback(nullptr), userData(nullptr)
+{
+	assert((void("Only one DisplayBus instance may exist"), instance == nullptr));
+	assert((void("Too many displays for DisplayBus"), numDisplays <= DISPLAY_BUS_MAX_DISPLAYS));
+
+	// TX channel: framebuffer -> SPI, paced by the SPI TX FIFO
+	txChannel = dma_claim_unused_channel(true);
+	dma_channel_config txConfig = dma_channel_get_default_config(txChannel);
+	channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_8);
+	channel_config_set_dreq(&txConfig, spi_get_dreq(spi, true));
+	channel_config_set_read_increment(&txConfig, true);
+	channel_config_set_write_increment(&txConfig, false);
+	dma_channel_configure(txChannel, &txConfig, &spi_get_hw(spi)->dr, nullptr, 0, false);
+
+	// RX channel: SPI -> dummy, paced by the SPI RX FIFO
+	rxChannel = dma_claim_unused_channel(true);
+	dma_channel_config rxConfig = dma_channel_get_default_config(rxChannel);
+	channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+	channel_config_set_dreq(&rxConfig, spi_get_dreq(spi, false));
+	channel_config_set_read_increment(&rxConfig, false);
+	channel_config_set_write_increment(&rxConfig, false);
+	dma_channel_configure(rxChannel, &rxConfig, &rxDummy, &spi_get_hw(spi)->dr, 0, false);
+
+	// Interrupt fires when the RX channel has received the last byte
+	instance = this;
+	dma_channel_set_irq0_enabled(rxChannel, true);
+	irq_add_shared_handler(DMA_IRQ_0, dmaIrqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	irq_set_enabled(DMA_IRQ_0, true);
+}
+
+DisplayBus::~DisplayBus()
+{
+	waitForFlush();
+
+	dma_channel_set_irq0_enabled(rxChannel, false);
+	irq_remove_handler(DMA_IRQ_0, dmaIrqHandler);
+	instance = nullptr;
+	dma_channel_unclaim(txChannel);
+	dma_channel_unclaim(rxChannel);
+}
+
+void DisplayBus::setFlushCompleteCallback(void (*callback)(void*), void* userData)
+{
+	this->callback = callback;
+	this->userData = userData;
+}
+
+bool DisplayBus::startFlush()
+{
+	if(flushing)
+		return false;
+
+	// Build the list of segments: for each changed page of each display,
+	// first the address commands, then the changed span of the page data
+	numSegments = 0;
+	for(uint d = 0; d < numDisplays; d++)
+	{
+		uint8_t first[8], last[8];
+		if(displays[d].captureChanges(first, last) == 0)
+			continue;
+		for(uint p = 0; p < 8; p++)
+		{
+			if(first[p] > last[p])
+				continue;
+			uint16_t length = last[p] - first[p] + 1;
+			segments[numSegments++] = Segment{static_cast<uint8_t>(d), false, displays[d].getTxCommands(p), 3};
+			segments[numSegments++] = Segment{static_cast<uint8_t>(d), true, displays[d].getTxData(p, first[p]), length};
+			bytesSent += 3 + length;
+		}
+	}
+	// Nothing has changed, keep the bus quiet
+	if(numSegments == 0)
+	{
+		if(callback != nullptr)
+			callback(userData);
+		return true;
+	}
+
+	// Discard anything left in the RX FIFO (the blocking methods of the
+	// Display class leave it empty, but let's be sure)
+	while(spi_is_readable(spi))
+		(void)spi_get_hw(spi)->dr;
+
+	flushing = true;
+	startSegment(0);
+	return true;
+}
+
+void DisplayBus::waitForFlush()
+{
+	// Check and sleep with interrupts disabled, otherwise the interrupt that
+	// ends the flush could fire after the check but before WFI, which would
+	// then sleep until some unrelated interrupt. A pending interrupt wakes up
+	// WFI even while disabled and is taken as soon as interrupts are enabled
+	// again.
+	uint32_t status = save_and_disable_interrupts();
+	while(flushing)
+	{
+		__wfi();
+		restore_interrupts(status);
+		status = save_and_disable_interrupts();
+	}
+	restore_interrupts(status);
+}
+
+void DisplayBus::startSegment(uint index)
+{
+	const Segment& segment = segments[index];
+	const Display& display = displays[segment.display];
+
+	if(index == 0 || segments[index - 1].display != segment.display)
+	{
+		// Deselect the previous display
+		if(index != 0)
+		{
+			// Wait 120ns
+			busy_wait_us_32(1);
+			gpio_put(displays[segments[index - 1].display].getCs(), 1);
+		}
+		// Select the next display
+		gpio_put(display.getDc(), segment.data);
+		gpio_put(display.getCs(), 0);
+		// Wait 300ns
+		busy_wait_us_32(1);
+	}
+	else
+		// Same display, the SPI is idle so D/C can be switched right away
+		gpio_put(display.getDc(), segment.data);
+
+	currentSegment = index;
+	dma_channel_set_read_addr(txChannel, segment.src, false);
+	dma_channel_set_trans_count(txChannel, segment.length, false);
+	dma_channel_set_write_addr(rxChannel, &rxDummy, false);
+	dma_channel_set_trans_count(rxChannel, segment.length, false);
+	dma_start_channel_mask((1u << txChannel) | (1u << rxChannel));
+}
+
+void DisplayBus::segmentComplete()
+{
+	uint next = currentSegment + 1;
+	if(next < numSegments)
+	{
+		startSegment(next);
+		return;
+	}
+
+	// Flush complete, deselect the last display
+	// Wait 120ns
+	busy_wait_us_32(1);
+	gpio_put(displays[segments[currentSegment].display].getCs(), 1);
+	flushing = false;
+	if(callback != nullptr)
+		callback(userData);
+}
+
+void DisplayBus::dmaIrqHandler()
+{
+	// The handler is shared, so check that the interrupt is actually ours
+	if(instance == nullptr || !dma_channel_get_irq0_status(instance->rxChannel))
+		return;
+	dma_channel_acknowledge_irq0(instance->rxChannel);
+	instance->segmentComplete();
+}
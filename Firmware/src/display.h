@@ -79,6 +79,172 @@ private:
 	 */
 	uint8_t framebuffer[8][128];
 
+	/**
+	 * \brief Transmit buffer
+	 * \details Mirrors the contents of the display's memory, i.e. the last
+	 * frame that has been transmitted (or is being transmitted by a
+	 * DisplayBus). This allows drawing into the framebuffer while the
+	 * previous frame is still being sent, and it is what the framebuffer is
+	 * compared against to find out what has changed.
+	 */
+	uint8_t txBuffer[8][128];
+
+	/**
+	 * \brief Address commands for the changed span of each page
+	 * \details Set Page Address followed by Set Column Address. Filled in by
+	 * captureChanges().
+	 */
+	uint8_t txCommands[8][3];
+
+	/**
+	 * \{
+	 * \brief Range of columns per page that drawing operations have touched
+	 * since the last update
+	 * \details A page is clean if dirtyFirst > dirtyLast.
+	 */
+	uint8_t dirtyFirst[8], dirtyLast[8];
+	/// \}
+
+	/**
+	 * \brief Number of bytes sent to the display by updates
+	 */
+	uint32_t bytesSent;
+
+	/**
+	 * \{
+	 * \brief Clipping rectangle for drawing operations
+	 * \details Left and top are inclusive, right and bottom exclusive.
+	 */
+	int clipLeft, clipTop, clipRight, clipBottom;
+	/// \}
+
+	/**
+	 * \brief Rows of each page that are inside the clipping rectangle
+	 */
+	uint8_t clipMask[8];
+
+	/**
+	 * \brief Intersects a rectangle with the clipping rectangle
+	 * \param[in,out] x0,y0 Upper left corner (inclusive).
+	 * \param[in,out] x1,y1 Lower right corner (exclusive).
+	 * \return Returns false if the intersection is empty.
+	 */
+	inline bool clip(int& x0, int& y0, int& x1, int& y1) const
+	{
+		x0 = MAX(x0, clipLeft);
+		y0 = MAX(y0, clipTop);
+		x1 = MIN(x1, clipRight);
+		y1 = MIN(y1, clipBottom);
+		return x0 < x1 && y0 < y1;
+	}
+
+	/**
+	 * \brief Marks a rectangular region as modified
+	 * \param x0,y0 Upper left corner. Must be in [0,128)x[0,64).
+	 * \param x1,y1 Lower right corner (inclusive). Must be in [0,128)x[0,64).
+	 */
+	inline void markDirty(uint x0, uint y0, uint x1, uint y1)
+	{
+		for(uint p = y0 / 8; p <= y1 / 8; p++)
+		{
+			if(x0 < dirtyFirst[p]) dirtyFirst[p] = x0;
+			if(x1 > dirtyLast[p]) dirtyLast[p] = x1;
+		}
+	}
+
+	/**
+	 * \brief Marks all pages as clean
+	 */
+	inline void markClean()
+	{
+		memset(dirtyFirst, 0xff, sizeof(dirtyFirst));
+		memset(dirtyLast, 0, sizeof(dirtyLast));
+	}
+
+	/**
+	 * \brief Combines source and destination bits using a raster operation
+	 * \details Works on eight pixels at once. See \see RasterOperation.
+	 * \param rop The raster operation.
+	 * \param src Source pixels.
+	 * \param dst Destination pixels.
+	 * \return Returns the resulting pixels.
+	 */
+	static inline uint8_t applyRop(RasterOperation rop, uint8_t src, uint8_t dst)
+	{
+		// Expand each bit of rop into a mask of 0x00 or 0xff
+		uint8_t r = static_cast<uint8_t>(rop);
+		uint8_t m0 = -(r & 1), m1 = -((r >> 1) & 1), m2 = -((r >> 2) & 1), m3 = -((r >> 3) & 1);
+		return (~src & ~dst & m0) | (~src & dst & m1) | (src & ~dst & m2) | (src & dst & m3);
+	}
+
+	/**
+	 * \brief Transposes a block of 8x8 pixels
+	 * \details Converts eight rows (bit c of block[r] is the pixel in column
+	 * c of row r) into eight columns (bit r of block[c] is the pixel in row r
+	 * of column c) and vice versa.
+	 * \param block The block to be transposed in place.
+	 */
+	static inline void transposeBlock(uint8_t block[8])
+	{
+		uint32_t lo = block[0] | (block[1] << 8) | (block[2] << 16) | (static_cast<uint32_t>(block[3]) << 24);
+		uint32_t hi = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+		uint32_t t;
+		// Swap 1x1 sub-blocks within 2x2 blocks
+		t = (lo ^ (lo >> 7)) & 0x00aa00aa; lo ^= t ^ (t << 7);
+		t = (hi ^ (hi >> 7)) & 0x00aa00aa; hi ^= t ^ (t << 7);
+		// Swap 2x2 sub-blocks within 4x4 blocks
+		t = (lo ^ (lo >> 14)) & 0x0000cccc; lo ^= t ^ (t << 14);
+		t = (hi ^ (hi >> 14)) & 0x0000cccc; hi ^= t ^ (t << 14);
+		// Swap 4x4 sub-blocks
+		t = (lo & 0x0f0f0f0f) | ((hi << 4) & 0xf0f0f0f0);
+		hi = (hi & 0xf0f0f0f0) | ((lo >> 4) & 0x0f0f0f0f);
+		lo = t;
+		for(uint i = 0; i < 4; i++)
+		{
+			block[i] = lo >> (8 * i);
+			block[4 + i] = hi >> (8 * i);
+		}
+	}
+
+	/**
+	 * \brief Combines a column of up to eight pixels with the framebuffer
+	 * \details The pixels are not marked as modified.
+	 * \param x Column. Must be in [0,128).
+	 * \param y Row of the pixel in the LSB of bits. Pixels outside the display
+	 * area or the rows of the clipping rectangle are clipped.
+	 * \param bits Source pixels, bit k is the pixel in row y + k.
+	 * \param mask Selects which of the bits are to be drawn.
+	 * \param rop The raster operation.
+	 */
+	inline void blitColumn(uint x, int y, uint8_t bits, uint8_t mask, RasterOperation rop)
+	{
+		// The column spans (at most) two pages
+		uint shift = y & 7;
+		int page = (y - static_cast<int>(shift)) / 8;
+		uint16_t b = bits << shift, m = mask << shift;
+		if(page >= 0 && page < 8)
+		{
+			uint8_t& dst = framebuffer[page][x];
+			uint8_t pm = m & clipMask[page];
+			dst = (dst & ~pm) | (applyRop(rop, b, dst) & pm);
+		}
+		if(page + 1 >= 0 && page + 1 < 8 && (m >> 8) != 0)
+		{
+			uint8_t& dst = framebuffer[page + 1][x];
+			uint8_t pm = (m >> 8) & clipMask[page + 1];
+			dst = (dst & ~pm) | (applyRop(rop, b >> 8, dst) & pm);
+		}
+	}
+
+	/**
+	 * \brief Set a pixel in the framebuffer without marking it as modified
+	 * \details Used by drawing methods which mark their whole area at once.
+	 */
+	inline void writePixel(uint x, uint y, uint8_t color)
+	{
+		framebuffer[y / 8][x] = (framebuffer[y / 8][x] & ~(1 << (y % 8))) | (color << (y % 8));
+	}
+
 	/**
 	 * \brief Send an 8-bit command to the display
 	 * \param cmd The command to be sent.
@@ -158,9 +324,65 @@ public:
 
 	/**
 	 * \brief Updates the display from the framebuffer
+	 * \details Only the parts of the framebuffer that differ from what the
+	 * display currently shows are transmitted. This method is blocking. Use a
+	 * DisplayBus for asynchronous updates.
 	 */
 	void update();
 
+	/**
+	 * \brief Returns the number of bytes sent by updates
+	 * \details This counts page data and address commands transmitted by
+	 * update() and DisplayBus::startFlush() since the display was
+	 * initialised. It stays constant while the framebuffer contents don't
+	 * change.
+	 * \return The number of bytes.
+	 */
+	inline uint32_t getBytesSent() const {return bytesSent;}
+
+	/**
+	 * \brief Getter for CS pin number
+	 * \return Returns the CS pin number assigned to this display.
+	 */
+	inline uint getCs() const {return cs;}
+
+	/**
+	 * \brief Getter for D/C pin number
+	 * \return Returns the D/C pin number assigned to this display.
+	 */
+	inline uint getDc() const {return dc;}
+
+	/**
+	 * \brief Collects the changes that need to be sent to the display
+	 * \details Compares the dirty parts of the framebuffer with the transmit
+	 * buffer and narrows each page down to the span between the first and the
+	 * last changed column. The changed bytes are copied into the transmit
+	 * buffer and the dirty markers are reset. Afterwards, the framebuffer may
+	 * be drawn into again while the transmit buffer is being sent.
+	 * This is called by update() and DisplayBus::startFlush().
+	 * \param[out] first,last For each page, the first and the last changed
+	 * column. If nothing changed in a page, first > last.
+	 * \return Returns the number of pages that need to be sent.
+	 */
+	uint captureChanges(uint8_t first[8], uint8_t last[8]);
+
+	/**
+	 * \brief Get the address commands for a page
+	 * \details Only valid for pages that captureChanges() reported as
+	 * changed.
+	 * \param page Index of the page. Must be in [0,8).
+	 * \return Returns a pointer to the 3 command bytes.
+	 */
+	inline const uint8_t* getTxCommands(uint page) const {return txCommands[page];}
+
+	/**
+	 * \brief Get data from the transmit buffer
+	 * \param page Index of the page. Must be in [0,8).
+	 * \param column Index of the first column. Must be in [0,128).
+	 * \return Returns a pointer to the data.
+	 */
+	inline const uint8_t* getTxData(uint page, uint column) const {return &txBuffer[page][column];}
+
 	/**
 	 * \brief Get a pixel from the framebuffer
 	 * \param x,y Coordinates of the pixel. Must be in [0,128)x[0,64). For
@@ -182,22 +404,43 @@ public:
 	 */
 	inline void setPixel(uint x, uint y, uint8_t color)
 	{
-		framebuffer[y / 8][x] = (framebuffer[y / 8][x] & ~(1 << (y % 8))) | (color << (y % 8));
+		writePixel(x, y, color);
+		markDirty(x, y, x, y);
 	}
 
 	/**
-	 * \brief Fills the whole display with a color
+	 * \brief Fills the whole display (or the clipping rectangle) with a color
 	 * \param color The color for filling: 0 for black, 1 for white
 	 */
 	inline void fill(uint8_t color)
 	{
-		memset(framebuffer, color, sizeof(framebuffer));
+		if(clipLeft > 0 || clipTop > 0 || clipRight < 128 || clipBottom < 64)
+		{
+			fillRect(clipLeft, clipTop, clipRight - clipLeft, clipBottom - clipTop, color);
+			return;
+		}
+		memset(framebuffer, color ? 0xff : 0x00, sizeof(framebuffer));
+		markDirty(0, 0, 127, 63);
 	}
 
+	/**
+	 * \brief Restricts all drawing operations to a rectangular region
+	 * \details Except for setPixel(), nothing outside the rectangle is
+	 * modified until the clipping rectangle is changed again.
+	 * \param x,y Upper left corner.
+	 * \param w,h Width and height.
+	 */
+	void setClipRect(int x, int y, int w, int h);
+
+	/**
+	 * \brief Allows drawing on the whole display again
+	 */
+	inline void resetClipRect() {setClipRect(0, 0, 128, 64);}
+
 	/**
 	 * \brief Fills a rectangluar region with a color
-	 * \details If parts of the rectangle are outside the display area, the
-	 * rectangle gets clipped.
+	 * \details If parts of the rectangle are outside the display area or the
+	 * clipping rectangle, the rectangle gets clipped.
 	 * \param x,y Coordinates of a corner.
 	 * \param w,h Width and height.
 	 * \param color The color for filling: 0 for black, 1 for white
@@ -207,7 +450,7 @@ public:
 	/**
 	 * \brief Copy a bitmap into the framebuffer
 	 * \details Parts of the bitmap that would end up outside of the display
-	 * area are clipped.
+	 * area or the clipping rectangle are clipped.
 	 * \param x,y Position where the bitmap should be copied to.
 	 * \param bitmap The bitmap to be copied.
 	 * \param rop Raster operation used to combine bitmap data with existing
@@ -216,15 +459,96 @@ public:
 	template<uint width, uint height>
 	void drawBitmap(int x, int y, const Bitmap<width, height>& bitmap, RasterOperation rop = RasterOperation::SRC)
 	{
-		for(int py = MAX(0, y); py < y + height && py < 64; py++)
-			for(int px = MAX(0, x); px < x + width && px < 128; px++)
-				setPixel(px, py, (static_cast<uint8_t>(rop) >> (2 * bitmap.getPixel(px - x, py - y) + getPixel(px, py))) & 1);
+		int x0 = x, y0 = y, x1 = x + (int)width, y1 = y + (int)height;
+		if(!clip(x0, y0, x1, y1))
+			return;
+		markDirty(x0, y0, x1 - 1, y1 - 1);
+		// Go through the bitmap in blocks of 8x8 pixels. Each block is
+		// transposed from rows into columns (the framebuffer's format) and
+		// then combined with the framebuffer one column at a time.
+		for(uint by = 0; by < height; by += 8)
+		{
+			int py = y + static_cast<int>(by);
+			if(py >= y1)
+				break;
+			if(py + 8 <= y0)
+				continue;
+			uint rows = MIN(8u, height - by);
+			uint8_t mask = 0xff >> (8 - rows);
+			for(uint bx = 0; bx < width; bx += 8)
+			{
+				int px = x + static_cast<int>(bx);
+				if(px >= x1)
+					break;
+				if(px + 8 <= x0)
+					continue;
+				uint8_t block[8];
+				for(uint r = 0; r < 8; r++)
+					block[r] = r < rows ? bitmap.getByte(bx, by + r) : 0;
+				transposeBlock(block);
+				uint columns = MIN(8u, width - bx);
+				for(uint c = 0; c < columns; c++)
+					if(px + static_cast<int>(c) >= x0 && px + static_cast<int>(c) < x1)
+						blitColumn(px + c, py, block[c], mask, rop);
+			}
+		}
+	}
+
+	/**
+	 * \brief Copy a page-major bitmap into the framebuffer
+	 * \details Parts of the bitmap that would end up outside of the display
+	 * area or the clipping rectangle are clipped. If y is a multiple of 8,
+	 * every page of the bitmap maps onto a single page of the framebuffer,
+	 * which makes this a plain copy (for RasterOperation::SRC) or a single
+	 * pass over the bytes.
+	 * \param x,y Position where the bitmap should be copied to.
+	 * \param bitmap The bitmap to be copied.
+	 * \param rop Raster operation used to combine bitmap data with existing
+	 * data on the display. See \see RasterOperation for details.
+	 */
+	template<uint width, uint height>
+	void drawBitmap(int x, int y, const PageBitmap<width, height>& bitmap, RasterOperation rop = RasterOperation::SRC)
+	{
+		int x0 = x, y0 = y, x1 = x + (int)width, y1 = y + (int)height;
+		if(!clip(x0, y0, x1, y1))
+			return;
+		markDirty(x0, y0, x1 - 1, y1 - 1);
+		// Range of visible columns of the bitmap
+		uint first = x0 - x;
+		uint last = x1 - x;
+		for(uint p = 0; p < PageBitmap<width, height>::NUM_PAGES; p++)
+		{
+			int py = y + 8 * static_cast<int>(p);
+			if(py >= y1)
+				break;
+			if(py + 8 <= y0)
+				continue;
+			uint rows = MIN(8u, height - 8 * p);
+			uint8_t mask = 0xff >> (8 - rows);
+			const uint8_t* src = bitmap.getPage(p);
+			if((py & 7) == 0)
+			{
+				uint8_t* dst = framebuffer[py / 8];
+				mask &= clipMask[py / 8];
+				if(rop == RasterOperation::SRC && mask == 0xff)
+					memcpy(dst + x + static_cast<int>(first), src + first, last - first);
+				else
+					for(uint c = first; c < last; c++)
+					{
+						uint8_t& d = dst[x + static_cast<int>(c)];
+						d = (d & ~mask) | (applyRop(rop, src[c], d) & mask);
+					}
+			}
+			else
+				for(uint c = first; c < last; c++)
+					blitColumn(x + c, py, src[c], mask, rop);
+		}
 	}
 
 	/**
 	 * \brief Renders text into the framebuffer
 	 * \details Parts of the text that would end up outside of the display
-	 * area are clipped.
+	 * area or the clipping rectangle are clipped.
 	 * \param x,y Coordinates where the text is to be rendered.
 	 * \param text The text to be rendered in UTF-8 encoding.
 	 * \param length The length of text in bytes (not characters!). If zero is
@@ -254,12 +578,209 @@ public:
 			if(glyph == nullptr)
 				continue;
 			// Draw glyph
-			for(uint gy = MAX(0, y); gy < y + height && gy < 64; gy++)
-				for(uint gx = MAX(0, x); gx < x + glyph->width && gx < 128; gx++)
-					setPixel(gx, gy, glyph->getPixel(gx - x, gy - y));
+			int x0 = x, y0 = y, x1 = x + (int)glyph->width, y1 = y + (int)height;
+			if(clip(x0, y0, x1, y1))
+			{
+				markDirty(x0, y0, x1 - 1, y1 - 1);
+				for(int gy = y0; gy < y1; gy++)
+					for(int gx = x0; gx < x1; gx++)
+						writePixel(gx, gy, glyph->getPixel(gx - x, gy - y));
+			}
 			x += glyph->width + font.getSpace();
 		}
 	}
 };
 
+/**
+ * \brief Maximum number of displays that can share a DisplayBus
+ */
+#define DISPLAY_BUS_MAX_DISPLAYS 3
+
+/**
+ * \brief Transfers the framebuffers of several displays via DMA
+ * \details All displays must be connected to the same SPI instance (and may
+ * share their D/C line). A flush collects the changed span of each page of
+ * each display (see Display::captureChanges()) and then sends the address
+ * commands and the data for all of them as one sequence of segments. A segment is a run of bytes
+ * for one display with a constant level on the D/C line. Since D/C and CS are
+ * ordinary GPIOs, they are switched from the DMA interrupt between segments,
+ * which then immediately starts the next segment. The CPU is free to draw the
+ * next frame in the meantime.
+ * A second DMA channel drains the SPI RX FIFO. Its completion indicates that
+ * the last byte of a segment has actually left the shift register, so D/C
+ * and CS can be changed safely.
+ * Only one instance may exist at any time. It must be created on the core
+ * that is supposed to handle the DMA interrupt. While a flush is ongoing, no
+ * other code may use the SPI instance, which includes the blocking methods of
+ * the Display class like Display::update() or Display::turnOnOff().
+ */
+class DisplayBus
+{
+private:
+	/**
+	 * \brief A contiguous part of a flush
+	 */
+	struct Segment
+	{
+		/// Index of the display in the displays array
+		uint8_t display;
+		/// Level of the D/C line (false for commands, true for data)
+		bool data;
+		/// Bytes to be transmitted
+		const uint8_t* src;
+		/// Number of bytes to be transmitted
+		uint16_t length;
+	};
+
+	/**
+	 * \brief The single instance (needed by the DMA interrupt handler)
+	 */
+	static DisplayBus* instance;
+
+	/**
+	 * \brief DMA interrupt handler
+	 */
+	static void dmaIrqHandler();
+
+	/**
+	 * \brief Pointer to the SPI instance
+	 */
+	spi_inst_t* spi;
+
+	/**
+	 * \brief Displays attached to this bus
+	 */
+	Display* displays;
+
+	/**
+	 * \brief Number of displays attached to this bus
+	 */
+	uint numDisplays;
+
+	/**
+	 * \brief DMA channels for feeding the SPI TX FIFO and draining the RX FIFO
+	 */
+	uint txChannel, rxChannel;
+
+	/**
+	 * \brief Sink for the data received while transmitting
+	 */
+	uint8_t rxDummy;
+
+	/**
+	 * \brief Segments of the current flush
+	 */
+	Segment segments[DISPLAY_BUS_MAX_DISPLAYS * 16];
+
+	/**
+	 * \brief Number of segments in the current flush
+	 */
+	uint numSegments;
+
+	/**
+	 * \brief Index of the segment currently being transmitted
+	 */
+	volatile uint currentSegment;
+
+	/**
+	 * \brief Remembers whether a flush is ongoing
+	 */
+	volatile bool flushing;
+
+	/**
+	 * \brief Number of bytes sent by all flushes
+	 */
+	uint32_t bytesSent;
+
+	/**
+	 * \brief Callback for when a flush has completed
+	 */
+	void (*callback)(void*);
+
+	/**
+	 * \brief User data for the callback
+	 */
+	void* userData;
+
+	/**
+	 * \brief Starts the transmission of a segment
+	 * \details Switches CS and D/C as required and starts both DMA channels.
+	 * \param index Index of the segment.
+	 */
+	void startSegment(uint index);
+
+	/**
+	 * \brief Called from the interrupt handler when a segment is complete
+	 */
+	void segmentComplete();
+
+public:
+	/**
+	 * \brief Constructs a DisplayBus instance
+	 * \details Claims two DMA channels and installs the DMA interrupt handler
+	 * on the calling core.
+	 * \param spi The SPI module shared by all displays. It must already be set
+	 * up.
+	 * \param displays Array of displays. They must already be initialised.
+	 * \param numDisplays Number of displays in the array. Must not exceed
+	 * DISPLAY_BUS_MAX_DISPLAYS.
+	 */
+	DisplayBus(spi_inst_t* spi, Display* displays, uint numDisplays);
+
+	/**
+	 * \brief Destructor
+	 * \details Waits for an ongoing flush to complete before releasing the
+	 * DMA channels.
+	 */
+	~DisplayBus();
+
+	/**
+	 * \{
+	 * \brief Prevent copying
+	 */
+	DisplayBus(const DisplayBus&) = delete;
+	DisplayBus& operator=(const DisplayBus&) = delete;
+	/// \}
+
+	/**
+	 * \brief Sets a function to be called whenever a flush has completed
+	 * \details The callback is invoked from the DMA interrupt, so it should
+	 * return quickly.
+	 * \param callback The function to be called or nullptr.
+	 * \param userData An arbitrary pointer passed to the callback.
+	 */
+	void setFlushCompleteCallback(void (*callback)(void*), void* userData = nullptr);
+
+	/**
+	 * \brief Starts transferring the framebuffers of all displays
+	 * \details This method is non-blocking. The changes are copied before
+	 * this method returns, so the framebuffers can be drawn into right away.
+	 * If nothing has changed, nothing is sent and the callback is invoked
+	 * immediately.
+	 * \return Returns true if the flush was started or false if another
+	 * flush is still ongoing.
+	 */
+	bool startFlush();
+
+	/**
+	 * \brief Determines whether a flush is ongoing
+	 * \return Returns true while a flush is ongoing, false once it has
+	 * completed.
+	 */
+	inline bool isFlushing() const {return flushing;}
+
+	/**
+	 * \brief Waits until an ongoing flush (if any) has completed
+	 * \details Sleeps until the DMA interrupt ends the flush, so it must be
+	 * called on the core that handles that interrupt.
+	 */
+	void waitForFlush();
+
+	/**
+	 * \brief Returns the number of bytes sent by all flushes
+	 * \return The number of bytes (page data and address commands).
+	 */
+	inline uint32_t getBytesSent() const {return bytesSent;}
+};
+
 #endif // _DISPLAY_H
@@ -79,7 +79,8 @@ void EepRom::exit()
 
 EepRom::EepRom(i2c_inst_t* i2c, uint baudRate, EepRomType type, uint8_t i2cAddress)
 :	i2c(i2c), baudRate(baudRate), i2cAddress(i2cAddress), type(type),
-	state(State::IDLE), result(Result::NONE)
+	state(State::IDLE), result(Result::NONE), pendingOperations(0),
+	queue{}, queueHead(0), queueCount(0), segmentIndex(0), completion{}
 {
 	assert((void("I²C address for EEPROM must be 7 bit (<128)"), i2cAddress < 128));
 
@@ -94,102 +95,212 @@ EepRom::~EepRom()
 	critical_section_deinit(&critSec);
 }
 
-bool EepRom::startReading(uint8_t* dest, uint memAddress, uint length)
+bool EepRom::queueRead(uint8_t* dest, uint memAddress, uint length, Callback callback, void* userData)
+{
+	return queueRequest({false, nullptr, 1, {dest, memAddress, length}, callback, userData});
+}
+
+bool EepRom::queueRead(const Segment* segments, uint numSegments, Callback callback, void* userData)
+{
+	return queueRequest({false, segments, numSegments, {}, callback, userData});
+}
+
+bool EepRom::queueWrite(const uint8_t* src, uint memAddress, uint length, Callback callback, void* userData)
+{
+	// The data is not modified, Segment just doesn't distinguish
+	return queueRequest({true, nullptr, 1, {const_cast<uint8_t*>(src), memAddress, length}, callback, userData});
+}
+
+bool EepRom::queueWrite(const Segment* segments, uint numSegments, Callback callback, void* userData)
+{
+	return queueRequest({true, segments, numSegments, {}, callback, userData});
+}
+
+bool EepRom::queueRequest(const Request& request)
 {
 	assert((void("EepRom::init() must be called before stating any operation"), irq_has_shared_handler(I2C0_IRQ + i2c_get_index(i2c))));
 
-	// Check parameters
+	// Check if there is anything to do at all (so a queued request never
+	// finishes right when it is started)
 	uint capacity = getCapacity();
-	if(memAddress > capacity)
-		return true;
-	if(memAddress + length > capacity)
-		length = capacity - memAddress;
-	if(length == 0)
+	const Segment* segments = request.segments != nullptr ? request.segments : &request.inlineSegment;
+	bool empty = true;
+	for(uint i = 0; i < request.numSegments; i++)
+		if(segments[i].memAddress < capacity && segments[i].length > 0)
+			empty = false;
+	if(empty)
+	{
+		if(request.callback != nullptr)
+			request.callback(Result::SUCCESS, request.userData);
 		return true;
+	}
 
 	// Secure access to state and other attributes
 	critical_section_enter_blocking(&critSec);
 
-	// Check if another operation is ongoing
-	if(state != State::IDLE)
+	// Check if there is space in the queue
+	if(queueCount == EEPROM_QUEUE_SIZE)
 	{
 		critical_section_exit(&critSec);
 		return false;
 	}
 
-	// Store parameters
-	readOp.data = dest;
-	readOp.memAddress = memAddress;
-	readOp.length = length;
-	// Reset counters
-	readOp.bytesRequested = 0;
-	readOp.bytesReceived = 0;
-	// Update result
-	result = Result::ONGOING;
+	// Append the request and start it if there is no other one
+	queue[(queueHead + queueCount) % EEPROM_QUEUE_SIZE] = request;
+	queueCount++;
+	if(queueCount == 1)
+		startRequest();
+
+	// We're done for now, interrupts will do the rest..
+	exitCritSec();
+	return true;
+}
+
+void EepRom::startRequest()
+{
+	segmentIndex = 0;
 
 	// Initialise I²C peripheral
 	i2c_set_slave_mode(i2c, false, 0);
 	i2c_set_baudrate(i2c, baudRate);
-	i2c_get_hw(i2c)->con |= I2C_IC_CON_IC_RESTART_EN_LSB;
+	if(!queue[queueHead].write)
+		i2c_get_hw(i2c)->con |= I2C_IC_CON_IC_RESTART_EN_LSB;
 
-	// Fill the FIFO with commands to send address bytes and receive data
-	readFillTxFifo();
+	startSegment();
+}
 
-	// We're done for now, interrupts will do the rest..
-	critical_section_exit(&critSec);
-	return true;
+void EepRom::startSegment()
+{
+	const Request& request = queue[queueHead];
+	const Segment* segments = request.segments != nullptr ? request.segments : &request.inlineSegment;
+	uint capacity = getCapacity();
+
+	// Find the next segment with something to do
+	for(; segmentIndex < request.numSegments; segmentIndex++)
+	{
+		const Segment& segment = segments[segmentIndex];
+		if(segment.memAddress >= capacity || segment.length == 0)
+			continue;
+		uint length = segment.memAddress + segment.length > capacity ? capacity - segment.memAddress : segment.length;
+
+		if(request.write)
+		{
+			// Store parameters
+			writeOp.data = segment.data;
+			writeOp.memAddress = segment.memAddress;
+			writeOp.length = length;
+			// Reset counters
+			writeOp.bytesEnqueued = 0;
+			writeOp.bytesTransmitted = 0;
+			// Fill the FIFO with address bytes and data
+			writeFillTxFifo();
+		}
+		else
+		{
+			// Store parameters
+			readOp.data = segment.data;
+			readOp.memAddress = segment.memAddress;
+			readOp.length = length;
+			// Reset counters
+			readOp.bytesRequested = 0;
+			readOp.bytesReceived = 0;
+			// Fill the FIFO with commands to send address bytes and receive
+			// data
+			readFillTxFifo();
+		}
+		return;
+	}
+
+	// All segments are done
+	finishRequest(Result::SUCCESS);
 }
 
-bool EepRom::startWriting(const uint8_t* src, uint memAddress, uint length)
+void EepRom::finishRequest(Result result)
 {
-	assert((void("EepRom::init() must be called before stating any operation"), irq_has_shared_handler(I2C0_IRQ + i2c_get_index(i2c))));
+	// There can only be one finished request per critical section (see
+	// queueRequest())
+	assert(!completion.pending);
+	const Request& request = queue[queueHead];
+	completion.pending = true;
+	completion.callback = request.callback;
+	completion.userData = request.userData;
+	completion.result = result;
+
+	// Remove the request from the queue
+	queueHead = (queueHead + 1) % EEPROM_QUEUE_SIZE;
+	queueCount--;
+	state = State::IDLE;
 
-	// Check parameters
-	uint capacity = getCapacity();
-	if(memAddress > capacity)
-		return true;
-	if(memAddress + length > capacity)
-		length = capacity - memAddress;
-	if(length == 0)
-		return true;
+	// Carry on with the next request right away
+	if(queueCount > 0)
+		startRequest();
+}
 
-	// Secure access to state and other attributes
+void EepRom::exitCritSec()
+{
+	bool pending = completion.pending;
+	Callback callback = completion.callback;
+	void* userData = completion.userData;
+	Result result = completion.result;
+	completion.pending = false;
+	critical_section_exit(&critSec);
+
+	if(pending && callback != nullptr)
+		callback(result, userData);
+}
+
+bool EepRom::startReading(uint8_t* dest, uint memAddress, uint length)
+{
+	// Count the operation before it is queued, it might finish right away
 	critical_section_enter_blocking(&critSec);
+	pendingOperations++;
+	critical_section_exit(&critSec);
 
-	// Check if another operation is ongoing
-	if(state != State::IDLE)
+	if(!queueRead(dest, memAddress, length, operationCallback, this))
 	{
+		critical_section_enter_blocking(&critSec);
+		pendingOperations--;
 		critical_section_exit(&critSec);
 		return false;
 	}
+	return true;
+}
 
-	// Store parameters
-	writeOp.data = src;
-	writeOp.memAddress = memAddress;
-	writeOp.length = length;
-	// Reset counters
-	writeOp.bytesEnqueued = 0;
-	writeOp.bytesTransmitted = 0;
-	// Update result
-	result = Result::ONGOING;
+bool EepRom::startWriting(const uint8_t* src, uint memAddress, uint length)
+{
+	// Count the operation before it is queued, it might finish right away
+	critical_section_enter_blocking(&critSec);
+	pendingOperations++;
+	critical_section_exit(&critSec);
 
-	// Initialise I²C peripheral
-	i2c_set_slave_mode(i2c, false, 0);
-	i2c_set_baudrate(i2c, baudRate);
+	if(!queueWrite(src, memAddress, length, operationCallback, this))
+	{
+		critical_section_enter_blocking(&critSec);
+		pendingOperations--;
+		critical_section_exit(&critSec);
+		return false;
+	}
+	return true;
+}
 
-	// First step of the operation is to perform a ready check on the EEPROM
-	// Set up an alarm that does this (zero delay before first attempt)
-	writeFillTxFifo();
+void EepRom::operationCallback(Result result, void* userData)
+{
+	EepRom* eeprom = static_cast<EepRom*>(userData);
+	critical_section_enter_blocking(&eeprom->critSec);
+	eeprom->result = result;
+	eeprom->pendingOperations--;
+	critical_section_exit(&eeprom->critSec);
+}
 
-	// We're done for now, interrupts will do the rest..
-	critical_section_exit(&critSec);
-	return true;
+void EepRom::blockingCallback(Result result, void* userData)
+{
+	*static_cast<volatile Result*>(userData) = result;
 }
 
 EepRom::Result EepRom::getResult()
 {
 	critical_section_enter_blocking(&critSec);
-	Result result = this->result;
+	Result result = pendingOperations > 0 ? Result::ONGOING : this->result;
 	critical_section_exit(&critSec);
 	return result;
 }
@@ -211,6 +322,13 @@ void EepRom::cancel()
 	state = State::IDLE;
 	result = Result::CANCELLED;
 
+	// Take all requests out of the queue
+	Request cancelled[EEPROM_QUEUE_SIZE];
+	uint numCancelled = queueCount;
+	for(uint i = 0; i < numCancelled; i++)
+		cancelled[i] = queue[(queueHead + i) % EEPROM_QUEUE_SIZE];
+	queueCount = 0;
+
 	// Wait until the I²C peripheral is done
 	if(i2c_get_hw(i2c)->enable & I2C_IC_ENABLE_ENABLE_BITS)
 	{
@@ -223,6 +341,11 @@ void EepRom::cancel()
 	}
 
 	critical_section_exit(&critSec);
+
+	// Let the owners of the requests know
+	for(uint i = 0; i < numCancelled; i++)
+		if(cancelled[i].callback != nullptr)
+			cancelled[i].callback(Result::CANCELLED, cancelled[i].userData);
 }
 
 int64_t EepRom::alarmCallback()
@@ -252,7 +375,7 @@ int64_t EepRom::alarmCallback()
 			assert(false);
 		}
 	}
-	critical_section_exit(&critSec);
+	exitCritSec();
 	return 0; // Don't re-schedule the alarm
 }
 
@@ -325,7 +448,7 @@ void EepRom::i2cCallback()
 			assert(false);
 		}
 	}
-	critical_section_exit(&critSec);
+	exitCritSec();
 }
 
 void EepRom::readFillTxFifo()
@@ -333,12 +456,12 @@ void EepRom::readFillTxFifo()
 	// TX FIFO is empty
 	assert((i2c_get_hw(i2c)->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS) != 0);
 
-	// Is the read operation finished?
+	// Is the segment finished? Then move on to the next one.
 	if(readOp.bytesReceived == readOp.length)
 	{
-		state = State::IDLE;
-		result = Result::SUCCESS;
 		i2c_get_hw(i2c)->enable = 0;
+		segmentIndex++;
+		startSegment();
 		return;
 	}
 
@@ -419,12 +542,12 @@ void EepRom::writeFillTxFifo()
 	// TX FIFO is empty
 	assert((i2c_get_hw(i2c)->raw_intr_stat & I2C_IC_RAW_INTR_STAT_TX_EMPTY_BITS) != 0);
 
-	// Is the write operation finished?
+	// Is the segment finished? Then move on to the next one.
 	if(writeOp.bytesTransmitted == writeOp.length)
 	{
-		state = State::IDLE;
-		result = Result::SUCCESS;
 		i2c_get_hw(i2c)->enable = 0;
+		segmentIndex++;
+		startSegment();
 		return;
 	}
 
@@ -514,20 +637,22 @@ void EepRom::writeFillTxFifo()
 
 EepRom::Result EepRom::read(uint8_t* dest, uint memAddress, uint length)
 {
-	if(!startReading(dest, memAddress, length))
+	volatile Result result = Result::ONGOING;
+	if(!queueRead(dest, memAddress, length, blockingCallback, const_cast<Result*>(&result)))
 		return Result::CANCELLED;
-	while(getResult() == Result::ONGOING)
+	while(result == Result::ONGOING)
 		__wfi();
-	return getResult();
+	return result;
 }
 
 EepRom::Result EepRom::write(const uint8_t* src, uint memAddress, uint length)
 {
-	if(!startWriting(src, memAddress, length))
+	volatile Result result = Result::ONGOING;
+	if(!queueWrite(src, memAddress, length, blockingCallback, const_cast<Result*>(&result)))
 		return Result::CANCELLED;
-	while(getResult() == Result::ONGOING)
+	while(result == Result::ONGOING)
 		__wfi();
-	return getResult();
+	return result;
 }
 
 uint8_t EepRom::calcI2cAddress(uint memAddress)
@@ -549,3 +674,8 @@ uint EepRom::getCapacity() const
 {
 	return 1u << PARAMS[type].addressBits;
 }
+
+uint EepRom::getPageSize() const
+{
+	return PARAMS[type].pageSize;
+}
@@ -21,6 +21,18 @@
  * from that core.
  *
  *
+ * Note on requests:
+ *
+ * Read and write operations are queued as requests (up to EEPROM_QUEUE_SIZE
+ * per instance), so different parts of the program can access the EEPROM
+ * without coordinating with each other. A request consists of one or more
+ * segments (scatter/gather), which are either all read or all written. The
+ * requests are carried out in the order they were queued. The next one is
+ * started from the same interrupt in which the previous one finished, so the
+ * bus doesn't sit idle in between. When a request is finished, its callback
+ * is invoked (from that interrupt as well).
+ *
+ *
  * Note on memory addresses:
  *
  * Before each read and write operation, the controller needs to tell the
@@ -59,6 +71,14 @@
 #include"hardware/i2c.h"
 #include"pico/sync.h"
 
+/**
+ * \brief Maximum number of requests that can be queued per EepRom instance
+ * \details This includes the request that is currently being carried out.
+ */
+#ifndef EEPROM_QUEUE_SIZE
+#define EEPROM_QUEUE_SIZE 8
+#endif
+
 /**
  * \brief Supported 24C* series EEPROM types
  */
@@ -98,6 +118,32 @@ public:
 		CANCELLED
 	};
 
+	/**
+	 * \brief Part of a request: a contiguous range of the EEPROM and the
+	 * memory it is read into or written from
+	 */
+	struct Segment
+	{
+		/// Memory where the data is read into (read requests) or taken from
+		/// (write requests, the data is not modified)
+		uint8_t* data;
+		/// Address in the EEPROM
+		uint memAddress;
+		/// Number of bytes. Trimmed if the segment would otherwise go past
+		/// the end of the EEPROM.
+		uint length;
+	};
+
+	/**
+	 * \brief Function that is called when a request is finished
+	 * \details It is called from the I²C or alarm interrupt (or right away if
+	 * there was nothing to do), so it should be short. It may queue further
+	 * requests, but it must not call one of the blocking methods.
+	 * \param result Result::SUCCESS or Result::CANCELLED.
+	 * \param userData The pointer that was passed along with the request.
+	 */
+	typedef void (*Callback)(Result result, void* userData);
+
 private:
 	/**
 	 * \brief I²C peripheral
@@ -165,10 +211,76 @@ private:
 	} state;
 
 	/**
-	 * \brief Result of the last operation
+	 * \brief Result of the last operation started with startReading() or
+	 * startWriting()
 	 */
 	Result result;
 
+	/**
+	 * \brief Number of operations started with startReading() or
+	 * startWriting() that haven't finished yet
+	 */
+	uint pendingOperations;
+
+	/**
+	 * \brief A queued request
+	 */
+	struct Request
+	{
+		/// Read or write request?
+		bool write;
+		/// The segments (nullptr if the request only consists of
+		/// inlineSegment)
+		const Segment* segments;
+		/// Number of segments
+		uint numSegments;
+		/// Storage for the segment of a request with only one segment
+		Segment inlineSegment;
+		/// Called when the request is finished (may be nullptr)
+		Callback callback;
+		/// Passed to the callback
+		void* userData;
+	};
+
+	/**
+	 * \brief Ring buffer of queued requests
+	 * \details The first one is being carried out.
+	 */
+	Request queue[EEPROM_QUEUE_SIZE];
+
+	/**
+	 * \brief Index of the first request in the queue
+	 */
+	uint queueHead;
+
+	/**
+	 * \brief Number of requests in the queue
+	 */
+	uint queueCount;
+
+	/**
+	 * \brief Index of the segment of the first request that is being carried
+	 * out
+	 */
+	uint segmentIndex;
+
+	/**
+	 * \brief Finished request whose callback hasn't been invoked yet
+	 * \details Callbacks are invoked by exitCritSec() once the critical
+	 * section has been left, since they may queue further requests.
+	 */
+	struct
+	{
+		/// Is there such a request?
+		bool pending;
+		/// Its callback
+		Callback callback;
+		/// Its user data
+		void* userData;
+		/// Its result
+		Result result;
+	} completion;
+
 	/**
 	 * \brief Alarm used during serveral stages of read/write operations
 	 */
@@ -256,6 +368,58 @@ private:
 	 */
 	uint8_t calcI2cAddress(uint memAddress);
 
+	/**
+	 * \brief Adds a request to the queue and starts it if the EEPROM is idle
+	 * \details If the request concerns zero bytes, it is not queued and its
+	 * callback is invoked right away.
+	 * \param request The request.
+	 * \return Returns false if the queue is full.
+	 */
+	bool queueRequest(const Request& request);
+
+	/**
+	 * \brief Starts the first request in the queue
+	 * \details Must be called from within the critical section while no
+	 * request is being carried out.
+	 */
+	void startRequest();
+
+	/**
+	 * \brief Starts the current segment of the first request
+	 * \details Segments that are empty (after trimming them to the capacity)
+	 * are skipped. If there are no more segments, the request is finished.
+	 * Must be called from within the critical section.
+	 */
+	void startSegment();
+
+	/**
+	 * \brief Removes the first request from the queue and starts the next one
+	 * (if any)
+	 * \details The callback is noted in completion. Must be called from within
+	 * the critical section.
+	 * \param result Result of the request.
+	 */
+	void finishRequest(Result result);
+
+	/**
+	 * \brief Leaves the critical section, then invokes the callback of the
+	 * request that has been finished within it (if any)
+	 */
+	void exitCritSec();
+
+	/**
+	 * \brief Callback for the requests queued by startReading() and
+	 * startWriting()
+	 * \param userData Pointer to the instance.
+	 */
+	static void operationCallback(Result result, void* userData);
+
+	/**
+	 * \brief Callback for the requests queued by read() and write()
+	 * \param userData Pointer to a volatile Result that receives the result.
+	 */
+	static void blockingCallback(Result result, void* userData);
+
 	/**
 	 * \brief Read operation: Fill the TX FIFO with read commands
 	 * \details Before the first read command, memory address data is put into
@@ -263,7 +427,7 @@ private:
 	 * This method also sets up the interrupt to fire when the RX FIFO fills up
 	 * with as many bytes as there have been read commands issued previously.
 	 * The interrupt callback will then call this method again. Once there is
-	 * no more data to read, this method ends the operation.
+	 * no more data to read, this method moves on to the next segment.
 	 * Must be called from within the critical section.
 	 */
 	void readFillTxFifo();
@@ -273,7 +437,8 @@ private:
 	 * \details "Data" is actual payload data interspersed with address bytes.
 	 * This method also sets up the interrupt to fire when the TX FIFO runs out
 	 * of data (or the transmission is aborted).
-	 * Once there is no more data to write, this method ends the operation.
+	 * Once there is no more data to write, this method moves on to the next
+	 * segment.
 	 * Must be called from within the critical section.
 	 */
 	void writeFillTxFifo();
@@ -318,72 +483,136 @@ public:
 	 */
 	~EepRom();
 
+	/**
+	 * \brief Queues a request for reading data from the EEPROM
+	 * \details This method is non-blocking.
+	 * \param dest Pointer to memory where the data should be written. Must
+	 * remain valid until the request is finished.
+	 * \param memAddress Address in memory where reading starts. If the address
+	 * is past the end of the EEPROM, a zero-length read will be performed.
+	 * \param length Number of bytes to read. This parameter is trimmed if the
+	 * operation would otherwise go past the end of the EEPROM.
+	 * \param callback Called when the request is finished (may be nullptr).
+	 * \param userData Passed to the callback.
+	 * \return Returns true if the request was queued (or there was nothing to
+	 * read) or false if the queue is full.
+	 */
+	bool queueRead(uint8_t* dest, uint memAddress, uint length, Callback callback, void* userData = nullptr);
+
+	/**
+	 * \brief Queues a request for reading several ranges of the EEPROM
+	 * \details This method is non-blocking. The segments are read one after
+	 * the other, the request is only finished once all of them are done.
+	 * \param segments The segments. The array (and the memory its entries
+	 * point to) must remain valid until the request is finished.
+	 * \param numSegments Number of segments.
+	 * \param callback Called when the request is finished (may be nullptr).
+	 * \param userData Passed to the callback.
+	 * \return Returns true if the request was queued (or there was nothing to
+	 * read) or false if the queue is full.
+	 */
+	bool queueRead(const Segment* segments, uint numSegments, Callback callback, void* userData = nullptr);
+
+	/**
+	 * \brief Queues a request for writing data to the EEPROM
+	 * \details This method is non-blocking.
+	 * \param src Pointer to the data to be written. Must remain valid until
+	 * the request is finished.
+	 * \param memAddress Memory address where writing starts. If the address
+	 * is past the end of the EEPROM, a zero-length write will be performed.
+	 * \param length Number of bytes to write. This parameter is trimmed if the
+	 * operation would otherwise go past the end of the EEPROM.
+	 * \param callback Called when the request is finished (may be nullptr).
+	 * \param userData Passed to the callback.
+	 * \return Returns true if the request was queued (or there was nothing to
+	 * write) or false if the queue is full.
+	 */
+	bool queueWrite(const uint8_t* src, uint memAddress, uint length, Callback callback, void* userData = nullptr);
+
+	/**
+	 * \brief Queues a request for writing several ranges of the EEPROM
+	 * \details This method is non-blocking. The segments are written one
+	 * after the other, the request is only finished once all of them are
+	 * done.
+	 * \param segments The segments. The array (and the memory its entries
+	 * point to) must remain valid until the request is finished.
+	 * \param numSegments Number of segments.
+	 * \param callback Called when the request is finished (may be nullptr).
+	 * \param userData Passed to the callback.
+	 * \return Returns true if the request was queued (or there was nothing to
+	 * write) or false if the queue is full.
+	 */
+	bool queueWrite(const Segment* segments, uint numSegments, Callback callback, void* userData = nullptr);
+
 	/**
 	 * \brief Reads data from the EEPROM
 	 * \details This method is non-blocking. Use getResult() to check when
-	 * the operation is done.
+	 * the operation is done. The operation is queued like any other request.
 	 * \param dest Pointer to memory where the data should be written. Must
 	 * remain valid until the read operation is finished.
 	 * \param memAddress Address in memory where reading starts. If the address
 	 * is past the end of the EEPROM, a zero-length read will be performed.
 	 * \param length Number of bytes to read. This parameter is trimmed if the
 	 * operation would otherwise go past the end of the EEPROM.
-	 * \return Returns true if the operation was successfully started or false
-	 * if another operation is currently ongoing.
-	 * If the read operation concerns zero bytes, the method will return true
-	 * regardless of the whether an operation is ongoing or not.
+	 * \return Returns true if the operation was successfully started (or
+	 * there was nothing to read) or false if the queue is full.
 	 */
 	bool startReading(uint8_t* dest, uint memAddress, uint length);
 
 	/**
 	 * \brief Writes data to the EEPROM
 	 * \details This method is non-blocking. Use getResult() to check when
-	 * the operation is done.
+	 * the operation is done. The operation is queued like any other request.
 	 * \param src Pointer to the data to be written. Must remain valid until
 	 * the operation has finished.
 	 * \param memAddress Memory address where writing starts. If the address
 	 * is past the end of the EEPROM, a zero-length write will be performed.
 	 * \param length Number of bytes to write. This parameter is trimmed if the
 	 * operation would otherwise go past the end of the EEPROM.
-	 * \return Returns true if the operation was successfully started or false
-	 * if another operation is currently ongoing.
-	 * If the write operation concerns zero bytes, the method will return true
-	 * regardless of the whether an operation is ongoing or not.
+	 * \return Returns true if the operation was successfully started (or
+	 * there was nothing to write) or false if the queue is full.
 	 */
 	bool startWriting(const uint8_t* src, uint memAddress, uint length);
 
 	/**
-	 * \brief Result of the last operation
-	 * \return Returns the \see Result of the last operation.
+	 * \brief Result of the operations started with startReading() and
+	 * startWriting()
+	 * \return Returns Result::ONGOING while one of them is still ongoing,
+	 * otherwise the \see Result of the last one.
 	 */
 	Result getResult();
 
 	/**
-	 * \brief Cancels an ongoing operation (if any)
+	 * \brief Cancels the ongoing operation and all queued requests (if any)
 	 * \details This method is blocking. It waits until the I²C peripheral is
 	 * finished with the current byte (thus leaving the bus in a defined state).
+	 * The callbacks of the requests are invoked with Result::CANCELLED.
 	 */
 	void cancel();
 
 	/**
 	 * \brief Reads data from the EEPROM
 	 * \details This method is blocking. It will only return once the operation
-	 * is completed or an error occurs.
+	 * is completed or an error occurs. Requests queued before are carried out
+	 * first.
 	 * \param dest Pointer to memory where the data should be written.
 	 * \param memAddress Memory address where reading starts.
 	 * \param length Number of bytes to read.
-	 * \return Returns the \see Result of the read operation.
+	 * \return Returns the \see Result of the read operation
+	 * (Result::CANCELLED if the queue is full).
 	 */
 	Result read(uint8_t* dest, uint memAddress, uint length);
 
 	/**
 	 * \brief Writes data to the EEPROM
 	 * \details This method is blocking. It will only return once the operation
-	 * is completed or an error occurs.
+	 * is completed or an error occurs. Requests queued before are carried out
+	 * first.
 	 * \param src Pointer to the data to be written.
 	 * \param memAddress Memory address where writing starts.
 	 * \param length Number of bytes to write.
-	 * \return Returns the \see Result of the write operation.
+	 * \return Returns the \see Result of the write operation
+	 * (Result::CANCELLED if the queue is full).
 	 */
 	Result write(const uint8_t* src, uint memAddress, uint length);
 
@@ -392,6 +621,14 @@ public:
 	 * \return The capacity in bytes.
 	 */
 	uint getCapacity() const;
+
+	/**
+	 * \brief Returns the page size of the EEPROM
+	 * \details Writing a page takes one internal write cycle, no matter how
+	 * many of its bytes are written.
+	 * \return The page size in bytes.
+	 */
+	uint getPageSize() const;
 };
 
 #endif // _EEPROM_H
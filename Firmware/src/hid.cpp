@@ -11,13 +11,48 @@
 
 UsbHidKeyboard::UsbHidKeyboard(uint8_t interface)
 :	UsbHidInterface(interface),
-	currentReport{.modifier = 0, .reserved = 0, .keycode = {0, 0, 0, 0, 0, 0}},
-	// Initialise previous report in such a way that the first comparison will fail
-	previousReport{.modifier = 0, .reserved = 0xff, .keycode = {0, 0, 0, 0, 0, 0}},
+	previousReport{},
+	// Initialise the queue in such a way that the first report will be sent
+	reports(Report{.modifier = 0, .reserved = 0xff}),
 	previousReportTime(0)
 {
 }
 
+const void* UsbHidKeyboard::getReport(const Report& report, uint& size)
+{
+	if(tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT)
+	{
+		size = sizeof(report);
+		return &report;
+	}
+#if NKRO
+	// Reduce the bitmap to 6 key codes
+	bootReport.modifier = report.modifier;
+	bootReport.reserved = 0;
+	memset(bootReport.keycode, HID_KEY_NONE, sizeof(bootReport.keycode));
+	uint n = 0;
+	for(uint i = 0; i < sizeof(report.bitmap); i++)
+	{
+		for(uint8_t bits = report.bitmap[i]; bits != 0; bits &= bits - 1)
+		{
+			if(n == sizeof(bootReport.keycode))
+			{
+				// Too many keys, report rollover error
+				memset(bootReport.keycode, 0x01, sizeof(bootReport.keycode));
+				break;
+			}
+			bootReport.keycode[n++] = 8 * i + __builtin_ctz(bits);
+		}
+	}
+	size = sizeof(bootReport);
+	return &bootReport;
+#else
+	// The first 8 bytes are the boot report
+	size = 8;
+	return &report;
+#endif
+}
+
 bool UsbHidKeyboard::setIdle(uint8_t idleRate)
 {
 	critical_section_enter_blocking(&critSec);
@@ -45,19 +80,22 @@ bool UsbHidKeyboard::setIdle(uint8_t idleRate)
 uint16_t UsbHidKeyboard::sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8_t buflen)
 {
 	critical_section_enter_blocking(&critSec);
-	uint reportSize = tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT ? sizeof(currentReport) : 8;
+	uint reportSize;
+	const void* report = getReport(reports.latest(), reportSize);
 	if(buflen < reportSize)
 	{
 		critical_section_exit(&critSec);
 		return 0;
 	}
-	memcpy(buffer, &currentReport, reportSize);
-	previousReport = currentReport;
+	memcpy(buffer, report, reportSize);
+	// The host now knows the newest state, so the queued ones are obsolete
+	previousReport = reports.latest();
+	reports.flush();
 	critical_section_exit(&critSec);
 	return reportSize;
 }
 
-void UsbHidKeyboard::sendReport(uint8_t previousReportId)
+bool UsbHidKeyboard::sendReport(uint8_t previousReportId)
 {
 	// This keyboard only sends one type of report, so previousReportId will
 	// always be 0.
@@ -65,36 +103,46 @@ void UsbHidKeyboard::sendReport(uint8_t previousReportId)
 	critical_section_enter_blocking(&critSec);
 
 	// Check if it is necessary to send a report. This is the case if either
-	// Actions have changed or the idle rate interval has elapsed.
+	// a new report is queued or the idle rate interval has elapsed (then the
+	// previous report is repeated).
+	bool sent = false;
 	absolute_time_t now = get_absolute_time();
-	if((idleRate != 0 && absolute_time_diff_us(previousReportTime, now) / 1000 > 4 * idleRate) || memcmp(&currentReport, &previousReport, sizeof(currentReport)) != 0)
+	if(!reports.empty() || (idleRate != 0 && absolute_time_diff_us(previousReportTime, now) / 1000 > 4 * idleRate))
 	{
-		// When using boot protocol, send only the first 8 bytes.
+		// When using boot protocol, send only the boot report.
 		// When using report protocol, send the whole report.
-		if(tud_hid_n_report(interface, 0, &currentReport, tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT ? sizeof(currentReport) : 8))
+		const Report& next = reports.empty() ? previousReport : reports.front();
+		uint reportSize;
+		const void* report = getReport(next, reportSize);
+		if(tud_hid_n_report(interface, 0, report, reportSize))
 		{
-			previousReport = currentReport;
+			previousReport = next;
+			reports.pop();
 			previousReportTime = now;
+			sent = true;
 		}
 	}
 	critical_section_exit(&critSec);
+	return sent;
 }
 
 void UsbHidKeyboard::startAssemblingReport()
 {
-	critical_section_enter_blocking(&critSec);
 	memset(&newReport, 0, sizeof(newReport));
-	critical_section_exit(&critSec);
 }
 
-void UsbHidKeyboard::addActionToReport(const Action& action)
+void UsbHidKeyboard::addActionToReport(const Action& action, uint scale)
 {
 	// Ignore non-INPUT type actions
 	if(action.type != ActionType::INPUT)
 		return;
 
-	critical_section_enter_blocking(&critSec);
-
+#if NKRO
+	// Set the bits of the keys
+	for(uint i = 0; i < MAX_KEYS_PER_ACTION; i++)
+		if(action.input.keys[i] != HID_KEY_NONE)
+			newReport.bitmap[action.input.keys[i] >> 3] |= 1u << (action.input.keys[i] & 7);
+#else
 	// Determine how much free space newReport still has
 	uint available = 0;
 	for(uint i = 0; i < sizeof(newReport.keycode); i++)
@@ -116,18 +164,18 @@ void UsbHidKeyboard::addActionToReport(const Action& action)
 	}
 	else
 		newReport.keycode[0] = 0x01; // Key code for rollover error
+#endif
 
 	// Add modifiers to the report
 	newReport.modifier |= action.input.modifiers;
-
-	critical_section_exit(&critSec);
 }
 
-void UsbHidKeyboard::finishAssemblingReport()
+bool UsbHidKeyboard::finishAssemblingReport()
 {
 	critical_section_enter_blocking(&critSec);
-	memcpy(&currentReport, &newReport, sizeof(currentReport));
+	bool changed = reports.push(newReport);
 	critical_section_exit(&critSec);
+	return changed;
 }
 
 //-----------------------------------------------------------------------------
@@ -135,28 +183,124 @@ void UsbHidKeyboard::finishAssemblingReport()
 
 UsbHidMouse::UsbHidMouse(uint8_t interface)
 :	UsbHidInterface(interface),
-	currentReport{.buttons = 0, .x = 0, .y = 0, .wheel = 0, .pan = 0},
-	// Initialise previous report in such a way that the first comparison will fail
-	previousReport{.buttons = 0xd0, .x = 0, .y = 0, .wheel = 0, .pan = 0}
+	currentReport{},
+	bootReport{},
+	newButtons(0),
+	// Initialise the queue in such a way that the first report will be sent
+	buttons(0xe0),
+	newMovement{},
+	residual{},
+	unsent(true),
+	resolutionMultipliers(0)
+{
+}
+
+/**
+ * \brief Limits a movement to a range
+ * \param value The movement.
+ * \param limit The largest magnitude.
+ * \return The limited movement.
+ */
+static int32_t limitMovement(int32_t value, int32_t limit)
+{
+	return value > limit ? limit : (value < -limit ? -limit : value);
+}
+
+/**
+ * \brief Determines the part of a high-resolution wheel movement that is sent
+ * in the next report
+ * \param value The outstanding movement.
+ * \return The movement for the next report (at least one unit).
+ */
+static int32_t smoothMovement(int32_t value)
+{
+	int32_t part = value / (1 << MOUSE_SCROLL_SMOOTHING);
+	return part != 0 ? part : value;
+}
+
+const void* UsbHidMouse::prepareReport(uint& size)
 {
+	// Next state of the buttons (or the last sent one if none is queued)
+	uint8_t nextButtons = buttons.empty() ? buttons.latest() : buttons.front();
+	if(tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT)
+	{
+		currentReport.buttons = nextButtons;
+		currentReport.x = limitMovement(residual.x, 32767);
+		currentReport.y = limitMovement(residual.y, 32767);
+		currentReport.wheel = limitMovement((resolutionMultipliers & 0x03) ? smoothMovement(residual.wheel) : residual.wheel, 32767);
+		currentReport.pan = limitMovement((resolutionMultipliers & 0x0c) ? smoothMovement(residual.pan) : residual.pan, 32767);
+		size = sizeof(currentReport);
+		return &currentReport;
+	}
+	bootReport.buttons = nextButtons;
+	bootReport.x = limitMovement(residual.x, 127);
+	bootReport.y = limitMovement(residual.y, 127);
+	size = sizeof(bootReport);
+	return &bootReport;
+}
+
+void UsbHidMouse::commitReport()
+{
+	if(tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT)
+	{
+		residual.x -= currentReport.x;
+		residual.y -= currentReport.y;
+		residual.wheel -= currentReport.wheel;
+		residual.pan -= currentReport.pan;
+	}
+	else
+	{
+		residual.x -= bootReport.x;
+		residual.y -= bootReport.y;
+		// The boot report has no wheels
+		residual.wheel = 0;
+		residual.pan = 0;
+	}
+	buttons.pop();
+	unsent = !buttons.empty() || residual.x != 0 || residual.y != 0 || residual.wheel != 0 || residual.pan != 0;
+}
+
+void UsbHidMouse::setProtocol(uint8_t protocol)
+{
+	// The resolution multipliers return to their defaults
+	critical_section_enter_blocking(&critSec);
+	resolutionMultipliers = 0;
+	critical_section_exit(&critSec);
+}
+
+void UsbHidMouse::setResolutionMultipliers(uint8_t multipliers)
+{
+	critical_section_enter_blocking(&critSec);
+	// Convert the outstanding movements of the wheels to the new resolution
+	uint8_t changed = (multipliers ^ resolutionMultipliers) & 0x0f;
+	if(changed & 0x03)
+		residual.wheel = (multipliers & 0x03) ? residual.wheel * MOUSE_RESOLUTION_MULTIPLIER : residual.wheel / MOUSE_RESOLUTION_MULTIPLIER;
+	if(changed & 0x0c)
+		residual.pan = (multipliers & 0x0c) ? residual.pan * MOUSE_RESOLUTION_MULTIPLIER : residual.pan / MOUSE_RESOLUTION_MULTIPLIER;
+	resolutionMultipliers = multipliers & 0x0f;
+	critical_section_exit(&critSec);
 }
 
 uint16_t UsbHidMouse::sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8_t buflen)
 {
 	critical_section_enter_blocking(&critSec);
-	uint reportSize = tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT ? sizeof(currentReport) : 3;
+	// The host asks for the newest state, so the queued states of the buttons
+	// are obsolete
+	buttons.flush();
+	uint reportSize;
+	const void* report = prepareReport(reportSize);
 	if(buflen < reportSize)
 	{
 		critical_section_exit(&critSec);
 		return 0;
 	}
-	memcpy(buffer, &currentReport, reportSize);
-	previousReport = currentReport;
+	memcpy(buffer, report, reportSize);
+	commitReport();
 	critical_section_exit(&critSec);
 	return reportSize;
 }
 
-void UsbHidMouse::sendReport(uint8_t previousReportId)
+bool UsbHidMouse::sendReport(uint8_t previousReportId)
 {
 	// This mouse only sends one type of report, so previousReportId will
 	// always be 0.
@@ -164,48 +308,60 @@ void UsbHidMouse::sendReport(uint8_t previousReportId)
 	critical_section_enter_blocking(&critSec);
 
 	// Check if it is necessary to send a report
-	if(memcmp(&currentReport, &previousReport, sizeof(currentReport)) != 0)
+	bool sent = false;
+	if(unsent)
 	{
-		// When using boot protocol, send only the first 3 bytes.
-		// When using report protocol, send the whole report.
-		if(tud_hid_n_report(interface, 0, &currentReport, tud_hid_n_get_protocol(interface) == HID_PROTOCOL_REPORT ? sizeof(currentReport) : 3))
-			previousReport = currentReport;
+		// When using boot protocol, send only buttons and x/y (8 bits each).
+		// When using report protocol, send the whole report. Whatever
+		// movement doesn't fit stays in the residual (and the report remains
+		// unsent).
+		uint reportSize;
+		const void* report = prepareReport(reportSize);
+		if(tud_hid_n_report(interface, 0, report, reportSize))
+		{
+			commitReport();
+			sent = true;
+		}
 	}
 	critical_section_exit(&critSec);
+	return sent;
 }
 
 void UsbHidMouse::startAssemblingReport()
 {
-	critical_section_enter_blocking(&critSec);
-	memset(&newReport, 0, sizeof(newReport));
-	critical_section_exit(&critSec);
+	newButtons = 0;
+	newMovement = Movement{};
 }
 
-void UsbHidMouse::addActionToReport(const Action& action)
+void UsbHidMouse::addActionToReport(const Action& action, uint scale)
 {
 	// Ignore non-INPUT type actions
 	if(action.type != ActionType::INPUT)
 		return;
 
-	critical_section_enter_blocking(&critSec);
-
 	// Relative x and y position
-	newReport.x += action.input.mouseX;
-	newReport.y += action.input.mouseY;
-	// Mouse wheel
-	newReport.wheel += action.input.mouseWheel;
-	newReport.pan += action.input.mousePan;
+	newMovement.x += action.input.mouseX * static_cast<int32_t>(scale);
+	newMovement.y += action.input.mouseY * static_cast<int32_t>(scale);
+	// Mouse wheels (in units of the resolution multiplier if enabled)
+	newMovement.wheel += action.input.mouseWheel * static_cast<int32_t>(scale) * ((resolutionMultipliers & 0x03) ? MOUSE_RESOLUTION_MULTIPLIER : 1);
+	newMovement.pan += action.input.mousePan * static_cast<int32_t>(scale) * ((resolutionMultipliers & 0x0c) ? MOUSE_RESOLUTION_MULTIPLIER : 1);
 	// Mouse buttons
-	newReport.buttons |= action.input.mouseButtons;
-
-	critical_section_exit(&critSec);
+	newButtons |= action.input.mouseButtons;
 }
 
-void UsbHidMouse::finishAssemblingReport()
+bool UsbHidMouse::finishAssemblingReport()
 {
 	critical_section_enter_blocking(&critSec);
-	memcpy(&currentReport, &newReport, sizeof(currentReport));
+	// Add the new movements to the ones that haven't been sent yet
+	residual.x += newMovement.x;
+	residual.y += newMovement.y;
+	residual.wheel += newMovement.wheel;
+	residual.pan += newMovement.pan;
+	bool changed = buttons.push(newButtons);
+	changed = changed || newMovement.x != 0 || newMovement.y != 0 || newMovement.wheel != 0 || newMovement.pan != 0;
+	unsent = unsent || changed;
 	critical_section_exit(&critSec);
+	return changed;
 }
 
 //-----------------------------------------------------------------------------
@@ -213,9 +369,9 @@ void UsbHidMouse::finishAssemblingReport()
 
 UsbHidComposite::UsbHidComposite(uint8_t interface)
 :	UsbHidInterface(interface),
-	currentCCReport(0), currentSCReport(0), currentSliderReport(0),
-	// Initialise previous reports in such a way that the first comparison will fail
-	previousCCReport(0xffff), previousSCReport(0xfc), previousSliderReport(0)
+	newCCReport(0), newSCReport(0), newSliderReport(0),
+	// Initialise the queues in such a way that the first reports will be sent
+	ccReports(0xffff), scReports(0xfc), sliderReports(0)
 {
 }
 
@@ -223,42 +379,44 @@ uint16_t UsbHidComposite::sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8
 {
 	critical_section_enter_blocking(&critSec);
 
+	// The host asks for the newest state, so the queued states of the report
+	// are obsolete
 	uint reportSize = 0;
 	switch(reportId)
 	{
 		case REPORT_ID_CONSUMER_CONTROL:
 		{
-			reportSize = sizeof(currentCCReport);
+			reportSize = sizeof(ccReports.latest());
 			if(buflen < reportSize)
 				reportSize = 0;
 			else
 			{
-				memcpy(buffer, &currentCCReport, sizeof(currentCCReport));
-				memcpy(&previousCCReport, &currentCCReport, sizeof(currentCCReport));
+				memcpy(buffer, &ccReports.latest(), reportSize);
+				ccReports.flush();
 			}
 			break;
 		}
 		case REPORT_ID_SYSTEM_CONTROL:
 		{
-			reportSize = sizeof(currentSCReport);
+			reportSize = sizeof(scReports.latest());
 			if(buflen < reportSize)
 				reportSize = 0;
 			else
 			{
-				memcpy(buffer, &currentSCReport, sizeof(currentSCReport));
-				memcpy(&previousSCReport, &currentSCReport, sizeof(currentSCReport));
+				memcpy(buffer, &scReports.latest(), reportSize);
+				scReports.flush();
 			}
 			break;
 		}
 		case REPORT_ID_SLIDER:
 		{
-			reportSize = sizeof(currentSliderReport);
+			reportSize = sizeof(sliderReports.latest());
 			if(buflen < reportSize)
 				reportSize = 0;
 			else
 			{
-				memcpy(buffer, &currentSliderReport, sizeof(currentSliderReport));
-				memcpy(&previousSliderReport, &currentSliderReport, sizeof(currentSliderReport));
+				memcpy(buffer, &sliderReports.latest(), reportSize);
+				sliderReports.flush();
 			}
 			break;
 		}
@@ -268,82 +426,85 @@ uint16_t UsbHidComposite::sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8
 	return reportSize;
 }
 
-void UsbHidComposite::sendReport(uint8_t previousReportId)
+/**
+ * \brief Hands the oldest queued state of a report to TinyUSB
+ * \param interface Interface number.
+ * \param reportId Report ID.
+ * \param reports Queue of the report.
+ * \return Returns true if a report has been handed to TinyUSB.
+ */
+template<typename T> static bool sendQueuedReport(uint8_t interface, uint8_t reportId, ReportQueue<T>& reports)
+{
+	// TinyUSB copies the report, so it can be removed right away
+	if(reports.empty() || !tud_hid_n_report(interface, reportId, &reports.front(), sizeof(T)))
+		return false;
+	reports.pop();
+	return true;
+}
+
+bool UsbHidComposite::sendReport(uint8_t previousReportId)
 {
 	// This interface sends multiple kinds of report, so the value of
 	// previousReportId matters
 
 	critical_section_enter_blocking(&critSec);
 
-	// Go through potential reports starting at previousReportId + 1 until we
-	// find one that needs sending
-	switch(previousReportId + 1)
+	// Go through the reports in turn, starting at previousReportId + 1 (and
+	// wrapping around), until we find one that has a state queued. This way
+	// no report can hold up the others.
+	bool sent = false;
+	for(uint i = 0; i < REPORT_ID_SLIDER && !sent; i++)
 	{
-	case REPORT_ID_CONSUMER_CONTROL:
-		if(currentCCReport != previousCCReport)
-		{
-			if(tud_hid_n_report(interface, REPORT_ID_CONSUMER_CONTROL, &currentCCReport, sizeof(currentCCReport)))
-				previousCCReport = currentCCReport;
-			break;
-		}
-	case REPORT_ID_SYSTEM_CONTROL:
-		if(currentSCReport != previousSCReport)
-		{
-			if(tud_hid_n_report(interface, REPORT_ID_SYSTEM_CONTROL, &currentSCReport, sizeof(currentSCReport)))
-				previousSCReport = currentSCReport;
-			break;
-		}
-	case REPORT_ID_SLIDER:
-		if(currentSliderReport != previousSliderReport)
+		switch((previousReportId + i) % REPORT_ID_SLIDER + 1)
 		{
-			if(tud_hid_n_report(interface, REPORT_ID_SLIDER, &currentSliderReport, sizeof(currentSliderReport)))
-				previousSliderReport = currentSliderReport;
-			break;
+			case REPORT_ID_CONSUMER_CONTROL:
+				sent = sendQueuedReport(interface, REPORT_ID_CONSUMER_CONTROL, ccReports);
+				break;
+			case REPORT_ID_SYSTEM_CONTROL:
+				sent = sendQueuedReport(interface, REPORT_ID_SYSTEM_CONTROL, scReports);
+				break;
+			case REPORT_ID_SLIDER:
+				sent = sendQueuedReport(interface, REPORT_ID_SLIDER, sliderReports);
+				break;
 		}
 	}
 
 	critical_section_exit(&critSec);
+	return sent;
 }
 
 void UsbHidComposite::startAssemblingReport()
 {
-	critical_section_enter_blocking(&critSec);
 	memset(&newCCReport, 0, sizeof(newCCReport));
 	memset(&newSCReport, 0, sizeof(newSCReport));
 	memset(&newSliderReport, 0, sizeof(newSliderReport));
-	critical_section_exit(&critSec);
 }
 
-void UsbHidComposite::addActionToReport(const Action& action)
+void UsbHidComposite::addActionToReport(const Action& action, uint scale)
 {
 	// Ignore non-INPUT type actions
 	if(action.type != ActionType::INPUT)
 		return;
 
-	critical_section_enter_blocking(&critSec);
-
 	// Consumer Control
 	newCCReport |= action.input.consumerControl;
 
 	// System Control
 	if(action.input.systemControl > newSCReport)
 		newSCReport = action.input.systemControl;
-
-	critical_section_exit(&critSec);
 }
 
-void UsbHidComposite::finishAssemblingReport()
+bool UsbHidComposite::finishAssemblingReport()
 {
 	critical_section_enter_blocking(&critSec);
-	memcpy(&currentCCReport, &newCCReport, sizeof(currentCCReport));
-	memcpy(&currentSCReport, &newSCReport, sizeof(currentSCReport));
-	memcpy(&currentSliderReport, &newSliderReport, sizeof(currentSliderReport));
+	bool changed = ccReports.push(newCCReport);
+	changed = scReports.push(newSCReport) || changed;
+	changed = sliderReports.push(newSliderReport) || changed;
 	critical_section_exit(&critSec);
+	return changed;
 }
 
-void UsbHidComposite::setSlider(uint8_t value)
+void UsbHidComposite::setSlider(uint16_t value)
 {
-	critical_section_enter_blocking(&critSec);
 	newSliderReport = value;
-	critical_section_exit(&critSec);
 }
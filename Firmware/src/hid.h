@@ -7,10 +7,114 @@
 #define _HID_H
 
 #include<cstdint>
+#include<cstring>
 #include"pico/stdlib.h"
 #include"settings.h"
 #include"tusb.h"
 
+/**
+ * \brief Number of states of a report that can wait to be sent
+ * \details See ReportQueue.
+ */
+#ifndef REPORT_QUEUE_SIZE
+#define REPORT_QUEUE_SIZE 8
+#endif
+
+/**
+ * \brief FIFO of the states of a report that haven't been sent yet
+ * \details Every distinct state a report goes through is queued and sent in
+ * order, so short pulses (e.g. a key that is pressed and released again
+ * before the first report has been sent) still reach the host. States equal
+ * to the previous one are not queued. If the queue is full, the new state
+ * replaces the newest queued one (i.e. the states are coalesced).
+ * There is no locking, the UsbHidInterface classes use their critical
+ * sections.
+ * \tparam T Type of the report (compared bytewise).
+ * \tparam N Capacity of the queue.
+ */
+template<typename T, uint N = REPORT_QUEUE_SIZE> class ReportQueue
+{
+private:
+	/**
+	 * \brief Ring buffer of the queued states
+	 */
+	T reports[N];
+
+	/**
+	 * \brief Index of the oldest queued state and number of queued states
+	 */
+	uint first, count;
+
+	/**
+	 * \brief The newest state (queued or already sent)
+	 */
+	T last;
+
+public:
+	/**
+	 * \brief Constructs an empty queue
+	 * \param initial Initial state (counts as sent). Choose a state that
+	 * differs from the first real one to force sending it.
+	 */
+	ReportQueue(const T& initial): first(0), count(0), last(initial) {}
+
+	/**
+	 * \brief Queues a state if it differs from the newest one
+	 * \param report The state.
+	 * \return Returns true if the state differs from the newest one.
+	 */
+	bool push(const T& report)
+	{
+		if(memcmp(&report, &last, sizeof(T)) == 0)
+			return false;
+		last = report;
+		if(count == N)
+		{
+			// Coalesce with the newest state (which is dropped altogether if
+			// the report returns to the state before it)
+			if(memcmp(&report, &reports[(first + N - 2) % N], sizeof(T)) == 0)
+				count--;
+			else
+				reports[(first + N - 1) % N] = report;
+		}
+		else
+			reports[(first + count++) % N] = report;
+		return true;
+	}
+
+	/**
+	 * \brief Checks if no state is waiting to be sent
+	 * \return Returns true if the queue is empty.
+	 */
+	inline bool empty() const {return count == 0;}
+
+	/**
+	 * \brief Returns the oldest queued state
+	 * \details The queue must not be empty.
+	 * \return The state that is to be sent next.
+	 */
+	inline const T& front() const {return reports[first];}
+
+	/**
+	 * \brief Removes the oldest queued state (once it has been sent)
+	 */
+	inline void pop() {if(count > 0) {first = (first + 1) % N; count--;}}
+
+	/**
+	 * \brief Returns the newest state
+	 * \return The newest queued state, or the last sent one if the queue is
+	 * empty.
+	 */
+	inline const T& latest() const {return last;}
+
+	/**
+	 * \brief Drops all queued states
+	 * \details Used when the newest state has been delivered another way
+	 * (e.g. through GET_REPORT).
+	 */
+	inline void flush() {count = 0;}
+};
+
 /**
  * \brief Base class for USB HID interfaces
  * \details This class and classes derived from it are capable of generating
@@ -28,9 +132,12 @@ protected:
 	uint8_t interface;
 
 	/**
-	 * \brief Critical section for access to attributes
+	 * \brief Critical section for access to the assembled reports
 	 * \details Many methods of this class are bound to be called from an
-	 * interrupt context, so all derived classes will need this.
+	 * interrupt context, so all derived classes will need this. The report
+	 * being assembled is private to the assembling context, though, so it is
+	 * built without locking and the lock is only taken once to publish it in
+	 * finishAssemblingReport().
 	 */
 	critical_section_t critSec;
 
@@ -101,19 +208,24 @@ public:
 	 * subsequent calls from tud_hid_report_complete_cb(), pass the number of
 	 * the report that just finished transmitting. This number is given to the
 	 * callback in the first byte of its second parameter.
+	 * \return Returns true if a report has been handed to TinyUSB for
+	 * transmission, false otherwise.
 	 */
-	virtual void sendReport(uint8_t previousReportId) = 0;
+	virtual bool sendReport(uint8_t previousReportId) = 0;
 
 	/**
 	 * \brief Start assembling a new report for this interface
 	 * \details The startAssemblingReport(), addActionToReport() and
 	 * finishAssemblingReport() methods are used to feed new input data into
-	 * this class. Whenever the is new data (this typically happens on a timer)
-	 * first call startAssemblingReport() to create a new report. Then add an
+	 * this class. Whenever there is new data (an input event or the next tick
+	 * of a macro) first call startAssemblingReport() to create a new report. Then add an
 	 * arbitrary number of Actions (of type ActionType::INPUT) to that report.
 	 * Finally, call finishAssemblingReport(). At that point the new report is
 	 * adopted as the "current" report which is used by sendEP0Report() and
 	 * sendReport().
+	 * Until then, the new report is only touched by these methods, which
+	 * don't lock. They must all be called from the same context (the main
+	 * loop).
 	 */
 	virtual void startAssemblingReport() = 0;
 
@@ -122,13 +234,17 @@ public:
 	 * \details Derived classes determine how exactly merging multiple Actions
 	 * into one report is supposed to work.
 	 * \param action An Action of type ActionType::INPUT.
+	 * \param scale Factor for the relative movements of the action (e.g.
+	 * when a macro has been sped up or several of its ticks are combined).
 	 */
-	virtual void addActionToReport(const Action& action) = 0;
+	virtual void addActionToReport(const Action& action, uint scale = 1) = 0;
 
 	/**
 	 * \brief Finishes compiling a report and installs it as the "current" one
+	 * \return Returns true if the new report differs from the previous one
+	 * (i.e. it needs to be sent), false otherwise.
 	 */
-	virtual void finishAssemblingReport() = 0;
+	virtual bool finishAssemblingReport() = 0;
 };
 
 /**
@@ -136,18 +252,39 @@ public:
  * \details This class implements a USB HID keyboard which supports both boot
  * and report protocol.
  * It supports n-key rollover with n being defined by the KRO constant from the
- * settings.h header file.
+ * settings.h header file, or true n-key rollover (a bitmap of all keys) if the
+ * NKRO constant is set.
  */
 class UsbHidKeyboard : public UsbHidInterface
 {
 private:
+#if NKRO
+	/**
+	 * \brief Keyboard report
+	 * \details Bit k of the bitmap is set while key code k is down. In boot
+	 * protocol, bootReport is sent instead.
+	 */
+	struct PACKED_STRUCT Report
+	{
+		uint8_t modifier;
+		uint8_t reserved;
+		uint8_t bitmap[32];
+	};
+
+	/**
+	 * \brief Boot protocol version of the report being sent
+	 * \details Holds the first 6 keys from the bitmap (or the rollover error
+	 * if there are more).
+	 */
+	hid_keyboard_report_t bootReport;
+#else
 	/**
 	 * \brief Keyboard report
 	 * \details Using a custom struct here to support n-key rollover.
 	 * The first 8 bytes equal hid_keyboard_report_t which also happens to be
 	 * the correct report format for boot protocol.
 	 */
-	struct PACKED_STRUCT
+	struct PACKED_STRUCT Report
 	{
 		uint8_t modifier;
 		uint8_t reserved;
@@ -156,7 +293,27 @@ private:
 #else
 		uint8_t keycode[KRO];
 #endif
-	} currentReport, previousReport, newReport;
+	};
+#endif
+
+	/**
+	 * \brief The report being assembled and the previously sent report
+	 */
+	Report newReport, previousReport;
+
+	/**
+	 * \brief Assembled reports waiting to be sent
+	 */
+	ReportQueue<Report> reports;
+
+	/**
+	 * \brief Returns a report in the format of the current protocol
+	 * \details Must be called inside the critical section.
+	 * \param report The report.
+	 * \param[out] size Receives the size of the report.
+	 * \return Pointer to the report.
+	 */
+	const void* getReport(const Report& report, uint& size);
 
 	/**
 	 * \brief Idle rate set by the host
@@ -179,29 +336,117 @@ public:
 
 	virtual bool setIdle(uint8_t idleRate);
 	virtual uint16_t sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8_t buflen);
-	virtual void sendReport(uint8_t previousReportId);
+	virtual bool sendReport(uint8_t previousReportId);
 	virtual void startAssemblingReport();
-	virtual void addActionToReport(const Action& action);
-	virtual void finishAssemblingReport();
+	virtual void addActionToReport(const Action& action, uint scale = 1);
+	virtual bool finishAssemblingReport();
 };
 
+/**
+ * \brief Smoothing of high-resolution wheel movements
+ * \details While the resolution multiplier of a wheel is enabled, each report
+ * carries only 1/2^MOUSE_SCROLL_SMOOTHING of the outstanding movement of that
+ * wheel, so a detent glides over a few reports instead of arriving at once.
+ * 0 disables smoothing.
+ */
+#ifndef MOUSE_SCROLL_SMOOTHING
+#define MOUSE_SCROLL_SMOOTHING 1
+#endif
+
 /**
  * \brief USB HID Mouse
  * \details This class implements a USB HID mouse which supports both boot and
  * report protocol. It does not support SET_IDLE (which is not required for
  * mice by the USB spec).
+ * In report protocol, all movements are 16 bit and the wheels support the
+ * HID resolution multiplier (see MOUSE_RESOLUTION_MULTIPLIER). Movements are
+ * summed up in an accumulator and each report takes as much of it as fits,
+ * the residual is carried over to the next report instead of being lost.
  */
 class UsbHidMouse : public UsbHidInterface
 {
 private:
 	/**
-	 * \brief Mouse report
-	 * \details There is no need to change this struct as it has everything we
-	 * need. For boot protocol, we just send the first three bytes. This
-	 * excludes the wheels and the bits for the forward/backward buttons are
-	 * ignored.
+	 * \brief Relative movements in the units of the report
+	 * \details Wider than the report, so nothing overflows while adding up.
 	 */
-	hid_mouse_report_t currentReport, previousReport, newReport;
+	struct Movement
+	{
+		int32_t x, y, wheel, pan;
+	};
+
+	/**
+	 * \brief Mouse report (report protocol)
+	 */
+	struct PACKED_STRUCT
+	{
+		uint8_t buttons;
+		int16_t x, y, wheel, pan;
+	} currentReport;
+
+	/**
+	 * \brief Mouse report (boot protocol)
+	 * \details Same as the first three bytes of hid_mouse_report_t. The bits
+	 * for the forward/backward buttons are ignored.
+	 */
+	struct PACKED_STRUCT
+	{
+		uint8_t buttons;
+		int8_t x, y;
+	} bootReport;
+
+	/**
+	 * \brief Buttons of the report being assembled
+	 */
+	uint8_t newButtons;
+
+	/**
+	 * \brief States of the buttons waiting to be sent
+	 * \details Each report carries the next state of the buttons (along with
+	 * as much of the residual movement as fits).
+	 */
+	ReportQueue<uint8_t> buttons;
+
+	/**
+	 * \brief Movement of the report being assembled
+	 */
+	Movement newMovement;
+
+	/**
+	 * \brief Movement that hasn't been sent yet
+	 */
+	Movement residual;
+
+	/**
+	 * \brief Has the current report not been sent yet?
+	 * \details Movements are relative, so a report must be sent as long as
+	 * there is a residual movement, even if no button state is queued.
+	 */
+	bool unsent;
+
+	/**
+	 * \brief Feature report holding the resolution multipliers
+	 * \details Bits 0-1: vertical wheel, bits 2-3: horizontal wheel. A value
+	 * of 1 enables MOUSE_RESOLUTION_MULTIPLIER for that wheel, 0 disables it.
+	 */
+	uint8_t resolutionMultipliers;
+
+	/**
+	 * \brief Fills the report of the current protocol with the buttons and
+	 * the next part of the residual movement
+	 * \details Must be called inside the critical section. The movement stays
+	 * in the residual until commitReport() is called.
+	 * \param[out] size Receives the size of the report.
+	 * \return Pointer to the report.
+	 */
+	const void* prepareReport(uint& size);
+
+	/**
+	 * \brief Removes the movement of the prepared report from the residual
+	 * \details Must be called inside the critical section after the report
+	 * from prepareReport() has been handed over.
+	 */
+	void commitReport();
 
 public:
 	/**
@@ -210,11 +455,24 @@ public:
 	 */
 	UsbHidMouse(uint8_t interface);
 
+	virtual void setProtocol(uint8_t protocol);
 	virtual uint16_t sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8_t buflen);
-	virtual void sendReport(uint8_t previousReportId);
+	virtual bool sendReport(uint8_t previousReportId);
 	virtual void startAssemblingReport();
-	virtual void addActionToReport(const Action& action);
-	virtual void finishAssemblingReport();
+	virtual void addActionToReport(const Action& action, uint scale = 1);
+	virtual bool finishAssemblingReport();
+
+	/**
+	 * \brief Returns the feature report with the resolution multipliers
+	 * \return See resolutionMultipliers.
+	 */
+	uint8_t getResolutionMultipliers() const {return resolutionMultipliers;}
+
+	/**
+	 * \brief Sets the resolution multipliers (on request of the host)
+	 * \param multipliers See resolutionMultipliers.
+	 */
+	void setResolutionMultipliers(uint8_t multipliers);
 };
 
 /**
@@ -233,19 +491,24 @@ class UsbHidComposite : public UsbHidInterface
 	 * unsigned integer. See Section "Consumer Page" in the HID Usage Tables
 	 * document or HID_USAGE_CONSUMER_* in hid.h.
 	 */
-	uint16_t currentCCReport, previousCCReport, newCCReport;
+	uint16_t newCCReport;
+	ReportQueue<uint16_t> ccReports;
 
 	/**
 	 * \brief System Control report
 	 * \details System control reports consist of only 2 bits (padded to 8):
 	 * 1 is power down, 2 is sleep, and 3 is wake up
 	 */
-	uint8_t currentSCReport, previousSCReport, newSCReport;
+	uint8_t newSCReport;
+	ReportQueue<uint8_t> scReports;
 
 	/**
 	 * \brief Slider Report
+	 * \details Slider reports consist of a single 16 bit unsigned integer
+	 * holding the 12-bit slider value.
 	 */
-	uint8_t currentSliderReport, previousSliderReport, newSliderReport;
+	uint16_t newSliderReport;
+	ReportQueue<uint16_t> sliderReports;
 
 public:
 	/**
@@ -255,10 +518,10 @@ public:
 	UsbHidComposite(uint8_t interface);
 
 	virtual uint16_t sendEp0Report(uint8_t reportId, uint8_t* buffer, uint8_t buflen);
-	virtual void sendReport(uint8_t previousReportId);
+	virtual bool sendReport(uint8_t previousReportId);
 	virtual void startAssemblingReport();
-	virtual void addActionToReport(const Action& action);
-	virtual void finishAssemblingReport();
+	virtual void addActionToReport(const Action& action, uint scale = 1);
+	virtual bool finishAssemblingReport();
 
 	/**
 	 * \brief Set slider report
@@ -267,8 +530,9 @@ public:
 	 * Therefore, this method is used to set it directly. It should be called
 	 * in between startAssemblingReport() and finishAssemblingReport(), just
 	 * like addActionToReport().
+	 * \param value Slider value (0..4095).
 	 */
-	void setSlider(uint8_t value);
+	void setSlider(uint16_t value);
 };
 
 #endif // _HID_H
@@ -5,7 +5,10 @@
 
 #include<new>
 #include"hardware/adc.h"
+#include"hardware/dma.h"
+#include"hardware/clocks.h"
 #include"input.h"
+#include"input.pio.h"
 
 //-----------------------------------------------------------------------------
 // Switch implementation
@@ -14,12 +17,13 @@ Switch::Switch(uint pin, uint debounceDuration)
 :	pin(pin),
 	pressed(false),
 	debounceDuration(debounceDuration),
-	events()
+	events(),
+	edgePending(false),
+	latency()
 {
-	// Set up debounce buffer
-	if(this->debounceDuration < 1 || this->debounceDuration > 31)
+	// Check debounce duration
+	if(this->debounceDuration < 1)
 		this->debounceDuration = 10;
-	buffer = (1 << this->debounceDuration) - 1;
 
 	// Set initial timestamp to now
 	tsLastEvent = get_absolute_time();
@@ -30,39 +34,107 @@ Switch::Switch(uint pin, uint debounceDuration)
 	gpio_pull_up(pin);
 }
 
-void Switch::update()
+void Switch::update(bool pressed, absolute_time_t now)
 {
-	// Read the pin and put the value into the debouncing buffer
-	buffer = ((buffer << 1) & ((1 << debounceDuration) - 1)) | (gpio_get(pin) ? 1 : 0);
+	if(pressed == this->pressed)
+		return;
 
-	// Check if the pin has stabilised (all buffer values are equal)
-	if(buffer == 0 && !pressed)
+	// Change state
+	this->pressed = pressed;
+	// Create event (captured at the edge that caused it, if known) and put in
+	// queue
+	uint32_t tsDebounced = static_cast<uint32_t>(to_us_since_boot(now));
+	uint32_t tsCapture = edgePending ? static_cast<uint32_t>(to_us_since_boot(tsEdge)) : tsDebounced;
+	events.insert(Event{pressed ? Event::PRESS : Event::RELEASE, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000), tsCapture, tsDebounced});
+	tsLastEvent = now;
+
+	// Measure the time since the edge that caused the event
+	if(edgePending)
 	{
-		// Press event detected
-		// Change state
-		pressed = true;
-		// Create event and put in queue
-		absolute_time_t now = get_absolute_time();
-		events.insert(Event{Event::PRESS, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000)});
-		tsLastEvent = now;
+		latency.add(absolute_time_diff_us(tsEdge, now));
+		edgePending = false;
 	}
-	else if(buffer == (1 << debounceDuration) - 1 && pressed)
+}
+
+void Switch::edge(absolute_time_t now)
+{
+	if(!edgePending)
 	{
-		// Release event detected
-		// Change state
-		pressed = false;
-		// Create event and put in queue
-		absolute_time_t now = get_absolute_time();
-		events.insert(Event{Event::RELEASE, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000)});
-		tsLastEvent = now;
+		edgePending = true;
+		tsEdge = now;
 	}
 }
 
+void Switch::expireEdge(absolute_time_t now)
+{
+	if(edgePending && absolute_time_diff_us(tsEdge, now) >= LATENCY_HISTOGRAM_BUCKETS * LATENCY_HISTOGRAM_BUCKET_WIDTH)
+		edgePending = false;
+}
+
+//-----------------------------------------------------------------------------
+// SwitchBank implementation
+
+SwitchBank::SwitchBank()
+: mask(0), state(0), counter{}, threshold{}
+{
+}
+
+void SwitchBank::addPin(uint pin, uint threshold)
+{
+	assert(pin < 32);
+
+	// Limit threshold
+	if(threshold < 1)
+		threshold = 1;
+	if(threshold > (1u << SWITCH_BANK_COUNTER_BITS) - 1)
+		threshold = (1u << SWITCH_BANK_COUNTER_BITS) - 1;
+
+	// Add pin (released, counter reset) and store threshold in bit planes
+	mask |= 1u << pin;
+	state &= ~(1u << pin);
+	for(uint i = 0; i < SWITCH_BANK_COUNTER_BITS; i++)
+	{
+		counter[i] &= ~(1u << pin);
+		if(threshold & (1u << i))
+			this->threshold[i] |= 1u << pin;
+		else
+			this->threshold[i] &= ~(1u << pin);
+	}
+}
+
+uint32_t SwitchBank::update(uint32_t levels)
+{
+	// Switches whose sample differs from the debounced state (pressed means
+	// low)
+	uint32_t delta = (~levels & mask) ^ state;
+
+	// Increment the counters of these switches and reset all others. At the
+	// same time, find the counters that differ from their thresholds.
+	uint32_t carry = delta;
+	uint32_t mismatch = 0;
+	for(uint i = 0; i < SWITCH_BANK_COUNTER_BITS; i++)
+	{
+		uint32_t c = counter[i];
+		counter[i] = (c ^ carry) & delta;
+		carry &= c;
+		mismatch |= counter[i] ^ threshold[i];
+	}
+
+	// Change the state of switches that have reached their thresholds and
+	// reset their counters
+	uint32_t changed = delta & ~mismatch;
+	state ^= changed;
+	for(uint i = 0; i < SWITCH_BANK_COUNTER_BITS; i++)
+		counter[i] &= ~changed;
+
+	return changed;
+}
+
 //-----------------------------------------------------------------------------
 // RotaryEncoder implementation
 
-RotaryEncoder::RotaryEncoder(uint pinA, uint pinB)
-: pinA(pinA), pinB(pinB), state(N), events()
+RotaryEncoder::RotaryEncoder(uint pinA, uint pinB, Type type)
+: pinA(pinA), pinB(pinB), decoder(type), velocity(0), lastType(Event::LEFT), events(), lastPins(0), edgePending(false), latency()
 {
 	// Set initial timestamp to now
 	tsLastEvent = get_absolute_time();
@@ -76,95 +148,108 @@ RotaryEncoder::RotaryEncoder(uint pinA, uint pinB)
 	gpio_pull_up(pinB);
 }
 
-void RotaryEncoder::update()
+void RotaryEncoder::update(uint pins, absolute_time_t now)
 {
-	// Read the pins (Bit 1 = B activated, Bit 0 = A activated. Note that
-	// "activated" means connected to GND, i.e. 0.)
-	uint pins = (gpio_get(pinA) ? 0 : 1) | (gpio_get(pinB) ? 0 : 2);
-
-	// Finite state machine
-	switch(state)
+	// Note the first change of the pins since the last event (for the
+	// latency histogram)
+	if(pins != lastPins)
 	{
-	case N:
-		if(pins == 0b01) state = L1;
-		else if(pins == 0b10) state = R1;
-		break;
-	case L1:
-		if(pins == 0b11) state = L2;
-		else if(pins == 0b00) state = N;
-		break;
-	case L2:
-		if(pins == 0b10) state = L3;
-		else if(pins == 0b01) state = L1;
-		break;
-	case L3:
-		if(pins == 0b00)
-		{
-			state = N;
-			// Left turn detected
-			absolute_time_t now = get_absolute_time();
-			events.insert(Event{Event::LEFT, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000)});
-			tsLastEvent = now;
-		}
-		else if(pins == 0b11) state = L2;
-		break;
-	case R1:
-		if(pins == 0b11) state = R2;
-		else if(pins == 0b00) state = N;
-		break;
-	case R2:
-		if(pins == 0b01) state = R3;
-		else if(pins == 0b10) state = R1;
-		break;
-	case R3:
-		if(pins == 0b00)
-		{
-			state = N;
-			// Right turn detected
-			absolute_time_t now = get_absolute_time();
-			events.insert(Event{Event::RIGHT, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000)});
-			tsLastEvent = now;
-		}
-		else if(pins == 0b11) state = R2;
-		break;
+		if(!edgePending || absolute_time_diff_us(tsEdge, now) >= LATENCY_HISTOGRAM_BUCKETS * LATENCY_HISTOGRAM_BUCKET_WIDTH)
+			tsEdge = now;
+		edgePending = true;
+		lastPins = pins;
 	}
+
+	// Finite state machine
+	QuadratureDecoder::Tick tick = decoder.update(pins);
+	if(tick == QuadratureDecoder::NONE)
+		return;
+
+	// Turn detected
+	Event event;
+	event.type = tick == QuadratureDecoder::LEFT ? Event::LEFT : Event::RIGHT;
+	int64_t interval = absolute_time_diff_us(tsLastEvent, now);
+	event.duration = static_cast<uint>(interval / 1000);
+
+	// Estimate velocity (average with the previous estimate if the knob is
+	// still being turned in the same direction)
+	uint current = static_cast<uint>(1000000 / (interval > 0 ? interval : 1));
+	if(event.type == lastType && event.duration < ROTENC_VELOCITY_TIMEOUT)
+		velocity = (velocity + current) / 2;
+	else
+		velocity = current;
+	event.velocity = velocity;
+	event.timestamp = static_cast<uint32_t>(to_us_since_boot(now));
+	lastType = event.type;
+
+	events.insert(event);
+	tsLastEvent = now;
+
+	// Measure the time since the first change that led to the event
+	latency.add(absolute_time_diff_us(tsEdge, now));
+	edgePending = false;
 }
 
 //-----------------------------------------------------------------------------
 // Potentiometer implementation
 
-Potentiometer::Potentiometer(uint pin, uint16_t adcMin, uint16_t adcMax, uint16_t hysteresis)
-: pin(pin), position(0), events(), adcMin(adcMin), adcMax(adcMax), hysteresis(hysteresis)
+Potentiometer::Potentiometer(uint pin, uint16_t hysteresis)
+:	pin(pin),
+	position(0),
+	value(0),
+	adcMin(POTI_UNCALIBRATED_MIN),
+	adcMax(POTI_UNCALIBRATED_MAX),
+	hysteresis(hysteresis),
+	filterState(0xffffffff),
+	calibrationChanged(false),
+	events()
 {
-	// Check parameter bounds
-	if(adcMax > 4095) adcMax = 4095;
-	if(adcMin > adcMax) adcMin = adcMax;
-	if(hysteresis > (adcMax - adcMin + 1) / 256)
-		hysteresis = (adcMax - adcMin + 1) / 256;
-
-	// Set initial timestamp to now
+	// Set initial timestamps to now
 	tsLastEvent = get_absolute_time();
+	tsCalibrationChanged = tsLastEvent;
 
-	// Set up pin (digital input buffer disabled)
-	adc_init();
+	// Set up pin (digital input buffer disabled). Conversions are done by the
+	// InputMonitor.
 	adc_gpio_init(pin);
-	adc_select_input(pin - 26);
 }
 
-void Potentiometer::update()
+void Potentiometer::update(uint raw)
 {
-	// Read the analog pin value
-	adc_select_input(pin - 26);
-	uint16_t newRaw = adc_read();
+	absolute_time_t now = get_absolute_time();
+
+	// Low-pass filter the oversampled value
+	if(filterState == 0xffffffff)
+		filterState = raw << POTI_FILTER_SHIFT;
+	else
+		filterState += raw - (filterState >> POTI_FILTER_SHIFT);
+	uint filtered = filterState >> POTI_FILTER_SHIFT;
+
+	// Widen the calibration if the potentiometer went beyond it
+	uint adc = filtered >> POTI_OVERSAMPLING_BITS;
+	if(adc < adcMin || adc > adcMax)
+	{
+		if(adc < adcMin)
+			adcMin = adc;
+		else
+			adcMax = adc;
+		calibrationChanged = true;
+		tsCalibrationChanged = now;
+	}
 
-	uint8_t oldPos = position;
-	uint8_t newPos = rawToPos(newRaw);
+	// High-resolution value
+	value = rawToSteps(filtered, POTI_VALUE_MAX + 1);
 
-	// Apply hysteresis
+	// Position (with hysteresis, which must not exceed one step)
+	uint hyst = hysteresis;
+	if(hyst > (adcMax - adcMin + 1) / 256)
+		hyst = (adcMax - adcMin + 1) / 256;
+	hyst <<= POTI_OVERSAMPLING_BITS;
+	uint8_t oldPos = position;
+	uint8_t newPos = rawToPos(filtered);
 	if(newPos < position)
 	{
 		// Moved down
-		if(newPos == 255 || rawToPos(newRaw + hysteresis) == newPos)
+		if(newPos == 255 || rawToPos(filtered + hyst) == newPos)
 			position = newPos;
 		else
 			position = newPos + 1;
@@ -172,7 +257,7 @@ void Potentiometer::update()
 	else if(newPos > position)
 	{
 		// Moved up
-		if(newPos == 0 || rawToPos(newRaw - hysteresis) == newPos)
+		if(newPos == 0 || rawToPos(filtered > hyst ? filtered - hyst : 0) == newPos)
 			position = newPos;
 		else
 			position = newPos - 1;
@@ -181,12 +266,39 @@ void Potentiometer::update()
 	// Create event
 	if(position != oldPos)
 	{
-		uint now = get_absolute_time();
 		events.insert(Event{(int)newPos - (int)oldPos, newPos, static_cast<uint>(absolute_time_diff_us(tsLastEvent, now) / 1000)});
 		tsLastEvent = now;
 	}
 }
 
+bool Potentiometer::setCalibration(const Calibration& calibration)
+{
+	if(calibration.adcMin >= calibration.adcMax || calibration.adcMax > 4095)
+		return false;
+	// update() is called from an alarm
+	uint32_t status = save_and_disable_interrupts();
+	adcMin = calibration.adcMin;
+	adcMax = calibration.adcMax;
+	calibrationChanged = false;
+	restore_interrupts(status);
+	return true;
+}
+
+bool Potentiometer::getUnsavedCalibration(Calibration& calibration)
+{
+	bool ready = false;
+	// update() is called from an alarm
+	uint32_t status = save_and_disable_interrupts();
+	if(calibrationChanged && absolute_time_diff_us(tsCalibrationChanged, get_absolute_time()) >= POTI_CALIBRATION_SETTLE_TIME * 1000)
+	{
+		calibration = Calibration{adcMin, adcMax};
+		calibrationChanged = false;
+		ready = true;
+	}
+	restore_interrupts(status);
+	return ready;
+}
+
 //-----------------------------------------------------------------------------
 // InputMonitor implementation
 
@@ -201,13 +313,67 @@ void InputMonitor::create()
 		instance = new(inputMonitorMemory) InputMonitor();
 }
 
+/// Types of the rotary encoders
+static constexpr RotaryEncoder::Type rotaryEncoderTypes[3] = ROTENC_TYPES;
+
 InputMonitor::InputMonitor()
-:	switches{Switch(16), Switch(17), Switch(18), Switch(19), Switch(20), Switch(21), Switch(11), Switch(8), Switch(27)},
-	rotaryEncoders{RotaryEncoder(13, 12), RotaryEncoder(10, 9), RotaryEncoder(22, 26)},
-	potentiometers{Potentiometer(28, 11, 4077, 3)},
+:	idle(false),
+	lastLevels(0),
+	burstScans(0),
+	idleScans(0),
+	pio(pio0),
+	pinBase(8),
+	switches{Switch(16), Switch(17), Switch(18), Switch(19), Switch(20), Switch(21), Switch(11), Switch(8), Switch(27)},
+	rotaryEncoders{RotaryEncoder(13, 12, rotaryEncoderTypes[0]), RotaryEncoder(10, 9, rotaryEncoderTypes[1]), RotaryEncoder(22, 26, rotaryEncoderTypes[2])},
+	potentiometers{Potentiometer(28, 3)},
 	mode(Mode::STOPPED),
 	sleepingInput(false)
 {
+	// Load the sampling program (the state machine is only started in
+	// Mode::RUNNING) and route its interrupt to this core
+	sm = pio_claim_unused_sm(pio, true);
+	pioOffset = pio_add_program(pio, &input_sampler_program);
+	irq_set_exclusive_handler(PIO0_IRQ_0, pioIrqHandler);
+	pio_set_irq0_source_enabled(pio, static_cast<pio_interrupt_source>(pis_sm0_rx_fifo_not_empty + sm), true);
+	irq_set_enabled(PIO0_IRQ_0, true);
+	for(const RotaryEncoder& re : rotaryEncoders)
+		assert((input_sampler_mask(pinBase) & (1u << re.getPinA())) && (input_sampler_mask(pinBase) & (1u << re.getPinB())));
+
+	// Set up the ADC for free-running round-robin conversions of all
+	// potentiometers. Each conversion is put into the FIFO and immediately
+	// moved to adcRing by DMA. The DMA channel is only started in
+	// Mode::RUNNING.
+	adc_init();
+	adcChannelMask = 0;
+	for(const Potentiometer& pt : potentiometers)
+		adcChannelMask |= 1u << pt.getAdcChannel();
+	assert((1u << ADC_RING_BITS) % __builtin_popcount(adcChannelMask) == 0);
+	adc_fifo_setup(true, true, 1, false, false);
+	adc_set_clkdiv(static_cast<float>(clock_get_hz(clk_adc)) / ADC_SAMPLE_RATE - 1.0f);
+	adcDmaChannel = dma_claim_unused_channel(true);
+	dma_channel_config dmaConfig = dma_channel_get_default_config(adcDmaChannel);
+	channel_config_set_transfer_data_size(&dmaConfig, DMA_SIZE_16);
+	channel_config_set_read_increment(&dmaConfig, false);
+	channel_config_set_write_increment(&dmaConfig, true);
+	channel_config_set_ring(&dmaConfig, true, ADC_RING_BITS + 1);
+	channel_config_set_dreq(&dmaConfig, DREQ_ADC);
+	dma_channel_configure(adcDmaChannel, &dmaConfig, adcRing, &adc_hw->fifo, ADC_RING_LAPS << ADC_RING_BITS, false);
+	dma_channel_set_irq1_enabled(adcDmaChannel, true);
+	irq_add_shared_handler(DMA_IRQ_1, adcDmaIrqHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+	irq_set_enabled(DMA_IRQ_1, true);
+
+	// Set up debouncing. Switch pins are sampled by the PIO as well, which
+	// detects their edges.
+	for(const Switch& sw : switches)
+		assert(input_sampler_mask(pinBase) & (1u << sw.getPin()));
+	for(const Switch& sw : switches)
+		switchBank.addPin(sw.getPin(), (sw.getDebounceDuration() + INPUT_POLL_INTERVAL - 1) / INPUT_POLL_INTERVAL);
+
+	// Pins whose changes count as activity
+	inputPinMask = switchBank.getMask();
+	for(const RotaryEncoder& re : rotaryEncoders)
+		inputPinMask |= (1u << re.getPinA()) | (1u << re.getPinB());
+
 	// Prepare IRQs on all switch & rotary encoder pins (but don't enable them yet)
 	gpio_set_irq_callback(sleepingGpioCb);
 	irq_set_enabled(IO_IRQ_BANK0, false);
@@ -233,7 +399,9 @@ void InputMonitor::setMode(Mode mode)
 			irq_set_enabled(IO_IRQ_BANK0, false);
 			break;
 		case Mode::RUNNING:
+			pio_sm_set_enabled(pio, sm, false);
 			cancel_alarm(runningAlarm);
+			stopAdc();
 			break;
 	}
 
@@ -245,7 +413,14 @@ void InputMonitor::setMode(Mode mode)
 			irq_set_enabled(IO_IRQ_BANK0, true);
 			break;
 		case Mode::RUNNING:
-			runningAlarm = add_alarm_in_ms(0, runningAlarmCb, this, true);
+			// (Re-)starting the state machine clears its FIFO. The first
+			// snapshot is pushed right away.
+			idle = false;
+			tsLastActivity = get_absolute_time();
+			lastLevels = gpio_get_all() & inputPinMask;
+			input_sampler_program_init(pio, sm, pioOffset, pinBase, INPUT_SAMPLE_RATE);
+			startAdc();
+			runningAlarm = add_alarm_in_ms(INPUT_POLL_INTERVAL, runningAlarmCb, this, true);
 			break;
 	}
 
@@ -254,16 +429,150 @@ void InputMonitor::setMode(Mode mode)
 
 int64_t InputMonitor::runningAlarmCallback(alarm_id_t id, void* user_data)
 {
-	// Update all input controls
-	for(Switch& sw : switches)
-		sw.update();
+	absolute_time_t now = get_absolute_time();
+	bool active = false;
+
+	// Debounce switches. Rotary encoders are only updated by the PIO
+	// interrupt. While idle, the switches are known to be stable because any
+	// edge would have ended idling.
+	if(!idle)
+	{
+		burstScans++;
+		uint32_t levels = gpio_get_all();
+		uint32_t changed = switchBank.update(levels);
+		uint32_t state = switchBank.getState();
+		// Switches whose pins disagree with their debounced states are still
+		// bouncing or about to change
+		uint32_t pending = (~levels ^ state) & switchBank.getMask();
+		for(Switch& sw : switches)
+		{
+			if(changed & (1u << sw.getPin()))
+				sw.update(state & (1u << sw.getPin()), now);
+			else if(!(pending & (1u << sw.getPin())))
+				sw.expireEdge(now);
+		}
+		active = changed != 0 || pending != 0;
+	}
+	else
+		idleScans++;
+
+	// Average each potentiometer's conversions in the ring (they are
+	// interleaved in ascending order of the channels). Until the ring has
+	// been filled once, it still contains conversions from before.
+	if(!adcRingFilled)
+		adcRingFilled = dma_hw->ch[adcDmaChannel].transfer_count <= (ADC_RING_LAPS - 1) << ADC_RING_BITS;
+	if(adcRingFilled)
+	{
+		uint numChannels = __builtin_popcount(adcChannelMask);
+		for(Potentiometer& pt : potentiometers)
+		{
+			uint sum = 0;
+			for(uint i = __builtin_popcount(adcChannelMask & ((1u << pt.getAdcChannel()) - 1)); i < (1u << ADC_RING_BITS); i += numChannels)
+				sum += adcRing[i];
+			uint8_t oldPos = pt.getPosition();
+			pt.update((sum << POTI_OVERSAMPLING_BITS) * numChannels >> ADC_RING_BITS);
+			active = active || pt.getPosition() != oldPos;
+		}
+	}
+
+	// Stay at (or return to) the burst rate while there is activity, drop to
+	// the idle rate after INPUT_IDLE_TIMEOUT without
+	if(active)
+		tsLastActivity = now;
+	idle = !active && absolute_time_diff_us(tsLastActivity, now) >= INPUT_IDLE_TIMEOUT * 1000;
+
+	// Fire again INPUT_POLL_INTERVAL (or INPUT_IDLE_POLL_INTERVAL) after this
+	// one was fired
+	return -(idle ? INPUT_IDLE_POLL_INTERVAL : INPUT_POLL_INTERVAL) * 1000;
+}
+
+void InputMonitor::pioIrqHandler()
+{
+	// Process all snapshots that have piled up. The PIO doesn't timestamp
+	// them, so they all get the time of this interrupt.
+	absolute_time_t now = get_absolute_time();
+	while(!pio_sm_is_rx_fifo_empty(instance->pio, instance->sm))
+		instance->processSnapshot(pio_sm_get(instance->pio, instance->sm), now);
+}
+
+void InputMonitor::startAdc()
+{
+	// Start with the lowest channel, round robin continues in ascending order
+	adc_run(false);
+	adc_fifo_drain();
+	adc_select_input(__builtin_ctz(adcChannelMask));
+	adc_set_round_robin(adcChannelMask);
+	adcRingFilled = false;
+	dma_channel_set_write_addr(adcDmaChannel, adcRing, false);
+	dma_channel_set_trans_count(adcDmaChannel, ADC_RING_LAPS << ADC_RING_BITS, true);
+	adc_run(true);
+}
+
+void InputMonitor::stopAdc()
+{
+	adc_run(false);
+	// Aborting may raise a spurious interrupt
+	dma_channel_set_irq1_enabled(adcDmaChannel, false);
+	dma_channel_abort(adcDmaChannel);
+	dma_channel_acknowledge_irq1(adcDmaChannel);
+	dma_channel_set_irq1_enabled(adcDmaChannel, true);
+	adc_set_round_robin(0);
+	adc_fifo_drain();
+}
+
+void InputMonitor::adcDmaIrqHandler()
+{
+	// The handler is shared, so check if the interrupt is ours
+	if(instance == nullptr || !dma_channel_get_irq1_status(instance->adcDmaChannel))
+		return;
+	dma_channel_acknowledge_irq1(instance->adcDmaChannel);
+
+	// If the FIFO overflowed in the meantime, conversions have been lost and
+	// the channels are no longer in their places in the ring
+	if(adc_hw->fcs & ADC_FCS_OVER_BITS)
+	{
+		adc_hw->fcs |= ADC_FCS_OVER_BITS;
+		instance->startAdc();
+		return;
+	}
+
+	// The write address has wrapped around to the start of the ring, so the
+	// next transfer continues right where this one ended. The FIFO buffers
+	// the conversions in the meantime.
+	dma_channel_set_trans_count(instance->adcDmaChannel, ADC_RING_LAPS << ADC_RING_BITS, true);
+}
+
+void InputMonitor::processSnapshot(uint32_t snapshot, absolute_time_t now)
+{
+	uint32_t levels = input_sampler_levels(snapshot, pinBase) & inputPinMask;
 	for(RotaryEncoder& re : rotaryEncoders)
-		re.update();
-	for(Potentiometer& pt : potentiometers)
-		pt.update();
+		re.update(QuadratureDecoder::pins(levels, re.getPinA(), re.getPinB()), now);
+
+	// Sampled pins that aren't connected to a control (e.g. VBUS sense on
+	// GPIO 24) don't count as activity
+	uint32_t changed = levels ^ lastLevels;
+	lastLevels = levels;
+	if(changed == 0)
+		return;
 
-	// Fire again 1000us after this one was fired
-	return -1000;
+	// Note the edges on switch pins (for the latency histograms)
+	uint32_t edges = changed & switchBank.getMask();
+	if(edges != 0)
+		for(Switch& sw : switches)
+			if(edges & (1u << sw.getPin()))
+				sw.edge(now);
+
+	// Any change ends idling. The alarm is rescheduled right away, so the
+	// switches are debounced at the burst rate from the first edge on. (Both
+	// the alarm and this interrupt have the same priority, so the alarm
+	// callback can't be running at this point.)
+	tsLastActivity = now;
+	if(idle)
+	{
+		idle = false;
+		cancel_alarm(runningAlarm);
+		runningAlarm = add_alarm_in_ms(INPUT_POLL_INTERVAL, runningAlarmCb, this, true);
+	}
 }
 
 void InputMonitor::sleepingGpioCallback(uint gpio, uint32_t event_mask)
@@ -7,82 +7,250 @@
 #define _INPUT_H
 
 #include<cstdint>
+#include<atomic>
 #include"pico/stdlib.h"
+#include"hardware/pio.h"
+#include"spscring.h"
+#include"quadrature.h"
 
 /**
- * \brief An EventQueue can hold a certain amount of events. It uses a ring
- * buffer internally. If the capacity is exceeded, the oldest elements get
- * overwritten.
+ * \brief Number of times per second the input pins are sampled by the PIO
  */
-template<typename Event, uint MAX_CAPACITY>
+#define INPUT_SAMPLE_RATE 100000
+
+/**
+ * \brief Interval (in ms) for debouncing switches and reading potentiometers
+ */
+#define INPUT_POLL_INTERVAL 2
+
+/**
+ * \brief Number of ADC conversions per second
+ * \details The ADC is free-running and converts the channels of all
+ * potentiometers in turn (round robin), so each of them gets its share of
+ * this rate.
+ */
+#define ADC_SAMPLE_RATE 16000
+
+/**
+ * \brief Size of the ring buffer for ADC conversions (as a power of two)
+ * \details DMA writes the conversions into a ring of 2^ADC_RING_BITS 16-bit
+ * entries. Each time the potentiometers are updated, they get the average of
+ * all their conversions in the ring (oversampling). The number of
+ * potentiometers must divide the ring size.
+ */
+#define ADC_RING_BITS 6
+
+/**
+ * \brief Number of laps around the ADC ring buffer per DMA transfer
+ * \details The DMA channel has to be restarted by an interrupt after each
+ * transfer. Many laps per transfer keep these interrupts rare.
+ */
+#define ADC_RING_LAPS 64
+
+/**
+ * \brief Interval (in ms) for reading potentiometers while idle
+ * \details While no control is active, the input monitor drops from
+ * INPUT_POLL_INTERVAL to this interval. Switches and rotary encoders switch
+ * back immediately when any of their pins changes.
+ */
+#define INPUT_IDLE_POLL_INTERVAL 20
+
+/**
+ * \brief Time (in ms) without activity after which the input monitor drops to
+ * INPUT_IDLE_POLL_INTERVAL
+ */
+#define INPUT_IDLE_TIMEOUT 250
+
+/**
+ * \brief Number of buckets of a LatencyHistogram
+ */
+#define LATENCY_HISTOGRAM_BUCKETS 24
+
+/**
+ * \brief Width (in us) of the buckets of a LatencyHistogram
+ */
+#define LATENCY_HISTOGRAM_BUCKET_WIDTH 1000
+
+/**
+ * \brief Queue for passing events from an interrupt handler to the main loop
+ * \details The events are stored in a lock-free SpscRing, so the interrupt
+ * handler (producer) can insert events while the main loop (consumer) drains
+ * them without any critical sections. If the queue is full, new events are
+ * dropped (the producer can't safely overwrite events the consumer might be
+ * reading) and counted as overflows. The highest number of events that has
+ * been in the queue is kept as well, to help choose the capacity.
+ * \tparam Event Type of the events. Should be trivially copyable.
+ * \tparam MAX_CAPACITY Capacity. Must be a power of two.
+ */
+template<typename Event, uint32_t MAX_CAPACITY>
 class EventQueue
 {
 private:
 	/**
 	 * \brief Buffer for events
 	 */
-	Event buffer[MAX_CAPACITY];
+	SpscRing<Event, MAX_CAPACITY> ring;
+
+	/**
+	 * \brief Number of events that have been dropped because the queue was
+	 * full
+	 * \details Only written by the producer.
+	 */
+	std::atomic<uint32_t> overflows;
 
 	/**
-	 * \brief Elements are inserted at head and extrated at tail
-	 * \details head==tail can mean an empty or a completely full queue.
-	 * numEvents helps distinguish between the two cases.
+	 * \brief Highest number of events that have been in the queue
+	 * \details Only written by the producer.
 	 */
-	uint head, tail, numEvents;
+	std::atomic<uint32_t> highWater;
 
 public:
 	/**
 	 * \brief Constructs an empty EventQueue
 	 */
-	EventQueue(): head(0), tail(0), numEvents(0) {}
+	EventQueue(): ring(), overflows(0), highWater(0) {}
 
 	/**
 	 * \brief Inserts an event into the queue
+	 * \details Must only be called by the producer.
 	 * \param event The event to be inserted.
+	 * \return Returns true if the event has been inserted or false if it has
+	 * been dropped because the queue is full.
 	 */
-	void insert(Event event)
+	bool insert(const Event& event)
 	{
-		buffer[head] = event;
-		head = (head + 1) % MAX_CAPACITY;
-		if(numEvents < MAX_CAPACITY)
-			numEvents++;
-		else
-			tail = (tail + 1) % MAX_CAPACITY;
+		if(!ring.push(event))
+		{
+			overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		uint32_t n = ring.size();
+		if(n > highWater.load(std::memory_order_relaxed))
+			highWater.store(n, std::memory_order_relaxed);
+		return true;
 	}
 
 	/**
 	 * \brief Extracts an event from the queue
+	 * \details Must only be called by the consumer.
 	 * \return Returns the extracted event. If the queue is empty, an Event
 	 * created via the standard constructor is returned.
 	 */
 	Event extract()
 	{
-		Event event;
-		if(numEvents != 0)
+		Event event{};
+		ring.pop(event);
+		return event;
+	}
+
+	/**
+	 * \brief Extracts all events from the queue in batches
+	 * \details Must only be called by the consumer. Hands out the events in
+	 * at most two contiguous spans (one if the events don't wrap around the
+	 * end of the ring buffer), which are removed from the queue once the
+	 * function returns. Events inserted meanwhile are left for the next call.
+	 * \param f Function (or lambda) with the signature
+	 * void f(const Event* events, uint32_t n), called for each span.
+	 * \return The number of events that have been extracted.
+	 */
+	template<typename F>
+	uint32_t drain(F&& f)
+	{
+		uint32_t total = 0;
+		for(uint i = 0; i < 2; i++)
 		{
-			numEvents--;
-			event = buffer[tail];
-			tail = (tail + 1) % MAX_CAPACITY;
+			const Event* events;
+			uint32_t n = ring.peek(events);
+			if(n == 0)
+				break;
+			f(events, n);
+			ring.consume(n);
+			total += n;
 		}
-		return event;
+		return total;
 	}
 
 	/**
 	 * \brief Calculates the size of the queue
+	 * \details Only a snapshot if called while the producer is active.
 	 * \return The number of events in the queue.
 	 */
-	inline uint size() const {return numEvents;}
+	inline uint size() const {return ring.size();}
+
+	/**
+	 * \brief Returns the number of dropped events
+	 * \return The number of events that have been dropped because the queue
+	 * was full.
+	 */
+	inline uint32_t getOverflows() const {return overflows.load(std::memory_order_relaxed);}
+
+	/**
+	 * \brief Returns the high-water mark
+	 * \return The highest number of events that have been in the queue.
+	 */
+	inline uint32_t getHighWater() const {return highWater.load(std::memory_order_relaxed);}
+};
+
+/**
+ * \brief Histogram of latencies
+ * \details Bucket i counts latencies from i * LATENCY_HISTOGRAM_BUCKET_WIDTH
+ * up to (i + 1) * LATENCY_HISTOGRAM_BUCKET_WIDTH microseconds. The last bucket
+ * also counts all longer latencies. Counts saturate at 65535.
+ */
+class LatencyHistogram
+{
+private:
+	/**
+	 * \brief Counts
+	 */
+	uint16_t buckets[LATENCY_HISTOGRAM_BUCKETS];
+
+public:
+	/**
+	 * \brief Constructs an empty histogram
+	 */
+	LatencyHistogram(): buckets{} {}
+
+	/**
+	 * \brief Counts a latency
+	 * \param latency The latency in microseconds.
+	 */
+	void add(int64_t latency)
+	{
+		uint i = latency < 0 ? 0 : (latency >= LATENCY_HISTOGRAM_BUCKETS * LATENCY_HISTOGRAM_BUCKET_WIDTH ? LATENCY_HISTOGRAM_BUCKETS - 1 : latency / LATENCY_HISTOGRAM_BUCKET_WIDTH);
+		if(buckets[i] != 0xffff)
+			buckets[i]++;
+	}
+
+	/**
+	 * \brief Resets all counts to zero
+	 */
+	void reset()
+	{
+		for(uint16_t& b : buckets)
+			b = 0;
+	}
+
+	/**
+	 * \brief Returns the count of a bucket
+	 * \param index Index of the bucket. Must be less than
+	 * LATENCY_HISTOGRAM_BUCKETS.
+	 * \return The number of latencies counted in the bucket.
+	 */
+	inline uint16_t getBucket(uint index) const {return buckets[index];}
 };
 
 /**
  * \brief Size of the event queue
+ * \details Must be a power of two.
  */
 #define SWITCH_EVENT_QUEUE_SIZE 8
 
 /**
  * \brief Represents a switch
  * \details A switch is associated with a pin that connects to GND when
- * pressed. The pin is sampled every 1ms and debounced in software.
+ * pressed. The pin is debounced in software by a SwitchBank, which reports
+ * changes of the debounced state to the switch.
  * The switch can be queried in two ways:
  * 1.) The current (debounced) state of the switch can be obtained via
  * isPressed().
@@ -105,6 +273,16 @@ public:
 		 * \brief How long did the previous state last (in milliseconds)?
 		 */
 		uint duration;
+		/**
+		 * \brief Time of the first edge on the pin that led to the event
+		 * (lower 32 bits of the microseconds since boot)
+		 */
+		uint32_t tsCapture;
+		/**
+		 * \brief Time at which the event was created (lower 32 bits of the
+		 * microseconds since boot)
+		 */
+		uint32_t tsDebounced;
 	};
 
 private:
@@ -119,12 +297,7 @@ private:
 	bool pressed;
 
 	/**
-	 * \brief Buffer for debouncing
-	 */
-	uint32_t buffer;
-
-	/**
-	 * \brief Debounce duration
+	 * \brief Debounce duration in milliseconds
 	 */
 	uint debounceDuration;
 
@@ -139,15 +312,30 @@ private:
 	 */
 	absolute_time_t tsLastEvent;
 
+	/**
+	 * \brief Is there an edge on the pin that hasn't led to an event yet?
+	 */
+	bool edgePending;
+
+	/**
+	 * \brief Timestamp of the first edge since the last event
+	 */
+	absolute_time_t tsEdge;
+
+	/**
+	 * \brief Histogram of the latencies from the first edge to the event
+	 */
+	LatencyHistogram latency;
+
 public:
 	/**
 	 * \brief Constructs a Switch instance
 	 * \param pin The pin that the switch is connected to. 
 	 * \param debounceDuration Debounce duration for in milliseconds. Must be
-	 * between 1 and 31. This determines the size of the debounce buffer: The
-	 * pin is sampled once every millisecond. As soon as debounceDuration many
-	 * consecutive samples have the same value, the switch is assumed to have
-	 * stopped bouncing.
+	 * at least 1. As soon as the pin level hasn't changed for this long, the
+	 * switch is assumed to have stopped bouncing. It is rounded up to a
+	 * multiple of INPUT_POLL_INTERVAL and limited to the maximum threshold of
+	 * a SwitchBank.
 	 */
 	Switch(uint pin, uint debounceDuration = 10);
 
@@ -158,11 +346,43 @@ public:
 	inline uint getPin() const {return pin;}
 
 	/**
-	 * \brief Updates the internal state of the instance
-	 * \details This method must be called in 1ms intervals in order for the
-	 * switch to be monitored.
+	 * \brief Getter for the debounce duration
+	 * \return Returns the debounce duration in milliseconds.
+	 */
+	inline uint getDebounceDuration() const {return debounceDuration;}
+
+	/**
+	 * \brief Changes the (debounced) state of the switch
+	 * \details Called by the InputMonitor whenever its SwitchBank detects a
+	 * change of the switch. Creates a press or release event.
+	 * \param pressed The new state.
+	 * \param now Time of the change.
+	 */
+	void update(bool pressed, absolute_time_t now);
+
+	/**
+	 * \brief Notes an edge on the pin
+	 * \details Called by the InputMonitor whenever the (raw) pin level
+	 * changes. Only the first edge after an event is remembered. The next
+	 * event adds the time since that edge to the latency histogram.
+	 * \param now Time of the edge.
+	 */
+	void edge(absolute_time_t now);
+
+	/**
+	 * \brief Forgets an edge that did not lead to an event
+	 * \details Called by the InputMonitor while the pin level agrees with the
+	 * debounced state. An edge is only forgotten once it is older than the
+	 * histogram range, so bouncing doesn't restart the measurement.
+	 * \param now Current time.
 	 */
-	void update();
+	void expireEdge(absolute_time_t now);
+
+	/**
+	 * \brief Returns the latency histogram
+	 * \return The histogram of latencies from the first edge to the event.
+	 */
+	inline LatencyHistogram& getLatencyHistogram() {return latency;}
 
 	/**
 	 * \brief Returns the current state of the switch
@@ -177,17 +397,115 @@ public:
 	inline EventQueue<Event, SWITCH_EVENT_QUEUE_SIZE>& getEvents() {return events;}
 };
 
+/**
+ * \brief Number of bits of the debounce counters of a SwitchBank
+ * \details Thresholds can be up to 2^SWITCH_BANK_COUNTER_BITS - 1 samples.
+ */
+#define SWITCH_BANK_COUNTER_BITS 5
+
+/**
+ * \brief Debounces up to 32 switches at once
+ * \details The switches are sampled all at once (e.g. with gpio_get_all()) in
+ * regular intervals. Each switch has a counter for the number of consecutive
+ * samples that differ from its debounced state, which is reset as soon as a
+ * sample agrees with the debounced state again. When the counter reaches the
+ * threshold of the switch, the switch is assumed to have stopped bouncing and
+ * its debounced state changes.
+ * The counters are stored as "vertical counters": Bit i of the counter of the
+ * switch on pin k is bit k of counter[i] (the same goes for the thresholds).
+ * This way, all counters are incremented, reset and compared using a few
+ * bitwise operations per counter bit, no matter how many switches there are.
+ */
+class SwitchBank
+{
+private:
+	/**
+	 * \brief Pins that are connected to switches
+	 */
+	uint32_t mask;
+
+	/**
+	 * \brief Debounced states of all switches (1 = pressed)
+	 */
+	uint32_t state;
+
+	/**
+	 * \brief Bit planes of the counters
+	 */
+	uint32_t counter[SWITCH_BANK_COUNTER_BITS];
+
+	/**
+	 * \brief Bit planes of the thresholds
+	 */
+	uint32_t threshold[SWITCH_BANK_COUNTER_BITS];
+
+public:
+	/**
+	 * \brief Constructs a SwitchBank without any switches
+	 */
+	SwitchBank();
+
+	/**
+	 * \brief Adds a switch
+	 * \details The switch is initially released.
+	 * \param pin The pin that the switch is connected to (0..31). The pin
+	 * connects to GND when the switch is pressed.
+	 * \param threshold Number of consecutive samples required for a change of
+	 * the debounced state. Limited to 1..2^SWITCH_BANK_COUNTER_BITS - 1.
+	 */
+	void addPin(uint pin, uint threshold);
+
+	/**
+	 * \brief Processes a sample of all pins
+	 * \param levels Levels of the pins (bit k = pin k), e.g. from
+	 * gpio_get_all().
+	 * \return Returns a mask of the switches whose debounced state has
+	 * changed.
+	 */
+	uint32_t update(uint32_t levels);
+
+	/**
+	 * \brief Returns the debounced states of all switches
+	 * \return A mask of the switches that are pressed.
+	 */
+	inline uint32_t getState() const {return state;}
+
+	/**
+	 * \brief Returns the pins that are connected to switches
+	 * \return A mask of the pins that have been added.
+	 */
+	inline uint32_t getMask() const {return mask;}
+};
+
 /**
  * \brief Size of the event queue
+ * \details Must be a power of two. A fast spin produces several events per
+ * report interval of the main loop.
+ */
+#define ROTENC_EVENT_QUEUE_SIZE 32
+
+/**
+ * \brief Time (in ms) after which the velocity of a rotary encoder is no
+ * longer averaged with the previous one
+ */
+#define ROTENC_VELOCITY_TIMEOUT 100
+
+/**
+ * \brief Types of the rotary encoders, one per knob (see RotaryEncoder::Type)
+ * \details The knobs are numbered like in the Settings. Can be overridden at
+ * build time if other encoders are fitted.
  */
-#define ROTENC_EVENT_QUEUE_SIZE 8
+#ifndef ROTENC_TYPES
+#define ROTENC_TYPES {RotaryEncoder::Type::FULL_STEP, RotaryEncoder::Type::FULL_STEP, RotaryEncoder::Type::FULL_STEP}
+#endif
 
 /**
  * \brief Represents a rotary encoder
  * \details A rotary encoder is associated with two pins that connect to GND
- * in a certain sequency when turned. The pins are sampled every 1ms.
- * A finite state machine is used to ensure the sequence is read correctly and
- * without bouncing.
+ * in a certain sequency when turned. Changes of the pin levels are reported by
+ * the InputMonitor as they happen.
+ * A QuadratureDecoder ensures the sequence is read correctly and without
+ * bouncing, at the cost of one table lookup per sample.
  * The events (left turn, right turn) are stored in an EventQueue which can be
  * obtained through getEvents().
  */
@@ -207,8 +525,27 @@ public:
 		 * \brief How long did the previous state last (in milliseconds)?
 		 */
 		uint duration;
+		/**
+		 * \brief Estimated speed of rotation (in ticks per second)
+		 * \details Averaged over recent ticks in the same direction.
+		 */
+		uint velocity;
+		/**
+		 * \brief Time at which the sample that completed the tick was
+		 * processed (lower 32 bits of the microseconds since boot)
+		 * \details The PIO doesn't timestamp its snapshots. They are stamped
+		 * when the interrupt handler reads them, so snapshots that have piled
+		 * up in the FIFO share the time of that interrupt.
+		 */
+		uint32_t timestamp;
 	};
 
+	/**
+	 * \brief Types of rotary encoders
+	 * \details See QuadratureDecoder::Type.
+	 */
+	typedef QuadratureDecoder::Type Type;
+
 private:
 	/**
 	 * \brief Pins that are connected to the rotary encoder
@@ -216,21 +553,19 @@ private:
 	uint pinA, pinB;
 
 	/**
-	 * \brief Finite state machine for decoding
+	 * \brief Decoder for the sequence on the pins
 	 */
-	enum
-	{
-		// Rotary encoder is in neutral state with neither pin connected to GND
-		N,
-		// Rotary encoder is currently turning left, going through a 2-bit
-		// Hamming sequence. The state reflects which stage of the sequence
-		// we're in.
-		L1, L2, L3,
-		// Rotary encoder is currently turning right, going through a 2-bit
-		// Hamming sequence. The state reflects which stage of the sequence
-		// we're in.
-		R1, R2, R3
-	} state;
+	QuadratureDecoder decoder;
+
+	/**
+	 * \brief Last velocity estimate
+	 */
+	uint velocity;
+
+	/**
+	 * \brief Direction of the last event
+	 */
+	decltype(Event::type) lastType;
 
 	/**
 	 * \brief Event queue for this switch
@@ -243,12 +578,34 @@ private:
 	 */
 	absolute_time_t tsLastEvent;
 
+	/**
+	 * \brief State of the pins in the previous sample
+	 */
+	uint lastPins;
+
+	/**
+	 * \brief Has a pin changed since the last event?
+	 */
+	bool edgePending;
+
+	/**
+	 * \brief Timestamp of the first change of the pins since the last event
+	 */
+	absolute_time_t tsEdge;
+
+	/**
+	 * \brief Histogram of the latencies from the first change of the pins to
+	 * the event
+	 */
+	LatencyHistogram latency;
+
 public:
 	/**
 	 * \brief Constructs a RotaryEncoder instance
 	 * \param pinA,pinB The pins that the rotary encoder is connected to.
+	 * \param type Type of the rotary encoder.
 	 */
-	RotaryEncoder(uint pinA, uint pinB);
+	RotaryEncoder(uint pinA, uint pinB, Type type = Type::FULL_STEP);
 
 	/**
 	 * \brief Getter for Pin A number
@@ -262,12 +619,40 @@ public:
 	 */
 	inline uint getPinB() const {return pinB;}
 
+	/**
+	 * \brief Getter for the type
+	 * \return Returns the type of the rotary encoder.
+	 */
+	inline Type getType() const {return decoder.getType();}
+
+	/**
+	 * \brief Changes the type
+	 * \details Resets the finite state machine.
+	 * \param type The new type.
+	 */
+	inline void setType(Type type) {decoder.setType(type);}
+
 	/**
 	 * \brief Updates the internal state of the instance
-	 * \details This method must be called in 1ms intervals in order for the
-	 * rotary encoder to be monitored.
+	 * \details This method must be called whenever the level of one of the
+	 * pins (potentially) changes. Missing a change may cause a turn to be
+	 * missed.
+	 * \param pins The state of the pins: Bit 0 is set if Pin A is activated
+	 * (connected to GND), Bit 1 if Pin B is activated.
+	 * \param now Time of the sample.
 	 */
-	void update();
+	void update(uint pins, absolute_time_t now);
+
+	/**
+	 * \brief Returns the latency histogram
+	 * \details Measures the time from the first change of the pins to the
+	 * completed tick, i.e. mostly how long the detent takes to pass through
+	 * the Gray code sequence. A change that is older than the histogram range
+	 * when the pins change again is replaced by the newer one, so wiggling
+	 * the knob without completing a tick doesn't count.
+	 * \return The histogram of latencies from the first change to the event.
+	 */
+	inline LatencyHistogram& getLatencyHistogram() {return latency;}
 
 	/**
 	 * \brief Returns the event queue
@@ -278,14 +663,59 @@ public:
 
 /**
  * \brief Size of the event queue
+ * \details Must be a power of two.
+ */
+#define POTI_EVENT_QUEUE_SIZE 16
+
+/**
+ * \brief Number of fractional bits gained by oversampling
+ * \details Raw potentiometer values are averages of many 12-bit conversions
+ * and carry this many additional bits, i.e. they range from 0 to 65535.
+ */
+#define POTI_OVERSAMPLING_BITS 4
+
+/**
+ * \brief Time constant of the IIR filter (as a power of two)
+ * \details Each update moves the filtered value 1/2^POTI_FILTER_SHIFT of the
+ * way towards the new raw value.
  */
-#define POTI_EVENT_QUEUE_SIZE 8
+#define POTI_FILTER_SHIFT 2
+
+/**
+ * \brief Maximum value of a potentiometer (12 bits)
+ */
+#define POTI_VALUE_MAX 4095
+
+/**
+ * \brief Initial calibration (in ADC units) for uncalibrated potentiometers
+ * \details Deliberately narrow, so both ends can be reached before the
+ * potentiometer has been calibrated. The calibration widens as soon as the
+ * potentiometer is moved beyond these values.
+ */
+#define POTI_UNCALIBRATED_MIN 256
+#define POTI_UNCALIBRATED_MAX 3839
+
+/**
+ * \brief Time (in ms) a calibration must remain unchanged before it is
+ * reported as ready for being stored
+ * \details Avoids writing to the EEPROM while the potentiometer is still
+ * moving.
+ */
+#define POTI_CALIBRATION_SETTLE_TIME 2000
 
 /**
  * \brief Represents a potentiometer
  * \details A potentiometer is associated with one of the ADC-capable pins.
- * The ADC outputs a 12-bit raw value which is downscaled to the interval
- * 0..255 by this class. Some hysteresis is applied to avoid jitter.
+ * The ADC conversions are done in the background (see InputMonitor) and
+ * handed to update() as an oversampled 16-bit raw value, which is smoothed by
+ * an IIR filter. The filtered value is mapped to a 12-bit value (0..4095)
+ * and to a position in the interval 0..255. Some hysteresis is applied to the
+ * position to avoid jitter.
+ * The mapping uses the range of raw values the potentiometer actually
+ * produces (calibration). Whenever the potentiometer is moved beyond the
+ * current calibration, the calibration is widened accordingly. The
+ * calibration can be stored and restored via getUnsavedCalibration() and
+ * setCalibration().
  */
 class Potentiometer
 {
@@ -309,6 +739,17 @@ public:
 		uint duration;
 	};
 
+	/**
+	 * \brief Calibration of a potentiometer
+	 */
+	struct Calibration
+	{
+		/**
+		 * \brief Minimum and maximum raw ADC value (0..4095)
+		 */
+		uint16_t adcMin, adcMax;
+	};
+
 private:
 	/**
 	 * \brief Pin that is connected to the potentiometer
@@ -321,6 +762,11 @@ private:
 	 */
 	uint8_t position;
 
+	/**
+	 * \brief 12-bit value of the potentiometer
+	 */
+	uint16_t value;
+
 	/**
 	 * \brief Minimum and maximum raw ADC value
 	 */
@@ -331,6 +777,24 @@ private:
 	 */
 	uint16_t hysteresis;
 
+	/**
+	 * \brief State of the IIR filter
+	 * \details The filtered raw value times 2^POTI_FILTER_SHIFT, or 0xffffffff
+	 * if there hasn't been a raw value yet.
+	 */
+	uint32_t filterState;
+
+	/**
+	 * \brief Has the calibration changed since it has last been reported by
+	 * getUnsavedCalibration()?
+	 */
+	bool calibrationChanged;
+
+	/**
+	 * \brief Timestamp of the last change of the calibration
+	 */
+	absolute_time_t tsCalibrationChanged;
+
 	/**
 	 * \brief Event queue for this switch
 	 * \details Stores press and release events.
@@ -343,32 +807,42 @@ private:
 	absolute_time_t tsLastEvent;
 
 	/**
-	 * \brief Convert a raw ADC value to a position.
-	 * \param raw A raw ADC value in the range 0..4095.
-	 * \return The corresponding position in the range 0..255.
+	 * \brief Maps a raw value linearly to the calibrated range
+	 * \param raw An oversampled raw value in the range 0..65535.
+	 * \param steps Number of steps of the output range.
+	 * \return The corresponding value in the range 0..steps-1.
 	 */
-	inline uint8_t rawToPos(uint raw)
+	inline uint rawToSteps(uint raw, uint steps) const
 	{
-		if(raw < adcMin) raw = adcMin;
-		if(raw > adcMax) raw = adcMax;
-		return static_cast<uint8_t>((raw - adcMin) * 256 / (adcMax - adcMin + 1));
+		uint lo = static_cast<uint>(adcMin) << POTI_OVERSAMPLING_BITS;
+		uint hi = (static_cast<uint>(adcMax + 1) << POTI_OVERSAMPLING_BITS) - 1;
+		if(raw < lo) raw = lo;
+		if(raw > hi) raw = hi;
+		return (raw - lo) * steps / (hi - lo + 1);
 	}
 
+	/**
+	 * \brief Convert a raw value to a position.
+	 * \param raw An oversampled raw value in the range 0..65535.
+	 * \return The corresponding position in the range 0..255.
+	 */
+	inline uint8_t rawToPos(uint raw) const {return static_cast<uint8_t>(rawToSteps(raw, 256));}
+
 public:
 	/**
 	 * \brief Constructs a Potentiometer instance
+	 * \details The potentiometer starts out with the calibration
+	 * POTI_UNCALIBRATED_MIN..POTI_UNCALIBRATED_MAX until setCalibration() is
+	 * called.
 	 * \param pin The pin that the potentiometer is connected to. Must be an
 	 * ADC-capable pin (26..29).
-	 * \param adcMin,adcMax Minimum and maximum ADC values. The potentiometer's
-	 * raw values will probably not go all the way down to 0 or all the way up
-	 * to 4095.
 	 * \param hysteresis Hysteresis for raw ADC value.
 	 * Example: Assume raw values 632..638 result in position 40 and the
 	 * poti is moved from 670 down into this interval. If the value falls to or
 	 * below 638-POTI_ADC_HYSTERESIS, position is set to 40. If it stays above
 	 * 638-POTI_ADC_HYSTERESIS, position stops at 41.
 	 */
-	Potentiometer(uint pin, uint16_t adcMin, uint16_t adcMax, uint16_t hysteresis);
+	Potentiometer(uint pin, uint16_t hysteresis);
 
 	/**
 	 * \brief Getter for pin number
@@ -376,12 +850,20 @@ public:
 	 */
 	inline uint getPin() const {return pin;}
 
+	/**
+	 * \brief Getter for the ADC channel
+	 * \return Returns the ADC input (0..3) the potentiometer is connected to.
+	 */
+	inline uint getAdcChannel() const {return pin - 26;}
+
 	/**
 	 * \brief Updates the internal state of the instance
-	 * \details This method must be called in 1ms intervals in order for the
-	 * potentiometer to be monitored.
+	 * \details This method must be called in regular intervals (see
+	 * INPUT_POLL_INTERVAL) in order for the potentiometer to be monitored.
+	 * \param raw Average of the latest ADC conversions, scaled to 16 bits
+	 * (see POTI_OVERSAMPLING_BITS).
 	 */
-	void update();
+	void update(uint raw);
 
 	/**
 	 * \brief Returns the current position of the potentiometer
@@ -390,6 +872,35 @@ public:
 	 */
 	inline uint8_t getPosition() const {return position;}
 
+	/**
+	 * \brief Returns the current value of the potentiometer
+	 * \details Unlike the position, the value has a higher resolution and no
+	 * hysteresis (apart from the filtering).
+	 * \return The current value of the potentiometer in the interval
+	 * [0,POTI_VALUE_MAX].
+	 */
+	inline uint16_t getValue() const {return value;}
+
+	/**
+	 * \brief Sets the calibration
+	 * \details Use this to restore a calibration that has previously been
+	 * obtained from getUnsavedCalibration().
+	 * \param calibration The new calibration. Ignored unless
+	 * adcMin < adcMax <= 4095.
+	 * \return Returns true if the calibration was valid and has been set.
+	 */
+	bool setCalibration(const Calibration& calibration);
+
+	/**
+	 * \brief Checks whether the calibration has changed and should be stored
+	 * \details Only reports a change once the calibration has remained
+	 * unchanged for POTI_CALIBRATION_SETTLE_TIME. Reporting a change resets
+	 * it, so it is only reported once.
+	 * \param[out] calibration Receives the new calibration if there is one.
+	 * \return Returns true if there is a new calibration.
+	 */
+	bool getUnsavedCalibration(Calibration& calibration);
+
 	/**
 	 * \brief Returns the event queue
 	 * \return The event queue for this potentiometer.
@@ -429,7 +940,12 @@ public:
 		 */
 		SLEEPING,
 		/**
-		 * All input controls are monitored using a 1ms timer.
+		 * Rotary encoders are sampled by a PIO state machine, which
+		 * interrupts whenever a pin changes. The ADC converts the
+		 * potentiometers' channels continuously. Switches are debounced and
+		 * potentiometers are updated using a timer. The timer runs at
+		 * INPUT_POLL_INTERVAL while any control is active and drops to
+		 * INPUT_IDLE_POLL_INTERVAL after INPUT_IDLE_TIMEOUT without activity.
 		 */
 		RUNNING
 	};
@@ -445,6 +961,120 @@ private:
 	 */
 	alarm_id_t runningAlarm;
 
+	/**
+	 * \brief Is the alarm running at the idle rate?
+	 * \details See INPUT_IDLE_POLL_INTERVAL.
+	 */
+	bool idle;
+
+	/**
+	 * \brief Timestamp of the last activity of any control
+	 */
+	absolute_time_t tsLastActivity;
+
+	/**
+	 * \brief Pin levels of the previous snapshot taken by the PIO
+	 * \details Bit k is pin k (see input_sampler_levels()). Only the pins in
+	 * inputPinMask are set.
+	 */
+	uint32_t lastLevels;
+
+	/**
+	 * \brief Number of times the alarm has fired at the burst and at the
+	 * idle rate
+	 */
+	uint32_t burstScans, idleScans;
+
+	/**
+	 * \brief PIO instance sampling the pins during Mode::RUNNING
+	 */
+	PIO pio;
+
+	/**
+	 * \brief State machine sampling the pins
+	 */
+	uint sm;
+
+	/**
+	 * \brief Location of the sampling program in PIO instruction memory
+	 */
+	uint pioOffset;
+
+	/**
+	 * \brief First pin sampled by the PIO
+	 * \details All switches and rotary encoders must be connected to pins
+	 * sampled by the PIO, see input_sampler_mask(). The pins of the EEPROM's
+	 * I2C bus in between are skipped, so bus traffic doesn't cause
+	 * snapshots.
+	 */
+	uint pinBase;
+
+	/**
+	 * \brief Pins that are connected to switches and rotary encoders
+	 * \details Bit k is pin k. Changes of the other pins sampled by the PIO
+	 * are ignored.
+	 */
+	uint32_t inputPinMask;
+
+	/**
+	 * \brief PIO interrupt handler
+	 */
+	static void pioIrqHandler();
+
+	/**
+	 * \brief Processes a snapshot of the pins taken by the PIO
+	 * \details Only rotary encoders are updated. Switches are sampled by
+	 * the alarm callback, because debouncing them doesn't benefit from a
+	 * higher sample rate. However, edges on the switches' pins are noted for
+	 * the latency histograms, and any edge brings the alarm back from the
+	 * idle rate.
+	 * \param snapshot A snapshot taken by the PIO (see
+	 * input_sampler_levels()).
+	 * \param now When the snapshot was read from the FIFO.
+	 */
+	void processSnapshot(uint32_t snapshot, absolute_time_t now);
+
+	/**
+	 * \brief Ring buffer for ADC conversions
+	 * \details Written by DMA. The conversions of the potentiometers'
+	 * channels are interleaved in ascending order of their channel numbers.
+	 * Must be aligned to its size for the DMA ring wrapping to work.
+	 */
+	alignas(2 << ADC_RING_BITS) uint16_t adcRing[1 << ADC_RING_BITS];
+
+	/**
+	 * \brief DMA channel transferring ADC conversions into adcRing
+	 */
+	uint adcDmaChannel;
+
+	/**
+	 * \brief ADC channels to convert in round-robin mode (bit k = channel k)
+	 */
+	uint adcChannelMask;
+
+	/**
+	 * \brief Has adcRing been filled completely since starting the ADC?
+	 */
+	bool adcRingFilled;
+
+	/**
+	 * \brief Starts free-running conversions and the DMA transfer
+	 * \details The first conversion goes to the first entry of adcRing.
+	 */
+	void startAdc();
+
+	/**
+	 * \brief Stops conversions and the DMA transfer
+	 */
+	void stopAdc();
+
+	/**
+	 * \brief DMA interrupt handler
+	 * \details Restarts the DMA transfer after ADC_RING_LAPS laps around
+	 * adcRing.
+	 */
+	static void adcDmaIrqHandler();
+
 	/**
 	 * \brief Helper method for alarm callback
 	 */
@@ -470,6 +1100,11 @@ private:
 	 */
 	Switch switches[9];
 
+	/**
+	 * \brief Debouncer for all switches
+	 */
+	SwitchBank switchBank;
+
 	/**
 	 * \brief Array of rotary encoder
 	 */
@@ -520,6 +1155,20 @@ public:
 	 */
 	void setMode(Mode mode);
 
+	/**
+	 * \brief Number of times the inputs have been scanned at the burst rate
+	 * \return Returns the number of times the alarm has fired at
+	 * INPUT_POLL_INTERVAL.
+	 */
+	inline uint32_t getBurstScans() const {return burstScans;}
+
+	/**
+	 * \brief Number of times the inputs have been scanned at the idle rate
+	 * \return Returns the number of times the alarm has fired at
+	 * INPUT_IDLE_POLL_INTERVAL.
+	 */
+	inline uint32_t getIdleScans() const {return idleScans;}
+
 	/**
 	 * \brief Has there been input in sleeping mode?
 	 * \return Returns true if input occurred since the last time the mode was
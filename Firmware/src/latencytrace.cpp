@@ -0,0 +1,122 @@
+/**
+ * \file latencytrace.cpp
+ * Implementation for latencytrace.h
+ */
+
+#include"latencytrace.h"
+
+LatencyTracer::LatencyTracer()
+:	pending{},
+	records(),
+	serial(0),
+	serials{},
+	abandoned(0)
+{
+}
+
+void LatencyTracer::finish(int trace)
+{
+	Record record;
+	record.control = pending[trace].control;
+	uint32_t previous = pending[trace].tsCapture;
+	for(uint i = 0; i < LATENCY_TRACE_STAGES; i++)
+	{
+		uint32_t duration = pending[trace].timestamps[i] - previous;
+		record.durations[i] = duration > 0xffff ? 0xffff : duration;
+		previous = pending[trace].timestamps[i];
+	}
+	records.insert(record);
+	pending[trace].active = false;
+}
+
+int LatencyTracer::start(uint8_t control, uint32_t tsCapture, uint32_t tsDebounced, uint32_t now)
+{
+	// Find a free slot (or the oldest trace if there is none)
+	int trace = 0;
+	for(int i = 0; i < LATENCY_TRACE_MAX_PENDING; i++)
+	{
+		if(!pending[i].active)
+		{
+			trace = i;
+			break;
+		}
+		if(serial - serials[i] > serial - serials[trace])
+			trace = i;
+	}
+	if(pending[trace].active)
+		abandoned++;
+
+	pending[trace].active = true;
+	pending[trace].stage = DEQUEUED;
+	pending[trace].control = control;
+	pending[trace].interfaces = 0;
+	pending[trace].tsCapture = tsCapture;
+	pending[trace].timestamps[DEBOUNCED] = tsDebounced;
+	pending[trace].timestamps[DEQUEUED] = now;
+	serials[trace] = serial++;
+	return trace;
+}
+
+void LatencyTracer::assembled(int trace, uint32_t now)
+{
+	if(trace < 0 || !pending[trace].active || pending[trace].stage != DEQUEUED)
+		return;
+	pending[trace].stage = ASSEMBLED;
+	pending[trace].timestamps[ASSEMBLED] = now;
+}
+
+void LatencyTracer::abandon(int trace)
+{
+	if(trace < 0 || !pending[trace].active)
+		return;
+	pending[trace].active = false;
+	abandoned++;
+}
+
+void LatencyTracer::assembledReports(uint8_t interfaces)
+{
+	for(int i = 0; i < LATENCY_TRACE_MAX_PENDING; i++)
+	{
+		if(!pending[i].active || pending[i].stage == QUEUED || pending[i].interfaces != 0)
+			continue;
+		// The action of the macro has been added to the reports in this round,
+		// so if it made a difference, one of them has changed
+		if(pending[i].stage == ASSEMBLED && interfaces != 0)
+			pending[i].interfaces = interfaces;
+		else
+			abandon(i);
+	}
+}
+
+void LatencyTracer::queued(uint8_t interface, uint32_t now)
+{
+	for(int i = 0; i < LATENCY_TRACE_MAX_PENDING; i++)
+	{
+		if(pending[i].active && pending[i].stage == ASSEMBLED && (pending[i].interfaces & (1u << interface)) != 0)
+		{
+			pending[i].stage = QUEUED;
+			pending[i].interfaces = 1u << interface;
+			pending[i].timestamps[QUEUED] = now;
+		}
+	}
+}
+
+void LatencyTracer::completed(uint8_t interface, uint32_t now)
+{
+	for(int i = 0; i < LATENCY_TRACE_MAX_PENDING; i++)
+	{
+		if(pending[i].active && pending[i].stage == QUEUED && (pending[i].interfaces & (1u << interface)) != 0)
+		{
+			pending[i].timestamps[COMPLETED] = now;
+			finish(i);
+		}
+	}
+}
+
+bool LatencyTracer::getRecord(Record& record)
+{
+	if(records.size() == 0)
+		return false;
+	record = records.extract();
+	return true;
+}
@@ -0,0 +1,232 @@
+/**
+ * \file latencytrace.h
+ * Tracing the latency of input events all the way to the USB host
+ */
+
+#ifndef _LATENCYTRACE_H
+#define _LATENCYTRACE_H
+
+#include"pico/stdlib.h"
+#include"input.h"
+
+/**
+ * \brief Number of stages of a trace (not counting the capture)
+ */
+#define LATENCY_TRACE_STAGES 5
+
+/**
+ * \brief Number of finished traces that are kept until they are read
+ * \details Must be a power of two. If more traces finish before they are
+ * read, the newer ones are dropped.
+ */
+#define LATENCY_TRACE_BUFFER_SIZE 64
+
+/**
+ * \brief Number of traces that can be in progress at the same time
+ * \details If more events are traced at once, the oldest trace in progress is
+ * abandoned.
+ */
+#define LATENCY_TRACE_MAX_PENDING 8
+
+/**
+ * \brief Number of finished traces per feature report
+ * \details Each trace takes 1 + 2 * LATENCY_TRACE_STAGES bytes.
+ */
+#define LATENCY_TRACE_RECORDS_PER_REPORT 5
+
+/**
+ * \brief Traces input events from their capture to the completion of the USB
+ * transfer carrying the resulting report
+ * \details A trace is started when the main loop takes an event out of the
+ * event queue of an input control. It carries the time the event was captured
+ * (first edge on the pin) and debounced, which are stored in the event itself.
+ * The trace then follows the macro that was started by the event: It notes
+ * when the first action of the macro has been added to a report, when that
+ * report has been handed to TinyUSB, and when its transfer to the host has
+ * been completed. Then the durations of the stages are stored in a ring buffer
+ * where they can be read (e.g. through a feature report).
+ * Traces that don't lead to a report (e.g. because the macro is empty or the
+ * report didn't change) are abandoned.
+ * All methods must be called from the same context (the main loop and the
+ * TinyUSB callbacks of Core 0), so no locking is needed. Timestamps are the
+ * lower 32 bits of the microseconds since boot (see time_us_32()).
+ */
+class LatencyTracer
+{
+public:
+	/**
+	 * \brief Stages of a trace
+	 * \details The duration of a stage is the time from the end of the
+	 * previous stage (or the capture of the event) to the end of this one.
+	 */
+	enum Stage
+	{
+		/// Capture to debounced event
+		DEBOUNCED,
+		/// Debounced event to extraction by the main loop
+		DEQUEUED,
+		/// Extraction to the first action added to a report
+		ASSEMBLED,
+		/// Report assembled to report handed to TinyUSB
+		QUEUED,
+		/// Report handed to TinyUSB to transfer completed
+		COMPLETED
+	};
+
+	/**
+	 * \brief A finished trace
+	 */
+	struct Record
+	{
+		/**
+		 * \brief The input control that caused the event
+		 * \details Switches are numbered from 0, knobs from
+		 * CONTROL_KNOB.
+		 */
+		uint8_t control;
+		/**
+		 * \brief Duration of each stage in microseconds (saturating at
+		 * 65535)
+		 */
+		uint16_t durations[LATENCY_TRACE_STAGES];
+	};
+
+	/**
+	 * \brief First control number for knobs
+	 */
+	static constexpr uint8_t CONTROL_KNOB = 0x10;
+
+private:
+	/**
+	 * \brief Traces in progress
+	 */
+	struct
+	{
+		/**
+		 * \brief Is this slot occupied?
+		 */
+		bool active;
+		/**
+		 * \brief Last stage that has been reached
+		 */
+		Stage stage;
+		/**
+		 * \brief The input control that caused the event
+		 */
+		uint8_t control;
+		/**
+		 * \brief Interfaces (bit i = interface i) whose reports carry the
+		 * traced action
+		 * \details Zero until the round of assembling reports is complete.
+		 * Once a report has been queued, only its interface is followed.
+		 */
+		uint8_t interfaces;
+		/**
+		 * \brief Time of the capture
+		 */
+		uint32_t tsCapture;
+		/**
+		 * \brief Time at which each stage has ended
+		 */
+		uint32_t timestamps[LATENCY_TRACE_STAGES];
+	} pending[LATENCY_TRACE_MAX_PENDING];
+
+	/**
+	 * \brief Finished traces
+	 */
+	EventQueue<Record, LATENCY_TRACE_BUFFER_SIZE> records;
+
+	/**
+	 * \brief Counter for the age of traces in progress
+	 * \details Used to find the oldest trace if all slots are occupied.
+	 */
+	uint32_t serial, serials[LATENCY_TRACE_MAX_PENDING];
+
+	/**
+	 * \brief Number of traces that have been abandoned
+	 */
+	uint32_t abandoned;
+
+	/**
+	 * \brief Stores a trace in progress as finished and frees its slot
+	 * \param trace Index of the trace.
+	 */
+	void finish(int trace);
+
+public:
+	/**
+	 * \brief Constructs a LatencyTracer without any traces
+	 */
+	LatencyTracer();
+
+	/**
+	 * \brief Starts a trace
+	 * \param control The input control that caused the event.
+	 * \param tsCapture Time at which the event was captured.
+	 * \param tsDebounced Time at which the event was put into the event queue.
+	 * \param now Time at which the event was taken out of the event queue.
+	 * \return Returns a handle for the trace that must be passed to the other
+	 * methods.
+	 */
+	int start(uint8_t control, uint32_t tsCapture, uint32_t tsDebounced, uint32_t now);
+
+	/**
+	 * \brief Notes that an action from the traced macro has been added to a
+	 * report
+	 * \details Only the first call for each trace has an effect.
+	 * \param trace Handle of the trace. Negative handles are ignored.
+	 * \param now Current time.
+	 */
+	void assembled(int trace, uint32_t now);
+
+	/**
+	 * \brief Abandons a trace
+	 * \param trace Handle of the trace. Negative handles are ignored.
+	 */
+	void abandon(int trace);
+
+	/**
+	 * \brief Notes which reports have changed in a round of assembling
+	 * reports
+	 * \details Must be called after each round. The traces whose action has
+	 * been added in this round now wait for one of the changed reports to be
+	 * handed to TinyUSB. If no report has changed, they are abandoned (as are
+	 * traces whose macro didn't add an action).
+	 * \param interfaces Interfaces whose report has changed (bit i =
+	 * interface i).
+	 */
+	void assembledReports(uint8_t interfaces);
+
+	/**
+	 * \brief Notes that a report has been handed to TinyUSB
+	 * \details All traces waiting for a report on this interface move on to
+	 * the QUEUED stage.
+	 * \param interface The interface number.
+	 * \param now Current time.
+	 */
+	void queued(uint8_t interface, uint32_t now);
+
+	/**
+	 * \brief Notes that a report has been transferred to the host
+	 * \details Called from tud_hid_report_complete_cb(). Finishes all traces
+	 * waiting for a report on this interface.
+	 * \param interface The interface number.
+	 * \param now Current time.
+	 */
+	void completed(uint8_t interface, uint32_t now);
+
+	/**
+	 * \brief Takes the oldest finished trace out of the buffer
+	 * \param[out] record Receives the trace.
+	 * \return Returns true if there was a finished trace, false otherwise.
+	 */
+	bool getRecord(Record& record);
+
+	/**
+	 * \brief Returns the number of traces that have been abandoned
+	 * \return The number of traces that didn't lead to a report.
+	 */
+	inline uint32_t getAbandoned() const {return abandoned;}
+};
+
+#endif // _LATENCYTRACE_H
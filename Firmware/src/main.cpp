@@ -13,15 +13,20 @@
 #include"settingstools.h"
 #include"input.h"
 #include"eeprom.h"
+#include"profilejournal.h"
 #include"hid.h"
+#include"latencytrace.h"
+#include"configchannel.h"
+#include"dirtypages.h"
 #include"display.h"
+#include"spscring.h"
 
 //-----------------------------------------------------------------------------
 // Global variables
 
-// Most of these variables are there to communicate status information from
-// Core 0 to Core 1. This means they are written by Core 0 and read by Core 1
-// which is why they need no synchronisation.
+// These variables are written by Core 0 and read by Core 1. Everything else
+// Core 1 needs to know is sent as UI events through a lock-free ring buffer
+// (see postUiEvent()).
 
 /**
  * \brief Settings
@@ -38,28 +43,39 @@ static volatile Mode mode = Mode::INITIALISING;
 // Core 1
 
 /**
- * \brief How long (in 50ms units) the turn indicator for a knob should be
- * hightlighted
+ * \brief Maximum number of frames per second
+ * \details Core 1 only redraws the displays when something has changed, but
+ * never more often than this.
+ */
+#define DISPLAY_MAX_FPS 60
+
+/**
+ * \brief How long (in ms) the turn indicator for a knob should be hightlighted
  */
-#define DISPLAY_KNOB_HIGHLIGHT_DURATION 2
+#define DISPLAY_KNOB_HIGHLIGHT_DURATION 100
 
 /**
- * \brief How long (in 50ms units) the move indicator for the slider should be
+ * \brief How long (in ms) the move indicator for the slider should be
  * hightlighted
  */
-#define DISPLAY_SLIDER_HIGHLIGHT_DURATION 5
+#define DISPLAY_SLIDER_HIGHLIGHT_DURATION 250
 
 /**
- * \brief How long (in 50ms units) the profile switching indicator should be
- * shown
+ * \brief How long (in ms) the profile switching indicator should be shown
  */
-#define DISPLAY_PROFILE_INDICATOR_DURATION 20
+#define DISPLAY_PROFILE_INDICATOR_DURATION 1000
+
+/**
+ * \brief Capacity of the ring buffer for UI events
+ * \details Must be a power of two.
+ */
+#define UI_EVENT_QUEUE_SIZE 64
 
 /**
  * \{
  * \brief Background image in normal mode
  */
-#include"background_normal.xbm"
+#include"background_normal_pages.h"
 // There are five spaces where a 38x30 image can be inserted, one for each of
 // the control inputs belonging to a display (knob left/right/push, left/right
 // key). These are the (upper left corner) coordinates of these spaces:
@@ -74,19 +90,19 @@ static volatile Mode mode = Mode::INITIALISING;
 #define IMG_KEY_RIGHT_X 88
 #define IMG_KEY_RIGHT_Y 32
 // Mask for the (non-rectangular) highlighted areas
-#include"background_mask_knob_press.xbm"
-#include"background_mask_key_left.xbm"
-#include"background_mask_key_right.xbm"
+#include"background_mask_knob_press_pages.h"
+#include"background_mask_key_left_pages.h"
+#include"background_mask_key_right_pages.h"
 /// \}
 
 /**
  * \{
  * \brief Background image for slider
  */
-#include"background_slider.xbm"
+#include"background_slider_pages.h"
 // Images for arrows
-#include"arrow_up.xbm"
-#include"arrow_down.xbm"
+#include"arrow_up_pages.h"
+#include"arrow_down_pages.h"
 // Position of the progress bar on the slider background
 #define IMG_SLIDER_X 48
 #define IMG_SLIDER_Y 57
@@ -100,52 +116,351 @@ static volatile Mode mode = Mode::INITIALISING;
  * \{
  * \brief Background image for maintenance mode
  */
-#include"background_maintenance.xbm"
+#include"background_maintenance_pages.h"
 /// \}
 
 /**
- * \brief Tells Core 1 which knobs to highlight and for how long
- * \details Set by Core 0, read and decremented by Core 1.
- * For performance reasons, we forego any kind of synchronisation mechanism.
- * Any glitch will be temporary.
+ * \brief Message from Core 0 telling Core 1 what has happened
+ * \details Core 1 keeps its own copy of everything it needs to know in order
+ * to render the displays. Core 0 only reports changes, so Core 1 can redraw
+ * just the affected parts of the displays.
+ */
+struct UiEvent
+{
+	/**
+	 * \brief Type of event
+	 */
+	enum Type : uint8_t
+	{
+		/// A key has been pressed (index: key)
+		KEY_DOWN,
+		/// A key has been released (index: key)
+		KEY_UP,
+		/// A knob has been turned one notch to the left (index: knob)
+		KNOB_LEFT,
+		/// A knob has been turned one notch to the right (index: knob)
+		KNOB_RIGHT,
+		/// The slider has been moved (value: position, delta: direction)
+		SLIDER,
+		/// Another profile has been activated (index: profile)
+		PROFILE,
+		/// The operating mode has changed (index: mode)
+		MODE,
+		/// USB has been suspended
+		SUSPEND,
+		/// USB has been resumed
+		RESUME
+	} type;
+
+	/**
+	 * \brief Index of the control, profile or mode
+	 */
+	uint8_t index;
+
+	/**
+	 * \brief Position of the slider
+	 */
+	uint8_t value;
+
+	/**
+	 * \brief Direction in which the slider has been moved
+	 */
+	int8_t delta;
+
+	/**
+	 * \brief When the event has happened
+	 */
+	absolute_time_t time;
+};
+
+/**
+ * \brief Ring buffer for sending UI events from Core 0 to Core 1
+ * \details Core 0 is the only producer and Core 1 the only consumer.
  */
-static volatile uint8_t displayHighlightKnobs[6] = {0, 0, 0, 0, 0, 0};
+static SpscRing<UiEvent, UI_EVENT_QUEUE_SIZE> uiEvents;
 
 /**
- * \brief Tells Core 1 which keys to highlight
- * \details Set and reset by Core 0, read by Core 1.
+ * \brief Counts how often UI events have been lost because the ring buffer
+ * was full
+ * \details Only written by Core 0. Core 1 resets its state and redraws
+ * everything whenever this changes.
  */
-static volatile bool displayHighlightKeys[9] = {false, false, false, false, false, false, false, false, false};
+static std::atomic<uint32_t> uiEventsLost(0);
 
 /**
- * \brief Tells Core 1 whether (and how long) to show the slider indicator
- * \details Set by Core 0, read and decremented by Core 1.
- * For performance reasons, we forego any kind of synchronisation mechanism.
- * Any glitch will be temporary.
+ * \brief Keys that Core 1 has been told are pressed
+ * \details Only used by Core 0.
  */
-uint8_t displaySlider = 0;
+static bool uiKeysPressed[9] = {false, false, false, false, false, false, false, false, false};
 
 /**
- * \{
- * \brief Tells Core 1 what value should be shown for the slider and which
- * direction it was last moved
- * \details Set by Core 0, read by Core 1.
+ * \brief Sends a UI event to Core 1
+ * \details Must only be called by Core 0. Never blocks. Wakes up Core 1 if it
+ * is waiting for events.
+ * \param type Type of the event.
+ * \param index Index of the control, profile or mode.
+ * \param value Position of the slider.
+ * \param delta Direction of the slider movement.
  */
-uint displaySliderValue = 0;
-int displaySliderDirection = 0;
-/// \}
+static void postUiEvent(UiEvent::Type type, uint8_t index = 0, uint8_t value = 0, int8_t delta = 0)
+{
+	UiEvent event = {type, index, value, delta, get_absolute_time()};
+	if(!uiEvents.push(event))
+	{
+		// Core 1 will reset its state, so key presses must be sent again
+		memset(uiKeysPressed, 0, sizeof(uiKeysPressed));
+		uiEventsLost.store(uiEventsLost.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	__sev();
+}
+
+/**
+ * \brief Images of the active profile in the page-major format of the displays
+ * \details The images in the settings are row-major. Core 1 converts them
+ * once whenever the active profile changes or the settings may have been
+ * modified, rather than for every frame.
+ */
+struct ProfileImages
+{
+	/// Index of the profile these images belong to (NUM_PROFILES if invalid)
+	uint8_t profile = NUM_PROFILES;
+	/// Picture of the profile
+	PageBitmapBuffer<IMG_PROFILE_WIDTH, IMG_PROFILE_HEIGHT> image;
+	/// Images of the keys
+	PageBitmapBuffer<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT> keys[9];
+	/// Images of the knobs
+	PageBitmapBuffer<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT> knobsLeft[3], knobsRight[3];
+	/// Image of the slider
+	PageBitmapBuffer<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT> slider;
+
+	/**
+	 * \brief Converts the images of a profile
+	 * \param index Index of the profile.
+	 * \param p The profile.
+	 */
+	void convert(uint8_t index, const Profile& p)
+	{
+		image.convert(Bitmap<IMG_PROFILE_WIDTH, IMG_PROFILE_HEIGHT>(p.image));
+		for(uint i = 0; i < 9; i++)
+			keys[i].convert(Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>(p.keys[i].image));
+		for(uint i = 0; i < 3; i++)
+		{
+			knobsLeft[i].convert(Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>(p.knobs[i].imageLeft));
+			knobsRight[i].convert(Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>(p.knobs[i].imageRight));
+		}
+		slider.convert(Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>(p.slider.image));
+		profile = index;
+	}
+};
+
+/**
+ * \brief Cache for the images of the active profile
+ * \details Only used by Core 1. Too large for its stack.
+ */
+static ProfileImages profileImages;
+
+/**
+ * \brief A rectangular part of a display
+ * \details Left and top are inclusive, right and bottom exclusive. A region
+ * is empty if left >= right or top >= bottom.
+ */
+struct Region
+{
+	int left, top, right, bottom;
+
+	/**
+	 * \brief Determines whether the region is empty
+	 */
+	inline bool isEmpty() const {return left >= right || top >= bottom;}
+
+	/**
+	 * \brief Extends the region to include another one
+	 */
+	inline void add(const Region& r)
+	{
+		if(r.isEmpty())
+			return;
+		if(isEmpty())
+		{
+			*this = r;
+			return;
+		}
+		left = MIN(left, r.left);
+		top = MIN(top, r.top);
+		right = MAX(right, r.right);
+		bottom = MAX(bottom, r.bottom);
+	}
+};
 
 /**
- * \brief Tells Core 1 whether (and how long) to show the profile switch indicator
- * \details Set by Core 0, read and decremented by Core 1.
- * For performance reasons, we forego any kind of synchronisation mechanism.
- * Any glitch will be temporary.
+ * \brief Region covering a whole display
  */
-uint8_t displayProfile = 0;
+static const Region FULL_REGION = {0, 0, 128, 64};
+
+/**
+ * \brief Region covering nothing
+ */
+static const Region EMPTY_REGION = {0, 0, 0, 0};
+
+/**
+ * \brief Region of the slider indicator that changes with the slider position
+ * \details Progress bar, arrow and text.
+ */
+static const Region SLIDER_VALUE_REGION = {IMG_SLIDER_X, 0, 128, 64};
+
+/**
+ * \brief Determines the smallest region containing all set pixels of a bitmap
+ * \param bitmap The bitmap.
+ * \return Returns the bounding box.
+ */
+template<uint width, uint height>
+static Region boundingBox(const PageBitmap<width, height>& bitmap)
+{
+	Region r = EMPTY_REGION;
+	for(uint y = 0; y < height; y++)
+		for(uint x = 0; x < width; x++)
+			if(bitmap.getPixel(x, y))
+				r.add({static_cast<int>(x), static_cast<int>(y), static_cast<int>(x) + 1, static_cast<int>(y) + 1});
+	return r;
+}
+
+/**
+ * \brief Everything Core 1 needs to know to render the displays
+ * \details Updated from the UI events sent by Core 0. Only used by Core 1.
+ */
+struct UiState
+{
+	/// Operating mode
+	Mode mode = Mode::INITIALISING;
+	/// Whether USB is suspended (and the displays are turned off)
+	bool suspended = false;
+	/// Keys that are currently pressed
+	bool highlightKeys[9] = {false, false, false, false, false, false, false, false, false};
+	/// Until when knob turns are highlighted (nil_time if not highlighted)
+	absolute_time_t highlightKnobs[6] = {nil_time, nil_time, nil_time, nil_time, nil_time, nil_time};
+	/// Until when the slider indicator is shown (nil_time if not shown)
+	absolute_time_t sliderIndicator = nil_time;
+	/// Position of the slider
+	uint8_t sliderValue = 0;
+	/// Direction in which the slider was last moved
+	int8_t sliderDirection = 0;
+	/// Until when the profile indicator is shown (nil_time if not shown)
+	absolute_time_t profileIndicator = nil_time;
+};
+
+/**
+ * \brief Location of the keys and knob turn indicators on the displays
+ * \details Filled in by main1().
+ */
+static struct
+{
+	/// Index of the display showing a key
+	uint8_t keyDisplays[9];
+	/// Region of a key's image and highlight
+	Region keyRegions[9];
+	/// Index of the display showing a knob turn
+	uint8_t knobDisplays[6];
+	/// Region of a knob turn's image
+	Region knobRegions[6];
+} uiLayout;
+
+/**
+ * \brief Renders a display
+ * \details Draws everything, but the drawing operations are usually limited
+ * to the invalidated region by a clipping rectangle.
+ * \param display The display.
+ * \param i Index of the display.
+ * \param ui What to show.
+ */
+static void renderDisplay(Display& display, uint i, const UiState& ui)
+{
+	display.fill(0);
+	switch(ui.mode)
+	{
+		case Mode::INITIALISING:
+		{
+			if(i == 1)
+			{
+				display.drawText(64, 21, "MacroPad", 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+				char buf[16];
+				snprintf(buf, sizeof(buf), "Version %u.%u", VERSION >> 8, VERSION & 0xff);
+				display.drawText(64, 42, buf, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+			}
+			break;
+		}
+		case Mode::NORMAL:
+		{
+			if(!is_nil_time(ui.profileIndicator))
+			{
+				if(i == 0)
+				{
+					// Print name and number of profile on left display
+					char buf[11];
+					snprintf(buf, sizeof(buf), "Profile %u", settings.activeProfile + 1);
+					display.drawText(64, 21, buf, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+					display.drawText(64, 42, getActiveProfile(settings).name, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+				}
+				else if(i == 1)
+					// Show profile picture on middle display
+					display.drawBitmap(0, 0, profileImages.image.getBitmap());
+			}
+			else if(i == 0 && !is_nil_time(ui.sliderIndicator)) // Display 1 is special b/c of the slider
+			{
+				display.drawBitmap(0, 0, PageBitmap<BACKGROUND_SLIDER_WIDTH, BACKGROUND_SLIDER_HEIGHT>(BACKGROUND_SLIDER_PAGES));
+				display.drawBitmap(2, 17, profileImages.slider.getBitmap());
+				display.fillRect(IMG_SLIDER_X, IMG_SLIDER_Y, IMG_SLIDER_WIDTH, -(int)ui.sliderValue * IMG_SLIDER_HEIGHT / 255, 1);
+				if(ui.sliderDirection > 0)
+					display.drawBitmap(IMG_ARROW_X, IMG_ARROW_Y, PageBitmap<ARROW_UP_WIDTH, ARROW_UP_HEIGHT>(ARROW_UP_PAGES));
+				else if(ui.sliderDirection < 0)
+					display.drawBitmap(IMG_ARROW_X, IMG_ARROW_Y, PageBitmap<ARROW_DOWN_WIDTH, ARROW_DOWN_HEIGHT>(ARROW_DOWN_PAGES));
+				// Print slider value
+				char buf[6];
+				snprintf(buf, sizeof(buf), "%u %%", (uint)ui.sliderValue * 100 / 255);
+				display.drawText(90, 26, buf, 0, DEFAULT_FONT);
+			}
+			else
+			{
+				display.drawBitmap(0, 0, PageBitmap<BKGND_NORMAL_WIDTH, BKGND_NORMAL_HEIGHT>(BKGND_NORMAL_PAGES));
+				// Left key
+				display.drawBitmap(IMG_KEY_LEFT_X, IMG_KEY_LEFT_Y, profileImages.keys[2 * i].getBitmap());
+				if(ui.highlightKeys[2 * i])
+					display.drawBitmap(0, 0, PageBitmap<BACKGROUND_MASK_KEY_LEFT_WIDTH, BACKGROUND_MASK_KEY_LEFT_HEIGHT>(BACKGROUND_MASK_KEY_LEFT_PAGES), RasterOperation::XOR);
+				// Right key
+				display.drawBitmap(IMG_KEY_RIGHT_X, IMG_KEY_RIGHT_Y, profileImages.keys[2 * i + 1].getBitmap());
+				if(ui.highlightKeys[2 * i + 1])
+					display.drawBitmap(0, 0, PageBitmap<BACKGROUND_MASK_KEY_RIGHT_WIDTH, BACKGROUND_MASK_KEY_RIGHT_HEIGHT>(BACKGROUND_MASK_KEY_RIGHT_PAGES), RasterOperation::XOR);
+				// Knob left
+				display.drawBitmap(IMG_ROT_LEFT_X, IMG_ROT_LEFT_Y, profileImages.knobsLeft[i].getBitmap(), !is_nil_time(ui.highlightKnobs[2 * i]) ? RasterOperation::SRCINV : RasterOperation::SRC);
+				// Knob right
+				display.drawBitmap(IMG_ROT_RIGHT_X, IMG_ROT_RIGHT_Y, profileImages.knobsRight[i].getBitmap(), !is_nil_time(ui.highlightKnobs[2 * i + 1]) ? RasterOperation::SRCINV : RasterOperation::SRC);
+				// Knob press
+				display.drawBitmap(IMG_ROT_PRESS_X, IMG_ROT_PRESS_Y, profileImages.keys[6 + i].getBitmap());
+				if(ui.highlightKeys[6 + i])
+					display.drawBitmap(0, 0, PageBitmap<BACKGROUND_MASK_KNOB_PRESS_WIDTH, BACKGROUND_MASK_KNOB_PRESS_HEIGHT>(BACKGROUND_MASK_KNOB_PRESS_PAGES), RasterOperation::XOR);
+			}
+			break;
+		}
+		case Mode::MAINTENANCE:
+		case Mode::LOADING_SETTINGS:
+		case Mode::STORING_SETTINGS:
+		{
+			if(i == 0)
+			{
+				const char* text = ui.mode == Mode::LOADING_SETTINGS ? "Reading EEPROM" : (ui.mode == Mode::STORING_SETTINGS ? "Writing EEPROM" : "Maintenance Mode");
+				display.drawText(64, 32, text, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+			}
+			else if(i == 1)
+				display.drawBitmap(0, 0, PageBitmap<BKGND_MAINTENANCE_WIDTH, BKGND_MAINTENANCE_HEIGHT>(BKGND_MAINTENANCE_PAGES));
+			break;
+		}
+	}
+}
 
 /**
  * \brief Core 1 main function
- * \details Core 1 is responsible for the displays.
+ * \details Core 1 is responsible for the displays. It sleeps until Core 0
+ * sends a UI event or a highlight expires, and then redraws the parts of the
+ * displays that are affected.
  */
 void main1()
 {
@@ -171,132 +486,229 @@ void main1()
 		Display(spi0, 2, 4),
 		Display(spi0, 3, 4)
 	};
-	for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
+	const uint numDisplays = sizeof(displays) / sizeof(Display);
+	for(uint i = 0; i < numDisplays; i++)
 		displays[i].init();
 
 	// Turn displays on
-	for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
+	for(uint i = 0; i < numDisplays; i++)
 		displays[i].turnOnOff(true);
 
+	// From now on, framebuffers are transferred via DMA
+	DisplayBus displayBus(spi0, displays, numDisplays);
+
+	// Work out which parts of the displays belong to which control
+	Region keyLeftMask = boundingBox(PageBitmap<BACKGROUND_MASK_KEY_LEFT_WIDTH, BACKGROUND_MASK_KEY_LEFT_HEIGHT>(BACKGROUND_MASK_KEY_LEFT_PAGES));
+	Region keyRightMask = boundingBox(PageBitmap<BACKGROUND_MASK_KEY_RIGHT_WIDTH, BACKGROUND_MASK_KEY_RIGHT_HEIGHT>(BACKGROUND_MASK_KEY_RIGHT_PAGES));
+	Region knobPressMask = boundingBox(PageBitmap<BACKGROUND_MASK_KNOB_PRESS_WIDTH, BACKGROUND_MASK_KNOB_PRESS_HEIGHT>(BACKGROUND_MASK_KNOB_PRESS_PAGES));
+	for(uint i = 0; i < numDisplays; i++)
+	{
+		uiLayout.keyDisplays[2 * i] = uiLayout.keyDisplays[2 * i + 1] = uiLayout.keyDisplays[6 + i] = i;
+		uiLayout.keyRegions[2 * i] = {IMG_KEY_LEFT_X, IMG_KEY_LEFT_Y, IMG_KEY_LEFT_X + IMG_CTRL_WIDTH, IMG_KEY_LEFT_Y + IMG_CTRL_HEIGHT};
+		uiLayout.keyRegions[2 * i].add(keyLeftMask);
+		uiLayout.keyRegions[2 * i + 1] = {IMG_KEY_RIGHT_X, IMG_KEY_RIGHT_Y, IMG_KEY_RIGHT_X + IMG_CTRL_WIDTH, IMG_KEY_RIGHT_Y + IMG_CTRL_HEIGHT};
+		uiLayout.keyRegions[2 * i + 1].add(keyRightMask);
+		uiLayout.keyRegions[6 + i] = {IMG_ROT_PRESS_X, IMG_ROT_PRESS_Y, IMG_ROT_PRESS_X + IMG_CTRL_WIDTH, IMG_ROT_PRESS_Y + IMG_CTRL_HEIGHT};
+		uiLayout.keyRegions[6 + i].add(knobPressMask);
+		uiLayout.knobDisplays[2 * i] = uiLayout.knobDisplays[2 * i + 1] = i;
+		uiLayout.knobRegions[2 * i] = {IMG_ROT_LEFT_X, IMG_ROT_LEFT_Y, IMG_ROT_LEFT_X + IMG_CTRL_WIDTH, IMG_ROT_LEFT_Y + IMG_CTRL_HEIGHT};
+		uiLayout.knobRegions[2 * i + 1] = {IMG_ROT_RIGHT_X, IMG_ROT_RIGHT_Y, IMG_ROT_RIGHT_X + IMG_CTRL_WIDTH, IMG_ROT_RIGHT_Y + IMG_CTRL_HEIGHT};
+	}
+
+	// Parts of the displays that need to be redrawn
+	Region invalid[numDisplays];
+	auto invalidateAll = [&]()
+	{
+		for(uint i = 0; i < numDisplays; i++)
+			invalid[i] = FULL_REGION;
+	};
+	invalidateAll();
+
 	// Main loop
-	absolute_time_t lastUpdate = from_us_since_boot(0);
+	UiState ui;
+	uint32_t uiEventsSeenLost = 0;
+	absolute_time_t nextFrame = get_absolute_time();
 	while(1)
 	{
-		// Sleep during USB suspension
-		if(tud_suspended())
+		// 1.) Process UI events
+		absolute_time_t now = get_absolute_time();
+		uint32_t lost = uiEventsLost.load(std::memory_order_acquire);
+		if(lost != uiEventsSeenLost)
 		{
-			// Turn displays off
-			for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-				displays[i].turnOnOff(false);
-			// Sleep until resumed
-			while(tud_suspended())
-				__wfe();
-			// Turn displays on
-			for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-				displays[i].turnOnOff(true);
+			// Start over from what Core 0 knows for sure. Events that are
+			// still in the ring buffer are applied afterwards.
+			uiEventsSeenLost = lost;
+			ui.mode = mode;
+			for(uint i = 0; i < 9; i++)
+				ui.highlightKeys[i] = false;
+			profileImages.profile = NUM_PROFILES;
+			invalidateAll();
 		}
-		// Update displays
-		absolute_time_t now = get_absolute_time();
-		if(absolute_time_diff_us(lastUpdate, now) >= 50000)
+		UiEvent event;
+		while(uiEvents.pop(event))
 		{
-			for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-				displays[i].fill(0);
-			switch(mode)
+			// In normal mode, the slider indicator (on display 0) and the
+			// profile indicator (on all displays) hide everything else
+			bool normal = ui.mode == Mode::NORMAL && is_nil_time(ui.profileIndicator);
+			switch(event.type)
 			{
-				case Mode::INITIALISING:
+				case UiEvent::KEY_DOWN:
+				case UiEvent::KEY_UP:
 				{
-					// Show empty screens
-					for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-						displays[i].fill(0);
-					displays[1].drawText(64, 21, "MacroPad", 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-					char buf[16];
-					snprintf(buf, sizeof(buf), "Version %u.%u", VERSION >> 8, VERSION & 0xff);
-					displays[1].drawText(64, 42, buf, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
+					if(event.index >= 9)
+						break;
+					ui.highlightKeys[event.index] = event.type == UiEvent::KEY_DOWN;
+					uint d = uiLayout.keyDisplays[event.index];
+					if(normal && !(d == 0 && !is_nil_time(ui.sliderIndicator)))
+						invalid[d].add(uiLayout.keyRegions[event.index]);
 					break;
 				}
-				case Mode::NORMAL:
+				case UiEvent::KNOB_LEFT:
+				case UiEvent::KNOB_RIGHT:
 				{
-					if(displayProfile > 0)
-					{
-						// Print name and number of profile on left display
-						char buf[11];
-						snprintf(buf, sizeof(buf), "Profile %u", settings.activeProfile + 1);
-						displays[0].drawText(64, 21, buf, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-						displays[0].drawText(64, 42, getActiveProfile(settings).name, 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-						// Show profile picture on middle display
-						displays[1].drawBitmap(0, 0, Bitmap<IMG_PROFILE_WIDTH, IMG_PROFILE_HEIGHT>(getActiveProfile(settings).image));
-						displayProfile--;
-					}
-					else
-					{
-						Bitmap<BKGND_NORMAL_WIDTH, BKGND_NORMAL_HEIGHT> background(BKGND_NORMAL_BITS);
-						for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-						{
-							if(i == 0 && displaySlider > 0) // Display 1 is special b/c of the slider
-							{
-								displays[i].drawBitmap(0, 0, Bitmap<BACKGROUND_SLIDER_WIDTH, BACKGROUND_SLIDER_HEIGHT>(BACKGROUND_SLIDER_BITS));
-								displays[i].drawBitmap(2, 17, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>(getActiveProfile(settings).slider.image));
-								displays[i].fillRect(IMG_SLIDER_X, IMG_SLIDER_Y, IMG_SLIDER_WIDTH, -(int)displaySliderValue * IMG_SLIDER_HEIGHT / 255, 1);
-								if(displaySliderDirection > 0)
-									displays[i].drawBitmap(IMG_ARROW_X, IMG_ARROW_Y, Bitmap<ARROW_UP_WIDTH, ARROW_UP_HEIGHT>(ARROW_UP_BITS));
-								else if(displaySliderDirection < 0)
-									displays[i].drawBitmap(IMG_ARROW_X, IMG_ARROW_Y, Bitmap<ARROW_DOWN_WIDTH, ARROW_DOWN_HEIGHT>(ARROW_DOWN_BITS));
-								// Print slider value
-								char buf[6];
-								snprintf(buf, sizeof(buf), "%u %%", (uint)displaySliderValue * 100 / 255);
-								displays[i].drawText(90, 26, buf, 0, DEFAULT_FONT);
-								displaySlider--;
-							}
-							else
-							{
-								displays[i].drawBitmap(0, 0, background);
-								// Left key
-								displays[i].drawBitmap(IMG_KEY_LEFT_X, IMG_KEY_LEFT_Y, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>((const uint8_t*)getActiveProfile(settings).keys[2 * i].image));
-								if(displayHighlightKeys[2 * i])
-									displays[i].drawBitmap(0, 0, Bitmap<BACKGROUND_MASK_KEY_LEFT_WIDTH, BACKGROUND_MASK_KEY_LEFT_HEIGHT>(BACKGROUND_MASK_KEY_LEFT_BITS), RasterOperation::XOR);
-								// Right key
-								displays[i].drawBitmap(IMG_KEY_RIGHT_X, IMG_KEY_RIGHT_Y, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>((const uint8_t*)getActiveProfile(settings).keys[2 * i + 1].image));
-								if(displayHighlightKeys[2 * i + 1])
-									displays[i].drawBitmap(0, 0, Bitmap<BACKGROUND_MASK_KEY_RIGHT_WIDTH, BACKGROUND_MASK_KEY_RIGHT_HEIGHT>(BACKGROUND_MASK_KEY_RIGHT_BITS), RasterOperation::XOR);
-								// Knob left
-								displays[i].drawBitmap(IMG_ROT_LEFT_X, IMG_ROT_LEFT_Y, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>((const uint8_t*)getActiveProfile(settings).knobs[i].imageLeft), displayHighlightKnobs[2 * i] > 0 ? RasterOperation::SRCINV : RasterOperation::SRC);
-								// Knob right
-								displays[i].drawBitmap(IMG_ROT_RIGHT_X, IMG_ROT_RIGHT_Y, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>((const uint8_t*)getActiveProfile(settings).knobs[i].imageRight), displayHighlightKnobs[2 * i + 1] > 0 ? RasterOperation::SRCINV : RasterOperation::SRC);
-								// Knob press
-								displays[i].drawBitmap(IMG_ROT_PRESS_X, IMG_ROT_PRESS_Y, Bitmap<IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT>((const uint8_t*)getActiveProfile(settings).keys[6 + i].image));
-								if(displayHighlightKeys[6 + i])
-									displays[i].drawBitmap(0, 0, Bitmap<BACKGROUND_MASK_KNOB_PRESS_WIDTH, BACKGROUND_MASK_KNOB_PRESS_HEIGHT>(BACKGROUND_MASK_KNOB_PRESS_BITS), RasterOperation::XOR);
-							}
-						}
-					}
-					for(uint i = 0; i < 6; i++)
-						if(displayHighlightKnobs[i] > 0)
-							displayHighlightKnobs[i]--;
+					if(event.index >= 3)
+						break;
+					uint k = 2 * event.index + (event.type == UiEvent::KNOB_RIGHT ? 1 : 0);
+					ui.highlightKnobs[k] = delayed_by_ms(event.time, DISPLAY_KNOB_HIGHLIGHT_DURATION);
+					uint d = uiLayout.knobDisplays[k];
+					if(normal && !(d == 0 && !is_nil_time(ui.sliderIndicator)))
+						invalid[d].add(uiLayout.knobRegions[k]);
+					break;
+				}
+				case UiEvent::SLIDER:
+				{
+					// Switching between the normal screen and the slider
+					// indicator requires redrawing the whole display
+					invalid[0].add(normal && !is_nil_time(ui.sliderIndicator) ? SLIDER_VALUE_REGION : FULL_REGION);
+					ui.sliderIndicator = delayed_by_ms(event.time, DISPLAY_SLIDER_HIGHLIGHT_DURATION);
+					ui.sliderValue = event.value;
+					ui.sliderDirection = event.delta;
 					break;
 				}
-				case Mode::MAINTENANCE:
+				case UiEvent::PROFILE:
 				{
-					displays[0].drawText(64, 32, "Maintenance Mode", 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-					displays[1].drawBitmap(0, 0, Bitmap<BKGND_MAINTENANCE_WIDTH, BKGND_MAINTENANCE_HEIGHT>(BKGND_MAINTENANCE_BITS));
+					ui.profileIndicator = delayed_by_ms(event.time, DISPLAY_PROFILE_INDICATOR_DURATION);
+					invalidateAll();
 					break;
 				}
-				case Mode::LOADING_SETTINGS:
+				case UiEvent::MODE:
 				{
-					displays[0].drawText(64, 32, "Reading EEPROM", 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-					displays[1].drawBitmap(0, 0, Bitmap<BKGND_MAINTENANCE_WIDTH, BKGND_MAINTENANCE_HEIGHT>(BKGND_MAINTENANCE_BITS));
+					ui.mode = static_cast<Mode>(event.index);
+					// Key states are sent again (see setMode()) and the
+					// settings might have changed
+					for(uint i = 0; i < 9; i++)
+						ui.highlightKeys[i] = false;
+					profileImages.profile = NUM_PROFILES;
+					invalidateAll();
 					break;
 				}
-				case Mode::STORING_SETTINGS:
+				case UiEvent::SUSPEND:
 				{
-					displays[0].drawText(64, 32, "Writing EEPROM", 0, DEFAULT_FONT, HorizontalAlignment::CENTER, VerticalAlignment::MIDDLE);
-					displays[1].drawBitmap(0, 0, Bitmap<BKGND_MAINTENANCE_WIDTH, BKGND_MAINTENANCE_HEIGHT>(BKGND_MAINTENANCE_BITS));
+					if(ui.suspended)
+						break;
+					ui.suspended = true;
+					// The SPI must be idle before sending commands
+					displayBus.waitForFlush();
+					for(uint i = 0; i < numDisplays; i++)
+						displays[i].turnOnOff(false);
 					break;
 				}
+				case UiEvent::RESUME:
+				{
+					if(!ui.suspended)
+						break;
+					ui.suspended = false;
+					for(uint i = 0; i < numDisplays; i++)
+						displays[i].turnOnOff(true);
+					break;
+				}
+			}
+		}
+
+		// 2.) Remove expired highlights and find out when the next one expires
+		absolute_time_t wakeUp = at_the_end_of_time;
+		auto wakeUpAt = [&](absolute_time_t t)
+		{
+			if(absolute_time_diff_us(t, wakeUp) > 0)
+				wakeUp = t;
+		};
+		for(uint k = 0; k < 6; k++)
+		{
+			if(is_nil_time(ui.highlightKnobs[k]))
+				continue;
+			if(absolute_time_diff_us(now, ui.highlightKnobs[k]) <= 0)
+			{
+				ui.highlightKnobs[k] = nil_time;
+				invalid[uiLayout.knobDisplays[k]].add(uiLayout.knobRegions[k]);
+			}
+			else
+				wakeUpAt(ui.highlightKnobs[k]);
+		}
+		if(!is_nil_time(ui.sliderIndicator))
+		{
+			if(absolute_time_diff_us(now, ui.sliderIndicator) <= 0)
+			{
+				ui.sliderIndicator = nil_time;
+				invalid[0] = FULL_REGION;
+			}
+			else
+				wakeUpAt(ui.sliderIndicator);
+		}
+		if(!is_nil_time(ui.profileIndicator))
+		{
+			if(absolute_time_diff_us(now, ui.profileIndicator) <= 0)
+			{
+				ui.profileIndicator = nil_time;
+				invalidateAll();
+			}
+			else
+				wakeUpAt(ui.profileIndicator);
+		}
+
+		// 3.) Redraw the invalid regions, but not more often than allowed
+		bool pending = false;
+		for(uint i = 0; i < numDisplays; i++)
+			pending |= !invalid[i].isEmpty();
+		if(pending && !ui.suspended)
+		{
+			if(absolute_time_diff_us(nextFrame, now) >= 0)
+			{
+				// Convert the profile images when (re-)entering normal mode
+				// (the settings might have changed) or after switching
+				// profiles
+				if(ui.mode == Mode::NORMAL && profileImages.profile != settings.activeProfile)
+				{
+					profileImages.convert(settings.activeProfile, getActiveProfile(settings));
+					invalidateAll();
+				}
+				// The framebuffers can be drawn into while the previous frame
+				// is still being sent (see DisplayBus::startFlush())
+				for(uint i = 0; i < numDisplays; i++)
+				{
+					if(invalid[i].isEmpty())
+						continue;
+					displays[i].setClipRect(invalid[i].left, invalid[i].top, invalid[i].right - invalid[i].left, invalid[i].bottom - invalid[i].top);
+					renderDisplay(displays[i], i, ui);
+					displays[i].resetClipRect();
+					invalid[i] = EMPTY_REGION;
+				}
+				// Start transferring the new frame once the previous one has
+				// gone out. The next frame can be drawn while this one is
+				// being sent.
+				displayBus.waitForFlush();
+				displayBus.startFlush();
+				nextFrame = delayed_by_us(now, 1000000 / DISPLAY_MAX_FPS);
 			}
-			for(uint i = 0; i < sizeof(displays) / sizeof(Display); i++)
-				displays[i].update();
-			lastUpdate = now;
+			else
+				wakeUpAt(nextFrame);
 		}
+
+		// 4.) Sleep until Core 0 sends an event (postUiEvent() executes SEV)
+		// or it is time to do something
+		if(to_us_since_boot(wakeUp) == to_us_since_boot(at_the_end_of_time))
+			__wfe();
+		else
+			best_effort_wfe_or_timeout(wakeUp);
 	}
 }
 
@@ -308,6 +720,141 @@ void main1()
  */
 EepRom eeprom(i2c1, 400000, EEPROM_24C512);
 
+/**
+ * \brief EEPROM address of the potentiometer calibration
+ * \details The calibration is stored behind the Settings struct, in a part of
+ * the EEPROM that the host cannot access. This way, it survives loading
+ * default settings or settings from the host. The address is at the start of
+ * an EEPROM page, so the calibration can be written in one go.
+ */
+#define CALIBRATION_ADDRESS 0xff00
+static_assert(CALIBRATION_ADDRESS >= sizeof(Settings), "Calibration overlaps with settings in EEPROM");
+
+/**
+ * \brief Stored calibration of the potentiometers
+ * \details There is one entry per ADC channel. The checksum is the sum of
+ * all other 16-bit words, plus CALIBRATION_CHECKSUM_SEED. An erased EEPROM
+ * (all 0xff) doesn't contain a valid calibration.
+ */
+static struct
+{
+	Potentiometer::Calibration adcChannels[4];
+	uint16_t checksum;
+} calibration;
+
+/**
+ * \brief Seed for the checksum of the stored calibration
+ */
+#define CALIBRATION_CHECKSUM_SEED 0xca1b
+
+/**
+ * \brief Computes the checksum of the calibration
+ * \return The checksum.
+ */
+static uint16_t calcCalibrationChecksum()
+{
+	uint16_t checksum = CALIBRATION_CHECKSUM_SEED;
+	for(const Potentiometer::Calibration& c : calibration.adcChannels)
+		checksum += c.adcMin + c.adcMax;
+	return checksum;
+}
+
+/**
+ * \brief EEPROM address and size of the journal of the active profile
+ * \details Like the calibration, the journal is stored behind the Settings
+ * struct where the host cannot access it. Each record takes 4 bytes.
+ */
+#define PROFILE_JOURNAL_ADDRESS 0xfd00
+#define PROFILE_JOURNAL_SIZE 0x200
+static_assert(PROFILE_JOURNAL_ADDRESS >= sizeof(Settings), "Profile journal overlaps with settings in EEPROM");
+static_assert(PROFILE_JOURNAL_ADDRESS + PROFILE_JOURNAL_SIZE <= CALIBRATION_ADDRESS, "Profile journal overlaps with calibration in EEPROM");
+
+/**
+ * \brief Journal of the active profile
+ * \details The active profile is persisted here rather than in the Settings
+ * struct in EEPROM (see ProfileJournal). When the settings are loaded, the
+ * profile from the journal takes precedence.
+ */
+static ProfileJournal profileJournal(eeprom, PROFILE_JOURNAL_ADDRESS, PROFILE_JOURNAL_SIZE);
+
+/**
+ * \brief Granularity (in bytes) of the tracking of modified settings
+ * \details Must be a multiple of the page size of the EEPROM (64 bytes for the
+ * 24C512, see EepRom::getPageSize()).
+ */
+#define SETTINGS_PAGE_SIZE 64
+
+/**
+ * \brief Pages of the settings that have been modified since they were last
+ * stored in EEPROM
+ * \details Only accessed from the main loop and the TinyUSB callbacks.
+ */
+static DirtyPages<sizeof(Settings), SETTINGS_PAGE_SIZE> settingsPages;
+
+/**
+ * \brief Should the modified pages of the settings be stored in EEPROM?
+ * \details Set when the host asks for the settings to be stored. The main loop
+ * then stores the pages in the background (outside of maintenance mode) and
+ * resets it once they are all done (or storing them failed), i.e. once there
+ * are no modified pages left and no EEPROM request of its own is running.
+ * Until then, Mode::STORING_SETTINGS is reported to the host.
+ */
+static bool persistSettings = false;
+
+/**
+ * \brief Maximum number of runs of modified pages that are stored with one
+ * EEPROM request
+ */
+#define SETTINGS_RUNS_PER_REQUEST 8
+
+/**
+ * \brief Background request of the EEPROM that the main loop is waiting for
+ */
+static enum class EepromTask
+{
+	/// None
+	NONE,
+	/// Loading the settings
+	LOADING,
+	/// Storing runs of modified pages of the settings
+	STORING
+} eepromTask = EepromTask::NONE;
+
+/**
+ * \brief Result of the background request
+ * \details Set from interrupt context when the request is finished.
+ */
+static volatile EepRom::Result eepromTaskResult = EepRom::Result::NONE;
+
+/**
+ * \brief Segments of a STORING request (one per run of modified pages)
+ * \details Must remain valid until the request is finished.
+ */
+static EepRom::Segment settingsSegments[SETTINGS_RUNS_PER_REQUEST];
+
+/**
+ * \brief Called by the EEPROM when the background request is finished
+ */
+static void eepromTaskCallback(EepRom::Result result, void*)
+{
+	eepromTaskResult = result;
+}
+
+/**
+ * \brief Is the calibration being written to EEPROM?
+ * \details Reset from interrupt context when the request is finished. The
+ * calibration must not be modified in the meantime.
+ */
+static volatile bool calibrationWriting = false;
+
+/**
+ * \brief Does the calibration contain changes that haven't been stored?
+ * \details Set when a potentiometer reports a new calibration. Remains set
+ * while the write request can't be queued, and is set again (from interrupt
+ * context) if the request fails, so the calibration is written again.
+ */
+static volatile bool calibrationUnsaved = false;
+
 /**
  * \{
  * \brief Simulated USB devices
@@ -315,7 +862,7 @@ EepRom eeprom(i2c1, 400000, EEPROM_24C512);
 UsbHidKeyboard keyboard(ITF_NUM_HID_KEYBOARD);
 UsbHidMouse mouse(ITF_NUM_HID_MOUSE);
 UsbHidComposite misc(ITF_NUM_HID_MISC);
-UsbHidInterface* interfaces[ITF_NUM_TOTAL] = {&keyboard, &mouse, &misc};
+UsbHidInterface* interfaces[ITF_NUM_INPUT] = {&keyboard, &mouse, &misc};
 /// \}
 
 /**
@@ -327,13 +874,130 @@ UsbHidInterface* interfaces[ITF_NUM_TOTAL] = {&keyboard, &mouse, &misc};
 static uint32_t settingsAddress = 0;
 static uint8_t settingsLength = sizeof(Settings) < 63 ? sizeof(Settings) : 63;
 
+/**
+ * \brief Index of the next region of the Settings struct whose hash is read
+ * by the host
+ */
+static uint16_t settingsHashRegion = 0;
+static_assert((sizeof(Settings) + SETTINGS_HASH_REGION_SIZE - 1) / SETTINGS_HASH_REGION_SIZE <= 0xffff, "Too many settings regions to hash");
+static_assert(3 + 4 * SETTINGS_HASHES_PER_REPORT <= 63, "Settings hashes don't fit into a feature report");
+
+/**
+ * \brief Faster access to the Settings structure through the configuration
+ * interface
+ * \details Only accessed from the main loop and the TinyUSB callbacks.
+ */
+static ConfigChannel configChannel(ITF_NUM_HID_CONFIG, reinterpret_cast<uint8_t*>(&settings), sizeof(Settings), [](uint32_t address, uint32_t length){settingsPages.mark(address, length);});
+
+/**
+ * \brief Index of the control whose latency histogram is read by the host
+ * \details Switches come first, followed by the rotary encoders.
+ */
+static uint8_t latencyHistogramIndex = 0;
+static_assert(13 + 2 * LATENCY_HISTOGRAM_BUCKETS <= 63, "Latency histogram doesn't fit into a feature report");
+
+/**
+ * \brief Traces input events through the macros to the USB host
+ * \details Only accessed from the main loop and the TinyUSB callbacks.
+ */
+static LatencyTracer tracer;
+static_assert(5 + (1 + 2 * LATENCY_TRACE_STAGES) * LATENCY_TRACE_RECORDS_PER_REPORT <= 63, "Latency traces don't fit into a feature report");
+
+/**
+ * \brief When input reports are assembled and handed to TinyUSB
+ * \details Only accessed from the main loop and the TinyUSB callbacks.
+ */
+static Scheduling scheduling = Scheduling::ON_DEMAND;
+
+/**
+ * \brief Timing of the reports relative to the USB frames
+ * \details The phase of a report is the time from the last SOF to the moment
+ * the report is handed to TinyUSB. The host polls at a fixed point in the
+ * frame, so the spread of the phases is the jitter it sees. The SOF callback
+ * runs from tud_task(), so all timestamps include the latency of the main
+ * loop. Only accessed from the main loop and the TinyUSB callbacks.
+ */
+static struct
+{
+	/// Time of the last SOF
+	uint32_t tsFrame;
+	/// Has there been an SOF since the reports were last assembled?
+	bool framePending;
+	/// Number of SOFs
+	uint32_t frames;
+	/// Number of reports handed to TinyUSB
+	uint32_t reports;
+	/// Minimum and maximum phase (in us)
+	uint16_t minPhase, maxPhase;
+	/// Sum and sum of squares of the phases (for mean and standard deviation)
+	uint64_t sumPhase, sumSquaredPhase;
+	/// Has the host started collecting the statistics (by selecting a
+	/// scheduling)?
+	bool collecting;
+} reportTiming;
+
+/**
+ * \brief Resets the statistics in reportTiming
+ */
+static void resetReportTiming()
+{
+	reportTiming.frames = 0;
+	reportTiming.reports = 0;
+	reportTiming.minPhase = 0xffff;
+	reportTiming.maxPhase = 0;
+	reportTiming.sumPhase = 0;
+	reportTiming.sumSquaredPhase = 0;
+}
+
+/**
+ * \brief Enables the SOF callback only while it is needed
+ * \details tud_sof_cb() is needed for Scheduling::START_OF_FRAME and for
+ * collecting the statistics in reportTiming. Otherwise, it would only cost an
+ * interrupt and a pass through tud_task() every millisecond.
+ * tud_sof_cb_enable() was introduced with TinyUSB 0.16 (Pico SDK 2.0). With
+ * older versions, the callback stays enabled.
+ */
+static void updateSofCallback()
+{
+#if TUSB_VERSION_MAJOR > 0 || TUSB_VERSION_MINOR >= 16
+	tud_sof_cb_enable(scheduling == Scheduling::START_OF_FRAME || reportTiming.collecting);
+#endif
+}
+
+/**
+ * \brief Hands the current report of an interface to TinyUSB if it needs
+ * sending
+ * \param instance The interface number.
+ * \param previousReportId See UsbHidInterface::sendReport().
+ */
+static void sendReport(uint8_t instance, uint8_t previousReportId)
+{
+	if(!interfaces[instance]->sendReport(previousReportId))
+		return;
+	uint32_t now = time_us_32();
+	tracer.queued(instance, now);
+
+	// Phase relative to the USB frame
+	if(reportTiming.frames == 0)
+		return;
+	uint32_t phase = now - reportTiming.tsFrame;
+	if(phase > 0xffff)
+		phase = 0xffff;
+	reportTiming.reports++;
+	if(phase < reportTiming.minPhase)
+		reportTiming.minPhase = phase;
+	if(phase > reportTiming.maxPhase)
+		reportTiming.maxPhase = phase;
+	reportTiming.sumPhase += phase;
+	reportTiming.sumSquaredPhase += static_cast<uint64_t>(phase) * phase;
+}
+
 /**
  * \brief Helper function for profile switching
  * \param profile Index of profile to switch to.
  * \param settings Reference to Settings struct.
- * \param eeprom Reference to EEPROM instance.
  */
-void switchProfile(uint8_t profile, Settings& settings, EepRom& eeprom)
+void switchProfile(uint8_t profile, Settings& settings)
 {
 	// Change settings
 	settings.activeProfile = profile;
@@ -341,12 +1005,25 @@ void switchProfile(uint8_t profile, Settings& settings, EepRom& eeprom)
 	// Print message to console
 	printf("Switching to profile %u \"%s\"\n", profile + 1, getActiveProfile(settings).name);
 
-	// Make change persistent in EEPROM
-	// We're risking a blocking call since it is very little data.
-	eeprom.write(&settings.activeProfile, offsetof(Settings, activeProfile), sizeof(settings.activeProfile));
+	// Make change persistent in EEPROM (in the background, once the profile
+	// has been active for a moment)
+	profileJournal.record(profile);
 
 	// Ask Core 1 to display the new profile for a bit
-	displayProfile = DISPLAY_PROFILE_INDICATOR_DURATION;
+	postUiEvent(UiEvent::PROFILE, profile);
+}
+
+/**
+ * \brief Helper function for changing the operating mode
+ * \details Lets Core 1 know about the change.
+ * \param newMode The new mode.
+ */
+static void setMode(Mode newMode)
+{
+	mode = newMode;
+	// Core 1 forgets about pressed keys when the mode changes
+	memset(uiKeysPressed, 0, sizeof(uiKeysPressed));
+	postUiEvent(UiEvent::MODE, static_cast<uint8_t>(newMode));
 }
 
 /**
@@ -367,7 +1044,9 @@ int main()
 
 	// Initialise USB
 	tusb_init();
-	absolute_time_t lastReportTime = from_us_since_boot(0);
+	resetReportTiming();
+	updateSofCallback();
+	uint16_t lastSliderValue = 0;
 
 	// Initialise EEPROM
 	i2c_init(i2c1, 400000);
@@ -381,13 +1060,32 @@ int main()
 	gpio_set_input_hysteresis_enabled(14, true);
 	gpio_set_input_hysteresis_enabled(15, true);
 	EepRom::init();
+	assert(SETTINGS_PAGE_SIZE % eeprom.getPageSize() == 0);
+
+	// Load the calibration of the potentiometers
+	// We're risking a blocking call since it is very little data.
+	if(eeprom.read(reinterpret_cast<uint8_t*>(&calibration), CALIBRATION_ADDRESS, sizeof(calibration)) != EepRom::Result::SUCCESS || calibration.checksum != calcCalibrationChecksum())
+	{
+		memset(&calibration, 0xff, sizeof(calibration));
+		printf("No calibration found\n");
+	}
 
-	// Start loading the settings from EEPROM
-	mode = Mode::LOADING_SETTINGS;
-	eeprom.startReading(reinterpret_cast<uint8_t*>(&settings), 0, sizeof(settings));
+	// Find the active profile in its journal
+	// We're risking a blocking call since it is very little data.
+	if(profileJournal.load() < 0)
+		printf("No active profile found in journal\n");
+
+	// Load the settings from EEPROM (the main loop starts reading)
+	setMode(Mode::LOADING_SETTINGS);
 
-	// Initialise InputMonitor
+	// Initialise InputMonitor and apply the calibration (invalid entries are
+	// ignored)
 	InputMonitor::create();
+	for(uint i = 0; i < InputMonitor::getInstance().getNumPotentiometers(); i++)
+	{
+		Potentiometer& poti = InputMonitor::getInstance().getPotentiometer(i);
+		poti.setCalibration(calibration.adcChannels[poti.getAdcChannel()]);
+	}
 
 	// Main loop
 	MacroList activeMacros;
@@ -405,6 +1103,9 @@ int main()
 			// Go back to performing USB tasks
 			continue;
 		}
+		// Continue transfers on the configuration interface (in any mode)
+		if(tud_hid_n_ready(ITF_NUM_HID_CONFIG))
+			configChannel.send();
 
 		// 2.) Perform other tasks
 		// These cannot take too long or USB will disconnect.
@@ -418,64 +1119,153 @@ int main()
 			continue;
 		}
 
-		// 2.b) Check if settings finished loading/storing
-		if(mode == Mode::LOADING_SETTINGS && eeprom.getResult() != EepRom::Result::ONGOING)
+		// 2.b) Load the settings from EEPROM or store the modified pages of
+		// them in the background. Both are queued as requests in the EEPROM,
+		// like the ones of the profile journal and the calibration.
+		profileJournal.update();
+		if(eepromTask == EepromTask::NONE || eepromTaskResult != EepRom::Result::ONGOING)
 		{
-			if(eeprom.getResult() != EepRom::Result::SUCCESS || !validateSettings(settings))
+			// Finish the previous request
+			if(eepromTask == EepromTask::LOADING)
 			{
-				makeDefaultSettings(settings);
-				printf("Loading settings failed, using defaults instead\n");
+				if(eepromTaskResult != EepRom::Result::SUCCESS || !validateSettings(settings))
+				{
+					makeDefaultSettings(settings);
+					// The EEPROM no longer matches, so all pages must be
+					// stored (the host only transfers regions that differ
+					// from the defaults, e.g. not the version)
+					settingsPages.mark(0, sizeof(Settings));
+					printf("Loading settings failed, using defaults instead\n");
+				}
+				else
+					printf("Settings loaded\n");
+				// The active profile from the journal is more recent than
+				// the one in the settings
+				int profile = profileJournal.getProfile();
+				if(profile >= 0 && profile < NUM_PROFILES)
+					settings.activeProfile = profile;
+				setMode(Mode::NORMAL);
 			}
-			else
-				printf("Settings loaded\n");
-			mode = Mode::NORMAL;
-		}
-		else if(mode == Mode::STORING_SETTINGS && eeprom.getResult() != EepRom::Result::ONGOING)
-		{
-			if(eeprom.getResult() != EepRom::Result::SUCCESS)
+			else if(eepromTask == EepromTask::STORING && eepromTaskResult != EepRom::Result::SUCCESS)
+			{
+				// Give up on the remaining pages as well
 				printf("Storing settings failed\n");
-			else
-				printf("Settings stored\n");
-			mode = Mode::NORMAL;
+				settingsPages.clear();
+				persistSettings = false;
+			}
+			eepromTask = EepromTask::NONE;
+
+			// Start the next one. Nothing is stored while the host may be
+			// modifying the settings in maintenance mode, and the modified
+			// pages are stored before the settings are reloaded.
+			if(persistSettings && mode != Mode::MAINTENANCE)
+			{
+				// Store several runs of pages with one scatter/gather request
+				uint numSegments = 0;
+				uint32_t address, length;
+				while(numSegments < SETTINGS_RUNS_PER_REQUEST && settingsPages.takeRun(address, length))
+					settingsSegments[numSegments++] = {reinterpret_cast<uint8_t*>(&settings) + address, address, length};
+				if(numSegments == 0)
+				{
+					persistSettings = false;
+					printf("Settings stored\n");
+				}
+				else
+				{
+					eepromTaskResult = EepRom::Result::ONGOING;
+					if(eeprom.queueWrite(settingsSegments, numSegments, eepromTaskCallback))
+						eepromTask = EepromTask::STORING;
+					else
+						// The queue is full, try again next time
+						for(uint i = 0; i < numSegments; i++)
+							settingsPages.mark(settingsSegments[i].memAddress, settingsSegments[i].length);
+				}
+			}
+			else if(mode == Mode::LOADING_SETTINGS)
+			{
+				eepromTaskResult = EepRom::Result::ONGOING;
+				if(eeprom.queueRead(reinterpret_cast<uint8_t*>(&settings), 0, sizeof(settings), eepromTaskCallback))
+				{
+					// Changes that haven't been stored are lost
+					settingsPages.clear();
+					eepromTask = EepromTask::LOADING;
+				}
+			}
 		}
 
-		// 2.c) Send USB HID reports every 10ms
+		// 2.c) Assemble USB HID reports as soon as there is an input event or
+		// a macro reaches its next tick (or at the start of the next frame
+		// after that), and hand them to TinyUSB for the next poll of the host
 		absolute_time_t now = get_absolute_time();
-		if(mode == Mode::NORMAL && tud_hid_ready() && absolute_time_diff_us(lastReportTime, now) >= 10000)
+		if(mode == Mode::NORMAL && (scheduling == Scheduling::ON_DEMAND || reportTiming.framePending))
 		{
+			reportTiming.framePending = false;
+
 			// 2.c.i) Go through the event queues of the input controls, start
 			// macros, and prepare information for Core 1 to show on the displays
+			bool update = activeMacros.isDue(now);
 
 			// Keys: Start macros triggered by events
 			for(uint i = 0; i < InputMonitor::getInstance().getNumSwitches(); i++)
 			{
 				Switch& sw = InputMonitor::getInstance().getSwitch(i);
-				while(sw.getEvents().size() > 0)
+				const Key& key = getActiveProfile(settings).keys[i];
+				update |= sw.getEvents().drain([&](const Switch::Event* events, uint32_t n)
 				{
-					Switch::Event event = sw.getEvents().extract();
-					const Key& key = getActiveProfile(settings).keys[i];
-					const Macro& macro = event.type == Switch::Event::PRESS ? key.press : (event.duration >= key.longPress ? key.longRelease : key.release);
-					activeMacros.add(macro);
-				}
+					for(uint32_t j = 0; j < n; j++)
+					{
+						const Switch::Event& event = events[j];
+						const Macro& macro = event.type == Switch::Event::PRESS ? key.press : (event.duration >= key.longPress ? key.longRelease : key.release);
+						int trace = tracer.start(i, event.tsCapture, event.tsDebounced, time_us_32());
+						if(!activeMacros.add(macro, 1, trace))
+							tracer.abandon(trace);
+					}
+				});
 			}
 
 			// Knobs: Start macros triggered by events and show events on displays
 			for(uint i = 0; i < InputMonitor::getInstance().getNumRotaryEncoders(); i++)
 			{
 				RotaryEncoder& rotenc = InputMonitor::getInstance().getRotaryEncoder(i);
-				while(rotenc.getEvents().size() > 0)
+				const Knob& knob = getActiveProfile(settings).knobs[i];
+				// Add up the (accelerated) notches in each direction, so each
+				// macro only needs to be started once (and is traced from the
+				// first of these events)
+				uint left = 0, right = 0;
+				uint32_t tsLeft = 0, tsRight = 0;
+				update |= rotenc.getEvents().drain([&](const RotaryEncoder::Event* events, uint32_t n)
 				{
-					// Get information about event
-					RotaryEncoder::Event event = rotenc.getEvents().extract();
-					const Knob& knob = getActiveProfile(settings).knobs[i];
-					const Macro& macro = event.type == RotaryEncoder::Event::LEFT ? knob.left : knob.right;
-					// Start macro
-					activeMacros.add(macro);
-					// Highlight on display
-					if(event.type == RotaryEncoder::Event::LEFT)
-						displayHighlightKnobs[2 * i] = DISPLAY_KNOB_HIGHLIGHT_DURATION;
-					else
-						displayHighlightKnobs[2 * i + 1] = DISPLAY_KNOB_HIGHLIGHT_DURATION;
+					for(uint32_t j = 0; j < n; j++)
+					{
+						uint multiplier = getAccelerationMultiplier(knob.acceleration, events[j].velocity);
+						if(events[j].type == RotaryEncoder::Event::LEFT)
+						{
+							if(left == 0)
+								tsLeft = events[j].timestamp;
+							left += multiplier;
+						}
+						else
+						{
+							if(right == 0)
+								tsRight = events[j].timestamp;
+							right += multiplier;
+						}
+					}
+				});
+				// Start macros and highlight on display
+				if(left > 0)
+				{
+					int trace = tracer.start(LatencyTracer::CONTROL_KNOB + i, tsLeft, tsLeft, time_us_32());
+					if(!activeMacros.add(knob.left, left, trace))
+						tracer.abandon(trace);
+					postUiEvent(UiEvent::KNOB_LEFT, i);
+				}
+				if(right > 0)
+				{
+					int trace = tracer.start(LatencyTracer::CONTROL_KNOB + i, tsRight, tsRight, time_us_32());
+					if(!activeMacros.add(knob.right, right, trace))
+						tracer.abandon(trace);
+					postUiEvent(UiEvent::KNOB_RIGHT, i);
 				}
 			}
 
@@ -483,60 +1273,106 @@ int main()
 			for(uint i = 0; i < InputMonitor::getInstance().getNumPotentiometers(); i++)
 			{
 				Potentiometer& poti = InputMonitor::getInstance().getPotentiometer(i);
-				while(poti.getEvents().size() > 0)
+				// Only the latest position is of interest
+				Potentiometer::Event event = {};
+				bool moved = poti.getEvents().drain([&event](const Potentiometer::Event* events, uint32_t n){event = events[n - 1];}) > 0;
+				if(moved)
+					postUiEvent(UiEvent::SLIDER, i, event.position, event.delta > 0 ? 1 : (event.delta < 0 ? -1 : 0));
+				// Take over a changed calibration (unless the previous one is
+				// still being written)
+				Potentiometer::Calibration newCalibration;
+				if(!calibrationWriting && poti.getUnsavedCalibration(newCalibration))
 				{
-					Potentiometer::Event event = poti.getEvents().extract();
-					displaySlider = DISPLAY_SLIDER_HIGHLIGHT_DURATION;
-					displaySliderDirection = event.delta;
-					displaySliderValue = event.position;
+					calibration.adcChannels[poti.getAdcChannel()] = newCalibration;
+					calibration.checksum = calcCalibrationChecksum();
+					calibrationUnsaved = true;
 				}
 			}
 
-			// 2.c.ii) Assemble reports
-			keyboard.startAssemblingReport();
-			mouse.startAssemblingReport();
-			misc.startAssemblingReport();
-			int switchToProfile = -1;
-
-			// Action due to keys being held down
-			for(uint i = 0; i < InputMonitor::getInstance().getNumSwitches(); i++)
+			// Make the calibration persistent in EEPROM. If the queue is
+			// full or the write fails, it remains unsaved and is tried again
+			// next time.
+			if(calibrationUnsaved && !calibrationWriting)
 			{
-				Switch& sw = InputMonitor::getInstance().getSwitch(i);
-				if(sw.isPressed())
+				// (Cleared first, because the callback may set it again as soon
+				// as the request is queued)
+				calibrationUnsaved = false;
+				calibrationWriting = true;
+				if(eeprom.queueWrite(reinterpret_cast<uint8_t*>(&calibration), CALIBRATION_ADDRESS, sizeof(calibration), [](EepRom::Result result, void*){if(result != EepRom::Result::SUCCESS) calibrationUnsaved = true; calibrationWriting = false;}))
 				{
-					// Add action to reports
-					const Action& action = getActiveProfile(settings).keys[i].hold;
-					if(action.type == ActionType::INPUT)
+					for(uint i = 0; i < InputMonitor::getInstance().getNumPotentiometers(); i++)
 					{
-						keyboard.addActionToReport(getActiveProfile(settings).keys[i].hold);
-						mouse.addActionToReport(getActiveProfile(settings).keys[i].hold);
-						misc.addActionToReport(getActiveProfile(settings).keys[i].hold);
+						const Potentiometer::Calibration& c = calibration.adcChannels[InputMonitor::getInstance().getPotentiometer(i).getAdcChannel()];
+						printf("Slider %u calibrated to %u..%u\n", i + 1, c.adcMin, c.adcMax);
 					}
-					else if(action.type == ActionType::SWITCH_PROFILE)
-						switchToProfile = action.switchProfile.index;
 				}
-				// Highlight the switch on the display
-				displayHighlightKeys[i] = sw.isPressed();
+				else
+				{
+					calibrationUnsaved = true;
+					calibrationWriting = false;
+				}
+			}
+
+			// The slider value changes more often than its position
+			uint16_t sliderValue = InputMonitor::getInstance().getPotentiometer(0).getValue();
+			if(sliderValue != lastSliderValue)
+			{
+				lastSliderValue = sliderValue;
+				update = true;
 			}
-			// Slider position
-			misc.setSlider(InputMonitor::getInstance().getPotentiometer(0).getPosition());
-			// Actions from macros that are currently running
-			activeMacros.addToReport(interfaces, ITF_NUM_TOTAL, [](const Action& action, void* userData){if(action.type == ActionType::SWITCH_PROFILE) *reinterpret_cast<int*>(userData) = action.switchProfile.index;}, &switchToProfile);
+			if(update)
+			{
+				// 2.c.ii) Assemble reports
+				keyboard.startAssemblingReport();
+				mouse.startAssemblingReport();
+				misc.startAssemblingReport();
+				int switchToProfile = -1;
 
-			keyboard.finishAssemblingReport();
-			mouse.finishAssemblingReport();
-			misc.finishAssemblingReport();
+				// Action due to keys being held down
+				for(uint i = 0; i < InputMonitor::getInstance().getNumSwitches(); i++)
+				{
+					Switch& sw = InputMonitor::getInstance().getSwitch(i);
+					if(sw.isPressed())
+					{
+						// Add action to reports
+						const Action& action = getActiveProfile(settings).keys[i].hold;
+						if(action.type == ActionType::INPUT)
+						{
+							keyboard.addActionToReport(getActiveProfile(settings).keys[i].hold);
+							mouse.addActionToReport(getActiveProfile(settings).keys[i].hold);
+							misc.addActionToReport(getActiveProfile(settings).keys[i].hold);
+						}
+						else if(action.type == ActionType::SWITCH_PROFILE)
+							switchToProfile = action.switchProfile.index;
+					}
+					// Highlight the switch on the display
+					if(sw.isPressed() != uiKeysPressed[i])
+					{
+						uiKeysPressed[i] = sw.isPressed();
+						postUiEvent(uiKeysPressed[i] ? UiEvent::KEY_DOWN : UiEvent::KEY_UP, i);
+					}
+				}
+				// Slider position
+				misc.setSlider(sliderValue);
+				// Actions from macros that are currently running
+				activeMacros.addToReport(now, interfaces, ITF_NUM_INPUT, [](const Action& action, void* userData){if(action.type == ActionType::SWITCH_PROFILE) *reinterpret_cast<int*>(userData) = action.switchProfile.index;}, &switchToProfile, &tracer);
 
-			// 2.c.iii) Send reports
-			keyboard.sendReport(0);
-			mouse.sendReport(0);
-			misc.sendReport(0);
+				uint8_t changed = 0;
+				for(uint i = 0; i < ITF_NUM_INPUT; i++)
+					if(interfaces[i]->finishAssemblingReport())
+						changed |= 1u << i;
+				tracer.assembledReports(changed);
 
-			// 2.c.iv) Check if we encountered a profile-switching action
-			if(switchToProfile != -1)
-				switchProfile(switchToProfile, settings, eeprom);
+				// 2.c.iii) Check if we encountered a profile-switching action
+				if(switchToProfile != -1)
+					switchProfile(switchToProfile, settings);
+			}
 
-			lastReportTime = now;
+			// 2.c.iv) Send reports on the interfaces that are idle (the others
+			// continue from tud_hid_report_complete_cb())
+			for(uint i = 0; i < ITF_NUM_INPUT; i++)
+				if(tud_hid_n_ready(i))
+					sendReport(i, 0);
 		}
 	}
 }
@@ -570,6 +1406,7 @@ void tud_umount_cb()
 void tud_suspend_cb(bool remote_wakeup_en)
 {
 	InputMonitor::getInstance().setMode(InputMonitor::Mode::SLEEPING);
+	postUiEvent(UiEvent::SUSPEND);
 	printf("USB suspended\n");
 }
 
@@ -579,6 +1416,7 @@ void tud_suspend_cb(bool remote_wakeup_en)
 void tud_resume_cb()
 {
 	InputMonitor::getInstance().setMode(InputMonitor::Mode::RUNNING);
+	postUiEvent(UiEvent::RESUME);
 	printf("USB resumed\n");
 }
 
@@ -599,7 +1437,7 @@ void tud_resume_cb()
 uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t* buffer, uint16_t reqlen)
 {
 	if(report_type == HID_REPORT_TYPE_INPUT // GET_REPORT(DATA)
-		&& instance < ITF_NUM_TOTAL) // On an existing interface
+		&& instance < ITF_NUM_INPUT) // On an existing interface
 		// Host requested an extra input report outside of the polling interval
 		return interfaces[instance]->sendEp0Report(report_id, buffer, reqlen);
 	else if(report_type == HID_REPORT_TYPE_FEATURE
@@ -617,7 +1455,8 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 			case REPORT_ID_MODE:
 			{
 				if(reqlen < 1) return 0;
-				buffer[0] = static_cast<uint8_t>(mode);
+				// The host waits for the settings to be stored
+				buffer[0] = static_cast<uint8_t>(mode == Mode::NORMAL && persistSettings ? Mode::STORING_SETTINGS : mode);
 				return 1;
 			}
 			case REPORT_ID_SETTINGS_ADDRESS:
@@ -646,6 +1485,101 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 				buffer[0] = settings.activeProfile;
 				return 1;
 			}
+			case REPORT_ID_LATENCY_HISTOGRAM:
+			{
+				if(reqlen < 13 + 2 * LATENCY_HISTOGRAM_BUCKETS) return 0;
+				InputMonitor& input = InputMonitor::getInstance();
+				uint32_t burstScans = input.getBurstScans();
+				uint32_t idleScans = input.getIdleScans();
+				buffer[0] = latencyHistogramIndex;
+				buffer[1] = LATENCY_HISTOGRAM_BUCKETS;
+				buffer[2] = LATENCY_HISTOGRAM_BUCKET_WIDTH & 0xff;
+				buffer[3] = (LATENCY_HISTOGRAM_BUCKET_WIDTH >> 8) & 0xff;
+				for(uint i = 0; i < 4; i++)
+				{
+					buffer[4 + i] = (burstScans >> (8 * i)) & 0xff;
+					buffer[8 + i] = (idleScans >> (8 * i)) & 0xff;
+				}
+				// Switches come first, then rotary encoders
+				bool isSwitch = latencyHistogramIndex < input.getNumSwitches();
+				const LatencyHistogram& histogram = isSwitch ?
+					input.getSwitch(latencyHistogramIndex).getLatencyHistogram() :
+					input.getRotaryEncoder(latencyHistogramIndex - input.getNumSwitches()).getLatencyHistogram();
+				for(uint i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+				{
+					buffer[12 + 2 * i] = histogram.getBucket(i) & 0xff;
+					buffer[13 + 2 * i] = histogram.getBucket(i) >> 8;
+				}
+				buffer[12 + 2 * LATENCY_HISTOGRAM_BUCKETS] = isSwitch ? 0 : 1;
+				return 13 + 2 * LATENCY_HISTOGRAM_BUCKETS;
+			}
+			case REPORT_ID_LATENCY_TRACE:
+			{
+				const uint16_t length = 5 + (1 + 2 * LATENCY_TRACE_STAGES) * LATENCY_TRACE_RECORDS_PER_REPORT;
+				if(reqlen < length) return 0;
+				memset(buffer, 0, length);
+				uint8_t n = 0;
+				LatencyTracer::Record record;
+				while(n < LATENCY_TRACE_RECORDS_PER_REPORT && tracer.getRecord(record))
+				{
+					uint8_t* p = buffer + 5 + (1 + 2 * LATENCY_TRACE_STAGES) * n;
+					p[0] = record.control;
+					for(uint i = 0; i < LATENCY_TRACE_STAGES; i++)
+					{
+						p[1 + 2 * i] = record.durations[i] & 0xff;
+						p[2 + 2 * i] = record.durations[i] >> 8;
+					}
+					n++;
+				}
+				uint32_t abandoned = tracer.getAbandoned();
+				buffer[0] = n;
+				for(uint i = 0; i < 4; i++)
+					buffer[1 + i] = (abandoned >> (8 * i)) & 0xff;
+				return length;
+			}
+			case REPORT_ID_REPORT_TIMING:
+			{
+				if(reqlen < 29) return 0;
+				buffer[0] = static_cast<uint8_t>(scheduling);
+				for(uint i = 0; i < 4; i++)
+				{
+					buffer[1 + i] = (reportTiming.frames >> (8 * i)) & 0xff;
+					buffer[5 + i] = (reportTiming.reports >> (8 * i)) & 0xff;
+				}
+				uint16_t minPhase = reportTiming.reports > 0 ? reportTiming.minPhase : 0;
+				buffer[9] = minPhase & 0xff;
+				buffer[10] = minPhase >> 8;
+				buffer[11] = reportTiming.maxPhase & 0xff;
+				buffer[12] = reportTiming.maxPhase >> 8;
+				for(uint i = 0; i < 8; i++)
+				{
+					buffer[13 + i] = (reportTiming.sumPhase >> (8 * i)) & 0xff;
+					buffer[21 + i] = (reportTiming.sumSquaredPhase >> (8 * i)) & 0xff;
+				}
+				return 29;
+			}
+			case REPORT_ID_SETTINGS_HASH:
+			{
+				const uint16_t length = 3 + 4 * SETTINGS_HASHES_PER_REPORT;
+				const uint32_t numRegions = (sizeof(Settings) + SETTINGS_HASH_REGION_SIZE - 1) / SETTINGS_HASH_REGION_SIZE;
+				if(reqlen < length) return 0;
+				memset(buffer, 0, length);
+				buffer[0] = settingsHashRegion & 0xff;
+				buffer[1] = settingsHashRegion >> 8;
+				uint8_t n = 0;
+				while(n < SETTINGS_HASHES_PER_REPORT && settingsHashRegion < numRegions)
+				{
+					uint32_t address = settingsHashRegion * SETTINGS_HASH_REGION_SIZE;
+					uint32_t size = sizeof(Settings) - address < SETTINGS_HASH_REGION_SIZE ? sizeof(Settings) - address : SETTINGS_HASH_REGION_SIZE;
+					uint32_t hash = hashSettingsRegion(reinterpret_cast<const uint8_t*>(&settings) + address, size);
+					for(uint i = 0; i < 4; i++)
+						buffer[3 + 4 * n + i] = (hash >> (8 * i)) & 0xff;
+					settingsHashRegion++;
+					n++;
+				}
+				buffer[2] = n;
+				return length;
+			}
 			default:
 			{
 				printf("Received request for unknown feature report (Interface %u, Report ID %u):", instance, report_id);
@@ -653,6 +1587,14 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
 			}
 		}
 	}
+	else if(report_type == HID_REPORT_TYPE_FEATURE
+		&& instance == ITF_NUM_HID_MOUSE) // GET_REPORT(FEATURE) for mouse interface
+	{
+		// Resolution multipliers of the wheels
+		if(reqlen < 1) return 0;
+		buffer[0] = mouse.getResolutionMultipliers();
+		return 1;
+	}
 	// Unsupported request, stall
 	return 0;
 }
@@ -661,7 +1603,10 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
  * \brief Callback for SET_REPORT control requests on EP0
  * \details The only possible outpur report is for the keyboard LEDs which we
  * just ignore. More importantly however, this could be a feature report from
- * the host to alter the settings.
+ * the host to alter the settings (or the resolution multipliers of the
+ * mouse).
+ * TinyUSB also calls this for reports received on the OUT endpoint of the
+ * configuration interface.
  * \param instance The interface number.
  * \param report_id ID of the received report.
  * \param report_type Whether this is an output report or a feature report.
@@ -670,7 +1615,14 @@ uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_t
  */
 void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type, uint8_t const* buffer, uint16_t bufsize)
 {
-	if(report_type == HID_REPORT_TYPE_OUTPUT) // SET_REPORT(DATA)
+	if(instance == ITF_NUM_HID_CONFIG)
+	{
+		// Packet on the OUT endpoint of the configuration interface (settings
+		// may only be written in maintenance mode)
+		if(report_type != HID_REPORT_TYPE_FEATURE)
+			configChannel.receive(buffer, bufsize, mode == Mode::MAINTENANCE);
+	}
+	else if(report_type == HID_REPORT_TYPE_OUTPUT) // SET_REPORT(DATA)
 	{
 		if(instance == ITF_NUM_HID_KEYBOARD && bufsize >= 1)
 			printf("Set keyboard LEDs: NumLock %u, CapsLock %u, ScrollLock %u, Compose %u, Kana %u\n", (buffer[0] >> 0) & 1, (buffer[0] >> 1) & 1, (buffer[0] >> 2) & 1, (buffer[0] >> 3) & 1, (buffer[0] >> 4) & 1);
@@ -685,11 +1637,12 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 		}
 	}
 	else if(report_type == HID_REPORT_TYPE_FEATURE // SET_REPORT(FEATURE)
-		&& instance == ITF_NUM_HID_MISC) // Only this interface supports feature requests
+		&& instance == ITF_NUM_HID_MISC) // Feature requests for the settings
 	{
 		switch(report_id)
 		{
 			case REPORT_ID_VERSION:
+			case REPORT_ID_LATENCY_TRACE:
 			{
 				// Ignore, this is read only
 				break;
@@ -699,21 +1652,22 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 				if(bufsize != 1) return;
 				if(mode == Mode::NORMAL && buffer[0] == static_cast<uint8_t>(Mode::MAINTENANCE))
 					// Switch from NORMAL to MAINTENANCE mode
-					mode = Mode::MAINTENANCE;
+					setMode(Mode::MAINTENANCE);
 				else if(mode == Mode::MAINTENANCE && buffer[0] == static_cast<uint8_t>(Mode::NORMAL))
 					// Switch from MAINTENANCE to NORMAL mode
-					mode = Mode::NORMAL;
+					setMode(Mode::NORMAL);
 				else if(mode == Mode::MAINTENANCE && buffer[0] == static_cast<uint8_t>(Mode::LOADING_SETTINGS))
-				{
-					// Reload settings from EEPROM
-					mode = Mode::LOADING_SETTINGS;
-					eeprom.startReading(reinterpret_cast<uint8_t*>(&settings), 0, sizeof(settings));
-				}
+					// Reload settings from EEPROM (the main loop starts reading)
+					setMode(Mode::LOADING_SETTINGS);
 				else if(mode == Mode::MAINTENANCE && buffer[0] == static_cast<uint8_t>(Mode::STORING_SETTINGS))
 				{
-					// Store current settings to EEPROM
-					mode = Mode::STORING_SETTINGS;
-					eeprom.startWriting(reinterpret_cast<uint8_t*>(&settings), 0, sizeof(settings));
+					// Store the modified pages of the settings to EEPROM in
+					// the background and carry on normally (the active profile
+					// goes into its journal). STORING_SETTINGS is reported
+					// until they are stored.
+					persistSettings = true;
+					profileJournal.record(settings.activeProfile);
+					setMode(Mode::NORMAL);
 				}
 				break;
 			}
@@ -730,6 +1684,7 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 			{
 				if(bufsize < settingsLength) return;
 				memcpy(reinterpret_cast<uint8_t*>(&settings) + settingsAddress, buffer, settingsLength);
+				settingsPages.mark(settingsAddress, settingsLength);
 				settingsAddress = (settingsAddress + settingsLength) % sizeof(Settings);
 				if(settingsAddress + settingsLength > sizeof(Settings))
 					settingsLength = sizeof(Settings) - settingsAddress;
@@ -744,7 +1699,44 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 				if(buffer[0] == settings.activeProfile)
 					// Profile already active
 					break;
-				switchProfile(buffer[0], settings, eeprom);
+				switchProfile(buffer[0], settings);
+				break;
+			}
+			case REPORT_ID_REPORT_TIMING:
+			{
+				if(bufsize != 1) return;
+				if(buffer[0] > static_cast<uint8_t>(Scheduling::START_OF_FRAME))
+					// Invalid scheduling
+					break;
+				scheduling = static_cast<Scheduling>(buffer[0]);
+				resetReportTiming();
+				reportTiming.collecting = true;
+				updateSofCallback();
+				break;
+			}
+			case REPORT_ID_LATENCY_HISTOGRAM:
+			{
+				if(bufsize < 1) return;
+				InputMonitor& input = InputMonitor::getInstance();
+				if(buffer[0] == 0xff)
+				{
+					// Reset all histograms (the alarm adds to them)
+					uint32_t status = save_and_disable_interrupts();
+					for(uint i = 0; i < input.getNumSwitches(); i++)
+						input.getSwitch(i).getLatencyHistogram().reset();
+					for(uint i = 0; i < input.getNumRotaryEncoders(); i++)
+						input.getRotaryEncoder(i).getLatencyHistogram().reset();
+					restore_interrupts(status);
+				}
+				else if(buffer[0] < input.getNumSwitches() + input.getNumRotaryEncoders())
+					latencyHistogramIndex = buffer[0];
+				break;
+			}
+			case REPORT_ID_SETTINGS_HASH:
+			{
+				if(bufsize < 2) return;
+				settingsHashRegion = buffer[0] | (buffer[1] << 8);
+				break;
 			}
 			default:
 			{
@@ -756,6 +1748,9 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
 			}
 		}
 	}
+	else if(report_type == HID_REPORT_TYPE_FEATURE // SET_REPORT(FEATURE)
+		&& instance == ITF_NUM_HID_MOUSE && bufsize == 1) // Resolution multipliers of the wheels
+		mouse.setResolutionMultipliers(buffer[0]);
 }
 
 /**
@@ -765,7 +1760,7 @@ void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_
  */
 void tud_hid_set_protocol_cb(uint8_t instance, uint8_t protocol)
 {
-	if(instance < ITF_NUM_TOTAL) // On existing interface
+	if(instance < ITF_NUM_INPUT) // On existing interface
 		interfaces[instance]->setProtocol(protocol);
 
 	// Print some info
@@ -789,7 +1784,7 @@ bool tud_hid_set_idle_cb(uint8_t instance, uint8_t idle_rate)
 	else
 		printf("Set idle rate to %ums for interface %u\n", 4 * idle_rate, instance);
 
-	if(instance < ITF_NUM_TOTAL) // On existing interface
+	if(instance < ITF_NUM_INPUT) // On existing interface
 		return interfaces[instance]->setIdle(idle_rate);
 	else
 		// Stall to signal that SET_IDLE is not supported
@@ -807,6 +1802,33 @@ bool tud_hid_set_idle_cb(uint8_t instance, uint8_t idle_rate)
  */
 void tud_hid_report_complete_cb(uint8_t instance, uint8_t const* rprt, uint16_t len)
 {
-	// This only happens for the misc interface
-	misc.sendReport(rprt[0]);
+	// The configuration interface streams its packets back to back
+	if(instance == ITF_NUM_HID_CONFIG)
+	{
+		configChannel.send();
+		return;
+	}
+
+	// Finish the traces waiting for this interface
+	tracer.completed(instance, time_us_32());
+
+	// Send the next report right away if there is one (only the misc
+	// interface has report IDs)
+	if(instance < ITF_NUM_INPUT && mode == Mode::NORMAL)
+		sendReport(instance, instance == ITF_NUM_HID_MISC ? rprt[0] : 0);
+}
+
+/**
+ * \brief Callback for the start of a USB frame (SOF)
+ * \details Called from tud_task() once per millisecond while the bus isn't
+ * suspended and the callback is enabled (see updateSofCallback()). Marks the
+ * start of the frame for the report timing and, with
+ * Scheduling::START_OF_FRAME, triggers assembling the reports.
+ * \param frame_count The frame number.
+ */
+void tud_sof_cb(uint32_t frame_count)
+{
+	reportTiming.tsFrame = time_us_32();
+	reportTiming.framePending = true;
+	reportTiming.frames++;
 }
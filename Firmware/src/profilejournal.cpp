@@ -0,0 +1,119 @@
+/**
+ * \file profilejournal.cpp
+ * Implementation for profilejournal.h
+ */
+
+#include"profilejournal.h"
+
+static_assert(sizeof(ProfileJournal::Record) == 4, "Journal records must not be padded");
+
+ProfileJournal::ProfileJournal(EepRom& eeprom, uint address, uint size)
+:	eeprom(eeprom),
+	address(address),
+	numRecords(size / sizeof(Record)),
+	nextRecord(0),
+	nextSequence(0),
+	storedProfile(-1),
+	pending(false),
+	pendingProfile(0),
+	tsPending(nil_time),
+	writing{},
+	busy(false),
+	writeResult(EepRom::Result::NONE)
+{
+}
+
+uint8_t ProfileJournal::calcChecksum(const Record& record)
+{
+	return PROFILE_JOURNAL_CHECKSUM_SEED ^ (record.sequence & 0xff) ^ (record.sequence >> 8) ^ record.profile;
+}
+
+int ProfileJournal::load()
+{
+	// Find the valid record with the highest number (the journal is small
+	// enough that all valid numbers are within half the range of each other).
+	// The records are read a few at a time.
+	int latest = -1;
+	uint16_t latestSequence = 0;
+	Record records[PROFILE_JOURNAL_RECORDS_PER_READ];
+	for(uint first = 0; first < numRecords; first += PROFILE_JOURNAL_RECORDS_PER_READ)
+	{
+		uint n = numRecords - first < PROFILE_JOURNAL_RECORDS_PER_READ ? numRecords - first : PROFILE_JOURNAL_RECORDS_PER_READ;
+		if(eeprom.read(reinterpret_cast<uint8_t*>(records), address + first * sizeof(Record), n * sizeof(Record)) != EepRom::Result::SUCCESS)
+			return -1;
+		for(uint i = 0; i < n; i++)
+		{
+			if(records[i].checksum != calcChecksum(records[i]))
+				continue;
+			if(latest == -1 || static_cast<int16_t>(records[i].sequence - latestSequence) > 0)
+			{
+				latest = first + i;
+				latestSequence = records[i].sequence;
+				storedProfile = records[i].profile;
+			}
+		}
+	}
+
+	// Continue after the latest record
+	if(latest != -1)
+	{
+		nextRecord = (latest + 1) % numRecords;
+		nextSequence = latestSequence + 1;
+	}
+	return storedProfile;
+}
+
+void ProfileJournal::record(uint8_t profile)
+{
+	// Compare with the record that is being written (if any), it will be
+	// the latest one once it is done
+	pendingProfile = profile;
+	pending = profile != (busy ? writing.profile : storedProfile);
+	tsPending = get_absolute_time();
+}
+
+void ProfileJournal::update()
+{
+	// Finish the previous write request
+	if(busy)
+	{
+		EepRom::Result result = writeResult;
+		if(result == EepRom::Result::ONGOING)
+			return;
+		busy = false;
+		finishWriting(result == EepRom::Result::SUCCESS);
+	}
+
+	// Queue the next one (if the queue is full, try again next time)
+	if(!pending || absolute_time_diff_us(tsPending, get_absolute_time()) < PROFILE_JOURNAL_DELAY * 1000)
+		return;
+	writing.sequence = nextSequence;
+	writing.profile = pendingProfile;
+	writing.checksum = calcChecksum(writing);
+	writeResult = EepRom::Result::ONGOING;
+	if(!eeprom.queueWrite(reinterpret_cast<const uint8_t*>(&writing), address + nextRecord * sizeof(Record), sizeof(Record), writeCallback, this))
+		return;
+	pending = false;
+	busy = true;
+}
+
+void ProfileJournal::writeCallback(EepRom::Result result, void* userData)
+{
+	static_cast<ProfileJournal*>(userData)->writeResult = result;
+}
+
+void ProfileJournal::finishWriting(bool success)
+{
+	// Move on to the next record either way, the failed one is invalid or
+	// outdated
+	nextRecord = (nextRecord + 1) % numRecords;
+	nextSequence++;
+	if(success)
+		storedProfile = writing.profile;
+	else if(!pending)
+	{
+		// Try again (unless another profile has been activated since)
+		pending = true;
+		pendingProfile = writing.profile;
+	}
+}
@@ -0,0 +1,190 @@
+/**
+ * \file profilejournal.h
+ * Persisting the active profile in a journal in EEPROM
+ */
+
+#ifndef _PROFILEJOURNAL_H
+#define _PROFILEJOURNAL_H
+
+#include"pico/stdlib.h"
+#include"eeprom.h"
+
+/**
+ * \brief Time (in ms) a profile must stay active before it is written to the
+ * journal
+ * \details Switching through several profiles in quick succession only
+ * writes the last one.
+ */
+#ifndef PROFILE_JOURNAL_DELAY
+#define PROFILE_JOURNAL_DELAY 500
+#endif
+
+/**
+ * \brief Number of records that are read at once when loading the journal
+ */
+#define PROFILE_JOURNAL_RECORDS_PER_READ 16
+
+/**
+ * \brief Seed for the checksum of a journal record
+ */
+#define PROFILE_JOURNAL_CHECKSUM_SEED 0x5a
+
+/**
+ * \brief Journal of the active profile in a reserved area of the EEPROM
+ * \details Rather than overwriting the same byte on every profile switch,
+ * each switch appends a record to a ring buffer in the EEPROM. The records
+ * are numbered consecutively (modulo 2^16), and the valid record with the
+ * highest number is the one that counts. This spreads the wear over the
+ * whole area, and a record that is only partially written (e.g. because of a
+ * power loss) fails its checksum and is simply ignored.
+ * The journal is read once at boot (blocking). Records are written with
+ * requests queued in the EEPROM (see EepRom::queueWrite()), alongside
+ * whatever else it is busy with: record() notes the profile, and the main loop
+ * calls update() regularly to write it once it is due.
+ * Not thread safe. All methods must be called from the same context.
+ */
+class ProfileJournal
+{
+public:
+	/**
+	 * \brief A record of the journal
+	 */
+	struct Record
+	{
+		/// Consecutive number of the record
+		uint16_t sequence;
+		/// Index of the active profile
+		uint8_t profile;
+		/// Checksum (see calcChecksum())
+		uint8_t checksum;
+	};
+
+private:
+	/**
+	 * \brief The EEPROM
+	 */
+	EepRom& eeprom;
+
+	/**
+	 * \brief Address of the journal in the EEPROM
+	 */
+	uint address;
+
+	/**
+	 * \brief Number of records in the journal
+	 */
+	uint numRecords;
+
+	/**
+	 * \brief Index of the record that is written next
+	 */
+	uint nextRecord;
+
+	/**
+	 * \brief Number of the record that is written next
+	 */
+	uint16_t nextSequence;
+
+	/**
+	 * \brief Profile in the latest valid record (-1 if there is none)
+	 */
+	int storedProfile;
+
+	/**
+	 * \brief Is there a profile waiting to be written?
+	 */
+	bool pending;
+
+	/**
+	 * \brief Profile waiting to be written
+	 */
+	uint8_t pendingProfile;
+
+	/**
+	 * \brief When the pending profile has been activated
+	 */
+	absolute_time_t tsPending;
+
+	/**
+	 * \brief Record that is currently being written
+	 * \details Must remain valid until the write request has finished.
+	 */
+	Record writing;
+
+	/**
+	 * \brief Is a write request queued in the EEPROM?
+	 */
+	bool busy;
+
+	/**
+	 * \brief Result of the write request
+	 * \details Set by writeCallback() from interrupt context.
+	 */
+	volatile EepRom::Result writeResult;
+
+	/**
+	 * \brief Called by the EEPROM when the write request is finished
+	 * \param userData Pointer to the instance.
+	 */
+	static void writeCallback(EepRom::Result result, void* userData);
+
+	/**
+	 * \brief Finishes the write request
+	 * \details If it failed, the profile is written again (to the next
+	 * record).
+	 * \param success Whether the request was successful.
+	 */
+	void finishWriting(bool success);
+
+	/**
+	 * \brief Computes the checksum of a record
+	 * \details An erased EEPROM (all 0xff) never contains a valid record.
+	 * \param record The record.
+	 * \return The checksum.
+	 */
+	static uint8_t calcChecksum(const Record& record);
+
+public:
+	/**
+	 * \brief Constructor
+	 * \param eeprom The EEPROM.
+	 * \param address Address of the reserved area. Should be at the start of
+	 * an EEPROM page.
+	 * \param size Size of the reserved area in bytes.
+	 */
+	ProfileJournal(EepRom& eeprom, uint address, uint size);
+
+	/**
+	 * \brief Reads the journal and finds the latest valid record
+	 * \details This method is blocking.
+	 * \return Returns the profile in the latest valid record, or -1 if there
+	 * is none (or the journal cannot be read).
+	 */
+	int load();
+
+	/**
+	 * \brief Notes that a profile has been activated
+	 * \details The profile is written to the journal once it has been active
+	 * for PROFILE_JOURNAL_DELAY ms (unless it is already the latest record or
+	 * the one being written).
+	 * \param profile Index of the profile.
+	 */
+	void record(uint8_t profile);
+
+	/**
+	 * \brief Finishes the previous write request (if it is done) and queues
+	 * the next one if the pending profile is due
+	 * \details To be called regularly from the main loop. Never blocks.
+	 */
+	void update();
+
+	/**
+	 * \brief Returns the profile that has been recorded last
+	 * \return The index of the pending profile if there is one, otherwise the
+	 * profile in the record that is being written, otherwise the profile in
+	 * the latest valid record, or -1 if there is none.
+	 */
+	inline int getProfile() const {return pending ? pendingProfile : (busy ? writing.profile : storedProfile);}
+};
+
+#endif // _PROFILEJOURNAL_H
@@ -0,0 +1,173 @@
+/**
+ * \file quadrature.h
+ * Table-driven decoder for the quadrature signals of rotary encoders
+ */
+
+#ifndef _QUADRATURE_H
+#define _QUADRATURE_H
+
+#include<cstdint>
+
+/**
+ * \brief Decodes the 2-bit Gray code of a rotary encoder into ticks
+ * \details A finite state machine reads the sequence on the two pins without
+ * being fooled by bouncing. There is one state table for each type of encoder,
+ * so each sample only costs one table lookup.
+ * The class doesn't depend on the Pico SDK, so it can be used (and tested) on
+ * other platforms as well.
+ */
+class QuadratureDecoder
+{
+public:
+	/**
+	 * \brief Types of rotary encoders
+	 * \details The types differ in how many ticks are reported per cycle of
+	 * the 2-bit Gray code sequence (00, 01, 11, 10) on the pins.
+	 */
+	enum class Type : uint8_t
+	{
+		/**
+		 * One tick per cycle (detents at 00)
+		 */
+		FULL_STEP,
+		/**
+		 * Two ticks per cycle (detents at 00 and 11)
+		 */
+		HALF_STEP,
+		/**
+		 * Four ticks per cycle (one per change of the pins)
+		 */
+		QUARTER_STEP
+	};
+
+	/**
+	 * \brief Result of processing a sample
+	 */
+	enum Tick {NONE, LEFT, RIGHT};
+
+private:
+	/**
+	 * \brief Flag in a state table entry: A left turn has been detected
+	 */
+	static constexpr uint8_t EMIT_LEFT = 0x10;
+
+	/**
+	 * \brief Flag in a state table entry: A right turn has been detected
+	 */
+	static constexpr uint8_t EMIT_RIGHT = 0x20;
+
+	/**
+	 * \brief Mask for the next state in a state table entry
+	 */
+	static constexpr uint8_t STATE_MASK = 0x0f;
+
+	/**
+	 * \brief State tables for all types of rotary encoders
+	 * \details Indexed by type, current state and pins. Each entry is the next
+	 * state, possibly combined with EMIT_LEFT or EMIT_RIGHT. State 0 is the
+	 * initial state. A left turn is the sequence 00, 01, 11, 10, 00 on the
+	 * pins, a right turn is the reverse.
+	 */
+	static constexpr uint8_t tables[3][7][4] =
+	{
+		// Type::FULL_STEP
+		// States: 0 = neutral (00), 1..3 = stages of a left turn, 4..6 =
+		// stages of a right turn
+		{
+			//00   01   10   11
+			{0,   1,   4,   0},
+			{0,   1,   1,   2},
+			{2,   1,   3,   2},
+			{0 | EMIT_LEFT, 3, 3, 2},
+			{0,   4,   4,   5},
+			{5,   6,   4,   5},
+			{0 | EMIT_RIGHT, 6, 6, 5}
+		},
+		// Type::HALF_STEP
+		// States: 0 = neutral at 00, 1 = neutral at 11, 2/3 = left turn from
+		// 00/11, 4/5 = right turn from 00/11
+		{
+			//00   01   10   11
+			{0,   2,   4,   1},
+			{0,   5,   3,   1},
+			{0,   2,   2,   1 | EMIT_LEFT},
+			{0 | EMIT_LEFT, 3, 3, 1},
+			{0,   4,   4,   1 | EMIT_RIGHT},
+			{0 | EMIT_RIGHT, 5, 5, 1},
+			{0,   0,   0,   0}
+		},
+		// Type::QUARTER_STEP
+		// States: 0..3 = position in the sequence 00, 01, 11, 10
+		{
+			//00   01   10   11
+			{0,   1 | EMIT_LEFT,  3 | EMIT_RIGHT, 2},
+			{0 | EMIT_RIGHT, 1, 3, 2 | EMIT_LEFT},
+			{0,   1 | EMIT_RIGHT, 3 | EMIT_LEFT, 2},
+			{0 | EMIT_LEFT, 1, 3, 2 | EMIT_RIGHT},
+			{0,   0,   0,   0},
+			{0,   0,   0,   0},
+			{0,   0,   0,   0}
+		}
+	};
+
+	/**
+	 * \brief Type of the rotary encoder
+	 */
+	Type type;
+
+	/**
+	 * \brief State of the finite state machine
+	 */
+	uint8_t state;
+
+public:
+	/**
+	 * \brief Constructs a decoder in its initial state
+	 * \param type Type of the rotary encoder.
+	 */
+	QuadratureDecoder(Type type = Type::FULL_STEP): type(type), state(0) {}
+
+	/**
+	 * \brief Getter for the type
+	 * \return Returns the type of the rotary encoder.
+	 */
+	inline Type getType() const {return type;}
+
+	/**
+	 * \brief Changes the type
+	 * \details Resets the finite state machine.
+	 * \param type The new type.
+	 */
+	inline void setType(Type type) {this->type = type; state = 0;}
+
+	/**
+	 * \brief Processes a sample of the pins
+	 * \param pins Bit 0 is set if Pin A is activated, Bit 1 if Pin B is
+	 * activated (see pins()).
+	 * \return Returns whether the sample has completed a tick, and in which
+	 * direction.
+	 */
+	inline Tick update(uint32_t pins)
+	{
+		uint8_t entry = tables[static_cast<uint32_t>(type)][state][pins];
+		state = entry & STATE_MASK;
+		return entry & EMIT_LEFT ? LEFT : (entry & EMIT_RIGHT ? RIGHT : NONE);
+	}
+
+	/**
+	 * \brief Extracts the pins of a rotary encoder from a snapshot of pin
+	 * levels
+	 * \details The pins are activated by connecting them to GND, i.e. a low
+	 * level means activated.
+	 * \param levels Pin levels, e.g. a snapshot taken by the PIO.
+	 * \param bitA,bitB Positions of Pin A and Pin B in levels.
+	 * \return The pins in the format expected by update().
+	 */
+	static inline uint32_t pins(uint32_t levels, uint32_t bitA, uint32_t bitB)
+	{
+		uint32_t active = ~levels;
+		return ((active >> bitA) & 1) | (((active >> bitB) & 1) << 1);
+	}
+};
+
+#endif // _QUADRATURE_H
@@ -24,7 +24,7 @@
  * include this header file). Note that changing constants like NUM_PROFILES
  * will also cause Settings struct to change.
  */
-#define VERSION 0x0100
+#define VERSION 0x0101
 
 /**
  * \brief Key rollover
@@ -38,11 +38,25 @@
 #define KRO 16
 #endif
 
+/**
+ * \brief N-key rollover
+ * \details If set to 1, keyboard reports contain a bitmap with one bit per
+ * key code instead of an array of KRO key codes. Any number of keys can then
+ * be down at the same time, and adding a key to a report is a single bit
+ * operation. KRO is ignored in this case.
+ * Like KRO, this only takes effect when report protocol is used. If the host
+ * requests boot protocol, the report is reduced to the usual array of 6 key
+ * codes.
+ */
+#ifndef NKRO
+#define NKRO 1
+#endif
+
 /**
  * \brief Number of profiles
  * \details Can be changed to accomodate for a larger or smaller EEPROM. The
  * setting take 3 Bytes + NUM_PROFILES * sizeof(Profile), where sizeof(Profile)
- * is currently 6200 Bytes.
+ * is currently 6215 Bytes.
  * When NUM_PROFILES is modified, other pieces of code might also need
  * changing, for example makeDefaultSettings().
  */
@@ -62,15 +76,20 @@
 
 /**
  * \brief Maximum number of simulanteous keys within an action
- * \details This must not be higher than NKRO, otherwise macros can never
+ * \details This must not be higher than KRO, otherwise macros can never
  * be executed.
  */
 #define MAX_KEYS_PER_ACTION 6
 
-#if MAX_KEYS_PER_ACTION > KRO
+#if MAX_KEYS_PER_ACTION > KRO && !NKRO
 	#error "The maximum number of keys within an Action (MAX_KEYS_PER_ACTION constant) must not exceed KRO."
 #endif
 
+/**
+ * \brief Maximum multiplier for the acceleration of knobs
+ */
+#define MAX_ACCELERATION_MULTIPLIER 16
+
 /**
  * \{
  * \brief Dimensions of profile images
@@ -276,6 +295,34 @@ struct PACKED_STRUCT Key
 	uint8_t image[IMG_CTRL_SIZE];
 };
 
+/**
+ * \brief Acceleration curve for a Knob
+ * \details Turning a knob quickly multiplies the effect of each notch. Up to
+ * minVelocity, the multiplier is 1. Between minVelocity and maxVelocity, it
+ * rises linearly to maxMultiplier. A maxMultiplier of 0 or 1 disables
+ * acceleration.
+ */
+struct PACKED_STRUCT Acceleration
+{
+	/**
+	 * \brief Speed (in notches per second) up to which there is no
+	 * acceleration
+	 */
+	uint16_t minVelocity;
+
+	/**
+	 * \brief Speed (in notches per second) from which on the multiplier is
+	 * maxMultiplier
+	 */
+	uint16_t maxVelocity;
+
+	/**
+	 * \brief Maximum multiplier
+	 * \details Must not exceed MAX_ACCELERATION_MULTIPLIER.
+	 */
+	uint8_t maxMultiplier;
+};
+
 /**
  * \brief Collects the settings for a Knob (Rotary Encoder)
  * \details This only concerns rotations. The integrated push switch of a
@@ -291,6 +338,13 @@ struct PACKED_STRUCT Knob
 	Macro left, right;
 	/// \}
 
+	/**
+	 * \brief Acceleration when the knob is turned quickly
+	 * \details Mouse movements in the macros are multiplied. Macros with other
+	 * actions are repeated instead, with a release of one tick in between.
+	 */
+	Acceleration acceleration;
+
 	/**
 	 * \{
 	 * \brief Images
@@ -8,6 +8,7 @@
 
 #include"settings.h"
 #include"hid.h"
+#include"latencytrace.h"
 
 //-----------------------------------------------------------------------------
 // Helper functions for Settings
@@ -34,6 +35,14 @@ void printSettings(const Settings& settings);
  */
 inline const Profile& getActiveProfile(const Settings& settings) {return settings.profiles[settings.activeProfile];}
 
+/**
+ * \brief Evaluate an acceleration curve
+ * \param acceleration The acceleration curve.
+ * \param velocity Speed of the knob in notches per second.
+ * \return Returns the multiplier (at least 1).
+ */
+uint getAccelerationMultiplier(const Acceleration& acceleration, uint velocity);
+
 //-----------------------------------------------------------------------------
 // Macro lists
 
@@ -42,6 +51,13 @@ inline const Profile& getActiveProfile(const Settings& settings) {return setting
  */
 #define MAX_ACTIVE_MACROS 32
 
+/**
+ * \brief Duration (in us) of a macro tick
+ * \details The durations of MacroSteps are given in ticks. Mouse movements
+ * are applied once per tick.
+ */
+#define MACRO_TICK_INTERVAL 10000
+
 /**
  * \brief List that holds the currently running macros
  */
@@ -64,9 +80,39 @@ private:
 		const Macro* macro;
 
 		/**
-		 * \brief Current tick (measured in 10ms) within the macro
+		 * \brief Current tick (measured in MACRO_TICK_INTERVAL) within the
+		 * macro
 		 */
 		uint tick;
+
+		/**
+		 * \brief Has the macro been added to a report yet?
+		 * \details The first tick starts when that happens.
+		 */
+		bool started;
+
+		/**
+		 * \brief When the next tick starts
+		 */
+		absolute_time_t tsNextTick;
+
+		/**
+		 * \brief Factor for mouse movements
+		 */
+		uint scale;
+
+		/**
+		 * \brief Number of times the macro still needs to run (including the
+		 * current run)
+		 * \details Each run but the last is followed by a pause of one tick.
+		 */
+		uint repeat;
+
+		/**
+		 * \brief Handle of the LatencyTracer trace following this macro
+		 * \details Negative if the macro isn't traced (any more).
+		 */
+		int trace;
 	} macros[MAX_ACTIVE_MACROS];
 
 public:
@@ -94,11 +140,30 @@ public:
 
 	/**
 	 * \brief Adds a macro to the list
+	 * \details A multiplier > 1 (e.g. from the acceleration of a knob) has the
+	 * same effect as adding the macro that many times, but only takes up one
+	 * slot: If the macro consists of nothing but mouse movements, these are
+	 * multiplied (the mouse carries over whatever doesn't fit into one
+	 * report). Otherwise the macro is run that many times in a row, with a
+	 * pause of one tick after each run, so keys and consumer controls are
+	 * released in between and the host sees separate presses.
 	 * \param macro Pointer to the macro that should be added.
+	 * \param multiplier How many times the macro should take effect.
+	 * \param trace Handle of a LatencyTracer trace that should follow the
+	 * macro until its first action has been added to a report, or -1.
 	 * \return Returns true if the macro was successfully added, false if the
 	 * list is full.
 	 */
-	bool add(const Macro& macro);
+	bool add(const Macro& macro, uint multiplier = 1, int trace = -1);
+
+	/**
+	 * \brief Determines if a macro has reached the next tick
+	 * \details The reports need to be assembled again whenever this is the
+	 * case (or a macro has been added).
+	 * \param now Current time.
+	 * \return Returns true if addToReport() needs to be called.
+	 */
+	bool isDue(absolute_time_t now) const;
 
 	/**
 	 * \brief Adds the actions from all the macros to a set of UsbHidInterface
@@ -106,14 +171,23 @@ public:
 	 * \details Goes through all the macros in the list and attempts to add
 	 * their current action to the reports using
 	 * UsbHidInterface::addActionToReport().
+	 * The macros advance in real time: Each call moves every macro on to the
+	 * tick it has reached by now, so this can be called as often as reports
+	 * need to be assembled without affecting the timing of the macros. Mouse
+	 * movements (and actions that aren't of type ActionType::INPUT) only take
+	 * effect once per tick, though. If a call comes late and several ticks
+	 * have passed, their mouse movements are combined.
+	 * \param now Current time.
 	 * \param interfaces List of interfaces to whose reports the actions are added.
 	 * \param numInterfaces Number of interfaces in the list.
 	 * \param nonInputActionCallback This class only processes Actions of type
 	 * ActionType::INPUT. If it encounters Actions of other types (e.g. profile
 	 * switches), it calls this function.
 	 * \param userData An arbitrary pointer passed to the callback.
+	 * \param tracer If not null, the traces of the macros are notified when
+	 * their first action has been added to the reports.
 	 */
-	void addToReport(UsbHidInterface* interfaces[], uint numInterfaces, void (*nonInputActionCallback)(const Action&, void*) = nullptr, void* userData = nullptr);
+	void addToReport(absolute_time_t now, UsbHidInterface* interfaces[], uint numInterfaces, void (*nonInputActionCallback)(const Action&, void*) = nullptr, void* userData = nullptr, LatencyTracer* tracer = nullptr);
 };
 
 #endif // _SETTINGSTOOLS_H
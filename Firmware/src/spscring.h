@@ -0,0 +1,151 @@
+/**
+ * \file spscring.h
+ * Lock-free ring buffer for passing data from one producer to one consumer
+ */
+
+#ifndef _SPSCRING_H
+#define _SPSCRING_H
+
+#include<cstdint>
+#include<atomic>
+
+/**
+ * \brief Lock-free single-producer/single-consumer ring buffer
+ * \details One thread of execution (e.g. Core 0) may push items while another
+ * one (e.g. Core 1) pops them, without any locks or critical sections. Each
+ * index is only ever written by one side. The producer publishes an item by
+ * storing the head index with release semantics after the item has been
+ * written, and the consumer reads the head index with acquire semantics before
+ * reading the item (and vice versa for the tail index), so an item can never
+ * be seen half-written.
+ * Only atomic loads and stores are needed, which are lock-free even on the
+ * Cortex-M0+. The class doesn't depend on the Pico SDK, so it can be used
+ * (and tested) on other platforms as well.
+ * Waking up the consumer is up to the user, e.g. by executing __sev() after
+ * push() if the consumer sleeps on __wfe().
+ * \tparam T Type of the items. Should be trivially copyable.
+ * \tparam N Capacity. Must be a power of two.
+ */
+template<typename T, uint32_t N>
+class SpscRing
+{
+	static_assert(N > 0 && (N & (N - 1)) == 0, "The capacity of an SpscRing must be a power of two");
+
+private:
+	/**
+	 * \brief Storage for the items
+	 */
+	T items[N];
+
+	/**
+	 * \brief Number of items pushed so far (modulo 2^32)
+	 * \details Only written by the producer.
+	 */
+	std::atomic<uint32_t> head;
+
+	/**
+	 * \brief Number of items popped so far (modulo 2^32)
+	 * \details Only written by the consumer.
+	 */
+	std::atomic<uint32_t> tail;
+
+public:
+	/**
+	 * \brief Constructs an empty ring buffer
+	 */
+	SpscRing(): head(0), tail(0) {}
+
+	/**
+	 * \{
+	 * \brief Prevent copying
+	 */
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+	/// \}
+
+	/**
+	 * \brief Capacity of the ring buffer
+	 * \return The maximum number of items.
+	 */
+	static constexpr uint32_t capacity() {return N;}
+
+	/**
+	 * \brief Adds an item
+	 * \details Must only be called by the producer.
+	 * \param item The item to be added.
+	 * \return Returns true if the item has been added or false if the ring
+	 * buffer is full.
+	 */
+	bool push(const T& item)
+	{
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if(h - tail.load(std::memory_order_acquire) >= N)
+			return false;
+		items[h % N] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Removes the oldest item
+	 * \details Must only be called by the consumer.
+	 * \param[out] item Receives the item.
+	 * \return Returns true if an item has been removed or false if the ring
+	 * buffer is empty.
+	 */
+	bool pop(T& item)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if(t == head.load(std::memory_order_acquire))
+			return false;
+		item = items[t % N];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Looks at the oldest items without removing them
+	 * \details Must only be called by the consumer. Only the items up to the
+	 * end of the storage are returned, so they form a contiguous span. If
+	 * there are more items, the remainder can be obtained by calling this
+	 * method again after consume().
+	 * \param[out] first Receives a pointer to the oldest item.
+	 * \return The number of items in the span (0 if the ring buffer is
+	 * empty).
+	 */
+	uint32_t peek(const T*& first) const
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		uint32_t n = head.load(std::memory_order_acquire) - t;
+		first = &items[t % N];
+		return n < N - t % N ? n : N - t % N;
+	}
+
+	/**
+	 * \brief Removes the oldest items
+	 * \details Must only be called by the consumer, after it is done with
+	 * the items obtained through peek().
+	 * \param n Number of items to remove. Must not exceed the number of
+	 * items returned by peek().
+	 */
+	void consume(uint32_t n)
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+	/**
+	 * \brief Number of items in the ring buffer
+	 * \details Only a snapshot if called while the other side is active.
+	 * \return The number of items.
+	 */
+	inline uint32_t size() const {return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);}
+
+	/**
+	 * \brief Determines whether the ring buffer is empty
+	 * \details Only a snapshot if called while the other side is active.
+	 * \return Returns true if there are no items.
+	 */
+	inline bool empty() const {return size() == 0;}
+};
+
+#endif // _SPSCRING_H
@@ -41,9 +41,9 @@
 #define CFG_TUD_ENDPOINT0_SIZE 64
 
 /**
- * \brief Implementing three HID-class devices
+ * \brief Implementing four HID-class devices
  */
-#define CFG_TUD_HID		3
+#define CFG_TUD_HID		4
 
 //-----------------------------------------------------------------------------
 // HID Interface Configuration
@@ -6,6 +6,8 @@
 #include"pico/unique_id.h"
 #include"tusb.h"
 #include"settings.h"
+#include"input.h"
+#include"latencytrace.h"
 #include"usb_descriptors.h"
 
 //-----------------------------------------------------------------------------
@@ -22,7 +24,8 @@ enum
 	STRID_SERIAL,
 	STRID_ITF0_NAME,
 	STRID_ITF1_NAME,
-	STRID_ITF2_NAME
+	STRID_ITF2_NAME,
+	STRID_ITF3_NAME
 };
 
 /**
@@ -42,8 +45,10 @@ const char* string_desc_arr[] =
 	"Keyboard Interface",
 	// 5: Interface 1
 	"Mouse Interface",
-	// 5: Interface 2
-	"Generic HID Interface"
+	// 6: Interface 2
+	"Generic HID Interface",
+	// 7: Interface 3
+	"Configuration Interface"
 };
 
 
@@ -150,9 +155,10 @@ uint8_t const* tud_descriptor_device_cb(void)
 //-----------------------------------------------------------------------------
 // HID Report descriptors
 
-// Keyboard reports (from device to host) are 3+KRO bytes in size:
+// Keyboard reports (from device to host) are 2+KRO bytes in size:
 // 1 byte for modifiers, 1 byte reserved, KRO bytes for key codes
-#if (3 + KRO) > CFG_TUD_HID_EP_BUFSIZE
+// (or 32 bytes for the bitmap with NKRO)
+#if !NKRO && (3 + KRO) > CFG_TUD_HID_EP_BUFSIZE
 	#error "Invalid KRO (key rollover). Please adjust in settings.h."
 #endif
 
@@ -189,6 +195,17 @@ const uint8_t desc_hid_report_keyboard[] =
 		HID_REPORT_COUNT(1),
 		HID_REPORT_SIZE(3),
 		HID_OUTPUT(HID_CONSTANT),
+#if NKRO
+		// Bitmap of key codes (one bit per key code)
+		HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
+		HID_USAGE_MIN(0),
+		HID_USAGE_MAX_N(255, 2),
+		HID_LOGICAL_MIN(0),
+		HID_LOGICAL_MAX(1),
+		HID_REPORT_COUNT_N(256, 2),
+		HID_REPORT_SIZE(1),
+		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+#else
 		// Array of key codes
 		HID_USAGE_PAGE(HID_USAGE_PAGE_KEYBOARD),
 		HID_USAGE_MIN(0),
@@ -198,6 +215,7 @@ const uint8_t desc_hid_report_keyboard[] =
 		HID_REPORT_COUNT(KRO), // from settings.h
 		HID_REPORT_SIZE(8),
 		HID_INPUT(HID_DATA | HID_ARRAY | HID_ABSOLUTE),
+#endif
 	HID_COLLECTION_END
 };
 
@@ -206,8 +224,77 @@ const uint8_t desc_hid_report_keyboard[] =
  */
 const uint8_t desc_hid_report_mouse[] =
 {
-	// (No Report ID since this interface has only one type of report)
-	TUD_HID_REPORT_DESC_MOUSE()
+	// (No Report ID since this interface has only one type of input report
+	// and one feature report)
+	HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+	HID_USAGE(HID_USAGE_DESKTOP_MOUSE),
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		HID_USAGE(HID_USAGE_DESKTOP_POINTER),
+		HID_COLLECTION(HID_COLLECTION_PHYSICAL),
+			// 5 buttons (padded to 8 bits)
+			HID_USAGE_PAGE(HID_USAGE_PAGE_BUTTON),
+			HID_USAGE_MIN(1),
+			HID_USAGE_MAX(5),
+			HID_LOGICAL_MIN(0),
+			HID_LOGICAL_MAX(1),
+			HID_REPORT_COUNT(5),
+			HID_REPORT_SIZE(1),
+			HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+			HID_REPORT_COUNT(1),
+			HID_REPORT_SIZE(3),
+			HID_INPUT(HID_CONSTANT),
+			// Relative x and y (16 bits each)
+			HID_USAGE_PAGE(HID_USAGE_PAGE_DESKTOP),
+			HID_USAGE(HID_USAGE_DESKTOP_X),
+			HID_USAGE(HID_USAGE_DESKTOP_Y),
+			HID_LOGICAL_MIN_N(-32767, 2),
+			HID_LOGICAL_MAX_N(32767, 2),
+			HID_REPORT_COUNT(2),
+			HID_REPORT_SIZE(16),
+			HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
+			// Vertical wheel (16 bits) with resolution multiplier (2 bits in
+			// the feature report)
+			HID_COLLECTION(HID_COLLECTION_LOGICAL),
+				HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+				HID_LOGICAL_MIN(0),
+				HID_LOGICAL_MAX(1),
+				HID_PHYSICAL_MIN(1),
+				HID_PHYSICAL_MAX_N(MOUSE_RESOLUTION_MULTIPLIER, 2),
+				HID_REPORT_COUNT(1),
+				HID_REPORT_SIZE(2),
+				HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+				HID_USAGE(HID_USAGE_DESKTOP_WHEEL),
+				HID_LOGICAL_MIN_N(-32767, 2),
+				HID_LOGICAL_MAX_N(32767, 2),
+				HID_PHYSICAL_MIN(0),
+				HID_PHYSICAL_MAX(0),
+				HID_REPORT_SIZE(16),
+				HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
+			HID_COLLECTION_END,
+			// Horizontal wheel (16 bits) with resolution multiplier (2 bits
+			// in the feature report)
+			HID_COLLECTION(HID_COLLECTION_LOGICAL),
+				HID_USAGE(HID_USAGE_DESKTOP_RESOLUTION_MULTIPLIER),
+				HID_LOGICAL_MIN(0),
+				HID_LOGICAL_MAX(1),
+				HID_PHYSICAL_MIN(1),
+				HID_PHYSICAL_MAX_N(MOUSE_RESOLUTION_MULTIPLIER, 2),
+				HID_REPORT_SIZE(2),
+				HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+				HID_USAGE_PAGE(HID_USAGE_PAGE_CONSUMER),
+				HID_USAGE_N(HID_USAGE_CONSUMER_AC_PAN, 2),
+				HID_LOGICAL_MIN_N(-32767, 2),
+				HID_LOGICAL_MAX_N(32767, 2),
+				HID_PHYSICAL_MIN(0),
+				HID_PHYSICAL_MAX(0),
+				HID_REPORT_SIZE(16),
+				HID_INPUT(HID_DATA | HID_VARIABLE | HID_RELATIVE),
+			HID_COLLECTION_END,
+			// Padding of the feature report to 8 bits
+			HID_REPORT_SIZE(4),
+			HID_FEATURE(HID_CONSTANT),
+		HID_COLLECTION_END,
+	HID_COLLECTION_END
 };
 
 /**
@@ -225,9 +312,9 @@ const uint8_t desc_hid_report_misc[] =
 	HID_COLLECTION(HID_COLLECTION_APPLICATION),
 		HID_REPORT_ID(REPORT_ID_SLIDER)
 		HID_LOGICAL_MIN(0),
-		HID_LOGICAL_MAX(255),
+		HID_LOGICAL_MAX_N(4095, 2),
 		HID_REPORT_COUNT(1),
-		HID_REPORT_SIZE(8),
+		HID_REPORT_SIZE(16),
 		HID_INPUT(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
 	HID_COLLECTION_END,
 	// Feature reports for reading/writing settings
@@ -250,9 +337,10 @@ const uint8_t desc_hid_report_misc[] =
 	// 3: Currently loading settings data from EEPROM. The mode feature is read
 	// only while this is going on. After the settings have been loaded, the
 	// device will automatically switch to normal mode.
-	// 4: Currently storing settings data in EEPROM. The mode feature is read
-	// only while this is going on. After the settings have been stored, the
-	// device will automatically switch to normal mode.
+	// 4: Store settings data in EEPROM. Only the parts that have been
+	// written since they were last stored are written to the EEPROM. This
+	// happens in the background, the device switches to normal mode right
+	// away (so this value is never read).
 	// (See Mode in main.cpp)
 	HID_COLLECTION(HID_COLLECTION_APPLICATION),
 		HID_REPORT_ID(REPORT_ID_MODE)
@@ -283,14 +371,101 @@ const uint8_t desc_hid_report_misc[] =
 		HID_REPORT_COUNT(63),
 		HID_REPORT_SIZE(8),
 		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+	HID_COLLECTION_END,
+	// 5.) Latency histogram of a switch (time from the first edge on the pin
+	// to the debounced event) or a rotary encoder (time from the first change
+	// of the pins to the tick), plus statistics of the input scan rate
+	// Access: read/write
+	// Writing one byte selects the control (or resets all histograms if it is
+	// 0xff). The switches come first, followed by the rotary encoders.
+	// Reading returns (all multi-byte values little endian):
+	// Byte 0: Index of the selected control
+	// Byte 1: Number of buckets (LATENCY_HISTOGRAM_BUCKETS)
+	// Bytes 2..3: Width of a bucket in us (LATENCY_HISTOGRAM_BUCKET_WIDTH)
+	// Bytes 4..7: Number of scans at the burst rate (INPUT_POLL_INTERVAL)
+	// Bytes 8..11: Number of scans at the idle rate (INPUT_IDLE_POLL_INTERVAL)
+	// Bytes 12..11+2*buckets: Counts of the buckets, 16 bits each
+	// Byte 12+2*buckets: Type of the control (0 = switch, 1 = rotary encoder)
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		HID_REPORT_ID(REPORT_ID_LATENCY_HISTOGRAM)
+		HID_REPORT_COUNT(13 + 2 * LATENCY_HISTOGRAM_BUCKETS),
+		HID_REPORT_SIZE(8),
+		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+	HID_COLLECTION_END,
+	// 6.) Finished latency traces (from the capture of an input event to the
+	// completed transfer of the report carrying the resulting action)
+	// Access: read only
+	// Each read takes up to LATENCY_TRACE_RECORDS_PER_REPORT traces out of the
+	// buffer of the LatencyTracer (all multi-byte values little endian):
+	// Byte 0: Number of traces in this report
+	// Bytes 1..4: Number of traces abandoned so far
+	// Bytes 5..: The traces, each consisting of the control (1 byte; switches
+	// count from 0, knobs from LatencyTracer::CONTROL_KNOB) followed by the
+	// durations of the LATENCY_TRACE_STAGES stages in us (16 bits each)
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		HID_REPORT_ID(REPORT_ID_LATENCY_TRACE)
+		HID_REPORT_COUNT(5 + (1 + 2 * LATENCY_TRACE_STAGES) * LATENCY_TRACE_RECORDS_PER_REPORT),
+		HID_REPORT_SIZE(8),
+		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+	HID_COLLECTION_END,
+	// 7.) Scheduling of the input reports and its timing statistics
+	// Access: read/write
+	// Writing one byte selects the Scheduling and (re)starts collecting the
+	// statistics. Until then, the SOFs aren't counted (unless the Scheduling
+	// is START_OF_FRAME).
+	// Reading returns (all multi-byte values little endian):
+	// Byte 0: Scheduling
+	// Bytes 1..4: Number of USB frames (SOFs)
+	// Bytes 5..8: Number of reports handed to TinyUSB
+	// Bytes 9..10: Minimum phase in us (time from the SOF to handing a report
+	// to TinyUSB)
+	// Bytes 11..12: Maximum phase in us
+	// Bytes 13..20: Sum of the phases
+	// Bytes 21..28: Sum of the squared phases
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		HID_REPORT_ID(REPORT_ID_REPORT_TIMING)
+		HID_REPORT_COUNT(29),
+		HID_REPORT_SIZE(8),
+		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
+	HID_COLLECTION_END,
+	// 8.) Hashes of the regions of the Settings struct (see
+	// hashSettingsRegion())
+	// Access: read/write
+	// Writing two bytes (little endian) selects the first region. Reading
+	// returns (all multi-byte values little endian):
+	// Bytes 0..1: Index of the first region in this report
+	// Byte 2: Number of hashes in this report
+	// Bytes 3..: The hashes, 32 bits each
+	// The index is automatically incremented by the number of hashes after
+	// each read, so all hashes can be read one report after the other.
+	HID_COLLECTION(HID_COLLECTION_APPLICATION),
+		HID_REPORT_ID(REPORT_ID_SETTINGS_HASH)
+		HID_REPORT_COUNT(3 + 4 * SETTINGS_HASHES_PER_REPORT),
+		HID_REPORT_SIZE(8),
+		HID_FEATURE(HID_DATA | HID_VARIABLE | HID_ABSOLUTE),
 	HID_COLLECTION_END
 };
 
+/**
+ * \brief HID descriptor for Interface 3 (Configuration)
+ * \details Vendor-defined input and output reports of CONFIG_REPORT_SIZE
+ * bytes (no Report ID) carrying the packets described at ConfigCommand.
+ */
+const uint8_t desc_hid_report_config[] =
+{
+	TUD_HID_REPORT_DESC_GENERIC_INOUT(CONFIG_REPORT_SIZE)
+};
+
+#if CONFIG_REPORT_SIZE > CFG_TUD_HID_EP_BUFSIZE
+	#error "Reports of the configuration interface don't fit into the endpoint buffer"
+#endif
+
 /**
  * \brief Callback function for when the host requests a report descriptor
  * \param itf Index of the interface for which the descriptor is requested.
  * \return Returns a pointer to the requested descriptor (either
- * desc_hid_report_keyboard, desc_hid_report_mouse, or desc_hid_report_misc).
+ * desc_hid_report_keyboard, desc_hid_report_mouse, desc_hid_report_misc, or
+ * desc_hid_report_config).
  */
 const uint8_t* tud_hid_descriptor_report_cb(uint8_t itf)
 {
@@ -299,6 +474,7 @@ const uint8_t* tud_hid_descriptor_report_cb(uint8_t itf)
 	case ITF_NUM_HID_KEYBOARD: return desc_hid_report_keyboard;
 	case ITF_NUM_HID_MOUSE: return desc_hid_report_mouse;
 	case ITF_NUM_HID_MISC: return desc_hid_report_misc;
+	case ITF_NUM_HID_CONFIG: return desc_hid_report_config;
 	default: return NULL;
 	}
 }
@@ -310,7 +486,7 @@ const uint8_t* tud_hid_descriptor_report_cb(uint8_t itf)
  * \brief Total length of configuration descriptor
  * \details This includes the interface, HID, and endpoint descriptors.
  */
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + ITF_NUM_TOTAL * TUD_HID_DESC_LEN)
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + ITF_NUM_INPUT * TUD_HID_DESC_LEN + TUD_HID_INOUT_DESC_LEN)
 
 /**
  * \{
@@ -319,8 +495,14 @@ const uint8_t* tud_hid_descriptor_report_cb(uint8_t itf)
 #define EPNUM_HID_KEYBOARD 0x81
 #define EPNUM_HID_MOUSE 0x82
 #define EPNUM_HID_MISC 0x83
+#define EPNUM_HID_CONFIG_IN 0x84
+#define EPNUM_HID_CONFIG_OUT 0x04
 /// \}
 
+#if HID_POLL_INTERVAL < 1 || HID_POLL_INTERVAL > 255
+#error "HID_POLL_INTERVAL must be between 1 and 255"
+#endif
+
 /**
  * \brief Configuration descriptor
  * \details This includes the interface, HID, and endpoint descriptors.
@@ -357,7 +539,7 @@ const uint8_t desc_configuration[] =
 		// EP Buffer size
 		CFG_TUD_HID_EP_BUFSIZE,
 		// Polling interval
-		10
+		HID_POLL_INTERVAL
 	),
 	TUD_HID_DESCRIPTOR
 	(
@@ -374,7 +556,7 @@ const uint8_t desc_configuration[] =
 		// EP Buffer size
 		CFG_TUD_HID_EP_BUFSIZE,
 		// Polling interval
-		10
+		HID_POLL_INTERVAL
 	),
 	TUD_HID_DESCRIPTOR
 	(
@@ -391,7 +573,27 @@ const uint8_t desc_configuration[] =
 		// EP Buffer size
 		CFG_TUD_HID_EP_BUFSIZE,
 		// Polling interval
-		10
+		HID_POLL_INTERVAL
+	),
+	TUD_HID_INOUT_DESCRIPTOR
+	(
+		// Interface number
+		ITF_NUM_HID_CONFIG,
+		// Index of string descriptor
+		STRID_ITF3_NAME,
+		// Protocol
+		HID_ITF_PROTOCOL_NONE,
+		// Length of report descriptor
+		sizeof(desc_hid_report_config),
+		// EP OUT Address
+		EPNUM_HID_CONFIG_OUT,
+		// EP IN Address
+		EPNUM_HID_CONFIG_IN,
+		// EP Buffer size
+		CFG_TUD_HID_EP_BUFSIZE,
+		// Polling interval (as fast as possible, this is what makes the
+		// transfers quick)
+		1
 	)
 };
 
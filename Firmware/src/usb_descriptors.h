@@ -3,6 +3,9 @@
  * USB Descriptors
  */
 
+#ifndef _USB_DESCRIPTORS_H
+#define _USB_DESCRIPTORS_H
+
 #include<cstdint>
 
 /**
@@ -20,22 +23,52 @@
  * in a way that is hard to get rid of. This means that if you change the
  * interfaces, you should probably choose a new PID.
  */
-#define USB_PID 0x9F8E
+#define USB_PID 0x9F8F
+
+/**
+ * \brief Polling interval (in ms) of the interrupt endpoints
+ * \details The bInterval of the endpoint descriptors (1..255). The host asks
+ * for a new report this often, so it bounds the latency of the reports (which
+ * are assembled as soon as there is new input). Lower values take up more of
+ * the periodic bandwidth of the bus.
+ */
+#ifndef HID_POLL_INTERVAL
+#define HID_POLL_INTERVAL 1
+#endif
+
+/**
+ * \brief Resolution multiplier of the mouse wheels
+ * \details If the host enables the high resolution of a wheel (through the
+ * feature report of the mouse interface), its movements are reported in units
+ * of 1/MOUSE_RESOLUTION_MULTIPLIER detents. 120 matches the WHEEL_DELTA of
+ * Windows and the high-resolution wheel events of Linux.
+ */
+#ifndef MOUSE_RESOLUTION_MULTIPLIER
+#define MOUSE_RESOLUTION_MULTIPLIER 120
+#endif
 
 /**
  * \brief Interface IDs
- * \details MacroPad presents three interfaces to the host: a keyboard (0),
- * a mouse (1) and a miscellaneous (2) which combines all other devices and is
- * also responsable for the feature requests.
+ * \details MacroPad presents four interfaces to the host: a keyboard (0),
+ * a mouse (1), a miscellaneous (2) which combines all other devices and is
+ * also responsable for the feature requests, and a vendor-defined one (3)
+ * for transferring the settings (see ConfigCommand).
+ * Only the first ITF_NUM_INPUT interfaces send input reports.
  */
 enum
 {
 	ITF_NUM_HID_KEYBOARD = 0,
 	ITF_NUM_HID_MOUSE,
 	ITF_NUM_HID_MISC,
+	ITF_NUM_HID_CONFIG,
 	ITF_NUM_TOTAL
 };
 
+/**
+ * \brief Number of interfaces that send input reports
+ */
+#define ITF_NUM_INPUT ITF_NUM_HID_CONFIG
+
 /**
  * \brief Data Report IDs for Interface 2 (Misc)
  * \details Interface 2 is the only one that sends multiple types of data
@@ -62,7 +95,15 @@ enum
 	/// Read/write settings data
 	REPORT_ID_SETTINGS_DATA,
 	/// Get/set active profile
-	REPORT_ID_ACTIVE_PROFILE
+	REPORT_ID_ACTIVE_PROFILE,
+	/// Select/read latency histogram of a switch
+	REPORT_ID_LATENCY_HISTOGRAM,
+	/// Read finished latency traces (read only)
+	REPORT_ID_LATENCY_TRACE,
+	/// Select report scheduling/read its timing statistics
+	REPORT_ID_REPORT_TIMING,
+	/// Select first region/read hashes of the settings
+	REPORT_ID_SETTINGS_HASH
 };
 
 /**
@@ -80,6 +121,109 @@ enum class Mode : uint8_t
 	MAINTENANCE,
 	/// Maintenance mode: Settings are currently being loaded from EEPROM
 	LOADING_SETTINGS,
-	/// Maintenance mode: Settings are currently being stored to EEPROM
+	/// Request from the host (in maintenance mode) to store the modified
+	/// settings to EEPROM. The device switches to normal mode right away and
+	/// stores them in the background, but keeps reporting this mode until
+	/// they are all stored (or storing them failed).
 	STORING_SETTINGS
 };
+
+/**
+ * \brief When input reports are assembled and handed to TinyUSB
+ * \details These are the possible values for the first byte of reports with
+ * id REPORT_ID_REPORT_TIMING.
+ */
+enum class Scheduling : uint8_t
+{
+	/// As soon as there is new input (at any point within a USB frame)
+	ON_DEMAND,
+	/// At the start of the next USB frame (SOF), so the report is fresh but
+	/// already queued when the host polls
+	START_OF_FRAME
+};
+
+/**
+ * \brief Size (in bytes) of the regions of the Settings struct that are hashed
+ * \details The host compares the hashes of the regions in the device with
+ * those of its own copy and only transfers the regions that differ. Smaller
+ * regions mean less data to transfer for small changes, but more hashes to
+ * read.
+ */
+#define SETTINGS_HASH_REGION_SIZE 128
+
+/**
+ * \brief Number of region hashes per REPORT_ID_SETTINGS_HASH feature report
+ */
+#define SETTINGS_HASHES_PER_REPORT 15
+
+/**
+ * \brief Computes the hash of a region of the Settings struct
+ * \details 32-bit FNV-1a. Used by both the device and the host, so they must
+ * agree on it. Region i covers the bytes from i * SETTINGS_HASH_REGION_SIZE up
+ * to the next region or the end of the struct.
+ * \param data Start of the region.
+ * \param length Length of the region in bytes.
+ * \return The hash.
+ */
+inline uint32_t hashSettingsRegion(const uint8_t* data, uint32_t length)
+{
+	uint32_t hash = 2166136261u;
+	for(uint32_t i = 0; i < length; i++)
+		hash = (hash ^ data[i]) * 16777619u;
+	return hash;
+}
+
+/**
+ * \brief Size of the reports on the configuration interface (both
+ * directions)
+ */
+#define CONFIG_REPORT_SIZE 64
+
+/**
+ * \brief Size of the header of each report on the configuration interface
+ * \details Byte 0: ConfigCommand, byte 1: sequence number, byte 2: length of
+ * the payload, byte 3: reserved, bytes 4-7: address (little endian).
+ */
+#define CONFIG_HEADER_SIZE 8
+
+/**
+ * \brief Maximum payload of a report on the configuration interface
+ */
+#define CONFIG_PAYLOAD_SIZE (CONFIG_REPORT_SIZE - CONFIG_HEADER_SIZE)
+
+/**
+ * \brief Number of packets that may be sent on the configuration interface
+ * before they have been acknowledged
+ */
+#define CONFIG_WINDOW 16
+
+/**
+ * \brief Commands on the configuration interface
+ * \details The configuration interface moves the Settings struct in windowed
+ * transfers: Either side may send up to CONFIG_WINDOW packets ahead of the
+ * acknowledgements it has received. Packets carrying data (OPEN, READ, WRITE
+ * from the host, DATA from the device) are numbered consecutively (modulo
+ * 256) in each direction. Acknowledgements are cumulative: ACK n confirms
+ * packet n and all before it.
+ */
+enum class ConfigCommand : uint8_t
+{
+	/// Host to device: Starts a session. Its sequence number is the first
+	/// one of the host. Aborts a READ in progress.
+	OPEN = 1,
+	/// Host to device: Read the number of bytes given in the payload (32 bit)
+	/// starting at the address. The device answers with DATA packets,
+	/// numbered from 0.
+	READ,
+	/// Host to device: Write the payload to the address
+	WRITE,
+	/// Device to host: Payload read from the address
+	DATA,
+	/// Acknowledges the packet with the sequence number and all before it
+	ACK,
+	/// Device to host: The packet with the sequence number (the one that was
+	/// expected) was missing or rejected. The session has to be opened again.
+	NAK
+};
+
+#endif // _USB_DESCRIPTORS_H
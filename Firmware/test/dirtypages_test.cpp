@@ -0,0 +1,296 @@
+/**
+ * \file dirtypages_test.cpp
+ * Host test for DirtyPages (runs across bitmap words, the trimmed last page,
+ * pages modified while they are stored) and the way the firmware keeps the
+ * settings in EEPROM up to date with them
+ * Usage: dirtypages_test
+ */
+
+#include<cstdio>
+#include<cstdint>
+#include<cstring>
+#include<vector>
+#include<utility>
+#include<cstddef>
+#include"settings.h"
+#include"usb_descriptors.h"
+#include"dirtypages.h"
+
+/// Same as in main.cpp
+#define SETTINGS_PAGE_SIZE 64
+
+/// Number of failed checks
+static int failures = 0;
+
+/// Reports a failed check
+#define CHECK(condition) do {if(!(condition)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++;}} while(0)
+
+/**
+ * \brief The settings side of the device: settings in RAM, their image in
+ * EEPROM and the pages that differ
+ */
+struct Device
+{
+	Settings settings;
+	uint8_t eeprom[sizeof(Settings)];
+	DirtyPages<sizeof(Settings), SETTINGS_PAGE_SIZE> pages;
+
+	/**
+	 * \brief Stand-in for makeDefaultSettings()
+	 */
+	static void makeDefaults(Settings& settings)
+	{
+		memset(&settings, 0, sizeof(settings));
+		settings.version = VERSION;
+		for(uint32_t p = 0; p < NUM_PROFILES; p++)
+			snprintf(settings.profiles[p].name, MAX_PROFILE_NAME_LEN, "Profile %u", p + 1);
+	}
+
+	/**
+	 * \brief Loads the settings from EEPROM like the main loop does when its
+	 * read request is finished
+	 * \param markOnFallback Mark all pages after falling back to the
+	 * defaults (the fix). False reproduces the previous behaviour.
+	 * \return Returns true if the settings were loaded, false if the
+	 * defaults are used.
+	 */
+	bool load(bool markOnFallback = true)
+	{
+		memcpy(&settings, eeprom, sizeof(settings));
+		pages.clear();
+		if(settings.version == VERSION)
+			return true;
+		makeDefaults(settings);
+		if(markOnFallback)
+			pages.mark(0, sizeof(Settings));
+		return false;
+	}
+
+	/**
+	 * \brief Writes a range through the configuration interface (or feature
+	 * reports)
+	 */
+	void write(uint32_t address, const uint8_t* data, uint32_t length)
+	{
+		memcpy(reinterpret_cast<uint8_t*>(&settings) + address, data, length);
+		pages.mark(address, length);
+	}
+
+	/**
+	 * \brief Stores all dirty pages like the main loop does in the background
+	 */
+	void store()
+	{
+		uint32_t address, length;
+		while(pages.takeRun(address, length))
+			memcpy(eeprom + address, reinterpret_cast<const uint8_t*>(&settings) + address, length);
+	}
+};
+
+/**
+ * \brief Writes settings to the device like writeToDevice() in the settings
+ * app: only the hash regions that differ are transferred
+ * \return Returns the number of bytes transferred.
+ */
+static uint32_t writeChangedRegions(Device& device, const Settings& settings)
+{
+	const uint8_t* host = reinterpret_cast<const uint8_t*>(&settings);
+	const uint8_t* ram = reinterpret_cast<const uint8_t*>(&device.settings);
+	uint32_t transferred = 0;
+	for(uint32_t address = 0; address < sizeof(Settings); address += SETTINGS_HASH_REGION_SIZE)
+	{
+		uint32_t size = sizeof(Settings) - address < SETTINGS_HASH_REGION_SIZE ? sizeof(Settings) - address : SETTINGS_HASH_REGION_SIZE;
+		if(hashSettingsRegion(ram + address, size) == hashSettingsRegion(host + address, size))
+			continue;
+		device.write(address, host + address, size);
+		transferred += size;
+	}
+	return transferred;
+}
+
+/// Runs of dirty pages: pairs of offset and length
+typedef std::vector<std::pair<uint32_t, uint32_t>> Runs;
+
+/**
+ * \brief Takes all runs
+ * \return The runs in the order they are handed out.
+ */
+template<uint32_t SIZE, uint32_t PAGE_SIZE> static Runs takeAll(DirtyPages<SIZE, PAGE_SIZE>& pages)
+{
+	Runs runs;
+	uint32_t address, length;
+	while(pages.takeRun(address, length))
+		runs.push_back({address, length});
+	return runs;
+}
+
+/**
+ * \brief Runs that start, end or cross the boundaries of the bitmap words
+ */
+static void wordBoundaries()
+{
+	// 71 pages in three words, the last one 5 bytes long
+	DirtyPages<70 * 16 + 5, 16> pages;
+	CHECK(pages.NUM_PAGES == 71);
+	CHECK(takeAll(pages).empty());
+
+	// Across the boundary between the first and second word
+	pages.mark(30 * 16 + 8, 3 * 16);
+	CHECK(pages.getCount() == 4);
+	CHECK((takeAll(pages) == Runs{{30 * 16, 4 * 16}}));
+	CHECK(pages.getCount() == 0);
+
+	// The last page of a word and the first of the next, separately
+	pages.mark(31 * 16, 1);
+	pages.mark(64 * 16 + 15, 1);
+	CHECK((takeAll(pages) == Runs{{31 * 16, 16}, {64 * 16, 16}}));
+
+	// Starting after two clean words
+	pages.mark(64 * 16, 16);
+	pages.mark(66 * 16, 16);
+	pages.mark(65 * 16, 16);
+	CHECK(pages.getCount() == 3);
+	CHECK((takeAll(pages) == Runs{{64 * 16, 3 * 16}}));
+
+	// A whole word and one page on either side
+	pages.mark(31 * 16, 34 * 16);
+	CHECK(pages.getCount() == 34);
+	CHECK((takeAll(pages) == Runs{{31 * 16, 34 * 16}}));
+
+	// Marking a page twice counts once
+	pages.mark(0, 1);
+	pages.mark(15, 1);
+	CHECK(pages.getCount() == 1);
+	pages.clear();
+	CHECK(pages.getCount() == 0);
+	CHECK(takeAll(pages).empty());
+}
+
+/**
+ * \brief The last page is shorter, and ranges past the end are trimmed
+ */
+static void lastPage()
+{
+	DirtyPages<70 * 16 + 5, 16> pages;
+
+	pages.mark(70 * 16 + 4, 1);
+	CHECK((takeAll(pages) == Runs{{70 * 16, 5}}));
+
+	pages.mark(69 * 16 + 15, 2);
+	CHECK((takeAll(pages) == Runs{{69 * 16, 16 + 5}}));
+
+	// Trimmed to the end of the block
+	pages.mark(70 * 16, 100);
+	CHECK(pages.getCount() == 1);
+	pages.mark(0, 0xffffffff);
+	CHECK(pages.getCount() == pages.NUM_PAGES);
+	CHECK((takeAll(pages) == Runs{{0, 70 * 16 + 5}}));
+
+	// Nothing to mark
+	pages.mark(70 * 16 + 5, 1);
+	pages.mark(0xffffffff, 0xffffffff);
+	pages.mark(3, 0);
+	CHECK(pages.getCount() == 0);
+
+	// A block that is a multiple of the page size
+	DirtyPages<64 * 16, 16> even;
+	even.mark(63 * 16, 16);
+	CHECK((takeAll(even) == Runs{{63 * 16, 16}}));
+}
+
+/**
+ * \brief A page that is modified while it is being stored is stored again
+ * \details The data of a run is only read when the EEPROM request is carried
+ * out, which may be before or after the modification.
+ * \param beforeModification Whether the request reads the data before the
+ * modification.
+ */
+static void remarkWhileStoring(bool beforeModification)
+{
+	static Device device;
+	Device::makeDefaults(device.settings);
+	memcpy(device.eeprom, &device.settings, sizeof(Settings));
+	device.pages.clear();
+
+	const char* names[] = {"First", "Second"};
+	uint32_t offset = offsetof(Settings, profiles[1].name);
+	device.write(offset, reinterpret_cast<const uint8_t*>(names[0]), strlen(names[0]) + 1);
+	CHECK(device.pages.getCount() == 1);
+
+	// Start storing the run, then the host modifies the same page
+	uint32_t address, length;
+	CHECK(device.pages.takeRun(address, length));
+	CHECK(address <= offset && offset < address + length);
+	CHECK(device.pages.getCount() == 0);
+	if(beforeModification)
+		memcpy(device.eeprom + address, reinterpret_cast<const uint8_t*>(&device.settings) + address, length);
+	device.write(offset, reinterpret_cast<const uint8_t*>(names[1]), strlen(names[1]) + 1);
+	if(!beforeModification)
+		memcpy(device.eeprom + address, reinterpret_cast<const uint8_t*>(&device.settings) + address, length);
+	CHECK(device.pages.getCount() == 1);
+
+	// The next store writes the page once more
+	device.store();
+	CHECK(memcmp(device.eeprom, &device.settings, sizeof(Settings)) == 0);
+	CHECK(device.load());
+	CHECK(strcmp(device.settings.profiles[1].name, names[1]) == 0);
+}
+
+/**
+ * \brief An EEPROM image of an older version falls back to the defaults, then
+ * the host writes only what differs from them
+ * \details The stored image must end up complete and current, i.e. load
+ * without falling back again.
+ * \param markOnFallback See Device::load().
+ * \return Returns true if the settings load after a reboot.
+ */
+static bool fallBackThenPartialWrite(bool markOnFallback)
+{
+	static Device device;
+
+	// EEPROM written by an older firmware
+	Device::makeDefaults(device.settings);
+	device.settings.version = VERSION - 1;
+	strcpy(device.settings.profiles[2].name, "Old");
+	memcpy(device.eeprom, &device.settings, sizeof(Settings));
+
+	// Boot: falls back to the defaults
+	CHECK(!device.load(markOnFallback));
+	if(markOnFallback)
+		CHECK(device.pages.getCount() == device.pages.NUM_PAGES);
+
+	// The host changes a single profile name and stores
+	static Settings host;
+	Device::makeDefaults(host);
+	strcpy(host.profiles[5].name, "Drawing");
+	uint32_t transferred = writeChangedRegions(device, host);
+	CHECK(transferred > 0 && transferred < sizeof(Settings));
+	device.store();
+	CHECK(device.pages.getCount() == 0);
+
+	// Reboot
+	bool loaded = device.load();
+	if(loaded)
+		CHECK(memcmp(&device.settings, &host, sizeof(Settings)) == 0);
+	return loaded;
+}
+
+int main()
+{
+	wordBoundaries();
+	lastPage();
+	remarkWhileStoring(true);
+	remarkWhileStoring(false);
+
+	CHECK(fallBackThenPartialWrite(true));
+	// Without marking the pages, the old version stays in EEPROM
+	CHECK(!fallBackThenPartialWrite(false));
+
+	if(failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,197 @@
+/**
+ * \file display_bench.cpp
+ * Host test and benchmark for Display::drawBitmap()
+ * Compares the blitter, which works on blocks of 8x8 pixels, with the
+ * previous implementation, which combined the bitmap with the framebuffer one
+ * pixel at a time. Both must produce identical framebuffers for all raster
+ * operations and positions. The same goes for the page-major versions of the
+ * images (see xbm2pages.cmake) and the PageBitmap overload, which copies
+ * whole pages when the bitmap is aligned to them. Then both are timed on the
+ * backgrounds and icons of the firmware.
+ * Usage: display_bench [number of iterations per measurement]
+ */
+
+#include<cstdio>
+#include<cstdlib>
+#include<chrono>
+#include"display.h"
+#include"arrow_down.xbm"
+#include"arrow_up.xbm"
+#include"background_maintenance.xbm"
+#include"background_mask_key_left.xbm"
+#include"background_mask_key_right.xbm"
+#include"background_mask_knob_press.xbm"
+#include"background_normal.xbm"
+#include"background_slider.xbm"
+#include"arrow_down_pages.h"
+#include"arrow_up_pages.h"
+#include"background_maintenance_pages.h"
+#include"background_mask_key_left_pages.h"
+#include"background_mask_key_right_pages.h"
+#include"background_mask_knob_press_pages.h"
+#include"background_normal_pages.h"
+#include"background_slider_pages.h"
+
+/**
+ * \brief Previous implementation of Display::drawBitmap()
+ * \details The loop of the firmware before the blitter was added, with casts
+ * to int so the comparisons compile without warnings. Works with both Bitmap
+ * and PageBitmap.
+ */
+template<template<uint, uint> class BitmapType, uint width, uint height>
+static void drawBitmapPerPixel(Display& display, int x, int y, const BitmapType<width, height>& bitmap, RasterOperation rop = RasterOperation::SRC)
+{
+	for(int py = MAX(0, y); py < y + (int)height && py < 64; py++)
+		for(int px = MAX(0, x); px < x + (int)width && px < 128; px++)
+			display.setPixel(px, py, (static_cast<uint8_t>(rop) >> (2 * bitmap.getPixel(px - x, py - y) + display.getPixel(px, py))) & 1);
+}
+
+/**
+ * \brief Fills the framebuffer with a pseudo-random pattern
+ * \param display The display.
+ * \param seed Selects the pattern.
+ */
+static void fillPattern(Display& display, uint32_t seed)
+{
+	uint32_t state = seed * 2654435761u + 1;
+	for(uint y = 0; y < 64; y++)
+		for(uint x = 0; x < 128; x++)
+		{
+			state = state * 1664525u + 1013904223u;
+			display.setPixel(x, y, state >> 31);
+		}
+}
+
+/**
+ * \brief Checks whether two framebuffers are identical
+ * \param a,b The displays.
+ * \return Returns the number of pixels that differ.
+ */
+static uint countDifferences(Display& a, Display& b)
+{
+	uint n = 0;
+	for(uint y = 0; y < 64; y++)
+		for(uint x = 0; x < 128; x++)
+			n += a.getPixel(x, y) != b.getPixel(x, y);
+	return n;
+}
+
+/// Number of failed comparisons
+static int failures = 0;
+
+/// Positions at which every bitmap is drawn, including partly and fully
+/// off-screen ones and rows that are and aren't aligned to pages
+static const int positions[][2] = {{0, 0}, {3, 5}, {-3, -5}, {-7, 9}, {57, -1}, {120, 60}, {121, 58}, {-200, 0}, {0, 70},
+	{5, 8}, {-9, -8}, {64, 56}, {117, 16}, {0, -64}};
+
+/**
+ * \brief Checks that both implementations produce the same framebuffer
+ * \param name Name of the bitmap (for messages).
+ * \param bitmap The bitmap.
+ */
+template<template<uint, uint> class BitmapType, uint width, uint height>
+static void compare(const char* name, const BitmapType<width, height>& bitmap)
+{
+	static Display a(nullptr, 0, 0), b(nullptr, 0, 0);
+	for(uint r = 0; r < 16; r++)
+		for(uint p = 0; p < sizeof(positions) / sizeof(positions[0]); p++)
+		{
+			RasterOperation rop = static_cast<RasterOperation>(r);
+			fillPattern(a, r * 31 + p);
+			fillPattern(b, r * 31 + p);
+			drawBitmapPerPixel(a, positions[p][0], positions[p][1], bitmap, rop);
+			b.drawBitmap(positions[p][0], positions[p][1], bitmap, rop);
+			uint n = countDifferences(a, b);
+			if(n != 0)
+			{
+				printf("%s: rop %u at (%d,%d): %u pixels differ\n", name, r, positions[p][0], positions[p][1], n);
+				failures++;
+			}
+		}
+}
+
+/**
+ * \brief Measures the time per call of both implementations
+ * \param name Name of the bitmap (for messages).
+ * \param bitmap The bitmap.
+ * \param rop The raster operation.
+ * \param iterations Number of calls per measurement.
+ */
+template<uint width, uint height>
+static void benchmark(const char* name, const Bitmap<width, height>& bitmap, RasterOperation rop, uint iterations)
+{
+	static Display display(nullptr, 0, 0);
+	uint checksum = 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for(uint i = 0; i < iterations; i++)
+	{
+		drawBitmapPerPixel(display, 0, 0, bitmap, rop);
+		checksum += display.getPixel(i % width, i % height);
+	}
+	double perPixel = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+	start = std::chrono::steady_clock::now();
+	for(uint i = 0; i < iterations; i++)
+	{
+		display.drawBitmap(0, 0, bitmap, rop);
+		checksum += display.getPixel(i % width, i % height);
+	}
+	double blocks = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+	printf("%-28s %3ux%-3u rop %2u  per pixel %8.2f us  8x8 blocks %7.2f us  speedup %5.1fx  (checksum %u)\n",
+		name, width, height, static_cast<uint>(rop), perPixel, blocks, perPixel / blocks, checksum);
+}
+
+/**
+ * \brief Runs the comparison and the benchmark for a bitmap
+ * \param name Name of the bitmap (for messages).
+ * \param bits The bitmap in XBM format.
+ * \param pages The same bitmap in page-major format.
+ * \param iterations Number of calls per measurement.
+ */
+template<uint width, uint height>
+static void run(const char* name, const uint8_t* bits, const uint8_t* pages, uint iterations)
+{
+	Bitmap<width, height> bitmap(bits);
+	PageBitmap<width, height> pageBitmap(pages);
+	char pagesName[64];
+	snprintf(pagesName, sizeof(pagesName), "%s_pages", name);
+	compare(name, bitmap);
+	compare(pagesName, pageBitmap);
+	// Both formats must describe the same image
+	for(uint y = 0; y < height; y++)
+		for(uint x = 0; x < width; x++)
+			if(bitmap.getPixel(x, y) != pageBitmap.getPixel(x, y))
+			{
+				printf("%s: pixel (%u,%u) differs between the formats\n", name, x, y);
+				failures++;
+				y = height;
+				break;
+			}
+	benchmark(name, bitmap, RasterOperation::SRC, iterations);
+	benchmark(name, bitmap, RasterOperation::XOR, iterations);
+}
+
+int main(int argc, char* argv[])
+{
+	uint iterations = argc > 1 ? strtoul(argv[1], nullptr, 0) : 200;
+
+	printf("Times are per call on this host, not on the RP2040.\n");
+	run<BKGND_NORMAL_WIDTH, BKGND_NORMAL_HEIGHT>("background_normal", BKGND_NORMAL_BITS, BKGND_NORMAL_PAGES, iterations);
+	run<BKGND_MAINTENANCE_WIDTH, BKGND_MAINTENANCE_HEIGHT>("background_maintenance", BKGND_MAINTENANCE_BITS, BKGND_MAINTENANCE_PAGES, iterations);
+	run<BACKGROUND_SLIDER_WIDTH, BACKGROUND_SLIDER_HEIGHT>("background_slider", BACKGROUND_SLIDER_BITS, BACKGROUND_SLIDER_PAGES, iterations);
+	run<BACKGROUND_MASK_KEY_LEFT_WIDTH, BACKGROUND_MASK_KEY_LEFT_HEIGHT>("background_mask_key_left", BACKGROUND_MASK_KEY_LEFT_BITS, BACKGROUND_MASK_KEY_LEFT_PAGES, iterations);
+	run<BACKGROUND_MASK_KEY_RIGHT_WIDTH, BACKGROUND_MASK_KEY_RIGHT_HEIGHT>("background_mask_key_right", BACKGROUND_MASK_KEY_RIGHT_BITS, BACKGROUND_MASK_KEY_RIGHT_PAGES, iterations);
+	run<BACKGROUND_MASK_KNOB_PRESS_WIDTH, BACKGROUND_MASK_KNOB_PRESS_HEIGHT>("background_mask_knob_press", BACKGROUND_MASK_KNOB_PRESS_BITS, BACKGROUND_MASK_KNOB_PRESS_PAGES, iterations);
+	run<ARROW_UP_WIDTH, ARROW_UP_HEIGHT>("arrow_up", ARROW_UP_BITS, ARROW_UP_PAGES, iterations);
+	run<ARROW_DOWN_WIDTH, ARROW_DOWN_HEIGHT>("arrow_down", ARROW_DOWN_BITS, ARROW_DOWN_PAGES, iterations);
+
+	if(failures != 0)
+	{
+		printf("%d comparison(s) failed\n", failures);
+		return 1;
+	}
+	printf("All comparisons passed\n");
+	return 0;
+}
@@ -0,0 +1,707 @@
+/**
+ * \file input_sim_test.cpp
+ * Host simulation of the PIO input sampler and the rotary encoder decoding
+ * The input_sampler program is read from input.pio and executed cycle by cycle
+ * on simulated pin levels: rotary encoders being spun at various speeds (with
+ * contact bounce) and switches being pressed. The snapshots it pushes are
+ * decoded the way InputMonitor::processSnapshot() does.
+ * Checks:
+ * • Both paths through the sampling loop take the same number of cycles, so
+ *   the pins are sampled at a fixed rate.
+ * • Each snapshot differs from its predecessor, and the snapshots are exactly
+ *   the changes of the sampled levels (none lost, none repeated).
+ * • The rotary encoders yield the expected number of ticks for each type.
+ * • If the CPU doesn't keep up, the state machine stalls instead of pushing
+ *   snapshots that skip over changes.
+ * • Traffic on the I2C bus of the EEPROM (GPIO 14/15, between the sampled
+ *   groups of pins) causes no snapshots, and changes of sampled pins that
+ *   aren't connected to a control cause no activity.
+ */
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstdint>
+#include<algorithm>
+#include<string>
+#include<vector>
+#include<deque>
+#include<map>
+#include<fstream>
+#include<sstream>
+#include<random>
+#include"quadrature.h"
+
+//-----------------------------------------------------------------------------
+// PIO simulator
+
+/**
+ * \brief Just enough of a PIO state machine to run input_sampler
+ * \details Supports the instructions jmp (unconditional and x!=y), in, out,
+ * mov and push, delays, .define (with sums as operands) and
+ * .wrap_target/.wrap. The input shift register shifts to the left without
+ * autopush, the output shift register to the right without autopull, and the
+ * FIFOs are joined for RX (8 entries), like input_sampler_program_init()
+ * configures them.
+ */
+class PioSimulator
+{
+public:
+	/**
+	 * \brief A decoded instruction
+	 */
+	struct Instruction
+	{
+		enum {JMP, IN, OUT, MOV, PUSH} op;
+		/// Destination (mov, out), source (in) or condition (jmp)
+		std::string a;
+		/// Source (mov)
+		std::string b;
+		/// Bit count (in, out), jump target (jmp)
+		uint32_t n;
+		/// Invert the source (mov)
+		bool invert;
+		/// Block if the FIFO is full (push)
+		bool block;
+		/// Delay cycles
+		uint32_t delay;
+	};
+
+	/// Capacity of the RX FIFO
+	static constexpr uint32_t FIFO_SIZE = 8;
+
+	std::vector<Instruction> program;
+	std::map<std::string, uint32_t> defines;
+	uint32_t wrapTarget = 0, wrap = 0;
+
+	uint32_t pc = 0, x = 0, y = 0, isr = 0, osr = 0, delay = 0;
+	std::deque<uint32_t> fifo;
+	uint64_t cycle = 0, stalls = 0;
+
+	/// Cycle and value of every read of the pins
+	std::vector<std::pair<uint64_t, uint32_t>> samples;
+
+	/**
+	 * \brief Assembles the first program in a .pio file
+	 * \param path Path to the file.
+	 * \return Returns false if the file can't be read or contains something
+	 * the simulator doesn't support.
+	 */
+	bool load(const char* path)
+	{
+		std::ifstream file(path);
+		if(!file)
+		{
+			printf("Can't open %s\n", path);
+			return false;
+		}
+		std::map<std::string, uint32_t> labels;
+		std::vector<std::string> targets;
+		std::string line;
+		bool sdkBlock = false;
+		while(std::getline(file, line))
+		{
+			// Skip comments and the code blocks for the SDK
+			line = line.substr(0, line.find(';'));
+			if(line.rfind("% ", 0) == 0)
+			{
+				sdkBlock = true;
+				continue;
+			}
+			if(line.rfind("%}", 0) == 0)
+			{
+				sdkBlock = false;
+				continue;
+			}
+			if(sdkBlock)
+				continue;
+
+			// Delay
+			uint32_t instrDelay = 0;
+			size_t bracket = line.find('[');
+			if(bracket != std::string::npos)
+			{
+				instrDelay = std::stoul(line.substr(bracket + 1));
+				line = line.substr(0, bracket);
+			}
+			for(char& c : line)
+				if(c == ',')
+					c = ' ';
+			std::istringstream tokens(line);
+			std::vector<std::string> t;
+			std::string token;
+			while(tokens >> token)
+				t.push_back(token);
+			if(t.empty())
+				continue;
+
+			if(t[0] == ".program")
+			{
+				if(!program.empty())
+					break;
+			}
+			else if(t[0] == ".define")
+				defines[t[t.size() - 2]] = std::stoul(t.back());
+			else if(t[0] == ".wrap_target")
+				wrapTarget = program.size();
+			else if(t[0] == ".wrap")
+				wrap = program.size() - 1;
+			else if(t[0].back() == ':')
+				labels[t[0].substr(0, t[0].size() - 1)] = program.size();
+			else if(t[0] == "jmp")
+			{
+				program.push_back(Instruction{Instruction::JMP, t.size() > 2 ? t[1] : "", "", 0, false, false, instrDelay});
+				targets.push_back(t.back());
+			}
+			else if((t[0] == "in" || t[0] == "out") && t.size() >= 3)
+			{
+				std::string count;
+				for(size_t i = 2; i < t.size(); i++)
+					count += t[i];
+				program.push_back(Instruction{t[0] == "in" ? Instruction::IN : Instruction::OUT, t[1], "", value(count), false, false, instrDelay});
+				targets.push_back("");
+			}
+			else if(t[0] == "mov" && t.size() == 3)
+			{
+				bool invert = t[2][0] == '~' || t[2][0] == '!';
+				program.push_back(Instruction{Instruction::MOV, t[1], invert ? t[2].substr(1) : t[2], 0, invert, false, instrDelay});
+				targets.push_back("");
+			}
+			else if(t[0] == "push")
+			{
+				bool noblock = t.size() > 1 && t.back() == "noblock";
+				program.push_back(Instruction{Instruction::PUSH, "", "", 0, false, !noblock, instrDelay});
+				targets.push_back("");
+			}
+			else
+			{
+				printf("Unsupported line in %s: %s\n", path, line.c_str());
+				return false;
+			}
+		}
+		for(size_t i = 0; i < program.size(); i++)
+			if(program[i].op == Instruction::JMP)
+			{
+				if(labels.count(targets[i]) == 0)
+				{
+					printf("Unknown label in %s: %s\n", path, targets[i].c_str());
+					return false;
+				}
+				program[i].n = labels[targets[i]];
+			}
+		return !program.empty();
+	}
+
+	/**
+	 * \brief Executes one clock cycle
+	 * \param pins Levels of the pins, bit 0 = first input pin.
+	 */
+	void step(uint32_t pins)
+	{
+		cycle++;
+		if(delay > 0)
+		{
+			delay--;
+			return;
+		}
+		const Instruction& instr = program[pc];
+		uint32_t next = pc == wrap ? wrapTarget : pc + 1;
+		switch(instr.op)
+		{
+			case Instruction::JMP:
+				if(instr.a.empty() || (instr.a == "x!=y" && x != y))
+					next = instr.n;
+				else if(instr.a != "x!=y")
+					abort();
+				break;
+			case Instruction::IN:
+			{
+				uint32_t v = read(instr.a, pins);
+				uint32_t bits = instr.n == 32 ? v : v & ((1u << instr.n) - 1);
+				isr = instr.n == 32 ? bits : (isr << instr.n) | bits;
+				break;
+			}
+			case Instruction::OUT:
+			{
+				uint32_t bits = instr.n == 32 ? osr : osr & ((1u << instr.n) - 1);
+				osr = instr.n == 32 ? 0 : osr >> instr.n;
+				if(instr.a != "null")
+					write(instr.a, bits);
+				break;
+			}
+			case Instruction::MOV:
+			{
+				uint32_t v = read(instr.b, pins);
+				if(instr.invert)
+					v = ~v;
+				write(instr.a, v);
+				break;
+			}
+			case Instruction::PUSH:
+				if(fifo.size() >= FIFO_SIZE)
+				{
+					if(instr.block)
+					{
+						// Stall, i.e. execute the same instruction again in
+						// the next cycle
+						stalls++;
+						return;
+					}
+				}
+				else
+					fifo.push_back(isr);
+				isr = 0;
+				break;
+		}
+		pc = next;
+		delay = instr.delay;
+	}
+
+private:
+	/**
+	 * \brief Evaluates an operand: a number, a define or a sum of them in
+	 * parentheses (without spaces)
+	 */
+	uint32_t value(std::string s)
+	{
+		if(s.size() > 2 && s.front() == '(' && s.back() == ')')
+			s = s.substr(1, s.size() - 2);
+		size_t plus = s.find('+');
+		if(plus != std::string::npos)
+			return value(s.substr(0, plus)) + value(s.substr(plus + 1));
+		return defines.count(s) ? defines[s] : std::stoul(s);
+	}
+
+	uint32_t read(const std::string& src, uint32_t pins)
+	{
+		if(src == "null") return 0;
+		if(src == "x") return x;
+		if(src == "y") return y;
+		if(src == "isr") return isr;
+		if(src == "osr") return osr;
+		if(src == "pins")
+		{
+			samples.emplace_back(cycle, pins);
+			return pins;
+		}
+		abort();
+	}
+
+	void write(const std::string& dst, uint32_t v)
+	{
+		if(dst == "x") x = v;
+		else if(dst == "y") y = v;
+		else if(dst == "isr") isr = v;
+		else if(dst == "osr") osr = v;
+		else abort();
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Simulated inputs
+
+/// First pin sampled by the PIO (see InputMonitor::pinBase)
+static constexpr uint32_t PIN_BASE = 8;
+
+/// Pins of the rotary encoders (see the InputMonitor constructor)
+static const uint32_t encoderPins[3][2] = {{13, 12}, {10, 9}, {22, 26}};
+
+/// Pins of the switches (see the InputMonitor constructor)
+static const uint32_t switchPins[9] = {16, 17, 18, 19, 20, 21, 11, 8, 27};
+
+/// Pins of the I2C bus of the EEPROM (see main.cpp)
+static const uint32_t busPins[2] = {14, 15};
+
+/// The PIO clock runs at CYCLES_PER_SAMPLE (9) cycles per sample at
+/// INPUT_SAMPLE_RATE (100 kHz)
+static constexpr double CYCLES_PER_US = 0.9;
+
+/**
+ * \brief A rotary encoder being turned at a constant speed
+ */
+struct Spin
+{
+	/// Index of the encoder
+	uint32_t encoder;
+	/// Cycle of the first change on the pins
+	uint64_t start;
+	/// Number of cycles of the Gray code sequence
+	uint32_t count;
+	/// Direction
+	bool left;
+	/// Cycles between changes of the pins
+	uint32_t period;
+};
+
+/**
+ * \brief Pin levels for each PIO cycle (bit 0 = pin PIN_BASE)
+ */
+class Waveform
+{
+public:
+	std::vector<uint32_t> levels;
+	std::mt19937 rng;
+
+	Waveform(uint64_t cycles): levels(cycles, 0xffffffff), rng(12345) {}
+
+	/**
+	 * \brief Sets the level of a pin from a cycle on, with contact bounce
+	 * \param bit Position of the pin.
+	 * \param from First cycle.
+	 * \param to End (exclusive).
+	 * \param level The new level.
+	 * \param bounce Number of cycles during which the pin bounces.
+	 */
+	void set(uint32_t bit, uint64_t from, uint64_t to, bool level, uint32_t bounce)
+	{
+		bool current = level;
+		uint64_t toggle = from;
+		for(uint64_t c = from; c < to && c < levels.size(); c++)
+		{
+			if(c < from + bounce && c >= toggle)
+			{
+				current = !current;
+				toggle = c + 1 + rng() % 4;
+			}
+			if(c >= from + bounce)
+				current = level;
+			levels[c] = (levels[c] & ~(1u << bit)) | (static_cast<uint32_t>(current) << bit);
+		}
+	}
+
+	/**
+	 * \brief Turns a rotary encoder
+	 * \param spin How to turn it.
+	 * \param bounce Maximum number of cycles the contacts bounce after each
+	 * change.
+	 */
+	void turn(const Spin& spin, uint32_t bounce)
+	{
+		// Activated pins (bit 0 = A, bit 1 = B) in the order of a left turn
+		static const uint32_t sequence[4] = {0b00, 0b01, 0b11, 0b10};
+		uint32_t bitA = encoderPins[spin.encoder][0] - PIN_BASE, bitB = encoderPins[spin.encoder][1] - PIN_BASE;
+		for(uint32_t k = 1; k <= 4 * spin.count; k++)
+		{
+			uint32_t prev = sequence[(spin.left ? k - 1 : 4 * spin.count - k + 1) % 4];
+			uint32_t next = sequence[(spin.left ? k : 4 * spin.count - k) % 4];
+			uint64_t t = spin.start + static_cast<uint64_t>(k) * spin.period;
+			uint64_t end = k == 4 * spin.count ? levels.size() : t + spin.period;
+			uint32_t b = bounce ? rng() % (bounce + 1) : 0;
+			// Only one pin changes, the other one is kept
+			bool changesA = (prev ^ next) & 1;
+			set(changesA ? bitA : bitB, t, end, !(next & (changesA ? 1 : 2)), b);
+			set(changesA ? bitB : bitA, t, end, !(next & (changesA ? 2 : 1)), 0);
+		}
+	}
+
+	/**
+	 * \brief Presses and releases switches at random
+	 * \param interval Average number of cycles between changes.
+	 * \param bounce Maximum number of cycles the contacts bounce.
+	 */
+	void chatter(uint32_t interval, uint32_t bounce)
+	{
+		bool pressed[9] = {};
+		for(uint64_t t = rng() % interval; t < levels.size(); t += 1 + rng() % (2 * interval))
+		{
+			uint32_t s = rng() % 9;
+			pressed[s] = !pressed[s];
+			set(switchPins[s] - PIN_BASE, t, levels.size(), !pressed[s], rng() % (bounce + 1));
+		}
+	}
+
+	/**
+	 * \brief Adds traffic on the I2C bus, i.e. SCL and SDA change all the time
+	 * \param from First cycle.
+	 * \param to End (exclusive).
+	 */
+	void busTraffic(uint64_t from, uint64_t to)
+	{
+		uint32_t scl = busPins[1] - PIN_BASE, sda = busPins[0] - PIN_BASE;
+		for(uint64_t c = from; c < to && c < levels.size(); c++)
+		{
+			uint32_t bits = (static_cast<uint32_t>((c / 2) & 1) << scl) | (static_cast<uint32_t>(rng() & 1) << sda);
+			levels[c] = (levels[c] & ~((1u << scl) | (1u << sda))) | bits;
+		}
+	}
+};
+
+//-----------------------------------------------------------------------------
+// Test
+
+/// Number of failed checks
+static int failures = 0;
+
+/// Reports a failed check
+#define CHECK(condition) do {if(!(condition)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++;}} while(0)
+
+/**
+ * \brief Outcome of a simulation
+ */
+struct Result
+{
+	/// The simulated state machine
+	PioSimulator pio;
+	/// All snapshots read from the FIFO
+	std::vector<uint32_t> snapshots;
+	/// Highest number of snapshots in the FIFO
+	size_t maxFifo = 0;
+	/// Ticks of the rotary encoders
+	int32_t left[3] = {}, right[3] = {};
+	/// Snapshots that counted as activity
+	uint32_t activity = 0;
+	/// Edges on the switches' pins
+	uint32_t switchEdges = 0;
+
+	/**
+	 * \brief Forms the snapshot of a sample like input_sampler does
+	 * \param pins Levels of the pins, bit 0 = pin PIN_BASE.
+	 */
+	uint32_t snapshotOf(uint32_t pins)
+	{
+		uint32_t low = pio.defines["LOW_PIN_COUNT"], gap = pio.defines["GAP"], high = pio.defines["HIGH_PIN_COUNT"];
+		return ((pins & ((1u << low) - 1)) << high) | ((pins >> (low + gap)) & ((1u << high) - 1));
+	}
+
+	/**
+	 * \brief Converts a snapshot into pin levels like input_sampler_levels()
+	 * \return Bit 0 = pin PIN_BASE.
+	 */
+	uint32_t levelsOf(uint32_t snapshot)
+	{
+		uint32_t low = pio.defines["LOW_PIN_COUNT"], gap = pio.defines["GAP"], high = pio.defines["HIGH_PIN_COUNT"];
+		return (snapshot >> high) | ((snapshot & ((1u << high) - 1)) << (low + gap));
+	}
+};
+
+/**
+ * \brief Runs the sampler on a waveform and decodes the snapshots
+ * \param result Receives the outcome. Its pio must have been loaded.
+ * \param wave The pin levels.
+ * \param types Types of the rotary encoders.
+ * \param serviceInterval Number of cycles between two runs of the interrupt
+ * handler that drains the FIFO.
+ */
+static void simulate(Result& result, const Waveform& wave, const QuadratureDecoder::Type types[3], uint32_t serviceInterval)
+{
+	PioSimulator& pio = result.pio;
+
+	// Like input_sampler_program_init(): X must not match the first sample
+	pio.x = ~0u;
+
+	// Pins connected to controls (InputMonitor::inputPinMask)
+	uint32_t switchMask = 0, inputMask = 0;
+	for(uint32_t pin : switchPins)
+		switchMask |= 1u << (pin - PIN_BASE);
+	inputMask = switchMask;
+	for(const auto& pins : encoderPins)
+		inputMask |= (1u << (pins[0] - PIN_BASE)) | (1u << (pins[1] - PIN_BASE));
+	uint32_t lastLevels = wave.levels[0] & inputMask;
+
+	QuadratureDecoder decoders[3] = {QuadratureDecoder(types[0]), QuadratureDecoder(types[1]), QuadratureDecoder(types[2])};
+	for(uint64_t c = 0; c < wave.levels.size(); c++)
+	{
+		pio.step(wave.levels[c]);
+		result.maxFifo = std::max(result.maxFifo, pio.fifo.size());
+
+		// Interrupt handler: InputMonitor::pioIrqHandler() and
+		// processSnapshot()
+		if(c % serviceInterval == 0)
+			while(!pio.fifo.empty())
+			{
+				uint32_t snapshot = pio.fifo.front();
+				pio.fifo.pop_front();
+				result.snapshots.push_back(snapshot);
+				uint32_t levels = result.levelsOf(snapshot) & inputMask;
+				for(uint32_t e = 0; e < 3; e++)
+				{
+					QuadratureDecoder::Tick tick = decoders[e].update(QuadratureDecoder::pins(levels, encoderPins[e][0] - PIN_BASE, encoderPins[e][1] - PIN_BASE));
+					if(tick == QuadratureDecoder::LEFT)
+						result.left[e]++;
+					else if(tick == QuadratureDecoder::RIGHT)
+						result.right[e]++;
+				}
+				uint32_t changed = levels ^ lastLevels;
+				lastLevels = levels;
+				if(changed == 0)
+					continue;
+				result.activity++;
+				result.switchEdges += __builtin_popcount(changed & switchMask);
+			}
+	}
+}
+
+/**
+ * \brief Runs the sampler on a waveform and checks the outcome
+ * \param name Name of the scenario (for messages).
+ * \param wave The pin levels.
+ * \param spins The spins contained in the waveform.
+ * \param types Types of the rotary encoders.
+ * \param serviceInterval Number of cycles between two runs of the interrupt
+ * handler that drains the FIFO.
+ * \param expectStalls Whether the CPU is too slow for the state machine.
+ */
+static void run(const char* name, const Waveform& wave, const std::vector<Spin>& spins, const QuadratureDecoder::Type types[3], uint32_t serviceInterval, bool expectStalls)
+{
+	static Result result;
+	result = Result();
+	if(!result.pio.load(INPUT_PIO))
+	{
+		failures++;
+		return;
+	}
+	simulate(result, wave, types, serviceInterval);
+	PioSimulator& pio = result.pio;
+	const std::vector<uint32_t>& snapshots = result.snapshots;
+
+	// The sampling rate is fixed: both paths through the loop take the same
+	// time (unless the state machine stalls)
+	uint64_t minInterval = ~0ull, maxInterval = 0;
+	for(size_t i = 1; i < pio.samples.size(); i++)
+	{
+		uint64_t interval = pio.samples[i].first - pio.samples[i - 1].first;
+		minInterval = std::min(minInterval, interval);
+		maxInterval = std::max(maxInterval, interval);
+	}
+
+	// Each snapshot differs from its predecessor
+	uint32_t repeated = 0;
+	for(size_t i = 1; i < snapshots.size(); i++)
+		repeated += snapshots[i] == snapshots[i - 1];
+
+	// The snapshots are the samples without repetitions. If the state machine
+	// stalls, it samples less often, but it still pushes every change it has
+	// sampled.
+	std::vector<uint32_t> changes;
+	for(const auto& sample : pio.samples)
+		if(changes.empty() || changes.back() != result.snapshotOf(sample.second))
+			changes.push_back(result.snapshotOf(sample.second));
+	// The last change may still be in the FIFO or waiting to be pushed
+	bool complete = snapshots.size() <= changes.size() && snapshots.size() + 1 + PioSimulator::FIFO_SIZE >= changes.size();
+	for(size_t i = 0; complete && i < snapshots.size(); i++)
+		complete = snapshots[i] == changes[i];
+
+	printf("%s: %zu samples, %zu snapshots, FIFO up to %zu, %llu stall cycles, sample interval %llu..%llu cycles\n",
+		name, pio.samples.size(), snapshots.size(), result.maxFifo, static_cast<unsigned long long>(pio.stalls),
+		static_cast<unsigned long long>(minInterval), static_cast<unsigned long long>(maxInterval));
+	CHECK(!snapshots.empty() && snapshots[0] == result.snapshotOf(wave.levels[0]));
+	CHECK(repeated == 0);
+	CHECK(complete);
+	if(expectStalls)
+	{
+		CHECK(pio.stalls > 0);
+		return;
+	}
+	CHECK(pio.stalls == 0);
+	CHECK(minInterval == pio.defines["CYCLES_PER_SAMPLE"] && maxInterval == pio.defines["CYCLES_PER_SAMPLE"]);
+
+	// Expected ticks per cycle of the Gray code sequence
+	for(uint32_t e = 0; e < 3; e++)
+	{
+		uint32_t ticksPerCycle = types[e] == QuadratureDecoder::Type::FULL_STEP ? 1 : (types[e] == QuadratureDecoder::Type::HALF_STEP ? 2 : 4);
+		int32_t expectLeft = 0, expectRight = 0;
+		for(const Spin& spin : spins)
+			if(spin.encoder == e)
+				(spin.left ? expectLeft : expectRight) += spin.count * ticksPerCycle;
+		int32_t left = result.left[e], right = result.right[e];
+		printf("  encoder %u: %d left, %d right (expected %d left, %d right)\n", e, left, right, expectLeft, expectRight);
+		if(types[e] == QuadratureDecoder::Type::QUARTER_STEP)
+			// Each change of the pins is a tick, so bouncing adds ticks back
+			// and forth that cancel each other out
+			CHECK(left - right == expectLeft - expectRight && left >= expectLeft && right >= expectRight);
+		else
+			CHECK(left == expectLeft && right == expectRight);
+	}
+}
+
+/**
+ * \brief Checks that traffic on the I2C bus and changes of pins that aren't
+ * connected to a control cause no snapshots, activity or events
+ * \param wave Input without bus traffic.
+ * \param types Types of the rotary encoders.
+ * \param serviceInterval See run().
+ */
+static void busTraffic(const Waveform& wave, const QuadratureDecoder::Type types[3], uint32_t serviceInterval)
+{
+	static Result quiet, busy, busyInputs, inputs;
+	quiet = Result();
+	busy = Result();
+	busyInputs = Result();
+	inputs = Result();
+	if(!quiet.pio.load(INPUT_PIO) || !busy.pio.load(INPUT_PIO) || !busyInputs.pio.load(INPUT_PIO) || !inputs.pio.load(INPUT_PIO))
+	{
+		failures++;
+		return;
+	}
+
+	// Bus traffic alone (bits 6 and 7 of the pins, i.e. GPIO 14/15) on top
+	// of idle controls. A sampled pin that isn't connected to a control
+	// (GPIO 24, VBUS sense) changes twice.
+	Waveform idle(wave.levels.size());
+	simulate(quiet, idle, types, serviceInterval);
+	idle.busTraffic(0, idle.levels.size());
+	idle.set(24 - PIN_BASE, idle.levels.size() / 3, 2 * idle.levels.size() / 3, false, 0);
+	simulate(busy, idle, types, serviceInterval);
+	printf("bus traffic: %zu snapshots, %u activity, %u switch edges\n", busy.snapshots.size(), busy.activity, busy.switchEdges);
+	CHECK(quiet.snapshots.size() == 1 && quiet.activity == 0);
+	// Only the first snapshot and the two changes of GPIO 24
+	CHECK(busy.snapshots.size() == 3);
+	CHECK(busy.activity == 0 && busy.switchEdges == 0);
+	for(uint32_t e = 0; e < 3; e++)
+		CHECK(busy.left[e] == 0 && busy.right[e] == 0);
+
+	// Bus traffic during input doesn't change what is seen of the input
+	simulate(inputs, wave, types, serviceInterval);
+	Waveform mixed = wave;
+	mixed.busTraffic(0, mixed.levels.size());
+	simulate(busyInputs, mixed, types, serviceInterval);
+	printf("bus traffic during input: %zu snapshots (%zu without traffic)\n", busyInputs.snapshots.size(), inputs.snapshots.size());
+	CHECK(busyInputs.snapshots == inputs.snapshots);
+	CHECK(busyInputs.activity == inputs.activity && busyInputs.switchEdges == inputs.switchEdges);
+	for(uint32_t e = 0; e < 3; e++)
+		CHECK(busyInputs.left[e] == inputs.left[e] && busyInputs.right[e] == inputs.right[e]);
+}
+
+int main()
+{
+	// 0.5 s of input
+	uint64_t cycles = static_cast<uint64_t>(500000 * CYCLES_PER_US);
+	// Contacts bounce for up to 20 us
+	uint32_t bounce = static_cast<uint32_t>(20 * CYCLES_PER_US);
+
+	// Slow and fast spins on all encoders, partly at the same time. The fastest
+	// one is 2000 cycles per second, i.e. a change on the pins every 125 us.
+	std::vector<Spin> spins =
+	{
+		{0, static_cast<uint64_t>(2000 * CYCLES_PER_US), 20, true, static_cast<uint32_t>(2000 * CYCLES_PER_US)},
+		{0, static_cast<uint64_t>(200000 * CYCLES_PER_US), 150, false, static_cast<uint32_t>(125 * CYCLES_PER_US)},
+		{1, static_cast<uint64_t>(8000 * CYCLES_PER_US), 100, false, static_cast<uint32_t>(250 * CYCLES_PER_US)},
+		{1, static_cast<uint64_t>(166000 * CYCLES_PER_US), 100, true, static_cast<uint32_t>(150 * CYCLES_PER_US)},
+		{2, static_cast<uint64_t>(33000 * CYCLES_PER_US), 60, true, static_cast<uint32_t>(500 * CYCLES_PER_US)},
+		{2, static_cast<uint64_t>(333000 * CYCLES_PER_US), 120, false, static_cast<uint32_t>(125 * CYCLES_PER_US)}
+	};
+	Waveform wave(cycles);
+	for(const Spin& spin : spins)
+		wave.turn(spin, bounce);
+	wave.chatter(static_cast<uint32_t>(5000 * CYCLES_PER_US), bounce);
+
+	// The interrupt handler runs within a few microseconds
+	const QuadratureDecoder::Type fullStep[3] = {QuadratureDecoder::Type::FULL_STEP, QuadratureDecoder::Type::FULL_STEP, QuadratureDecoder::Type::FULL_STEP};
+	const QuadratureDecoder::Type mixed[3] = {QuadratureDecoder::Type::FULL_STEP, QuadratureDecoder::Type::HALF_STEP, QuadratureDecoder::Type::QUARTER_STEP};
+	run("full-step", wave, spins, fullStep, static_cast<uint32_t>(5 * CYCLES_PER_US), false);
+	run("mixed types", wave, spins, mixed, static_cast<uint32_t>(5 * CYCLES_PER_US), false);
+
+	// The interrupt handler is held off for 1 ms at a time, so the FIFO fills
+	// up and the state machine stalls
+	run("slow CPU", wave, spins, fullStep, static_cast<uint32_t>(1000 * CYCLES_PER_US), true);
+
+	// The EEPROM is busy all the time
+	busTraffic(wave, mixed, static_cast<uint32_t>(5 * CYCLES_PER_US));
+
+	if(failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,214 @@
+/**
+ * \file profilejournal_test.cpp
+ * Host test for ProfileJournal: profile switches that interleave with a write
+ * request queued behind other EEPROM traffic
+ * Usage: profilejournal_test
+ */
+
+#include<cstdio>
+#include<cstdint>
+#include<cstring>
+#include<deque>
+#include"profilejournal.h"
+
+/// Address of the journal in the fake EEPROM
+#define JOURNAL_ADDRESS 64
+
+/// Size of the journal in bytes
+#define JOURNAL_SIZE 64
+
+/// Number of failed checks
+static int failures = 0;
+
+/// Reports a failed check
+#define CHECK(condition) do {if(!(condition)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++;}} while(0)
+
+/**
+ * \brief Contents of the fake EEPROM
+ */
+static uint8_t memory[256];
+
+/**
+ * \brief A write request queued in the fake EEPROM
+ */
+struct FakeRequest
+{
+	const uint8_t* src;
+	uint memAddress;
+	uint length;
+	EepRom::Callback callback;
+	void* userData;
+};
+
+/**
+ * \brief Requests in the order they are carried out
+ * \details They only finish when the test says so (see finishNext()).
+ */
+static std::deque<FakeRequest> requests;
+
+// Fake EepRom: reads are done right away, writes are queued until the test
+// finishes them. Only what ProfileJournal uses is defined.
+
+EepRom::EepRom(i2c_inst_t* i2c, uint baudRate, EepRomType type, uint8_t i2cAddress)
+:	i2c(i2c),
+	baudRate(baudRate),
+	i2cAddress(i2cAddress),
+	type(type)
+{
+}
+
+EepRom::~EepRom()
+{
+}
+
+EepRom::Result EepRom::read(uint8_t* dest, uint memAddress, uint length)
+{
+	memcpy(dest, memory + memAddress, length);
+	return Result::SUCCESS;
+}
+
+bool EepRom::queueWrite(const uint8_t* src, uint memAddress, uint length, Callback callback, void* userData)
+{
+	if(requests.size() >= EEPROM_QUEUE_SIZE)
+		return false;
+	requests.push_back({src, memAddress, length, callback, userData});
+	return true;
+}
+
+/**
+ * \brief Finishes the oldest queued request
+ * \details Like the real driver, the data is taken from the caller's memory
+ * while the request is carried out, not when it is queued.
+ * \param result Result::SUCCESS or Result::CANCELLED (nothing is written).
+ */
+static void finishNext(EepRom::Result result)
+{
+	FakeRequest request = requests.front();
+	requests.pop_front();
+	if(result == EepRom::Result::SUCCESS)
+		memcpy(memory + request.memAddress, request.src, request.length);
+	if(request.callback != nullptr)
+		request.callback(result, request.userData);
+}
+
+/**
+ * \brief Lets time pass and calls update() like the main loop
+ * \param ms Time in ms.
+ */
+static void advance(ProfileJournal& journal, uint ms)
+{
+	host_time_us += ms * 1000ull;
+	journal.update();
+}
+
+/**
+ * \brief Lets the journal write everything it has to
+ */
+static void settle(ProfileJournal& journal)
+{
+	for(int i = 0; i < 10; i++)
+	{
+		advance(journal, PROFILE_JOURNAL_DELAY);
+		while(!requests.empty())
+			finishNext(EepRom::Result::SUCCESS);
+	}
+	journal.update();
+}
+
+/**
+ * \brief Reboots: loads the journal from the fake EEPROM
+ * \return Returns the stored profile.
+ */
+static int reboot(EepRom& eeprom)
+{
+	ProfileJournal journal(eeprom, JOURNAL_ADDRESS, JOURNAL_SIZE);
+	return journal.load();
+}
+
+/**
+ * \brief The user switches from Y to X, X is queued behind a long store, and
+ * the user switches back to Y before the write of X has finished
+ * \param result Result of the write of X.
+ */
+static void switchBackWhileWriting(EepRom::Result result)
+{
+	const uint8_t X = 3;
+	const uint8_t Y = 1;
+	static uint8_t settings[128];
+
+	memset(memory, 0xff, sizeof(memory));
+	requests.clear();
+	EepRom eeprom(nullptr, 0, EEPROM_24C02);
+	ProfileJournal journal(eeprom, JOURNAL_ADDRESS, JOURNAL_SIZE);
+	CHECK(journal.load() == -1);
+
+	// Y is stored
+	journal.record(Y);
+	settle(journal);
+	CHECK(journal.getProfile() == Y);
+	CHECK(reboot(eeprom) == Y);
+
+	// Switch to X while the settings are being stored
+	CHECK(eeprom.queueWrite(settings, 0, sizeof(settings), nullptr));
+	journal.record(X);
+	advance(journal, PROFILE_JOURNAL_DELAY);
+	CHECK(requests.size() == 2);
+	CHECK(journal.getProfile() == X);
+
+	// Back to Y while X is still queued
+	journal.record(Y);
+	CHECK(journal.getProfile() == Y);
+	finishNext(EepRom::Result::SUCCESS);
+	journal.update();
+	finishNext(result);
+	journal.update();
+	CHECK(journal.getProfile() == Y);
+
+	// Y must end up as the latest record
+	settle(journal);
+	CHECK(journal.getProfile() == Y);
+	CHECK(reboot(eeprom) == Y);
+}
+
+/**
+ * \brief The user switches to X and back to X while it is being written
+ * \details X must be written only once (or again if the write failed).
+ * \param result Result of the write of X.
+ */
+static void switchToSameWhileWriting(EepRom::Result result)
+{
+	const uint8_t X = 2;
+
+	memset(memory, 0xff, sizeof(memory));
+	requests.clear();
+	EepRom eeprom(nullptr, 0, EEPROM_24C02);
+	ProfileJournal journal(eeprom, JOURNAL_ADDRESS, JOURNAL_SIZE);
+	journal.load();
+
+	journal.record(X);
+	advance(journal, PROFILE_JOURNAL_DELAY);
+	CHECK(requests.size() == 1);
+	journal.record(X);
+	finishNext(result);
+	advance(journal, PROFILE_JOURNAL_DELAY);
+	CHECK(requests.size() == (result == EepRom::Result::SUCCESS ? 0u : 1u));
+	settle(journal);
+	CHECK(journal.getProfile() == X);
+	CHECK(reboot(eeprom) == X);
+}
+
+int main()
+{
+	switchBackWhileWriting(EepRom::Result::SUCCESS);
+	switchBackWhileWriting(EepRom::Result::CANCELLED);
+	switchToSameWhileWriting(EepRom::Result::SUCCESS);
+	switchToSameWhileWriting(EepRom::Result::CANCELLED);
+
+	if(failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,165 @@
+/**
+ * \file reportqueue_test.cpp
+ * Host test for ReportQueue: order of the queued states, coalescing when the
+ * queue is full and flushing
+ * Usage: reportqueue_test
+ */
+
+#include<cstdio>
+#include<cstdint>
+#include<vector>
+#include"hid.h"
+
+/// Number of failed checks
+static int failures = 0;
+
+/// Reports a failed check
+#define CHECK(condition) do {if(!(condition)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++;}} while(0)
+
+/**
+ * \brief Sends all queued states
+ * \return The states in the order they are sent.
+ */
+template<typename T, uint N> static std::vector<T> drain(ReportQueue<T, N>& queue)
+{
+	std::vector<T> sent;
+	while(!queue.empty())
+	{
+		sent.push_back(queue.front());
+		queue.pop();
+	}
+	return sent;
+}
+
+/**
+ * \brief Distinct states are sent in order, repeated ones are not queued
+ */
+static void order()
+{
+	ReportQueue<uint8_t, 4> queue(0xff);
+	CHECK(queue.empty());
+	CHECK(!queue.push(0xff));
+	CHECK(queue.empty());
+
+	// A key that is pressed and released before the first report is sent
+	CHECK(queue.push(1));
+	CHECK(!queue.push(1));
+	CHECK(queue.push(0));
+	CHECK(queue.latest() == 0);
+	CHECK((drain(queue) == std::vector<uint8_t>{1, 0}));
+	CHECK(queue.latest() == 0);
+	CHECK(!queue.push(0));
+
+	// Around the end of the ring buffer
+	for(uint8_t round = 0; round < 3; round++)
+	{
+		CHECK(queue.push(1));
+		CHECK(queue.push(2));
+		CHECK(queue.push(3));
+		CHECK(queue.front() == 1);
+		queue.pop();
+		CHECK(queue.push(0));
+		CHECK((drain(queue) == std::vector<uint8_t>{2, 3, 0}));
+	}
+	queue.pop();
+	CHECK(queue.empty());
+}
+
+/**
+ * \brief A full queue coalesces the new state with the newest one
+ */
+static void coalesce()
+{
+	ReportQueue<uint8_t, 4> queue(0);
+	for(uint8_t i = 1; i <= 4; i++)
+		CHECK(queue.push(i));
+	CHECK(queue.push(5));
+	CHECK(queue.push(6));
+	CHECK(queue.latest() == 6);
+	CHECK((drain(queue) == std::vector<uint8_t>{1, 2, 3, 6}));
+
+	// Coalescing after the ring buffer has wrapped around
+	for(uint8_t i = 1; i <= 2; i++)
+		CHECK(queue.push(i));
+	queue.pop();
+	for(uint8_t i = 3; i <= 6; i++)
+		CHECK(queue.push(i));
+	CHECK((drain(queue) == std::vector<uint8_t>{2, 3, 4, 6}));
+}
+
+/**
+ * \brief A full queue drops the newest state if the report returns to the
+ * state before it (e.g. a short pulse), rather than sending it twice
+ */
+static void dropBack()
+{
+	ReportQueue<uint8_t, 4> queue(0);
+	for(uint8_t i = 1; i <= 4; i++)
+		CHECK(queue.push(i));
+	CHECK(queue.push(3));
+	CHECK(queue.latest() == 3);
+	CHECK((drain(queue) == std::vector<uint8_t>{1, 2, 3}));
+
+	// There is room again afterwards, so the next state is queued normally
+	for(uint8_t i = 1; i <= 4; i++)
+		CHECK(queue.push(i));
+	CHECK(queue.push(3));
+	CHECK(queue.push(7));
+	CHECK((drain(queue) == std::vector<uint8_t>{1, 2, 3, 7}));
+
+	// Repeating the newest state changes nothing, even if the queue is full
+	for(uint8_t i = 1; i <= 4; i++)
+		CHECK(queue.push(i));
+	CHECK(!queue.push(4));
+	CHECK((drain(queue) == std::vector<uint8_t>{1, 2, 3, 4}));
+}
+
+/**
+ * \brief flush() drops the queued states but remembers the newest one
+ */
+static void flush()
+{
+	ReportQueue<uint8_t, 4> queue(0);
+	CHECK(queue.push(1));
+	CHECK(queue.push(2));
+	queue.flush();
+	CHECK(queue.empty());
+	CHECK(queue.latest() == 2);
+	CHECK(!queue.push(2));
+	CHECK(queue.empty());
+	CHECK(queue.push(1));
+	CHECK((drain(queue) == std::vector<uint8_t>{1}));
+	// pop() on an empty queue does nothing
+	queue.pop();
+	CHECK(queue.empty());
+}
+
+/**
+ * \brief Reports are compared bytewise
+ */
+static void bytewise()
+{
+	ReportQueue<uint16_t, 4> queue(0);
+	CHECK(queue.push(0x0100));
+	CHECK(queue.push(0x0001));
+	CHECK(!queue.push(0x0001));
+	CHECK(queue.push(0x0100));
+	CHECK((drain(queue) == std::vector<uint16_t>{0x0100, 0x0001, 0x0100}));
+}
+
+int main()
+{
+	order();
+	coalesce();
+	dropBack();
+	flush();
+	bytewise();
+
+	if(failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
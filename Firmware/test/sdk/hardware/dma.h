@@ -0,0 +1,30 @@
+/**
+ * \file hardware/dma.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _HARDWARE_DMA_H
+#define _HARDWARE_DMA_H
+
+#include"pico/stdlib.h"
+
+enum dma_channel_transfer_size {DMA_SIZE_8, DMA_SIZE_16, DMA_SIZE_32};
+typedef struct {uint32_t ctrl;} dma_channel_config;
+
+static inline int dma_claim_unused_channel(bool) {return 0;}
+static inline void dma_channel_unclaim(uint) {}
+static inline dma_channel_config dma_channel_get_default_config(uint) {return dma_channel_config{0};}
+static inline void channel_config_set_transfer_data_size(dma_channel_config*, dma_channel_transfer_size) {}
+static inline void channel_config_set_dreq(dma_channel_config*, uint) {}
+static inline void channel_config_set_read_increment(dma_channel_config*, bool) {}
+static inline void channel_config_set_write_increment(dma_channel_config*, bool) {}
+static inline void dma_channel_configure(uint, const dma_channel_config*, volatile void*, const volatile void*, uint, bool) {}
+static inline void dma_channel_set_read_addr(uint, const volatile void*, bool) {}
+static inline void dma_channel_set_write_addr(uint, volatile void*, bool) {}
+static inline void dma_channel_set_trans_count(uint, uint32_t, bool) {}
+static inline void dma_start_channel_mask(uint32_t) {}
+static inline void dma_channel_set_irq0_enabled(uint, bool) {}
+static inline bool dma_channel_get_irq0_status(uint) {return false;}
+static inline void dma_channel_acknowledge_irq0(uint) {}
+
+#endif // _HARDWARE_DMA_H
@@ -0,0 +1,13 @@
+/**
+ * \file hardware/i2c.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _HARDWARE_I2C_H
+#define _HARDWARE_I2C_H
+
+#include"pico/stdlib.h"
+
+typedef struct i2c_inst i2c_inst_t;
+
+#endif // _HARDWARE_I2C_H
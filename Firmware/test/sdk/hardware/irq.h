@@ -0,0 +1,20 @@
+/**
+ * \file hardware/irq.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _HARDWARE_IRQ_H
+#define _HARDWARE_IRQ_H
+
+#include"pico/stdlib.h"
+
+#define DMA_IRQ_0 11
+#define PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY 0x80
+
+typedef void (*irq_handler_t)();
+
+static inline void irq_add_shared_handler(uint, irq_handler_t, uint8_t) {}
+static inline void irq_remove_handler(uint, irq_handler_t) {}
+static inline void irq_set_enabled(uint, bool) {}
+
+#endif // _HARDWARE_IRQ_H
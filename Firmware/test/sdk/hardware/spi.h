@@ -0,0 +1,19 @@
+/**
+ * \file hardware/spi.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _HARDWARE_SPI_H
+#define _HARDWARE_SPI_H
+
+#include"pico/stdlib.h"
+
+typedef struct {volatile uint32_t dr;} spi_hw_t;
+typedef struct spi_inst spi_inst_t;
+
+static inline spi_hw_t* spi_get_hw(spi_inst_t*) {static spi_hw_t hw; return &hw;}
+static inline uint spi_get_dreq(spi_inst_t*, bool) {return 0;}
+static inline bool spi_is_readable(spi_inst_t*) {return false;}
+static inline int spi_write_blocking(spi_inst_t*, const uint8_t*, size_t length) {return static_cast<int>(length);}
+
+#endif // _HARDWARE_SPI_H
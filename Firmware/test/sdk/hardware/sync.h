@@ -0,0 +1,17 @@
+/**
+ * \file hardware/sync.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include<cstdint>
+
+static inline uint32_t save_and_disable_interrupts() {return 0;}
+static inline void restore_interrupts(uint32_t) {}
+static inline void __wfi() {}
+static inline void __wfe() {}
+static inline void __sev() {}
+
+#endif // _HARDWARE_SYNC_H
@@ -0,0 +1,43 @@
+/**
+ * \file pico/stdlib.h
+ * Host stand-in for the Pico SDK
+ * Provides just enough of the SDK for compiling display.cpp and
+ * profilejournal.cpp on the host. The hardware functions do nothing, and the
+ * time only advances when a test sets host_time_us.
+ */
+
+#ifndef _PICO_STDLIB_H
+#define _PICO_STDLIB_H
+
+#include<cstdint>
+#include<cassert>
+
+typedef unsigned int uint;
+
+#include"hardware/sync.h"
+
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#endif
+#ifndef MAX
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
+
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+
+/// Current time in µs, set by the tests
+inline uint64_t host_time_us = 0;
+
+static const absolute_time_t nil_time = 0;
+
+static inline absolute_time_t get_absolute_time() {return host_time_us;}
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {return static_cast<int64_t>(to - from);}
+
+static inline void gpio_init(uint) {}
+static inline void gpio_set_dir(uint, bool) {}
+static inline void gpio_put(uint, bool) {}
+static inline void sleep_us(uint64_t) {}
+static inline void busy_wait_us_32(uint32_t) {}
+
+#endif // _PICO_STDLIB_H
@@ -0,0 +1,18 @@
+/**
+ * \file pico/sync.h
+ * Host stand-in for the Pico SDK (see pico/stdlib.h)
+ */
+
+#ifndef _PICO_SYNC_H
+#define _PICO_SYNC_H
+
+#include"pico/stdlib.h"
+
+typedef struct {uint32_t unused;} critical_section_t;
+
+static inline void critical_section_init(critical_section_t*) {}
+static inline void critical_section_deinit(critical_section_t*) {}
+static inline void critical_section_enter_blocking(critical_section_t*) {}
+static inline void critical_section_exit(critical_section_t*) {}
+
+#endif // _PICO_SYNC_H
@@ -0,0 +1,20 @@
+/**
+ * \file tusb.h
+ * Host stand-in for TinyUSB (see pico/stdlib.h)
+ * Provides the types hid.h needs for its declarations.
+ */
+
+#ifndef _TUSB_H
+#define _TUSB_H
+
+#include<cstdint>
+#include"pico/sync.h"
+
+typedef struct
+{
+	uint8_t modifier;
+	uint8_t reserved;
+	uint8_t keycode[6];
+} hid_keyboard_report_t;
+
+#endif // _TUSB_H
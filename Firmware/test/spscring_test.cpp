@@ -0,0 +1,222 @@
+/**
+ * \file spscring_test.cpp
+ * Host test and stress benchmark for SpscRing
+ * Usage: spscring_test [number of events for the stress run]
+ */
+
+#include<cstdio>
+#include<cstdlib>
+#include<cstdint>
+#include<atomic>
+#include<chrono>
+#include<thread>
+#include"spscring.h"
+
+/**
+ * \brief Item passed through the ring buffer
+ * \details Larger than a machine word, so it can't be copied atomically. All
+ * fields are derived from the sequence number, so a torn item (partly written
+ * by the producer when the consumer reads it) is detected by check().
+ */
+struct Message
+{
+	uint32_t seq;
+	uint32_t inverted;
+	uint64_t time;
+	uint8_t payload[16];
+
+	static Message make(uint32_t seq)
+	{
+		Message m;
+		m.seq = seq;
+		m.inverted = ~seq;
+		m.time = static_cast<uint64_t>(seq) * 1000003u;
+		for(uint32_t i = 0; i < sizeof(m.payload); i++)
+			m.payload[i] = static_cast<uint8_t>(seq + i);
+		return m;
+	}
+
+	bool check() const
+	{
+		if(inverted != ~seq || time != static_cast<uint64_t>(seq) * 1000003u)
+			return false;
+		for(uint32_t i = 0; i < sizeof(payload); i++)
+			if(payload[i] != static_cast<uint8_t>(seq + i))
+				return false;
+		return true;
+	}
+};
+
+/// Number of failed checks
+static int failures = 0;
+
+/// Reports a failed check
+#define CHECK(condition) do {if(!(condition)) {printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++;}} while(0)
+
+/**
+ * \brief Checks the ring buffer on a single thread
+ * \details Full and empty conditions, order of items, and peek()/consume()
+ * across the end of the storage.
+ */
+static void testSingleThread()
+{
+	SpscRing<Message, 8> ring;
+	Message m;
+	CHECK(ring.empty());
+	CHECK(!ring.pop(m));
+
+	// Fill up completely, then one more must fail
+	for(uint32_t i = 0; i < 8; i++)
+		CHECK(ring.push(Message::make(i)));
+	CHECK(!ring.push(Message::make(8)));
+	CHECK(ring.size() == 8);
+
+	// Pop some, so the next items wrap around the end of the storage
+	for(uint32_t i = 0; i < 5; i++)
+		CHECK(ring.pop(m) && m.seq == i && m.check());
+	for(uint32_t i = 8; i < 13; i++)
+		CHECK(ring.push(Message::make(i)));
+
+	// peek() stops at the end of the storage, the remainder comes after
+	// consume()
+	const Message* first;
+	uint32_t n = ring.peek(first);
+	CHECK(n == 3);
+	for(uint32_t i = 0; i < n; i++)
+		CHECK(first[i].seq == 5 + i);
+	ring.consume(n);
+	n = ring.peek(first);
+	CHECK(n == 5);
+	for(uint32_t i = 0; i < n; i++)
+		CHECK(first[i].seq == 8 + i);
+	ring.consume(n);
+	CHECK(ring.empty());
+	CHECK(ring.peek(first) == 0);
+}
+
+/**
+ * \brief Passes items from a producer thread to a consumer thread
+ * \details The producer retries while the ring buffer is full, so every item
+ * must arrive, in order and intact.
+ * \param count Number of items.
+ */
+static void testTwoThreads(uint32_t count)
+{
+	SpscRing<Message, 4> ring;
+	std::thread producer([&]()
+	{
+		for(uint32_t i = 0; i < count; i++)
+			while(!ring.push(Message::make(i)))
+				std::this_thread::yield();
+	});
+
+	uint32_t expected = 0, errors = 0;
+	while(expected < count)
+	{
+		Message m;
+		if(!ring.pop(m))
+		{
+			std::this_thread::yield();
+			continue;
+		}
+		if(m.seq != expected || !m.check())
+			errors++;
+		expected++;
+	}
+	producer.join();
+	CHECK(errors == 0);
+	CHECK(ring.empty());
+}
+
+/**
+ * \brief Passes items between two threads as fast as possible
+ * \details The consumer drains the ring buffer in batches with
+ * peek()/consume(). Every item must either arrive (in order and intact) or
+ * have been counted as dropped.
+ * \param count Number of items.
+ * \param drop If true, the producer drops items while the ring buffer is full
+ * (like postUiEvent() in main.cpp), otherwise it retries.
+ */
+static void stress(uint32_t count, bool drop)
+{
+	static SpscRing<Message, 64> ring;
+	uint32_t dropped = 0;
+	std::atomic<bool> started(false), done(false);
+
+	std::thread producer([&]()
+	{
+		// Don't start before the consumer is ready
+		while(!started.load(std::memory_order_acquire))
+			std::this_thread::yield();
+		for(uint32_t i = 0; i < count; i++)
+			while(!ring.push(Message::make(i)))
+			{
+				if(drop)
+				{
+					dropped++;
+					break;
+				}
+				std::this_thread::yield();
+			}
+		done.store(true, std::memory_order_release);
+	});
+
+	uint32_t received = 0, torn = 0, disordered = 0, batches = 0;
+	int64_t last = -1;
+	auto start = std::chrono::steady_clock::now();
+	started.store(true, std::memory_order_release);
+	for(;;)
+	{
+		bool finished = done.load(std::memory_order_acquire);
+		const Message* first;
+		uint32_t n = ring.peek(first);
+		if(n == 0)
+		{
+			// Only stop once the ring has been drained after the producer
+			// has finished
+			if(finished)
+				break;
+			std::this_thread::yield();
+			continue;
+		}
+		for(uint32_t i = 0; i < n; i++)
+		{
+			if(!first[i].check())
+				torn++;
+			if(static_cast<int64_t>(first[i].seq) <= last)
+				disordered++;
+			last = first[i].seq;
+		}
+		ring.consume(n);
+		received += n;
+		batches++;
+	}
+	producer.join();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("Stress (%s): %u events in %.3f s (%.1f M/s), %u received in %u batches, %u dropped, %u torn, %u out of order\n",
+		drop ? "dropping" : "retrying", count, seconds, count / seconds / 1e6, received, batches, dropped, torn, disordered);
+	CHECK(received + dropped == count);
+	CHECK(drop || dropped == 0);
+	CHECK(torn == 0);
+	CHECK(disordered == 0);
+	CHECK(ring.empty());
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t count = argc > 1 ? strtoul(argv[1], nullptr, 0) : 2000000;
+
+	testSingleThread();
+	testTwoThreads(count / 10);
+	stress(count, false);
+	stress(count, true);
+
+	if(failures != 0)
+	{
+		printf("%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("All checks passed\n");
+	return 0;
+}
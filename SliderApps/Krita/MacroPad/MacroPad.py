@@ -13,7 +13,7 @@ Manual for details.
 # These must coincide with the ones chosen in usb_descriptors.h when compiling
 # the firmware. 
 VID = 0xcafe
-PID = 0x9f8e
+PID = 0x9f8f
 
 # Interface number for the Misc Interface of MacroPad (the one that is used for
 # slider and feature reports)
@@ -22,6 +22,10 @@ ITF_NUM_MISC = 2
 # Report ID for data reports from the slider
 REPORT_ID_SLIDER = 3
 
+# Maximum slider position (the slider reports positions between 0 and
+# SLIDER_MAX)
+SLIDER_MAX = 4095
+
 # Report ID for feature reports for the active profile
 REPORT_ID_ACTIVE_PROFILE = 5
 
@@ -171,13 +175,13 @@ class MacroPad(object):
 		
 		This method issues a GET_REPORT(DATA) request on Endpoint 0. 
 		:return: Returns the current slider position as a value between 0
-		(bottom) and 255 (top). 
+		(bottom) and SLIDER_MAX (top). 
 		:raises MacroPadException: If the request fails. 
 		"""
-		buffer = ffi.new("unsigned char[2]", [REPORT_ID_SLIDER, 0]) # 2 Bytes: 1 for Report ID, 1 for slider data
-		if(hidapi.hid_get_input_report(self.__device, buffer, 2) != 2):
+		buffer = ffi.new("unsigned char[3]", [REPORT_ID_SLIDER, 0, 0]) # 3 Bytes: 1 for Report ID, 2 for slider data (little endian)
+		if(hidapi.hid_get_input_report(self.__device, buffer, 3) != 3):
 			raise MacroPadException("Data request failed: " + ffi.string(hidapi.hid_error(self.__device)))
-		return buffer[1];
+		return buffer[1] | (buffer[2] << 8);
 	
 	def waitForSliderChange(self, timeout):
 		"""
@@ -188,14 +192,15 @@ class MacroPad(object):
 		endpoint. 
 		:param timeout: Timeout in milliseconds, -1 for indefinite waiting. 
 		:return: Returns the new slider position as a value between 0 (bottom)
-		and 255 (top) or -1 if the timeout elapsed before there was any change. 
+		and SLIDER_MAX (top) or -1 if the timeout elapsed before there was any
+		change. 
 		:raises MacroPadException: If an error occurs while waiting for data. 
 		"""
-		buffer = ffi.new("unsigned char[2]", [REPORT_ID_SLIDER, 0]) # 2 Bytes: 1 for Report ID, 1 for slider data
-		rc = hidapi.hid_read_timeout(self.__device, buffer, 2, timeout)
+		buffer = ffi.new("unsigned char[3]", [REPORT_ID_SLIDER, 0, 0]) # 3 Bytes: 1 for Report ID, 2 for slider data (little endian)
+		rc = hidapi.hid_read_timeout(self.__device, buffer, 3, timeout)
 		if(rc == 0):
 			# Timeout elapsed
 			return -1
-		elif(rc != 2):
+		elif(rc != 3):
 			raise MacroPadException("Error occurred while waiting for data: " + ffi.string(hidapi.hid_error(self.__device)))
-		return buffer[1]
+		return buffer[1] | (buffer[2] << 8)
@@ -1,6 +1,6 @@
 from PyQt5.QtCore import *
 from krita import *
-from MacroPad.MacroPad import MacroPad
+from MacroPad.MacroPad import MacroPad, SLIDER_MAX
 
 class MacroPadDocker(DockWidget):
 	def __init__(self):
@@ -59,7 +59,7 @@ class MacroPadDocker(DockWidget):
 			self.previousPos = pos
 			# Convert slider position to brush size
 			# FIXME: This is rather crude at the moment. We probably want something more logarithmic
-			brushSize = pos / 4
+			brushSize = pos * 64 / (SLIDER_MAX + 1)
 			# Set brush size
 			Krita.instance().activeWindow().activeView().setBrushSize(brushSize)
 	
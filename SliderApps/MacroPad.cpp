@@ -99,30 +99,30 @@ void MacroPad::setActiveProfile(uint8_t profileIdx)
 	}
 }
 	
-uint8_t MacroPad::getSliderPos()
+uint16_t MacroPad::getSliderPos()
 {
-	uint8_t buffer[2]; // 2 Bytes: 1 for Report ID, 1 for slider data
+	uint8_t buffer[3]; // 3 Bytes: 1 for Report ID, 2 for slider data (little endian)
 	buffer[0] = REPORT_ID_SLIDER;
-	if(hid_get_input_report(device, buffer, 2) != 2)
+	if(hid_get_input_report(device, buffer, 3) != 3)
 	{
 		std::wstring werr(hid_error(device));
 		throw MacroPadException("Data request failed: " + std::string(werr.begin(), werr.end()));
 	}
-	return buffer[1];
+	return buffer[1] | (buffer[2] << 8);
 }
 
 int16_t MacroPad::waitForSliderChange(int timeout)
 {
-	uint8_t buffer[2]; // 2 Bytes: 1 for Report ID, 1 for slider data
+	uint8_t buffer[3]; // 3 Bytes: 1 for Report ID, 2 for slider data (little endian)
 	buffer[0] = REPORT_ID_SLIDER;
-	int rc = hid_read_timeout(device, buffer, 2, timeout);
+	int rc = hid_read_timeout(device, buffer, 3, timeout);
 	if(rc == 0)
 		// Timeout elapsed
 		return -1;
-	else if(rc != 2)
+	else if(rc != 3)
 	{
 		std::wstring werr(hid_error(device));
 		throw MacroPadException("Error occurred while waiting for data: " + std::string(werr.begin(), werr.end()));
 	}
-	return buffer[1];
+	return buffer[1] | (buffer[2] << 8);
 }
@@ -20,9 +20,16 @@
  * compiling the firmware. 
  */
 #define VID 0xcafe
-#define PID 0x9f8e
+#define PID 0x9f8f
 ///\}
 
+/**
+ * \brief Maximum slider position
+ * \details The slider reports positions between 0 (bottom) and SLIDER_MAX
+ * (top).
+ */
+#define SLIDER_MAX 4095
+
 #include<cstdint>
 #include<string>
 #include<map>
@@ -98,10 +105,10 @@ public:
 	 * \brief Get the slider position
 	 * \details This method issues a GET_REPORT(DATA) request on Endpoint 0. 
 	 * \return Returns the current slider position as a value between 0
-	 * (bottom) and 255 (top). 
+	 * (bottom) and SLIDER_MAX (top). 
 	 * \throws MacroPadException If the request fails. 
 	 */
-	uint8_t getSliderPos();
+	uint16_t getSliderPos();
 	
 	/**
 	 * \brief Wait for a change of the slider position
@@ -110,7 +117,8 @@ public:
 	 * endpoint. 
 	 * \param timeout Timeout in milliseconds, -1 for indefinite waiting. 
 	 * \return Returns the new slider position as a value between 0 (bottom)
-	 * and 255 (top) or -1 if the timeout elapsed before there was any change. 
+	 * and SLIDER_MAX (top) or -1 if the timeout elapsed before there was any
+	 * change. 
 	 * \throws MacroPadException If an error occurs while waiting for data. 
 	 */
 	int16_t waitForSliderChange(int timeout = -1);
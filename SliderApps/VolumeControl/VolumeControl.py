@@ -1,4 +1,4 @@
-from MacroPad import MacroPad
+from MacroPad import MacroPad, SLIDER_MAX
 
 # Needs pyvolume from https://github.com/thevickypedia/volume-control
 # Install it via "pip install volume-control"
@@ -10,14 +10,14 @@ devices = MacroPad.listDevices()
 mp = MacroPad(next(iter(devices.values())))
 
 # Read initial slider value
-vol = mp.getSliderPos() * 100 // 255
+vol = mp.getSliderPos() * 100 // SLIDER_MAX
 print("Setting volume to " + str(vol) + "%")
 pyvolume.custom(percent = vol)
 previousVol = vol
 
 # Set volume whenever slider changes
 while(True):
-	vol = mp.waitForSliderChange(-1) * 100 // 255
+	vol = mp.waitForSliderChange(-1) * 100 // SLIDER_MAX
 	if vol != previousVol:
 		print("Setting volume to " + str(vol) + "%")
 		pyvolume.custom(percent = vol)
@@ -647,3 +647,45 @@ void SliderEditor::OnCancel(wxCommandEvent& evt)
 {
 	EndModal(wxID_CANCEL);
 }
+
+//-----------------------------------------------------------------------------
+// AccelerationEditor implementation
+
+AccelerationEditor::AccelerationEditor(wxWindow* parent, wxWindowID winid, wxString title, Settings* settings, Acceleration* acceleration, const wxPoint& pos, const wxSize& size)
+:	TAccelerationEditor(parent, winid, title, pos, size),
+	settings(settings), origAcceleration(acceleration), acceleration(*acceleration)
+{
+	// A multiplier of 0 is the same as 1 (no acceleration)
+	if(this->acceleration.maxMultiplier < 1)
+		this->acceleration.maxMultiplier = 1;
+	scMinVelocity->SetValue(this->acceleration.minVelocity);
+	scMaxVelocity->SetValue(this->acceleration.maxVelocity);
+	scMaxMultiplier->SetRange(1, MAX_ACCELERATION_MULTIPLIER);
+	scMaxMultiplier->SetValue(this->acceleration.maxMultiplier);
+}
+
+void AccelerationEditor::OnMinVelocityChange(wxSpinEvent& evt)
+{
+	acceleration.minVelocity = scMinVelocity->GetValue();
+}
+
+void AccelerationEditor::OnMaxVelocityChange(wxSpinEvent& evt)
+{
+	acceleration.maxVelocity = scMaxVelocity->GetValue();
+}
+
+void AccelerationEditor::OnMaxMultiplierChange(wxSpinEvent& evt)
+{
+	acceleration.maxMultiplier = scMaxMultiplier->GetValue();
+}
+
+void AccelerationEditor::OnOk(wxCommandEvent& evt)
+{
+	*origAcceleration = acceleration;
+	EndModal(wxID_OK);
+}
+
+void AccelerationEditor::OnCancel(wxCommandEvent& evt)
+{
+	EndModal(wxID_CANCEL);
+}
@@ -456,5 +456,80 @@ private:
 	void OnOk(wxCommandEvent& evt);
 };
 
+/**
+ * \brief AccelerationEditor dialog
+ */
+class AccelerationEditor : public TAccelerationEditor
+{
+private:
+	/**
+	 * \brief Pointer to the Acceleration structure that is being edited
+	 */
+	Acceleration* origAcceleration;
+
+	/**
+	 * \brief Local copy while editing
+	 * \details When clicking Ok, this is copied into origAcceleration.
+	 */
+	Acceleration acceleration;
+
+	/**
+	 * \brief Pointer to the Settings structure that the acceleration is part
+	 * of
+	 */
+	Settings* settings;
+
+public:
+	/**
+	 * \brief Constructor
+	 * \details Takes the data from acceleration and uses it to initialise the
+	 * widgets.
+	 * \param parent The parent window of this dialog.
+	 * \param winid The window ID for this dialog.
+	 * \param title The title string for this dialog.
+	 * \param settings Pointer to the Settings structure that the acceleration is part of.
+	 * \param acceleration Pointer to the Acceleration structure that is to be edited.
+	 * \param pos Initial position of the dialog.
+	 * \param size Initial size of the dialog.
+	 */
+	AccelerationEditor(wxWindow* parent, wxWindowID winid, wxString title, Settings* settings, Acceleration* acceleration, const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize);
+
+private:
+	/**
+	 * \brief Event handler for when the value of scMinVelocity changes
+	 * \details Writes the new value to acceleration.
+	 * \param evt Spin event.
+	 */
+	void OnMinVelocityChange(wxSpinEvent& evt);
+
+	/**
+	 * \brief Event handler for when the value of scMaxVelocity changes
+	 * \details Writes the new value to acceleration.
+	 * \param evt Spin event.
+	 */
+	void OnMaxVelocityChange(wxSpinEvent& evt);
+
+	/**
+	 * \brief Event handler for when the value of scMaxMultiplier changes
+	 * \details Writes the new value to acceleration.
+	 * \param evt Spin event.
+	 */
+	void OnMaxMultiplierChange(wxSpinEvent& evt);
+
+	/**
+	 * \brief Event handler for btnCancel
+	 * \details Closes the dialog, discarding all modified data.
+	 * \param evt Command event.
+	 */
+	void OnCancel(wxCommandEvent& evt);
+
+	/**
+	 * \brief Event handler for btnOk
+	 * \details Copies the modified data, then closes the dialog.
+	 * \param evt Command event.
+	 */
+	void OnOk(wxCommandEvent& evt);
+};
+
 #endif // _CTRLWIDGETS_H
 
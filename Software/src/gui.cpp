@@ -639,3 +639,70 @@ TSliderEditor::TSliderEditor( wxWindow* parent, wxWindowID id, const wxString& t
 TSliderEditor::~TSliderEditor()
 {
 }
+
+TAccelerationEditor::TAccelerationEditor( wxWindow* parent, wxWindowID id, const wxString& title, const wxPoint& pos, const wxSize& size, long style ) : wxDialog( parent, id, title, pos, size, style )
+{
+	this->SetSizeHints( wxDefaultSize, wxDefaultSize );
+
+	wxBoxSizer* sizerDlg;
+	sizerDlg = new wxBoxSizer( wxVERTICAL );
+
+	wxFlexGridSizer* sizerAcceleration;
+	sizerAcceleration = new wxFlexGridSizer( 0, 2, 0, 0 );
+	sizerAcceleration->SetFlexibleDirection( wxBOTH );
+	sizerAcceleration->SetNonFlexibleGrowMode( wxFLEX_GROWMODE_SPECIFIED );
+
+	lMinVelocity = new wxStaticText( this, wxID_ANY, _("No acceleration up to (notches per second)"), wxDefaultPosition, wxDefaultSize, 0 );
+	lMinVelocity->Wrap( -1 );
+	sizerAcceleration->Add( lMinVelocity, 0, wxALL, 5 );
+
+	scMinVelocity = new wxSpinCtrl( this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 65535, 0 );
+	sizerAcceleration->Add( scMinVelocity, 0, wxALL, 5 );
+
+	lMaxVelocity = new wxStaticText( this, wxID_ANY, _("Full acceleration from (notches per second)"), wxDefaultPosition, wxDefaultSize, 0 );
+	lMaxVelocity->Wrap( -1 );
+	sizerAcceleration->Add( lMaxVelocity, 0, wxALL, 5 );
+
+	scMaxVelocity = new wxSpinCtrl( this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 0, 65535, 0 );
+	sizerAcceleration->Add( scMaxVelocity, 0, wxALL, 5 );
+
+	lMaxMultiplier = new wxStaticText( this, wxID_ANY, _("Full acceleration multiplies each notch by (1 = off)"), wxDefaultPosition, wxDefaultSize, 0 );
+	lMaxMultiplier->Wrap( -1 );
+	sizerAcceleration->Add( lMaxMultiplier, 0, wxALL, 5 );
+
+	scMaxMultiplier = new wxSpinCtrl( this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxSP_ARROW_KEYS, 1, 16, 1 );
+	sizerAcceleration->Add( scMaxMultiplier, 0, wxALL, 5 );
+
+
+	sizerDlg->Add( sizerAcceleration, 1, wxEXPAND, 5 );
+
+	wxBoxSizer* sizerButtons;
+	sizerButtons = new wxBoxSizer( wxHORIZONTAL );
+
+	btnCancel = new wxButton( this, wxID_ANY, _("Cancel"), wxDefaultPosition, wxDefaultSize, 0 );
+	sizerButtons->Add( btnCancel, 0, wxALL, 5 );
+
+	btnOk = new wxButton( this, wxID_ANY, _("Ok"), wxDefaultPosition, wxDefaultSize, 0 );
+	sizerButtons->Add( btnOk, 0, wxALL, 5 );
+
+
+	sizerDlg->Add( sizerButtons, 0, wxALIGN_RIGHT, 5 );
+
+
+	this->SetSizer( sizerDlg );
+	this->Layout();
+	sizerDlg->Fit( this );
+
+	this->Centre( wxBOTH );
+
+	// Connect Events
+	scMinVelocity->Connect( wxEVT_COMMAND_SPINCTRL_UPDATED, wxSpinEventHandler( TAccelerationEditor::OnMinVelocityChange ), NULL, this );
+	scMaxVelocity->Connect( wxEVT_COMMAND_SPINCTRL_UPDATED, wxSpinEventHandler( TAccelerationEditor::OnMaxVelocityChange ), NULL, this );
+	scMaxMultiplier->Connect( wxEVT_COMMAND_SPINCTRL_UPDATED, wxSpinEventHandler( TAccelerationEditor::OnMaxMultiplierChange ), NULL, this );
+	btnCancel->Connect( wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler( TAccelerationEditor::OnCancel ), NULL, this );
+	btnOk->Connect( wxEVT_COMMAND_BUTTON_CLICKED, wxCommandEventHandler( TAccelerationEditor::OnOk ), NULL, this );
+}
+
+TAccelerationEditor::~TAccelerationEditor()
+{
+}
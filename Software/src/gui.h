@@ -302,3 +302,36 @@ class TSliderEditor : public wxDialog
 
 };
 
+///////////////////////////////////////////////////////////////////////////////
+/// Class TAccelerationEditor
+///////////////////////////////////////////////////////////////////////////////
+class TAccelerationEditor : public wxDialog
+{
+	private:
+
+	protected:
+		wxStaticText* lMinVelocity;
+		wxSpinCtrl* scMinVelocity;
+		wxStaticText* lMaxVelocity;
+		wxSpinCtrl* scMaxVelocity;
+		wxStaticText* lMaxMultiplier;
+		wxSpinCtrl* scMaxMultiplier;
+		wxButton* btnCancel;
+		wxButton* btnOk;
+
+		// Virtual event handlers, override them in your derived class
+		virtual void OnMinVelocityChange( wxSpinEvent& event ) { event.Skip(); }
+		virtual void OnMaxVelocityChange( wxSpinEvent& event ) { event.Skip(); }
+		virtual void OnMaxMultiplierChange( wxSpinEvent& event ) { event.Skip(); }
+		virtual void OnCancel( wxCommandEvent& event ) { event.Skip(); }
+		virtual void OnOk( wxCommandEvent& event ) { event.Skip(); }
+
+
+	public:
+
+		TAccelerationEditor( wxWindow* parent, wxWindowID id = wxID_ANY, const wxString& title = wxEmptyString, const wxPoint& pos = wxDefaultPosition, const wxSize& size = wxDefaultSize, long style = wxDEFAULT_DIALOG_STYLE );
+
+		~TAccelerationEditor();
+
+};
+
@@ -6,6 +6,9 @@
 #include<stdexcept>
 #include<functional>
 #include<cstring>
+#include<cmath>
+#include<thread>
+#include<chrono>
 #include"usb_descriptors.h" // Import VID, PID, and interface numbers from firmware project
 #include"raiiwrapper.h"
 #include"hid.h"
@@ -62,6 +65,286 @@ void checkFirmwareVersion(hid_device* device)
 		throw std::runtime_error("Device firmware is version " + std::to_string(version >> 8) + "." + std::to_string(version & 0xff) + " but this app is version " + std::to_string(VERSION >> 8) + "." + std::to_string(VERSION & 0xff));
 }
 
+/**
+ * \brief A range of bytes within the Settings struct
+ */
+struct SettingsRange
+{
+	/// Offset of the first byte
+	uint32_t address;
+	/// Number of bytes
+	uint32_t length;
+};
+
+/**
+ * \brief Finds the parts of the settings that differ from those in the device
+ * \details Reads the hashes of the regions of the device's settings (see
+ * hashSettingsRegion()) and compares them with the hashes of the given
+ * settings. Adjacent regions that differ are merged into one range.
+ * \param device The device (misc interface).
+ * \param settings The settings that are about to be written.
+ * \return The ranges that need to be written, in ascending order.
+ * \throws std::runtime_error If the hashes cannot be read.
+ */
+static std::vector<SettingsRange> findChangedRanges(hid_device* device, const Settings& settings)
+{
+	const uint32_t numRegions = (sizeof(Settings) + SETTINGS_HASH_REGION_SIZE - 1) / SETTINGS_HASH_REGION_SIZE;
+	uint8_t buffer[64];
+
+	// Start with the first region
+	buffer[0] = REPORT_ID_SETTINGS_HASH;
+	buffer[1] = 0; buffer[2] = 0;
+	if(hid_send_feature_report(device, buffer, 3) != 3)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to select settings region: " + std::string(werr.begin(), werr.end()));
+	}
+
+	std::vector<SettingsRange> ranges;
+	uint32_t region = 0;
+	while(region < numRegions)
+	{
+		buffer[0] = REPORT_ID_SETTINGS_HASH;
+		int length = hid_get_feature_report(device, buffer, 4 + 4 * SETTINGS_HASHES_PER_REPORT);
+		if(length < 4 || length < 4 + 4 * buffer[3])
+		{
+			std::wstring werr(hid_error(device));
+			throw std::runtime_error("Unable to read settings hashes: " + std::string(werr.begin(), werr.end()));
+		}
+		if((buffer[1] | (buffer[2] << 8)) != region || buffer[3] == 0)
+			throw std::runtime_error("Unexpected settings hashes from device");
+		for(unsigned int i = 0; i < buffer[3] && region < numRegions; i++, region++)
+		{
+			uint32_t deviceHash = buffer[4 + 4 * i] | (buffer[5 + 4 * i] << 8) | (buffer[6 + 4 * i] << 16) | (static_cast<uint32_t>(buffer[7 + 4 * i]) << 24);
+			uint32_t address = region * SETTINGS_HASH_REGION_SIZE;
+			uint32_t size = sizeof(Settings) - address < SETTINGS_HASH_REGION_SIZE ? sizeof(Settings) - address : SETTINGS_HASH_REGION_SIZE;
+			if(deviceHash == hashSettingsRegion(reinterpret_cast<const uint8_t*>(&settings) + address, size))
+				continue;
+			if(!ranges.empty() && ranges.back().address + ranges.back().length == address)
+				ranges.back().length += size;
+			else
+				ranges.push_back(SettingsRange{address, size});
+		}
+	}
+	return ranges;
+}
+
+/**
+ * \brief Time to wait for a packet on the configuration interface (in ms)
+ */
+#define CONFIG_TIMEOUT 1000
+
+/**
+ * \brief Finds the configuration interface of a device
+ * \details The HIDAPI library must have been initialised.
+ * \param path Path of the device (as returned by scanDevices()).
+ * \return Path of the configuration interface of the same device, or an empty
+ * string if it has none.
+ */
+static std::string findConfigInterface(const std::string& path)
+{
+	RaiiWrapper<struct hid_device_info*> deviceList
+	(
+		hid_enumerate(USB_VID, USB_PID),
+		[](struct hid_device_info* deviceList) {hid_free_enumeration(deviceList);}
+	);
+
+	// Find the serial number of the device
+	std::wstring serial;
+	bool found = false;
+	for(struct hid_device_info* i = deviceList; i != NULL; i = i->next)
+	{
+		if(path == i->path && i->serial_number != NULL)
+		{
+			serial = i->serial_number;
+			found = true;
+			break;
+		}
+	}
+	if(!found)
+		return "";
+
+	// Find its configuration interface
+	for(struct hid_device_info* i = deviceList; i != NULL; i = i->next)
+		if(i->interface_number == ITF_NUM_HID_CONFIG && i->serial_number != NULL && serial == i->serial_number)
+			return i->path;
+	return "";
+}
+
+/**
+ * \brief Sends a packet on the configuration interface
+ * \param device The configuration interface.
+ * \param command Command of the packet.
+ * \param seq Sequence number of the packet.
+ * \param address Address field of the packet.
+ * \param payload Payload (may be NULL if length is zero).
+ * \param length Length of the payload (at most CONFIG_PAYLOAD_SIZE).
+ * \throws std::runtime_error If the packet cannot be sent.
+ */
+static void sendConfigPacket(hid_device* device, ConfigCommand command, uint8_t seq, uint32_t address, const uint8_t* payload, uint8_t length)
+{
+	// The reports have no ID, so the first byte is 0
+	uint8_t buffer[1 + CONFIG_REPORT_SIZE] = {};
+	buffer[1] = static_cast<uint8_t>(command);
+	buffer[2] = seq;
+	buffer[3] = length;
+	for(unsigned int i = 0; i < 4; i++)
+		buffer[5 + i] = (address >> (8 * i)) & 0xff;
+	if(length > 0)
+		std::memcpy(&buffer[1 + CONFIG_HEADER_SIZE], payload, length);
+	if(hid_write(device, buffer, sizeof(buffer)) != sizeof(buffer))
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to send packet to configuration interface: " + std::string(werr.begin(), werr.end()));
+	}
+}
+
+/**
+ * \brief Receives a packet on the configuration interface
+ * \param device The configuration interface.
+ * \param packet Buffer of CONFIG_REPORT_SIZE bytes receiving the packet.
+ * \throws std::runtime_error If no packet arrives in time or the device has
+ * rejected a packet.
+ */
+static void receiveConfigPacket(hid_device* device, uint8_t* packet)
+{
+	int rc = hid_read_timeout(device, packet, CONFIG_REPORT_SIZE, CONFIG_TIMEOUT);
+	if(rc < 0)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to receive packet from configuration interface: " + std::string(werr.begin(), werr.end()));
+	}
+	if(rc < CONFIG_HEADER_SIZE)
+		throw std::runtime_error("Timeout on configuration interface");
+	if(packet[0] == static_cast<uint8_t>(ConfigCommand::NAK))
+		throw std::runtime_error("Device rejected packet " + std::to_string(packet[1]) + " on configuration interface");
+}
+
+/**
+ * \brief Opens a session on the configuration interface
+ * \param device The configuration interface.
+ * \return The sequence number of the next packet.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+static uint8_t openConfigSession(hid_device* device)
+{
+	sendConfigPacket(device, ConfigCommand::OPEN, 0, 0, NULL, 0);
+	// Skip whatever was left over from a previous session
+	uint8_t packet[CONFIG_REPORT_SIZE];
+	do
+		receiveConfigPacket(device, packet);
+	while(packet[0] != static_cast<uint8_t>(ConfigCommand::ACK) || packet[1] != 0);
+	return 1;
+}
+
+/**
+ * \brief Opens the configuration interface
+ * \param path Path of the configuration interface.
+ * \return The device.
+ * \throws std::runtime_error If the device cannot be opened.
+ */
+static hid_device* openConfigInterface(const std::string& path)
+{
+	hid_device* device = hid_open_path(path.c_str());
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open configuration interface: " + std::string(werr.begin(), werr.end()));
+	}
+	return device;
+}
+
+/**
+ * \brief Reads the settings through the configuration interface
+ * \details The device streams the settings, the host acknowledges every
+ * CONFIG_WINDOW / 2 packets so the device never has to wait.
+ * \param path Path of the configuration interface.
+ * \param settings Receives the settings.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+static void readViaConfigInterface(const std::string& path, Settings& settings)
+{
+	RaiiWrapper<hid_device*> device
+	(
+		openConfigInterface(path),
+		[](hid_device* device) {hid_close(device);}
+	);
+	uint8_t seq = openConfigSession(device);
+
+	// Request all of the settings
+	uint8_t count[4];
+	for(unsigned int i = 0; i < 4; i++)
+		count[i] = (sizeof(settings) >> (8 * i)) & 0xff;
+	sendConfigPacket(device, ConfigCommand::READ, seq, 0, count, sizeof(count));
+
+	// Receive the data
+	uint8_t packet[CONFIG_REPORT_SIZE];
+	uint32_t bytesRead = 0;
+	uint8_t dataSeq = 0;
+	while(bytesRead < sizeof(settings))
+	{
+		receiveConfigPacket(device, packet);
+		if(packet[0] == static_cast<uint8_t>(ConfigCommand::ACK))
+			// Acknowledgement of the request
+			continue;
+		uint32_t address = packet[4] | (packet[5] << 8) | (packet[6] << 16) | (static_cast<uint32_t>(packet[7]) << 24);
+		uint8_t length = packet[2];
+		if(packet[0] != static_cast<uint8_t>(ConfigCommand::DATA) || packet[1] != dataSeq || address != bytesRead || length == 0 || length > CONFIG_PAYLOAD_SIZE || length > sizeof(settings) - bytesRead)
+			throw std::runtime_error("Unexpected packet on configuration interface");
+		std::memcpy(reinterpret_cast<uint8_t*>(&settings) + bytesRead, &packet[CONFIG_HEADER_SIZE], length);
+		bytesRead += length;
+		if(dataSeq % (CONFIG_WINDOW / 2) == CONFIG_WINDOW / 2 - 1)
+			sendConfigPacket(device, ConfigCommand::ACK, dataSeq, 0, NULL, 0);
+		dataSeq++;
+	}
+}
+
+/**
+ * \brief Writes parts of the settings through the configuration interface
+ * \details Keeps up to CONFIG_WINDOW packets in flight.
+ * \param path Path of the configuration interface.
+ * \param settings The settings.
+ * \param ranges The parts of the settings to be written.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+static void writeViaConfigInterface(const std::string& path, const Settings& settings, const std::vector<SettingsRange>& ranges)
+{
+	RaiiWrapper<hid_device*> device
+	(
+		openConfigInterface(path),
+		[](hid_device* device) {hid_close(device);}
+	);
+	uint8_t seq = openConfigSession(device);
+
+	uint8_t packet[CONFIG_REPORT_SIZE];
+	uint8_t firstUnacked = seq;
+	std::vector<SettingsRange>::const_iterator range = ranges.begin();
+	uint32_t bytesWritten = 0;
+	while(range != ranges.end() || firstUnacked != seq)
+	{
+		// Send as long as the window isn't full
+		if(range != ranges.end() && static_cast<uint8_t>(seq - firstUnacked) < CONFIG_WINDOW)
+		{
+			uint32_t bytesToWrite = range->length - bytesWritten;
+			if(bytesToWrite > CONFIG_PAYLOAD_SIZE) bytesToWrite = CONFIG_PAYLOAD_SIZE;
+			uint32_t address = range->address + bytesWritten;
+			sendConfigPacket(device, ConfigCommand::WRITE, seq++, address, reinterpret_cast<const uint8_t*>(&settings) + address, bytesToWrite);
+			bytesWritten += bytesToWrite;
+			if(bytesWritten == range->length)
+			{
+				range++;
+				bytesWritten = 0;
+			}
+			continue;
+		}
+
+		// Wait for acknowledgements
+		receiveConfigPacket(device, packet);
+		if(packet[0] == static_cast<uint8_t>(ConfigCommand::ACK) && static_cast<uint8_t>(packet[1] + 1 - firstUnacked) <= static_cast<uint8_t>(seq - firstUnacked))
+			firstUnacked = packet[1] + 1;
+	}
+}
+
 Settings readFromDevice(std::string path)
 {
 	// Initialise library
@@ -97,31 +380,38 @@ Settings readFromDevice(std::string path)
 		throw std::runtime_error("Unable put device into maintenance mode: " + std::string(werr.begin(), werr.end()));
 	}
 
-	// Set address pointer to zero and length to maximum (63)
-	buffer[0] = REPORT_ID_SETTINGS_ADDRESS;
-	buffer[1] = 0; buffer[2] = 0; buffer[3] = 0; buffer[4] = 0;
-	buffer[5] = 63;
-	if(hid_send_feature_report(device, buffer, 6) != 6)
-	{
-		std::wstring werr(hid_error(device));
-		throw std::runtime_error("Unable set memory address/length: " + std::string(werr.begin(), werr.end()));
-	}
-
-	// Read data
+	// Read data through the configuration interface (or through feature
+	// reports if the device doesn't have one)
 	Settings settings;
-	uint32_t bytesRead = 0;
-	while(bytesRead < sizeof(settings))
+	std::string configPath = findConfigInterface(path);
+	if(!configPath.empty())
+		readViaConfigInterface(configPath, settings);
+	else
 	{
-		uint32_t bytesToRead = sizeof(settings) - bytesRead;
-		if(bytesToRead > 63) bytesToRead = 63;
-		buffer[0] = REPORT_ID_SETTINGS_DATA;
-		if(hid_get_feature_report(device, buffer, bytesToRead + 1) != bytesToRead + 1)
+		// Set address pointer to zero and length to maximum (63)
+		buffer[0] = REPORT_ID_SETTINGS_ADDRESS;
+		buffer[1] = 0; buffer[2] = 0; buffer[3] = 0; buffer[4] = 0;
+		buffer[5] = 63;
+		if(hid_send_feature_report(device, buffer, 6) != 6)
 		{
 			std::wstring werr(hid_error(device));
-			throw std::runtime_error("Unable to read data from device: " + std::string(werr.begin(), werr.end()));
+			throw std::runtime_error("Unable set memory address/length: " + std::string(werr.begin(), werr.end()));
+		}
+
+		uint32_t bytesRead = 0;
+		while(bytesRead < sizeof(settings))
+		{
+			uint32_t bytesToRead = sizeof(settings) - bytesRead;
+			if(bytesToRead > 63) bytesToRead = 63;
+			buffer[0] = REPORT_ID_SETTINGS_DATA;
+			if(hid_get_feature_report(device, buffer, bytesToRead + 1) != bytesToRead + 1)
+			{
+				std::wstring werr(hid_error(device));
+				throw std::runtime_error("Unable to read data from device: " + std::string(werr.begin(), werr.end()));
+			}
+			std::memcpy(reinterpret_cast<uint8_t*>(&settings) + bytesRead, &buffer[1], bytesToRead);
+			bytesRead += bytesToRead;
 		}
-		std::memcpy(reinterpret_cast<uint8_t*>(&settings) + bytesRead, &buffer[1], bytesToRead);
-		bytesRead += bytesToRead;
 	}
 
 	// Put device back into normal mode
@@ -171,30 +461,52 @@ void writeToDevice(const Settings& settings, std::string path)
 		throw std::runtime_error("Unable put device into maintenance mode: " + std::string(werr.begin(), werr.end()));
 	}
 
-	// Set address pointer to zero and length to maximum (63)
-	buffer[0] = REPORT_ID_SETTINGS_ADDRESS;
-	buffer[1] = 0; buffer[2] = 0; buffer[3] = 0; buffer[4] = 0;
-	buffer[5] = 63;
-	if(hid_send_feature_report(device, buffer, 6) != 6)
-	{
-		std::wstring werr(hid_error(device));
-		throw std::runtime_error("Unable set memory address/length: " + std::string(werr.begin(), werr.end()));
-	}
+	// Only the parts of the settings that differ from the device's need to
+	// be transferred
+	std::vector<SettingsRange> ranges = findChangedRanges(device, settings);
 
-	// Write data
-	uint32_t bytesWritten = 0;
-	while(bytesWritten < sizeof(settings))
+	// Write data through the configuration interface (or through feature
+	// reports if the device doesn't have one)
+	std::string configPath = findConfigInterface(path);
+	if(!configPath.empty())
+		writeViaConfigInterface(configPath, settings, ranges);
+	else
 	{
-		uint32_t bytesToWrite = sizeof(settings) - bytesWritten;
-		if(bytesToWrite > 63) bytesToWrite = 63;
-		buffer[0] = REPORT_ID_SETTINGS_DATA;
-		std::memcpy(&buffer[1], reinterpret_cast<const uint8_t*>(&settings) + bytesWritten, bytesToWrite);
-		if(hid_send_feature_report(device, buffer, bytesToWrite + 1) != bytesToWrite + 1)
+		for(const SettingsRange& range : ranges)
 		{
-			std::wstring werr(hid_error(device));
-			throw std::runtime_error("Unable to write data to device: " + std::string(werr.begin(), werr.end()));
+			uint32_t bytesWritten = 0;
+			while(bytesWritten < range.length)
+			{
+				uint32_t bytesToWrite = range.length - bytesWritten;
+				if(bytesToWrite > 63) bytesToWrite = 63;
+
+				// Set address pointer and length at the start of each range
+				// (after that, the address is incremented automatically) and
+				// for the last, shorter transfer of a range
+				if(bytesWritten == 0 || bytesToWrite < 63)
+				{
+					uint32_t address = range.address + bytesWritten;
+					buffer[0] = REPORT_ID_SETTINGS_ADDRESS;
+					for(unsigned int i = 0; i < 4; i++)
+						buffer[1 + i] = (address >> (8 * i)) & 0xff;
+					buffer[5] = bytesToWrite;
+					if(hid_send_feature_report(device, buffer, 6) != 6)
+					{
+						std::wstring werr(hid_error(device));
+						throw std::runtime_error("Unable set memory address/length: " + std::string(werr.begin(), werr.end()));
+					}
+				}
+
+				buffer[0] = REPORT_ID_SETTINGS_DATA;
+				std::memcpy(&buffer[1], reinterpret_cast<const uint8_t*>(&settings) + range.address + bytesWritten, bytesToWrite);
+				if(hid_send_feature_report(device, buffer, bytesToWrite + 1) != bytesToWrite + 1)
+				{
+					std::wstring werr(hid_error(device));
+					throw std::runtime_error("Unable to write data to device: " + std::string(werr.begin(), werr.end()));
+				}
+				bytesWritten += bytesToWrite;
+			}
 		}
-		bytesWritten += bytesToWrite;
 	}
 
 	// Tell device to store new settings data in EEPROM
@@ -206,4 +518,258 @@ void writeToDevice(const Settings& settings, std::string path)
 		std::wstring werr(hid_error(device));
 		throw std::runtime_error("Unable put device into normal mode: " + std::string(werr.begin(), werr.end()));
 	}
+
+	// Wait until the device has stored them (it reports STORING_SETTINGS
+	// until then), so it can be unplugged safely afterwards
+	auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(STORE_SETTINGS_TIMEOUT);
+	while(true)
+	{
+		buffer[0] = REPORT_ID_MODE;
+		if(hid_get_feature_report(device, buffer, 2) != 2)
+		{
+			std::wstring werr(hid_error(device));
+			throw std::runtime_error("Unable to read mode from device: " + std::string(werr.begin(), werr.end()));
+		}
+		if(buffer[1] != static_cast<uint8_t>(Mode::STORING_SETTINGS))
+			break;
+		if(std::chrono::steady_clock::now() > timeout)
+			throw std::runtime_error("Timeout while storing settings in EEPROM");
+		std::this_thread::sleep_for(std::chrono::milliseconds(STORE_SETTINGS_POLL_INTERVAL));
+	}
+}
+
+InputStatistics readInputStatistics(std::string path)
+{
+	// Initialise library
+	int rc = hid_init();
+	if(rc != 0)
+		throw std::runtime_error("Error initialising HIDAPI library");
+	RaiiWrapper<void> library([](void) {hid_exit();});
+
+	// Open device
+	RaiiWrapper<hid_device*> device
+	(
+		hid_open_path(path.c_str()),
+		[](hid_device* device) {if(device != NULL) hid_close(device);}
+	);
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open device: " + std::string(werr.begin(), werr.end()));
+	}
+
+	// Check firmware version of device
+	checkFirmwareVersion(device);
+
+	// Buffer for feature requests
+	uint8_t buffer[64];
+
+	// Select one control after the other until the device refuses to select
+	// the next one (because there is no such control)
+	InputStatistics statistics;
+	for(uint8_t index = 0; index < 0xff; index++)
+	{
+		buffer[0] = REPORT_ID_LATENCY_HISTOGRAM;
+		buffer[1] = index;
+		if(hid_send_feature_report(device, buffer, 2) != 2)
+		{
+			std::wstring werr(hid_error(device));
+			throw std::runtime_error("Unable to select latency histogram: " + std::string(werr.begin(), werr.end()));
+		}
+		buffer[0] = REPORT_ID_LATENCY_HISTOGRAM;
+		int length = hid_get_feature_report(device, buffer, sizeof(buffer));
+		if(length < 14 || length < 14 + 2 * buffer[2])
+		{
+			std::wstring werr(hid_error(device));
+			throw std::runtime_error("Unable to read latency histogram: " + std::string(werr.begin(), werr.end()));
+		}
+		if(buffer[1] != index)
+			break;
+		statistics.burstScans = buffer[5] | (buffer[6] << 8) | (buffer[7] << 16) | (static_cast<uint32_t>(buffer[8]) << 24);
+		statistics.idleScans = buffer[9] | (buffer[10] << 8) | (buffer[11] << 16) | (static_cast<uint32_t>(buffer[12]) << 24);
+		LatencyHistogram histogram;
+		histogram.bucketWidth = buffer[3] | (buffer[4] << 8);
+		for(unsigned int i = 0; i < buffer[2]; i++)
+			histogram.buckets.push_back(buffer[13 + 2 * i] | (buffer[14 + 2 * i] << 8));
+		if(buffer[13 + 2 * buffer[2]] == 0)
+			statistics.switches.push_back(histogram);
+		else
+			statistics.rotaryEncoders.push_back(histogram);
+	}
+
+	return statistics;
+}
+
+void resetLatencyHistograms(std::string path)
+{
+	// Initialise library
+	int rc = hid_init();
+	if(rc != 0)
+		throw std::runtime_error("Error initialising HIDAPI library");
+	RaiiWrapper<void> library([](void) {hid_exit();});
+
+	// Open device
+	RaiiWrapper<hid_device*> device
+	(
+		hid_open_path(path.c_str()),
+		[](hid_device* device) {if(device != NULL) hid_close(device);}
+	);
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open device: " + std::string(werr.begin(), werr.end()));
+	}
+
+	// Check firmware version of device
+	checkFirmwareVersion(device);
+
+	// Index 0xff resets all histograms
+	uint8_t buffer[2] = {REPORT_ID_LATENCY_HISTOGRAM, 0xff};
+	if(hid_send_feature_report(device, buffer, 2) != 2)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to reset latency histograms: " + std::string(werr.begin(), werr.end()));
+	}
+}
+
+LatencyTraces readLatencyTraces(std::string path)
+{
+	// Initialise library
+	int rc = hid_init();
+	if(rc != 0)
+		throw std::runtime_error("Error initialising HIDAPI library");
+	RaiiWrapper<void> library([](void) {hid_exit();});
+
+	// Open device
+	RaiiWrapper<hid_device*> device
+	(
+		hid_open_path(path.c_str()),
+		[](hid_device* device) {if(device != NULL) hid_close(device);}
+	);
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open device: " + std::string(werr.begin(), werr.end()));
+	}
+
+	// Check firmware version of device
+	checkFirmwareVersion(device);
+
+	// Each trace consists of the control and the durations of the stages (see
+	// latencytrace.h in the firmware project)
+	const unsigned int numStages = 5;
+	const unsigned int traceSize = 1 + 2 * numStages;
+
+	// Read until the device has no more traces
+	LatencyTraces traces;
+	uint8_t buffer[64];
+	while(true)
+	{
+		buffer[0] = REPORT_ID_LATENCY_TRACE;
+		int length = hid_get_feature_report(device, buffer, sizeof(buffer));
+		if(length < 6 || length < 6 + static_cast<int>(traceSize * buffer[1]))
+		{
+			std::wstring werr(hid_error(device));
+			throw std::runtime_error("Unable to read latency traces: " + std::string(werr.begin(), werr.end()));
+		}
+		traces.abandoned = buffer[2] | (buffer[3] << 8) | (buffer[4] << 16) | (static_cast<uint32_t>(buffer[5]) << 24);
+		if(buffer[1] == 0)
+			break;
+		for(unsigned int i = 0; i < buffer[1]; i++)
+		{
+			const uint8_t* p = buffer + 6 + traceSize * i;
+			LatencyTrace trace;
+			trace.control = p[0];
+			for(unsigned int j = 0; j < numStages; j++)
+				trace.durations.push_back(p[1 + 2 * j] | (p[2 + 2 * j] << 8));
+			traces.traces.push_back(trace);
+		}
+	}
+
+	return traces;
+}
+
+ReportTiming readReportTiming(std::string path)
+{
+	// Initialise library
+	int rc = hid_init();
+	if(rc != 0)
+		throw std::runtime_error("Error initialising HIDAPI library");
+	RaiiWrapper<void> library([](void) {hid_exit();});
+
+	// Open device
+	RaiiWrapper<hid_device*> device
+	(
+		hid_open_path(path.c_str()),
+		[](hid_device* device) {if(device != NULL) hid_close(device);}
+	);
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open device: " + std::string(werr.begin(), werr.end()));
+	}
+
+	// Check firmware version of device
+	checkFirmwareVersion(device);
+
+	// Read statistics
+	uint8_t buffer[64];
+	buffer[0] = REPORT_ID_REPORT_TIMING;
+	int length = hid_get_feature_report(device, buffer, sizeof(buffer));
+	if(length < 30)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to read report timing: " + std::string(werr.begin(), werr.end()));
+	}
+	auto read = [&buffer](unsigned int offset, unsigned int size)
+	{
+		uint64_t value = 0;
+		for(unsigned int i = 0; i < size; i++)
+			value |= static_cast<uint64_t>(buffer[offset + i]) << (8 * i);
+		return value;
+	};
+	ReportTiming timing;
+	timing.scheduling = static_cast<Scheduling>(buffer[1]);
+	timing.frames = read(2, 4);
+	timing.reports = read(6, 4);
+	timing.minPhase = read(10, 2);
+	timing.maxPhase = read(12, 2);
+	uint64_t sum = read(14, 8);
+	uint64_t sumSquared = read(22, 8);
+	timing.meanPhase = timing.reports > 0 ? static_cast<double>(sum) / timing.reports : 0.0;
+	double variance = timing.reports > 0 ? static_cast<double>(sumSquared) / timing.reports - timing.meanPhase * timing.meanPhase : 0.0;
+	timing.phaseDeviation = variance > 0.0 ? std::sqrt(variance) : 0.0;
+	return timing;
+}
+
+void setReportScheduling(std::string path, Scheduling scheduling)
+{
+	// Initialise library
+	int rc = hid_init();
+	if(rc != 0)
+		throw std::runtime_error("Error initialising HIDAPI library");
+	RaiiWrapper<void> library([](void) {hid_exit();});
+
+	// Open device
+	RaiiWrapper<hid_device*> device
+	(
+		hid_open_path(path.c_str()),
+		[](hid_device* device) {if(device != NULL) hid_close(device);}
+	);
+	if(device == NULL)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to open device: " + std::string(werr.begin(), werr.end()));
+	}
+
+	// Check firmware version of device
+	checkFirmwareVersion(device);
+
+	// Select scheduling
+	uint8_t buffer[2] = {REPORT_ID_REPORT_TIMING, static_cast<uint8_t>(scheduling)};
+	if(hid_send_feature_report(device, buffer, 2) != 2)
+	{
+		std::wstring werr(hid_error(device));
+		throw std::runtime_error("Unable to select report scheduling: " + std::string(werr.begin(), werr.end()));
+	}
 }
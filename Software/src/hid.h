@@ -9,8 +9,22 @@
 
 #include<string>
 #include<map>
+#include<vector>
 #include<hidapi.h>
 #include"settings.h"
+#include"usb_descriptors.h"
+
+/**
+ * \brief Time (in ms) writeToDevice() waits for the device to store the
+ * settings in EEPROM
+ */
+#define STORE_SETTINGS_TIMEOUT 10000
+
+/**
+ * \brief Interval (in ms) in which writeToDevice() asks the device whether
+ * the settings are stored
+ */
+#define STORE_SETTINGS_POLL_INTERVAL 20
 
 /**
  * \brief Scan for MacoPads
@@ -29,10 +43,134 @@ Settings readFromDevice(std::string path);
 
 /**
  * \brief Write settings to device
+ * \details Returns once the device has stored them in EEPROM.
  * \param settings The settings to be written to the device
  * \param path Path of the device.
  * \throws std::runtime_error If anything goes wrong.
  */
 void writeToDevice(const Settings& settings, std::string path);
 
+/**
+ * \brief Latency histogram of a switch or rotary encoder
+ * \details Counts the latencies from the first edge on the switch's pin to
+ * the (debounced) event, or from the first change of the rotary encoder's
+ * pins to the tick.
+ */
+struct LatencyHistogram
+{
+	/// Width of each bucket in microseconds
+	unsigned int bucketWidth;
+	/// Counts of the buckets. The last bucket also counts all longer latencies.
+	std::vector<unsigned int> buckets;
+};
+
+/**
+ * \brief Statistics of the device's input scanning
+ */
+struct InputStatistics
+{
+	/// Number of scans at the burst rate
+	uint32_t burstScans;
+	/// Number of scans at the idle rate
+	uint32_t idleScans;
+	/// Latency histograms of all switches
+	std::vector<LatencyHistogram> switches;
+	/// Latency histograms of all rotary encoders
+	std::vector<LatencyHistogram> rotaryEncoders;
+};
+
+/**
+ * \brief Read input statistics from device
+ * \param path Path of the device.
+ * \return The input statistics.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+InputStatistics readInputStatistics(std::string path);
+
+/**
+ * \brief Reset the latency histograms of the device
+ * \param path Path of the device.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+void resetLatencyHistograms(std::string path);
+
+/**
+ * \brief Latency trace of an input event
+ * \details Follows an event from its capture through the macro it started to
+ * the completed transfer of the report carrying the macro's first action.
+ */
+struct LatencyTrace
+{
+	/// Input control that caused the event (switches count from 0, knobs
+	/// from 0x10)
+	unsigned int control;
+	/// Duration of each stage in microseconds (capture to debounced event,
+	/// to extraction by the main loop, to first action in a report, to report
+	/// queued, to transfer completed)
+	std::vector<unsigned int> durations;
+};
+
+/**
+ * \brief Latency traces finished by the device
+ */
+struct LatencyTraces
+{
+	/// Number of traces the device has abandoned (e.g. because the event
+	/// didn't change any report)
+	uint32_t abandoned;
+	/// Finished traces
+	std::vector<LatencyTrace> traces;
+};
+
+/**
+ * \brief Read the finished latency traces from the device
+ * \details The device only keeps a limited number of traces, and each trace
+ * is only reported once.
+ * \param path Path of the device.
+ * \return The latency traces.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+LatencyTraces readLatencyTraces(std::string path);
+
+/**
+ * \brief Timing of the device's input reports relative to the USB frames
+ * \details The phase of a report is the time from the start of the frame
+ * (SOF) to the moment the device queued the report. Its spread is the jitter
+ * seen by the host.
+ */
+struct ReportTiming
+{
+	/// When the device assembles its reports
+	Scheduling scheduling;
+	/// Number of USB frames since the statistics were reset
+	uint32_t frames;
+	/// Number of reports since the statistics were reset
+	uint32_t reports;
+	/// Minimum phase in microseconds
+	unsigned int minPhase;
+	/// Maximum phase in microseconds
+	unsigned int maxPhase;
+	/// Mean phase in microseconds
+	double meanPhase;
+	/// Standard deviation of the phase in microseconds
+	double phaseDeviation;
+};
+
+/**
+ * \brief Read the report timing statistics from device
+ * \param path Path of the device.
+ * \return The report timing.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+ReportTiming readReportTiming(std::string path);
+
+/**
+ * \brief Select when the device assembles its reports
+ * \details This also resets the report timing statistics.
+ * \param path Path of the device.
+ * \param scheduling The scheduling.
+ * \throws std::runtime_error If anything goes wrong.
+ */
+void setReportScheduling(std::string path, Scheduling scheduling);
+
 #endif // _HID_H
@@ -61,6 +61,18 @@ MacroPadWidget::MacroPadWidget(wxWindow* parent, wxWindowID winid, const wxPoint
 			(new MacroEditor(this, wxID_ANY, wxString("Rotate Knob ") << (i + 1) << " to the Right", this->settings, &this->settings->profiles[this->profile].knobs[i].right))->ShowModal();
 		});
 	}
+	// Create buttons for knob acceleration
+	btnAccelerations[0] = new wxButton(this, wxID_ANY, "Acceleration", wxPoint(255, 420), wxSize(110, 30));
+	btnAccelerations[1] = new wxButton(this, wxID_ANY, "Acceleration", wxPoint(619, 420), wxSize(110, 30));
+	btnAccelerations[2] = new wxButton(this, wxID_ANY, "Acceleration", wxPoint(983, 420), wxSize(110, 30));
+	for(unsigned int i = 0; i < 3; i++)
+	{
+		btnAccelerations[i]->SetToolTip(wxString("Speed up Knob ") << (i + 1) << " when turned quickly");
+		btnAccelerations[i]->Bind(wxEVT_BUTTON, [this,i](wxCommandEvent&)
+		{
+			(new AccelerationEditor(this, wxID_ANY, wxString("Acceleration of Knob ") << (i + 1), this->settings, &this->settings->profiles[this->profile].knobs[i].acceleration))->ShowModal();
+		});
+	}
 	// Create button for slider
 	btnSlider = new wxButton(this, wxID_ANY, "Slider", wxPoint(32, 220), wxSize(70, 30));
 	btnSlider->Bind(wxEVT_BUTTON, [this](wxCommandEvent&)
@@ -36,6 +36,7 @@ private:
 	 */
 	wxButton* btnKeys[9];
 	wxButton* btnKnobs[6];
+	wxButton* btnAccelerations[3];
 	wxButton* btnSlider;
 
 	/**
@@ -4,10 +4,13 @@
  */
 
 #include<iostream>
+#include<iomanip>
 #include<fstream>
 #include<string>
 #include<stdexcept>
 #include<cstring>
+#include<vector>
+#include<algorithm>
 #include<getopt.h>
 #include"settings.h"
 #include"hid.h"
@@ -30,7 +33,23 @@ void printUsage()
 		<< "   given file." << std::endl << std::endl
 		<< "macropad-cli --write <file name> [--device <path>]" << std::endl
 		<< "   Load settings from the given file and write them to the MacroPad device with the given device" << std::endl
-		<< "   path." << std::endl << std::endl;
+		<< "   path." << std::endl << std::endl
+		<< "macropad-cli --latency [--device <path>]" << std::endl
+		<< "   Print how often the MacroPad device with the given device path has scanned its inputs and" << std::endl
+		<< "   histograms of how long its keys take from the first contact to the key event and its knobs" << std::endl
+		<< "   from the first change of the contacts to the completed tick." << std::endl << std::endl
+		<< "macropad-cli --reset-latency [--device <path>]" << std::endl
+		<< "   Reset the latency histograms of the MacroPad device with the given device path." << std::endl << std::endl
+		<< "macropad-cli --trace [--device <path>]" << std::endl
+		<< "   Print percentiles of how long the events traced by the MacroPad device with the given device" << std::endl
+		<< "   path took from the first contact to the USB host, broken down into stages. Traces are only" << std::endl
+		<< "   reported once." << std::endl << std::endl
+		<< "macropad-cli --timing [--device <path>]" << std::endl
+		<< "   Print when the MacroPad device with the given device path assembles its reports and how much" << std::endl
+		<< "   they jitter against the USB frames. The statistics are only collected after --schedule." << std::endl << std::endl
+		<< "macropad-cli --schedule <demand|sof> [--device <path>]" << std::endl
+		<< "   Make the MacroPad device with the given device path assemble its reports on demand (as soon as" << std::endl
+		<< "   there is input) or at the start of each USB frame (SOF), and reset the timing statistics." << std::endl << std::endl;
 	exit(1);
 }
 
@@ -45,6 +64,11 @@ static const struct option longOptions[] =
 	{"read", required_argument, 0, 'r'},
 	{"write", required_argument, 0, 'w'},
 	{"device", required_argument, 0, 'd'},
+	{"latency", no_argument, 0, 't'},
+	{"reset-latency", no_argument, 0, 'T'},
+	{"trace", no_argument, 0, 'e'},
+	{"timing", no_argument, 0, 'j'},
+	{"schedule", required_argument, 0, 's'},
 	// Secret option for debugging: Instead of reading from/writing to a
 	// device, use a binary file instead.
 	{"binfile", required_argument, 0, 'b'},
@@ -55,7 +79,7 @@ static const struct option longOptions[] =
  * \brief Command line argument (short) options
  * \details See getopt().
  */
-static const char* shortOptions = "hlr:w:d:b:";
+static const char* shortOptions = "hlr:w:d:b:tTejs:";
 
 /**
  * \brief Read settings data from binary file
@@ -103,8 +127,9 @@ int main(int argc, char** argv)
 		printUsage();
 
 	// Parse command line arguments
-	enum {CMD_HELP, CMD_LIST, CMD_READ, CMD_WRITE} command = CMD_HELP;
+	enum {CMD_HELP, CMD_LIST, CMD_READ, CMD_WRITE, CMD_LATENCY, CMD_RESET_LATENCY, CMD_TRACE, CMD_TIMING, CMD_SCHEDULE} command = CMD_HELP;
 	std::string filename, path;
+	Scheduling scheduling = Scheduling::ON_DEMAND;
 	bool binfileInsteadOfDevice = false;
 	int opt, optIdx;
 	while((opt = getopt_long(argc, argv, shortOptions, longOptions, &optIdx)) != -1)
@@ -125,6 +150,27 @@ int main(int argc, char** argv)
 				command = CMD_WRITE;
 				filename = optarg;
 				break;
+			case 't':
+				command = CMD_LATENCY;
+				break;
+			case 'T':
+				command = CMD_RESET_LATENCY;
+				break;
+			case 'e':
+				command = CMD_TRACE;
+				break;
+			case 'j':
+				command = CMD_TIMING;
+				break;
+			case 's':
+				command = CMD_SCHEDULE;
+				if(std::string(optarg) == "demand")
+					scheduling = Scheduling::ON_DEMAND;
+				else if(std::string(optarg) == "sof")
+					scheduling = Scheduling::START_OF_FRAME;
+				else
+					printUsage();
+				break;
 			case 'd':
 				path = optarg;
 				binfileInsteadOfDevice = false;
@@ -170,6 +216,92 @@ int main(int argc, char** argv)
 					writeToDevice(settings, path);
 				break;
 			}
+			case CMD_LATENCY:
+			{
+				InputStatistics statistics = readInputStatistics(path);
+				std::cout << "Input scans: " << statistics.burstScans << " at burst rate, " << statistics.idleScans << " at idle rate" << std::endl;
+				auto printHistogram = [](const LatencyHistogram& histogram)
+				{
+					for(unsigned int j = 0; j < histogram.buckets.size(); j++)
+					{
+						if(histogram.buckets[j] == 0)
+							continue;
+						std::cout << "  " << (j * histogram.bucketWidth) << " us";
+						if(j + 1 < histogram.buckets.size())
+							std::cout << " - " << ((j + 1) * histogram.bucketWidth) << " us";
+						else
+							std::cout << " and more";
+						std::cout << ": " << histogram.buckets[j] << std::endl;
+					}
+				};
+				for(unsigned int i = 0; i < statistics.switches.size(); i++)
+				{
+					std::cout << "Key " << (i + 1) << ":" << std::endl;
+					printHistogram(statistics.switches[i]);
+				}
+				for(unsigned int i = 0; i < statistics.rotaryEncoders.size(); i++)
+				{
+					std::cout << "Knob " << (i + 1) << ":" << std::endl;
+					printHistogram(statistics.rotaryEncoders[i]);
+				}
+				break;
+			}
+			case CMD_RESET_LATENCY:
+			{
+				resetLatencyHistograms(path);
+				break;
+			}
+			case CMD_TRACE:
+			{
+				LatencyTraces traces = readLatencyTraces(path);
+				std::cout << traces.traces.size() << " trace(s), " << traces.abandoned << " abandoned so far" << std::endl;
+				if(traces.traces.empty())
+					break;
+				// Durations of each stage plus the total (last column)
+				const char* stageNames[] = {"Debounce", "Dequeue", "Macro", "Queue", "Transfer", "Total"};
+				const unsigned int numColumns = sizeof(stageNames) / sizeof(stageNames[0]);
+				std::vector<std::vector<unsigned int>> columns(numColumns);
+				for(const LatencyTrace& trace : traces.traces)
+				{
+					unsigned int total = 0;
+					for(unsigned int i = 0; i < trace.durations.size() && i + 1 < numColumns; i++)
+					{
+						columns[i].push_back(trace.durations[i]);
+						total += trace.durations[i];
+					}
+					columns[numColumns - 1].push_back(total);
+				}
+				std::cout << "Stage (us)      p50      p90      p99      max" << std::endl;
+				for(unsigned int i = 0; i < numColumns; i++)
+				{
+					std::vector<unsigned int>& column = columns[i];
+					std::sort(column.begin(), column.end());
+					// Nearest-rank percentile
+					auto percentile = [&column](unsigned int p) {return column[(p * column.size() + 99) / 100 - 1];};
+					std::cout << std::left << std::setw(10) << stageNames[i] << std::right
+						<< " " << std::setw(8) << percentile(50)
+						<< " " << std::setw(8) << percentile(90)
+						<< " " << std::setw(8) << percentile(99)
+						<< " " << std::setw(8) << column.back() << std::endl;
+				}
+				break;
+			}
+			case CMD_TIMING:
+			{
+				ReportTiming timing = readReportTiming(path);
+				std::cout << "Scheduling: " << (timing.scheduling == Scheduling::START_OF_FRAME ? "start of frame" : "on demand") << std::endl;
+				std::cout << timing.reports << " report(s) in " << timing.frames << " frame(s)" << std::endl;
+				if(timing.reports > 0)
+					std::cout << std::fixed << std::setprecision(1)
+						<< "Phase after SOF: " << timing.minPhase << " - " << timing.maxPhase << " us, mean "
+						<< timing.meanPhase << " us, jitter (standard deviation) " << timing.phaseDeviation << " us" << std::endl;
+				break;
+			}
+			case CMD_SCHEDULE:
+			{
+				setReportScheduling(path, scheduling);
+				break;
+			}
 		}
 	}
 	catch(const std::runtime_error& e)
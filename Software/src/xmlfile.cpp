@@ -540,6 +540,23 @@ Settings loadFromFile(std::string filename)
 							if(!xmlToBitmap(xmlImage, wxSize(IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT), knob.imageRight))
 								throw std::runtime_error("Invalid image data for right turn of Knob " + std::to_string(knobId) + " in Profile " + std::to_string(profileId) + ": " + parsingError);
 					}
+					else if(xmlKnobChild->GetName() == "acceleration")
+					{
+						unsigned int minVelocity, maxVelocity, maxMultiplier;
+						if
+						(
+							// Parse integers
+							!xmlKnobChild->GetAttribute("minvelocity").ToUInt(&minVelocity)
+							|| !xmlKnobChild->GetAttribute("maxvelocity").ToUInt(&maxVelocity)
+							|| !xmlKnobChild->GetAttribute("maxmultiplier").ToUInt(&maxMultiplier)
+							// Verify boundaries
+							|| minVelocity > 65535 || maxVelocity > 65535 || maxMultiplier > MAX_ACCELERATION_MULTIPLIER
+						)
+							throw std::runtime_error("Invalid <acceleration> element for Knob " + std::to_string(knobId) + " in Profile " + std::to_string(profileId));
+						knob.acceleration.minVelocity = minVelocity;
+						knob.acceleration.maxVelocity = maxVelocity;
+						knob.acceleration.maxMultiplier = maxMultiplier;
+					}
 				}
 			}
 			else if(xmlProfileChild->GetName() == "slider")
@@ -806,6 +823,13 @@ void saveToFile(const Settings& settings, std::string filename)
 			wxXmlNode* xmlKnobRightPic = new wxXmlNode(wxXML_ELEMENT_NODE, "image");
 			xmlKnobRight->AddChild(xmlKnobRightPic);
 			wxXmlNode* xmlKnobRightPicData = new wxXmlNode(xmlKnobRightPic, wxXML_TEXT_NODE, "", bitmapToString(wxSize(IMG_CTRL_WIDTH, IMG_CTRL_HEIGHT), knob.imageRight));
+
+			// Acceleration
+			wxXmlNode* xmlKnobAcceleration = new wxXmlNode(wxXML_ELEMENT_NODE, "acceleration");
+			xmlKnob->AddChild(xmlKnobAcceleration);
+			xmlKnobAcceleration->AddAttribute("minvelocity", wxString() << knob.acceleration.minVelocity);
+			xmlKnobAcceleration->AddAttribute("maxvelocity", wxString() << knob.acceleration.maxVelocity);
+			xmlKnobAcceleration->AddAttribute("maxmultiplier", wxString() << static_cast<unsigned int>(knob.acceleration.maxMultiplier));
 		}
 
 		// Slider